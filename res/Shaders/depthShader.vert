@@ -0,0 +1,30 @@
+#version 330 core
+
+//Depth pre-pass. The position has to come out bit for bit the same as in
+//the colour pass shaders, hence the invariant and the same expression.
+invariant gl_Position;
+
+uniform mat4 M;
+
+//See lightTextureShader.vert
+uniform mat4 VP[2];
+uniform int EyeCount;
+
+layout(location = 0) in vec3 vertexPosition;
+
+void main()
+{
+    int Eye = gl_InstanceID % EyeCount;
+    vec4 Clip = VP[Eye] * M * vec4(vertexPosition, 1.0f);
+    if (EyeCount == 2)
+    {
+	float Side = (Eye == 0) ? -1.0f : 1.0f;
+	gl_ClipDistance[0] = Clip.w + Side*Clip.x;
+	Clip.x = 0.5f*Clip.x + 0.5f*Side*Clip.w;
+    }
+    else
+    {
+	gl_ClipDistance[0] = 1.0f;
+    }
+    gl_Position = Clip;
+}
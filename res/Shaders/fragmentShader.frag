@@ -2,7 +2,7 @@
 
 struct light {
     float Power;
-    vec3 Position;
+    vec4 Position;
 
     vec3 Ambient;
     vec3 Diffuse;
@@ -18,10 +18,12 @@ struct color_material {
 
 uniform light Light;
 uniform color_material Material;
-uniform vec3 CameraPosition;
+//Per eye, see vertexShader.vert
+uniform vec3 CameraPosition[2];
 
 in vec3 FragPos;
 in vec3 FragNormal;
+flat in int FragEye;
 
 out vec3 Color;
 
@@ -31,14 +33,21 @@ void main()
     vec3 DiffuseColor = Light.Diffuse*Material.Diffuse;
     vec3 SpecularColor = Light.Specular*Material.Specular;
 
-    float LightDistance = length(Light.Position - FragPos);
+    vec3 LightPosition = vec3(Light.Position);
+    float LightDistance = length(LightPosition - FragPos);
     float LightDistanceSquared = LightDistance*LightDistance;
 
     vec3 N = normalize(FragNormal);
-    vec3 L = normalize(Light.Position - FragPos);
+    vec3 L = normalize(LightPosition - FragPos);
+    //A directional light's position is the direction towards it, with w 0.
+    if (Light.Position.w == 0.0f)
+    {
+	LightDistanceSquared = 1.0f;
+	L = normalize(LightPosition);
+    }
     float LightAngle = max(dot(N,L), 0.0);
 
-    vec3 E = normalize(CameraPosition - FragPos);
+    vec3 E = normalize(CameraPosition[FragEye] - FragPos);
     vec3 R = reflect(-L, N);
     float EyeLightAngle = max(dot(E, R), 0.0);
 
@@ -0,0 +1,66 @@
+#version 330 core
+
+//FXAA style edge smoothing: finds edges from the luma of the neighbours and
+//blends along them. SourceRect is the part of Source to read, in texture
+//coordinates (x, y, width, height), so it can also stretch a smaller viewport.
+in vec2 UV;
+
+uniform sampler2D Source;
+uniform vec4 SourceRect;
+uniform vec2 TexelSize;
+
+out vec4 Color;
+
+#define FXAA_EDGE_THRESHOLD (1.0f/8.0f)
+#define FXAA_EDGE_THRESHOLD_MIN (1.0f/32.0f)
+#define FXAA_REDUCE_MIN (1.0f/128.0f)
+#define FXAA_REDUCE_MUL (1.0f/8.0f)
+#define FXAA_SPAN_MAX 8.0f
+
+float Luma(vec3 Color)
+{
+    return dot(Color, vec3(0.299f, 0.587f, 0.114f));
+}
+
+//Clamped to the rectangle so one eye never reads the other's half.
+vec3 Fetch(vec2 Position)
+{
+    vec2 Low = SourceRect.xy + 0.5f*TexelSize;
+    vec2 High = SourceRect.xy + SourceRect.zw - 0.5f*TexelSize;
+    return texture(Source, clamp(Position, Low, High)).rgb;
+}
+
+void main()
+{
+    vec2 Position = SourceRect.xy + UV*SourceRect.zw;
+    vec3 Middle = Fetch(Position);
+    float LumaM = Luma(Middle);
+    float LumaNW = Luma(Fetch(Position + vec2(-1.0f, 1.0f)*TexelSize));
+    float LumaNE = Luma(Fetch(Position + vec2(1.0f, 1.0f)*TexelSize));
+    float LumaSW = Luma(Fetch(Position + vec2(-1.0f, -1.0f)*TexelSize));
+    float LumaSE = Luma(Fetch(Position + vec2(1.0f, -1.0f)*TexelSize));
+    float LumaMin = min(LumaM, min(min(LumaNW, LumaNE), min(LumaSW, LumaSE)));
+    float LumaMax = max(LumaM, max(max(LumaNW, LumaNE), max(LumaSW, LumaSE)));
+
+    //Flat areas are most of the screen; leave them alone.
+    if (LumaMax - LumaMin < max(FXAA_EDGE_THRESHOLD_MIN, LumaMax*FXAA_EDGE_THRESHOLD))
+    {
+	Color = vec4(Middle, 1.0f);
+	return;
+    }
+
+    vec2 Direction = vec2(-((LumaNW + LumaNE) - (LumaSW + LumaSE)),
+			  (LumaNW + LumaSW) - (LumaNE + LumaSE));
+    float DirectionReduce = max((LumaNW + LumaNE + LumaSW + LumaSE)*(0.25f*FXAA_REDUCE_MUL),
+				FXAA_REDUCE_MIN);
+    float InverseDirectionMin = 1.0f/(min(abs(Direction.x), abs(Direction.y)) + DirectionReduce);
+    Direction = clamp(Direction*InverseDirectionMin, -FXAA_SPAN_MAX, FXAA_SPAN_MAX)*TexelSize;
+
+    vec3 Near = 0.5f*(Fetch(Position + Direction*(1.0f/3.0f - 0.5f)) +
+		      Fetch(Position + Direction*(2.0f/3.0f - 0.5f)));
+    vec3 Far = 0.5f*Near + 0.25f*(Fetch(Position - 0.5f*Direction) +
+				  Fetch(Position + 0.5f*Direction));
+    float LumaFar = Luma(Far);
+    //The wider blend went past the local contrast, so it crossed another edge.
+    Color = vec4((LumaFar < LumaMin || LumaFar > LumaMax) ? Near : Far, 1.0f);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+//One triangle covering the screen, made from the vertex index.
+out vec2 UV;
+
+void main()
+{
+    UV = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0f*UV - 1.0f, 0.0f, 1.0f);
+}
@@ -18,14 +18,112 @@ struct light {
 
 uniform light Light;
 uniform material Material;
-uniform vec3 CameraPosition;
+//Per eye, indexed by ClusterEye
+uniform vec3 CameraPosition[2];
+
+//Clustered point lights: two texels per light, position and radius then
+//colour and power. Each cluster's entry in the grid is the offset and
+//count of its run of light indices.
+uniform int PointLightCount;
+uniform samplerBuffer PointLights;
+uniform usamplerBuffer ClusterGrid;
+uniform usamplerBuffer ClusterLightIndices;
+uniform ivec3 ClusterCounts;
+uniform vec2 ClusterDepthParams;
+//Where this pass's eyes start among the eyes the clusters were built for
+uniform int ClusterFirstEye;
+
+//Key light shadows: mode 1 is a cube map around a point light, mode 2
+//cascades for a directional one. Each has a cached map of the static
+//casters and one of the dynamic casters redrawn every frame, and a fragment
+//gets whatever light both let through. The cascade arrays are
+//SHADOW_CASCADE_COUNT long.
+uniform int ShadowMode;
+uniform samplerCubeShadow ShadowCubeStatic;
+uniform samplerCubeShadow ShadowCubeDynamic;
+uniform vec2 ShadowCubeDepth;
+uniform float ShadowCubeTexel;
+uniform sampler2DArrayShadow ShadowCascadesStatic;
+uniform sampler2DArrayShadow ShadowCascadesDynamic;
+uniform mat4 ShadowCascadeMatrices[3];
+uniform vec4 ShadowCascadeSpheres[3];
+uniform float ShadowCascadeTexels[3];
 
 in vec2 UV;
 in vec3 FragPos;
 in vec3 Normal;
+in vec4 ClusterClip;
+flat in int ClusterEye;
 
 out vec3 Color;
 
+int GetCluster()
+{
+    vec2 NDC = ClusterClip.xy / ClusterClip.w;
+    ivec2 Tile = clamp(ivec2((NDC*0.5f + 0.5f)*vec2(ClusterCounts.xy)), ivec2(0), ClusterCounts.xy - 1);
+    float SliceDepth = log(ClusterClip.w)*ClusterDepthParams.x + ClusterDepthParams.y;
+    int Slice = (SliceDepth < 0.0f) ? 0 : min(1 + int(SliceDepth), ClusterCounts.z - 1);
+    return (((ClusterFirstEye + ClusterEye)*ClusterCounts.z + Slice)*ClusterCounts.y + Tile.y)*ClusterCounts.x + Tile.x;
+}
+
+//Samples are pushed out along the normal by a texel or so to keep surfaces
+//from shadowing themselves.
+float GetShadow(vec3 N)
+{
+    if (ShadowMode == 1)
+    {
+	vec3 ToFrag = FragPos - Light.Position.xyz;
+	vec3 Axes = abs(ToFrag);
+	ToFrag += N*1.5f*ShadowCubeTexel*max(Axes.x, max(Axes.y, Axes.z));
+	Axes = abs(ToFrag);
+	float Depth = ShadowCubeDepth.x - ShadowCubeDepth.y / max(Axes.x, max(Axes.y, Axes.z));
+	return (texture(ShadowCubeStatic, vec4(ToFrag, Depth))*
+		texture(ShadowCubeDynamic, vec4(ToFrag, Depth)));
+    }
+    if (ShadowMode == 2)
+    {
+	for(int Cascade = 0; Cascade < 3; ++Cascade)
+	{
+	    vec4 Sphere = ShadowCascadeSpheres[Cascade];
+	    vec3 ToCenter = FragPos - Sphere.xyz;
+	    if (dot(ToCenter, ToCenter) < Sphere.w*Sphere.w)
+	    {
+		vec3 Position = FragPos + N*1.5f*ShadowCascadeTexels[Cascade];
+		vec4 ShadowPosition = ShadowCascadeMatrices[Cascade]*vec4(Position, 1.0f);
+		vec4 Coord = vec4(ShadowPosition.xy, float(Cascade), ShadowPosition.z);
+		return (texture(ShadowCascadesStatic, Coord)*
+			texture(ShadowCascadesDynamic, Coord));
+	    }
+	}
+    }
+    return 1.0f;
+}
+
+vec3 ShadePointLights(vec3 N, vec3 E, vec3 DiffuseTexel, vec3 SpecularTexel)
+{
+    vec3 Result = vec3(0.0f);
+    uvec2 Range = texelFetch(ClusterGrid, GetCluster()).rg;
+    for(uint Index = 0u; Index < Range.y; ++Index)
+    {
+	int LightIndex = int(texelFetch(ClusterLightIndices, int(Range.x + Index)).r);
+	vec4 PositionRadius = texelFetch(PointLights, 2*LightIndex);
+	vec4 ColorPower = texelFetch(PointLights, 2*LightIndex + 1);
+
+	vec3 ToLight = PositionRadius.xyz - FragPos;
+	float DistanceSquared = max(dot(ToLight, ToLight), 0.0001f);
+	float Distance = sqrt(DistanceSquared);
+	//Inverse square, windowed to reach zero at the radius.
+	float Window = clamp(1.0f - pow(Distance / PositionRadius.w, 4.0f), 0.0f, 1.0f);
+	float Attenuation = ColorPower.w*Window*Window / DistanceSquared;
+
+	vec3 L = ToLight / Distance;
+	float Diff = max(dot(N, L), 0.0f);
+	float Spec = pow(max(dot(E, reflect(-L, N)), 0.0f), Material.Shine);
+	Result += ColorPower.rgb*Attenuation*(Diff*DiffuseTexel + Spec*SpecularTexel);
+    }
+    return Result;
+}
+
 void main()
 {
     vec3 LightPosition = vec3(Light.Position);
@@ -34,9 +132,16 @@ void main()
 
     vec3 N = normalize(Normal);
     vec3 L = normalize(LightPosition - FragPos);
+    //A directional light's position is the direction towards it, with w 0.
+    if (Light.Position.w == 0.0f)
+    {
+	LightDistanceSquared = 1.0f;
+	L = normalize(LightPosition);
+    }
+    float Shadow = GetShadow(N);
     float Diff = max(dot(N,L),0.0);
     
-    vec3 E = normalize(CameraPosition - FragPos);
+    vec3 E = normalize(CameraPosition[ClusterEye] - FragPos);
     vec3 R = reflect(-L, N);
     float Spec = pow(max(dot(E,R),0.0), Material.Shine);
  
@@ -46,7 +151,12 @@ void main()
     vec3 EmissiveColor = texture(Material.Emissive, UV).rgb;
 
     Color = AmbientColor +
-	DiffuseColor*Light.Power / LightDistanceSquared + 
-	SpecularColor*Light.Power / LightDistanceSquared +
+	DiffuseColor*Shadow*Light.Power / LightDistanceSquared + 
+	SpecularColor*Shadow*Light.Power / LightDistanceSquared +
 	EmissiveColor;
+
+    if (PointLightCount > 0)
+    {
+	Color += ShadePointLights(N, E, texture(Material.Diffuse, UV).rgb, texture(Material.Specular, UV).rgb);
+    }
 }
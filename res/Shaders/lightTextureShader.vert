@@ -11,11 +11,18 @@ struct light {
 
 uniform light Light;
 
+//Must match the depth pre-pass exactly, see depthShader.vert
+invariant gl_Position;
+
 //Model
-uniform mat4 MVP;
 uniform mat4 V;
 uniform mat4 M;
 
+//Per eye view-projection. With EyeCount 2 each draw is instanced twice and
+//instance parity picks the eye, which lands in its half of a side-by-side target.
+uniform mat4 VP[2];
+uniform int EyeCount;
+
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 vertexNormal;
@@ -23,10 +30,27 @@ layout(location = 2) in vec3 vertexNormal;
 out vec2 UV;
 out vec3 FragPos;
 out vec3 Normal;
+//Unmodified per eye clip position and the eye, to find the light cluster.
+out vec4 ClusterClip;
+flat out int ClusterEye;
 
 void main()
 {
-    gl_Position = MVP * vec4(vertexPosition,1.0f);
+    int Eye = gl_InstanceID % EyeCount;
+    vec4 Clip = VP[Eye] * M * vec4(vertexPosition, 1.0f);
+    ClusterClip = Clip;
+    ClusterEye = Eye;
+    if (EyeCount == 2)
+    {
+	float Side = (Eye == 0) ? -1.0f : 1.0f;
+	gl_ClipDistance[0] = Clip.w + Side*Clip.x;
+	Clip.x = 0.5f*Clip.x + 0.5f*Side*Clip.w;
+    }
+    else
+    {
+	gl_ClipDistance[0] = 1.0f;
+    }
+    gl_Position = Clip;
     FragPos = vec3(M*vec4(vertexPosition, 1.0f));
     Normal = mat3(M) * vertexNormal;
     //Normal = mat3(transpose(inverse(M)))*vertexNormal;
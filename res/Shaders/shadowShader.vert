@@ -0,0 +1,12 @@
+#version 330 core
+
+//Depth only, into a shadow map face or cascade.
+uniform mat4 VP;
+uniform mat4 M;
+
+layout(location = 0) in vec3 vertexPosition;
+
+void main()
+{
+    gl_Position = VP * M * vec4(vertexPosition, 1.0f);
+}
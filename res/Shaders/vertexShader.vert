@@ -2,7 +2,7 @@
 
 struct light {
     float Power;
-    vec3 Position;
+    vec4 Position;
 
     vec3 Ambient;
     vec3 Diffuse;
@@ -11,19 +11,39 @@ struct light {
 
 uniform light Light;
 
-uniform mat4 MVP;
+//Must match the depth pre-pass exactly, see depthShader.vert
+invariant gl_Position;
+
 uniform mat4 V;
 uniform mat4 M;
 
+//See lightTextureShader.vert
+uniform mat4 VP[2];
+uniform int EyeCount;
+
 layout(location = 0) in vec3 vertexPosition;
-layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec3 vertexNormal;
 
 out vec3 FragPos;
 out vec3 FragNormal;
+flat out int FragEye;
 
 void main()
 {
-    gl_Position = MVP * vec4(vertexPosition, 1);
+    int Eye = gl_InstanceID % EyeCount;
+    FragEye = Eye;
+    vec4 Clip = VP[Eye] * M * vec4(vertexPosition, 1);
+    if (EyeCount == 2)
+    {
+	float Side = (Eye == 0) ? -1.0f : 1.0f;
+	gl_ClipDistance[0] = Clip.w + Side*Clip.x;
+	Clip.x = 0.5f*Clip.x + 0.5f*Side*Clip.w;
+    }
+    else
+    {
+	gl_ClipDistance[0] = 1.0f;
+    }
+    gl_Position = Clip;
     FragPos = vec3(M*vec4(vertexPosition, 1));
     FragNormal = mat3(M) * vertexNormal;
 }
@@ -1 +1,2 @@
-cc linux_glx.cpp -o gl.out -Wall -Wno-write-strings -lX11 -lGL -lGLU -lm
+cc linux_glx.cpp -o gl.out -Wall -Wno-write-strings -fno-exceptions -lX11 -lGL -lGLU -lm -lpthread
+cc linux_headless.cpp -o headless.out -Wall -Wno-write-strings -fno-exceptions -lEGL -lGL -lm -lpthread
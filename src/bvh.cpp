@@ -0,0 +1,612 @@
+#ifndef BVH_CPP__
+#define BVH_CPP__
+
+#include "platform.h"
+#include "matrixMath.cpp"
+#include "camera.cpp"
+#include "culling.cpp"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define BVH_SAH_BINS 12
+#define BVH_MAX_LEAF_ITEMS 2
+// NOTE: Past BVH_SAH_MAX_DEPTH nodes only take median splits, which halve
+// the count, so no tree is deeper than BVH_SAH_MAX_DEPTH + 31 levels. The
+// traversal stacks hold one pending sibling per level plus the pair just
+// pushed, so BVH_STACK_SIZE covers that in every build, not just where the
+// Asserts are compiled in.
+#define BVH_SAH_MAX_DEPTH 64
+#define BVH_STACK_SIZE 128
+
+// NOTE: Leaves have Left == -1 and own ItemCount entries of Items starting at FirstItem.
+struct bvh_node
+{
+    aabb Bounds;
+    int32 Parent;
+    int32 Left;
+    int32 Right;
+    int32 FirstItem;
+    int32 ItemCount;
+};
+
+struct bvh
+{
+    int32 MaxItems;
+    int32 ItemCount;
+    aabb *ItemBounds;
+    int32 *ItemLeaf;
+    int32 *Items;
+
+    int32 MaxNodes;
+    int32 NodeCount;
+    bvh_node *Nodes;
+
+    // NOTE: Surface area of the root right after the last build, used to decide
+    // when refitting has loosened the tree enough that it should be rebuilt.
+    float BuiltRootArea;
+    // NOTE: Items were added or removed since the last build; the nodes
+    // don't cover them and must not be queried until it's rebuilt.
+    bool32 NeedsBuild;
+};
+
+struct ray
+{
+    v3 Origin;
+    v3 Direction;
+};
+
+aabb UnionAABB(aabb A, aabb B)
+{
+    aabb Result;
+    for(int Axis = 0; Axis < 3; ++Axis)
+    {
+	Result.Min.E[Axis] = Min(A.Min.E[Axis], B.Min.E[Axis]);
+	Result.Max.E[Axis] = Max(A.Max.E[Axis], B.Max.E[Axis]);
+    }
+    return Result;
+}
+
+aabb EmptyAABB()
+{
+    aabb Result;
+    Result.Min = V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    Result.Max = V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    return Result;
+}
+
+float SurfaceArea(aabb Box)
+{
+    v3 D = Box.Max - Box.Min;
+    if (D.x < 0.0f || D.y < 0.0f || D.z < 0.0f)
+    {
+	return 0.0f;
+    }
+    return 2.0f*(D.x*D.y + D.y*D.z + D.z*D.x);
+}
+
+bool32 AABBEqual(aabb A, aabb B)
+{
+    return (A.Min.x == B.Min.x && A.Min.y == B.Min.y && A.Min.z == B.Min.z &&
+	    A.Max.x == B.Max.x && A.Max.y == B.Max.y && A.Max.z == B.Max.z);
+}
+
+// NOTE: Arvo's method, transforms the eight corners implicitly.
+aabb TransformAABB(aabb Box, mat4 M)
+{
+    aabb Result;
+    for(int Row = 0; Row < 3; ++Row)
+    {
+	Result.Min.E[Row] = M.E[3][Row];
+	Result.Max.E[Row] = M.E[3][Row];
+	for(int Col = 0; Col < 3; ++Col)
+	{
+	    float A = M.E[Col][Row]*Box.Min.E[Col];
+	    float B = M.E[Col][Row]*Box.Max.E[Col];
+	    Result.Min.E[Row] += Min(A, B);
+	    Result.Max.E[Row] += Max(A, B);
+	}
+    }
+    return Result;
+}
+
+void InitBVH(bvh *BVH, memory_arena *Arena, int32 MaxItems)
+{
+    BVH->MaxItems = MaxItems;
+    BVH->ItemCount = 0;
+    BVH->ItemBounds = PushArray(Arena, MaxItems, aabb);
+    BVH->ItemLeaf = PushArray(Arena, MaxItems, int32);
+    BVH->Items = PushArray(Arena, MaxItems, int32);
+    BVH->MaxNodes = 2*MaxItems;
+    BVH->NodeCount = 0;
+    BVH->Nodes = PushArray(Arena, BVH->MaxNodes, bvh_node);
+    BVH->BuiltRootArea = 0.0f;
+    BVH->NeedsBuild = false;
+}
+
+int32 AddBVHItem(bvh *BVH, aabb Bounds)
+{
+    Assert(BVH->ItemCount < BVH->MaxItems);
+    int32 Item = BVH->ItemCount++;
+    BVH->ItemBounds[Item] = Bounds;
+    BVH->ItemLeaf[Item] = -1;
+    BVH->NeedsBuild = true;
+    return Item;
+}
+
+// NOTE: The last item takes the removed one's index, the same way the
+// entity store packs its arrays.
+void RemoveBVHItem(bvh *BVH, int32 Item)
+{
+    Assert(Item >= 0 && Item < BVH->ItemCount);
+    int32 Last = --BVH->ItemCount;
+    BVH->ItemBounds[Item] = BVH->ItemBounds[Last];
+    BVH->ItemLeaf[Item] = -1;
+    BVH->NeedsBuild = true;
+}
+
+// NOTE: Replaces every item, for when the items were reordered. The tree
+// is rebuilt before it's next queried.
+void ResetBVHItems(bvh *BVH, aabb *Bounds, int32 Count)
+{
+    Assert(Count <= BVH->MaxItems);
+    BVH->ItemCount = Count;
+    memcpy(BVH->ItemBounds, Bounds, Count*sizeof(aabb));
+    for(int32 Item = 0; Item < Count; ++Item)
+    {
+	BVH->ItemLeaf[Item] = -1;
+    }
+    BVH->NeedsBuild = true;
+}
+
+v3 AABBCentroid(aabb Box)
+{
+    return 0.5f*(Box.Min + Box.Max);
+}
+
+int32 BuildBVHNode(bvh *BVH, int32 Parent, int32 First, int32 Count, int32 Depth)
+{
+    Assert(BVH->NodeCount < BVH->MaxNodes);
+    int32 NodeIndex = BVH->NodeCount++;
+    bvh_node *Node = BVH->Nodes + NodeIndex;
+    Node->Parent = Parent;
+    Node->Left = -1;
+    Node->Right = -1;
+    Node->FirstItem = First;
+    Node->ItemCount = Count;
+
+    aabb Bounds = EmptyAABB();
+    aabb CentroidBounds = EmptyAABB();
+    for(int32 Index = First; Index < First + Count; ++Index)
+    {
+	aabb ItemBounds = BVH->ItemBounds[BVH->Items[Index]];
+	v3 Centroid = AABBCentroid(ItemBounds);
+	aabb CentroidBox = {Centroid, Centroid};
+	Bounds = UnionAABB(Bounds, ItemBounds);
+	CentroidBounds = UnionAABB(CentroidBounds, CentroidBox);
+    }
+    Node->Bounds = Bounds;
+
+    if (Count <= BVH_MAX_LEAF_ITEMS)
+    {
+	for(int32 Index = First; Index < First + Count; ++Index)
+	{
+	    BVH->ItemLeaf[BVH->Items[Index]] = NodeIndex;
+	}
+	return NodeIndex;
+    }
+
+    v3 Extent = CentroidBounds.Max - CentroidBounds.Min;
+    int Axis = 0;
+    if (Extent.y > Extent.E[Axis]) Axis = 1;
+    if (Extent.z > Extent.E[Axis]) Axis = 2;
+
+    // NOTE: SAH over centroid bins on the widest axis. Each candidate split
+    // between bins is costed as count*area on both sides.
+    int32 SplitBin = -1;
+    float AxisMin = CentroidBounds.Min.E[Axis];
+    float AxisExtent = Extent.E[Axis];
+    if (AxisExtent > 0.0f && Depth < BVH_SAH_MAX_DEPTH)
+    {
+	int32 BinCount[BVH_SAH_BINS] = {0};
+	aabb BinBounds[BVH_SAH_BINS];
+	for(int Bin = 0; Bin < BVH_SAH_BINS; ++Bin)
+	{
+	    BinBounds[Bin] = EmptyAABB();
+	}
+
+	float BinScale = BVH_SAH_BINS / AxisExtent;
+	for(int32 Index = First; Index < First + Count; ++Index)
+	{
+	    aabb ItemBounds = BVH->ItemBounds[BVH->Items[Index]];
+	    int Bin = (int)((AABBCentroid(ItemBounds).E[Axis] - AxisMin)*BinScale);
+	    Bin = Clamp(Bin, 0, BVH_SAH_BINS - 1);
+	    ++BinCount[Bin];
+	    BinBounds[Bin] = UnionAABB(BinBounds[Bin], ItemBounds);
+	}
+
+	float RightArea[BVH_SAH_BINS];
+	int32 RightCount[BVH_SAH_BINS];
+	aabb Accumulated = EmptyAABB();
+	int32 AccumulatedCount = 0;
+	for(int Bin = BVH_SAH_BINS - 1; Bin > 0; --Bin)
+	{
+	    Accumulated = UnionAABB(Accumulated, BinBounds[Bin]);
+	    AccumulatedCount += BinCount[Bin];
+	    RightArea[Bin] = SurfaceArea(Accumulated);
+	    RightCount[Bin] = AccumulatedCount;
+	}
+
+	float BestCost = Count*SurfaceArea(Bounds);
+	Accumulated = EmptyAABB();
+	AccumulatedCount = 0;
+	for(int Bin = 0; Bin < BVH_SAH_BINS - 1; ++Bin)
+	{
+	    Accumulated = UnionAABB(Accumulated, BinBounds[Bin]);
+	    AccumulatedCount += BinCount[Bin];
+	    float Cost = AccumulatedCount*SurfaceArea(Accumulated) + RightCount[Bin + 1]*RightArea[Bin + 1];
+	    if (AccumulatedCount && RightCount[Bin + 1] && Cost < BestCost)
+	    {
+		BestCost = Cost;
+		SplitBin = Bin;
+	    }
+	}
+
+	if (SplitBin >= 0)
+	{
+	    int32 Low = First;
+	    int32 High = First + Count - 1;
+	    while(Low <= High)
+	    {
+		aabb ItemBounds = BVH->ItemBounds[BVH->Items[Low]];
+		int Bin = (int)((AABBCentroid(ItemBounds).E[Axis] - AxisMin)*BinScale);
+		Bin = Clamp(Bin, 0, BVH_SAH_BINS - 1);
+		if (Bin <= SplitBin)
+		{
+		    ++Low;
+		}
+		else
+		{
+		    SWAP(BVH->Items[Low], BVH->Items[High], int32);
+		    --High;
+		}
+	    }
+	    int32 LeftCount = Low - First;
+	    Node->Left = BuildBVHNode(BVH, NodeIndex, First, LeftCount, Depth + 1);
+	    Node->Right = BuildBVHNode(BVH, NodeIndex, Low, Count - LeftCount, Depth + 1);
+	    Node = BVH->Nodes + NodeIndex;
+	    Node->ItemCount = 0;
+	    return NodeIndex;
+	}
+    }
+
+    // NOTE: SAH found nothing cheaper than a leaf (or all centroids coincide,
+    // or the tree is already BVH_SAH_MAX_DEPTH deep), fall back to a median
+    // split so leaves stay small.
+    int32 LeftCount = Count/2;
+    Node->Left = BuildBVHNode(BVH, NodeIndex, First, LeftCount, Depth + 1);
+    Node->Right = BuildBVHNode(BVH, NodeIndex, First + LeftCount, Count - LeftCount, Depth + 1);
+    Node = BVH->Nodes + NodeIndex;
+    Node->ItemCount = 0;
+    return NodeIndex;
+}
+
+void BuildBVH(bvh *BVH)
+{
+    BVH->NodeCount = 0;
+    for(int32 Item = 0; Item < BVH->ItemCount; ++Item)
+    {
+	BVH->Items[Item] = Item;
+    }
+    if (BVH->ItemCount > 0)
+    {
+	BuildBVHNode(BVH, -1, 0, BVH->ItemCount, 0);
+	BVH->BuiltRootArea = SurfaceArea(BVH->Nodes[0].Bounds);
+    }
+    BVH->NeedsBuild = false;
+}
+
+// NOTE: Walks from the item's leaf to the root and stops as soon as a node's
+// bounds come out unchanged, so a moving object only touches its own path.
+void UpdateBVHItem(bvh *BVH, int32 Item, aabb Bounds)
+{
+    if (AABBEqual(BVH->ItemBounds[Item], Bounds))
+    {
+	return;
+    }
+    BVH->ItemBounds[Item] = Bounds;
+    if (BVH->NeedsBuild)
+    {
+	return;
+    }
+
+    int32 NodeIndex = BVH->ItemLeaf[Item];
+    while(NodeIndex >= 0)
+    {
+	bvh_node *Node = BVH->Nodes + NodeIndex;
+	aabb NewBounds;
+	if (Node->Left < 0)
+	{
+	    NewBounds = EmptyAABB();
+	    for(int32 Index = Node->FirstItem; Index < Node->FirstItem + Node->ItemCount; ++Index)
+	    {
+		NewBounds = UnionAABB(NewBounds, BVH->ItemBounds[BVH->Items[Index]]);
+	    }
+	}
+	else
+	{
+	    NewBounds = UnionAABB(BVH->Nodes[Node->Left].Bounds, BVH->Nodes[Node->Right].Bounds);
+	}
+
+	if (AABBEqual(NewBounds, Node->Bounds))
+	{
+	    break;
+	}
+	Node->Bounds = NewBounds;
+	NodeIndex = Node->Parent;
+    }
+}
+
+// NOTE: Copies just the live items and nodes, enough for queries. The copy
+// is sized to the source and can't take new items.
+void CopyBVH(bvh *Dest, bvh *Source, memory_arena *Arena)
+{
+    Dest->MaxItems = Source->ItemCount;
+    Dest->ItemCount = Source->ItemCount;
+    Dest->ItemBounds = PushArray(Arena, Source->ItemCount, aabb);
+    Dest->ItemLeaf = PushArray(Arena, Source->ItemCount, int32);
+    Dest->Items = PushArray(Arena, Source->ItemCount, int32);
+    Dest->MaxNodes = Source->NodeCount;
+    Dest->NodeCount = Source->NodeCount;
+    Dest->Nodes = PushArray(Arena, Source->NodeCount, bvh_node);
+    Dest->BuiltRootArea = Source->BuiltRootArea;
+    Dest->NeedsBuild = Source->NeedsBuild;
+
+    memcpy(Dest->ItemBounds, Source->ItemBounds, Source->ItemCount*sizeof(aabb));
+    memcpy(Dest->ItemLeaf, Source->ItemLeaf, Source->ItemCount*sizeof(int32));
+    memcpy(Dest->Items, Source->Items, Source->ItemCount*sizeof(int32));
+    memcpy(Dest->Nodes, Source->Nodes, Source->NodeCount*sizeof(bvh_node));
+}
+
+bool32 BVHNeedsRebuild(bvh *BVH)
+{
+    return (BVH->NeedsBuild ||
+	    (BVH->NodeCount > 0 &&
+	     SurfaceArea(BVH->Nodes[0].Bounds) > 2.0f*BVH->BuiltRootArea));
+}
+
+enum frustum_test
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECT,
+    FRUSTUM_INSIDE
+};
+
+frustum_test TestFrustumAABB(frustum *Frustum, aabb Box)
+{
+    frustum_test Result = FRUSTUM_INSIDE;
+    for(int PlaneIndex = 0; PlaneIndex < 6; ++PlaneIndex)
+    {
+	plane Plane = Frustum->Planes[PlaneIndex];
+	v3 Positive, Negative;
+	for(int Axis = 0; Axis < 3; ++Axis)
+	{
+	    bool32 Forward = Plane.Normal.E[Axis] >= 0.0f;
+	    Positive.E[Axis] = Forward ? Box.Max.E[Axis] : Box.Min.E[Axis];
+	    Negative.E[Axis] = Forward ? Box.Min.E[Axis] : Box.Max.E[Axis];
+	}
+	if (Dot(Plane.Normal, Positive) + Plane.D < 0.0f)
+	{
+	    return FRUSTUM_OUTSIDE;
+	}
+	if (Dot(Plane.Normal, Negative) + Plane.D < 0.0f)
+	{
+	    Result = FRUSTUM_INTERSECT;
+	}
+    }
+    return Result;
+}
+
+int32 AppendSubtreeItems(bvh *BVH, int32 NodeIndex, int32 *OutItems, int32 OutCount, int32 MaxOut)
+{
+    int32 Stack[BVH_STACK_SIZE];
+    int32 StackCount = 0;
+    Stack[StackCount++] = NodeIndex;
+    while(StackCount > 0)
+    {
+	bvh_node *Node = BVH->Nodes + Stack[--StackCount];
+	if (Node->Left < 0)
+	{
+	    for(int32 Index = Node->FirstItem; Index < Node->FirstItem + Node->ItemCount && OutCount < MaxOut; ++Index)
+	    {
+		OutItems[OutCount++] = BVH->Items[Index];
+	    }
+	}
+	else
+	{
+	    Assert(StackCount + 2 <= BVH_STACK_SIZE);
+	    Stack[StackCount++] = Node->Right;
+	    Stack[StackCount++] = Node->Left;
+	}
+    }
+    return OutCount;
+}
+
+// NOTE: Subtrees fully inside the frustum are emitted without further tests.
+int32 QueryBVHFrustum(bvh *BVH, frustum *Frustum, int32 *OutItems, int32 MaxOut)
+{
+    int32 OutCount = 0;
+    if (BVH->NodeCount == 0)
+    {
+	return 0;
+    }
+
+    int32 Stack[BVH_STACK_SIZE];
+    int32 StackCount = 0;
+    Stack[StackCount++] = 0;
+    while(StackCount > 0 && OutCount < MaxOut)
+    {
+	int32 NodeIndex = Stack[--StackCount];
+	bvh_node *Node = BVH->Nodes + NodeIndex;
+	frustum_test Test = TestFrustumAABB(Frustum, Node->Bounds);
+	if (Test == FRUSTUM_OUTSIDE)
+	{
+	    continue;
+	}
+
+	if (Test == FRUSTUM_INSIDE)
+	{
+	    OutCount = AppendSubtreeItems(BVH, NodeIndex, OutItems, OutCount, MaxOut);
+	}
+	else if (Node->Left < 0)
+	{
+	    for(int32 Index = Node->FirstItem; Index < Node->FirstItem + Node->ItemCount && OutCount < MaxOut; ++Index)
+	    {
+		int32 Item = BVH->Items[Index];
+		if (TestFrustumAABB(Frustum, BVH->ItemBounds[Item]) != FRUSTUM_OUTSIDE)
+		{
+		    OutItems[OutCount++] = Item;
+		}
+	    }
+	}
+	else
+	{
+	    Assert(StackCount + 2 <= BVH_STACK_SIZE);
+	    Stack[StackCount++] = Node->Right;
+	    Stack[StackCount++] = Node->Left;
+	}
+    }
+    return OutCount;
+}
+
+bool32 TestSphereAABB(bounding_sphere Sphere, aabb Box)
+{
+    float DistanceSquared = 0.0f;
+    for(int Axis = 0; Axis < 3; ++Axis)
+    {
+	float C = Sphere.Center.E[Axis];
+	float Closest = Clamp(C, Box.Min.E[Axis], Box.Max.E[Axis]);
+	DistanceSquared += (C - Closest)*(C - Closest);
+    }
+    return DistanceSquared <= Sphere.Radius*Sphere.Radius;
+}
+
+int32 QueryBVHSphere(bvh *BVH, bounding_sphere Sphere, int32 *OutItems, int32 MaxOut)
+{
+    int32 OutCount = 0;
+    if (BVH->NodeCount == 0)
+    {
+	return 0;
+    }
+
+    int32 Stack[BVH_STACK_SIZE];
+    int32 StackCount = 0;
+    Stack[StackCount++] = 0;
+    while(StackCount > 0 && OutCount < MaxOut)
+    {
+	bvh_node *Node = BVH->Nodes + Stack[--StackCount];
+	if (!TestSphereAABB(Sphere, Node->Bounds))
+	{
+	    continue;
+	}
+
+	if (Node->Left < 0)
+	{
+	    for(int32 Index = Node->FirstItem; Index < Node->FirstItem + Node->ItemCount && OutCount < MaxOut; ++Index)
+	    {
+		int32 Item = BVH->Items[Index];
+		if (TestSphereAABB(Sphere, BVH->ItemBounds[Item]))
+		{
+		    OutItems[OutCount++] = Item;
+		}
+	    }
+	}
+	else
+	{
+	    Assert(StackCount + 2 <= BVH_STACK_SIZE);
+	    Stack[StackCount++] = Node->Right;
+	    Stack[StackCount++] = Node->Left;
+	}
+    }
+    return OutCount;
+}
+
+// NOTE: Slab test. Returns the entry distance, or FLT_MAX on a miss. A ray
+// parallel to an axis has an infinite InvDirection there, and an origin on
+// that slab's plane would make 0*inf = NaN, so those axes only check the
+// origin is between the planes.
+float IntersectRayAABB(v3 Origin, v3 InvDirection, aabb Box, float MaxT)
+{
+    float TMin = 0.0f;
+    float TMax = MaxT;
+    for(int Axis = 0; Axis < 3; ++Axis)
+    {
+	if (isinf(InvDirection.E[Axis]))
+	{
+	    if (Origin.E[Axis] < Box.Min.E[Axis] || Origin.E[Axis] > Box.Max.E[Axis])
+	    {
+		return FLT_MAX;
+	    }
+	    continue;
+	}
+	float T0 = (Box.Min.E[Axis] - Origin.E[Axis])*InvDirection.E[Axis];
+	float T1 = (Box.Max.E[Axis] - Origin.E[Axis])*InvDirection.E[Axis];
+	TMin = Max(TMin, Min(T0, T1));
+	TMax = Min(TMax, Max(T0, T1));
+    }
+    return (TMin <= TMax) ? TMin : FLT_MAX;
+}
+
+// NOTE: Closest item whose bounds the ray enters, or -1. Picking against
+// bounds is enough for selection; callers wanting triangles refine from here.
+int32 QueryBVHRay(bvh *BVH, ray Ray, float MaxT, float *OutT)
+{
+    int32 Hit = -1;
+    float HitT = MaxT;
+    if (BVH->NodeCount == 0)
+    {
+	return Hit;
+    }
+
+    v3 InvDirection = V3(1.0f / Ray.Direction.x, 1.0f / Ray.Direction.y, 1.0f / Ray.Direction.z);
+    int32 Stack[BVH_STACK_SIZE];
+    int32 StackCount = 0;
+    Stack[StackCount++] = 0;
+    while(StackCount > 0)
+    {
+	bvh_node *Node = BVH->Nodes + Stack[--StackCount];
+	if (IntersectRayAABB(Ray.Origin, InvDirection, Node->Bounds, HitT) == FLT_MAX)
+	{
+	    continue;
+	}
+
+	if (Node->Left < 0)
+	{
+	    for(int32 Index = Node->FirstItem; Index < Node->FirstItem + Node->ItemCount; ++Index)
+	    {
+		int32 Item = BVH->Items[Index];
+		float T = IntersectRayAABB(Ray.Origin, InvDirection, BVH->ItemBounds[Item], HitT);
+		if (T < HitT)
+		{
+		    HitT = T;
+		    Hit = Item;
+		}
+	    }
+	}
+	else
+	{
+	    Assert(StackCount + 2 <= BVH_STACK_SIZE);
+	    Stack[StackCount++] = Node->Right;
+	    Stack[StackCount++] = Node->Left;
+	}
+    }
+
+    if (OutT)
+    {
+	*OutT = HitT;
+    }
+    return Hit;
+}
+
+#endif
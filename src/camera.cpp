@@ -18,6 +18,48 @@ struct camera
     v3 Up;
 };
 
+struct plane
+{
+    v3 Normal;
+    float D;
+};
+
+// NOTE: Planes point inwards: Left, Right, Bottom, Top, Near, Far.
+struct frustum
+{
+    plane Planes[6];
+};
+
+// NOTE: Gribb/Hartmann extraction. E is column-major, so row i is E[0..3][i].
+frustum ExtractFrustumPlanes(mat4 ViewProjection)
+{
+    frustum Frustum;
+    float (*E)[4] = ViewProjection.E;
+    for(int PlaneIndex = 0; PlaneIndex < 6; ++PlaneIndex)
+    {
+	int Row = PlaneIndex / 2;
+	float Sign = (PlaneIndex % 2) ? -1.0f : 1.0f;
+	v3 Normal = V3(E[0][3] + Sign*E[0][Row],
+		       E[1][3] + Sign*E[1][Row],
+		       E[2][3] + Sign*E[2][Row]);
+	float D = E[3][3] + Sign*E[3][Row];
+	float InvLength = 1.0f / Length(Normal);
+	Frustum.Planes[PlaneIndex].Normal = InvLength*Normal;
+	Frustum.Planes[PlaneIndex].D = InvLength*D;
+    }
+    return Frustum;
+}
+
+// NOTE: For two eyes offset along the camera's right axis the top, bottom,
+// near and far planes coincide, so the union is the left eye's frustum with
+// the right eye's right plane.
+frustum MergeStereoFrustum(frustum Left, frustum Right)
+{
+    frustum Result = Left;
+    Result.Planes[1] = Right.Planes[1];
+    return Result;
+}
+
 mat4 GenerateCameraOrthographic(camera Camera)
 {
     mat4 Projection = MakeOrthographicProjection(6.0f, Camera.Aspect, Camera.Near, Camera.Far);
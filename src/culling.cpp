@@ -0,0 +1,162 @@
+#ifndef CULLING_CPP__
+#define CULLING_CPP__
+
+#include "platform.h"
+#include "matrixMath.cpp"
+#include "camera.cpp"
+
+#include <float.h>
+#include <emmintrin.h>
+
+struct aabb
+{
+    v3 Min;
+    v3 Max;
+};
+
+struct bounding_sphere
+{
+    v3 Center;
+    float Radius;
+};
+
+aabb ComputeAABB(float *Vertices, int VertexCount)
+{
+    aabb Result;
+    Result.Min = V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    Result.Max = V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(int VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+    {
+	float *P = Vertices + 3*VertexIndex;
+	for(int Axis = 0; Axis < 3; ++Axis)
+	{
+	    Result.Min.E[Axis] = Min(Result.Min.E[Axis], P[Axis]);
+	    Result.Max.E[Axis] = Max(Result.Max.E[Axis], P[Axis]);
+	}
+    }
+    return Result;
+}
+
+// NOTE: Centered on the AABB rather than a minimal sphere; it is cheap and
+// tight enough for the convex meshes we load.
+bounding_sphere ComputeBoundingSphere(float *Vertices, int VertexCount, aabb Box)
+{
+    bounding_sphere Result;
+    Result.Center = 0.5f*(Box.Min + Box.Max);
+    float RadiusSquared = 0.0f;
+    for(int VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+    {
+	float *P = Vertices + 3*VertexIndex;
+	v3 Offset = V3(P[0], P[1], P[2]) - Result.Center;
+	RadiusSquared = Max(RadiusSquared, Dot(Offset, Offset));
+    }
+    Result.Radius = sqrtf(RadiusSquared);
+    return Result;
+}
+
+v3 TransformPoint(mat4 M, v3 P)
+{
+    v3 Result;
+    Result.x = M.E[0][0]*P.x + M.E[1][0]*P.y + M.E[2][0]*P.z + M.E[3][0];
+    Result.y = M.E[0][1]*P.x + M.E[1][1]*P.y + M.E[2][1]*P.z + M.E[3][1];
+    Result.z = M.E[0][2]*P.x + M.E[1][2]*P.y + M.E[2][2]*P.z + M.E[3][2];
+    return Result;
+}
+
+bounding_sphere TransformBoundingSphere(bounding_sphere Sphere, mat4 Model, v3 Scale)
+{
+    bounding_sphere Result;
+    Result.Center = TransformPoint(Model, Sphere.Center);
+    float MaxScale = Max(Max(fabsf(Scale.x), fabsf(Scale.y)), fabsf(Scale.z));
+    Result.Radius = Sphere.Radius*MaxScale;
+    return Result;
+}
+
+// NOTE: Spheres are kept SoA so the cull can test four of them per plane at once.
+// Count is padded up to a multiple of 4 with zero-radius spheres at the origin,
+// so the arrays have room for Capacity rounded up to 4.
+struct cull_list
+{
+    int Count;
+    int Capacity;
+    float *CenterX;
+    float *CenterY;
+    float *CenterZ;
+    float *Radius;
+    uint32 *Visible;
+};
+
+void InitCullList(cull_list *List, memory_arena *Arena, int Capacity)
+{
+    int PaddedCapacity = (Capacity + 3) & ~3;
+    List->Count = 0;
+    List->Capacity = Capacity;
+    List->CenterX = PushArray(Arena, PaddedCapacity, float);
+    List->CenterY = PushArray(Arena, PaddedCapacity, float);
+    List->CenterZ = PushArray(Arena, PaddedCapacity, float);
+    List->Radius = PushArray(Arena, PaddedCapacity, float);
+    List->Visible = PushArray(Arena, PaddedCapacity, uint32);
+}
+
+struct cull_stats
+{
+    uint32 Tested;
+    uint32 Culled;
+    uint32 Occluded;
+    uint32 Drawn;
+};
+
+int AddCullSphere(cull_list *List, bounding_sphere Sphere)
+{
+    Assert(List->Count < List->Capacity);
+    int Index = List->Count++;
+    List->CenterX[Index] = Sphere.Center.x;
+    List->CenterY[Index] = Sphere.Center.y;
+    List->CenterZ[Index] = Sphere.Center.z;
+    List->Radius[Index] = Sphere.Radius;
+    return Index;
+}
+
+void CullSpheres(cull_list *List, frustum *Frustum)
+{
+    int Count = List->Count;
+    int PaddedCount = (Count + 3) & ~3;
+    for(int Index = Count; Index < PaddedCount; ++Index)
+    {
+	List->CenterX[Index] = 0.0f;
+	List->CenterY[Index] = 0.0f;
+	List->CenterZ[Index] = 0.0f;
+	List->Radius[Index] = 0.0f;
+    }
+
+    __m128 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneD[6];
+    for(int PlaneIndex = 0; PlaneIndex < 6; ++PlaneIndex)
+    {
+	plane Plane = Frustum->Planes[PlaneIndex];
+	PlaneX[PlaneIndex] = _mm_set1_ps(Plane.Normal.x);
+	PlaneY[PlaneIndex] = _mm_set1_ps(Plane.Normal.y);
+	PlaneZ[PlaneIndex] = _mm_set1_ps(Plane.Normal.z);
+	PlaneD[PlaneIndex] = _mm_set1_ps(Plane.D);
+    }
+
+    for(int Index = 0; Index < PaddedCount; Index += 4)
+    {
+	__m128 X = _mm_loadu_ps(List->CenterX + Index);
+	__m128 Y = _mm_loadu_ps(List->CenterY + Index);
+	__m128 Z = _mm_loadu_ps(List->CenterZ + Index);
+	__m128 NegRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(List->Radius + Index));
+
+	__m128 Inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for(int PlaneIndex = 0; PlaneIndex < 6; ++PlaneIndex)
+	{
+	    __m128 Distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(X, PlaneX[PlaneIndex]),
+						    _mm_mul_ps(Y, PlaneY[PlaneIndex])),
+					 _mm_add_ps(_mm_mul_ps(Z, PlaneZ[PlaneIndex]),
+						    PlaneD[PlaneIndex]));
+	    Inside = _mm_and_ps(Inside, _mm_cmpgt_ps(Distance, NegRadius));
+	}
+	_mm_storeu_ps((float *)(List->Visible + Index), Inside);
+    }
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef DYNAMICRESOLUTION_CPP__
+#define DYNAMICRESOLUTION_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+#include "gpuProfiler.cpp"
+
+#include <math.h>
+
+// NOTE: Scales the eye viewport to keep the GPU frame under a time budget.
+// The eye buffers are allocated DYNAMIC_RESOLUTION_MAX_SCALE times the size
+// the headset asks for; each frame renders into their bottom left corner and
+// the resolve stretches that over the whole eye texture. Scale is relative to
+// the headset's size, so 1 renders exactly what it asked for.
+//
+// GPU timings come back GPU_PROFILER_LATENCY frames late, so after a change
+// the controller waits for the first frame drawn at the new scale before it
+// judges again; reacting to older frames would overshoot and oscillate.
+
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+// NOTE: Frames inside [HEADROOM*Target, Target] are left alone; the scale
+// aims for the middle of that band.
+#define DYNAMIC_RESOLUTION_HEADROOM 0.85f
+// NOTE: Dropping resolution is urgent, raising it isn't; the largest step up.
+#define DYNAMIC_RESOLUTION_MAX_STEP_UP 0.05f
+
+struct dynamic_resolution
+{
+    bool32 Enabled;
+    float TargetMilliseconds;
+    float Scale;
+    int64 SettleFrameIndex;
+    int64 LastResultFrameIndex;
+};
+
+void InitDynamicResolution(dynamic_resolution *Resolution, platform_data *Platform)
+{
+    Resolution->Scale = 1.0f;
+    Resolution->LastResultFrameIndex = -1;
+    if (Platform->DynamicResolutionTargetMs <= 0.0f || !Platform->LeftEye)
+    {
+	return;
+    }
+    Resolution->Enabled = true;
+    Resolution->TargetMilliseconds = Platform->DynamicResolutionTargetMs;
+}
+
+// NOTE: Call once a frame after BeginGPUFrame, before anything is drawn at
+// the scale it picks.
+void UpdateDynamicResolution(dynamic_resolution *Resolution, gpu_profiler *Profiler)
+{
+    if (!Resolution->Enabled ||
+	Profiler->ResultFrameIndex == Resolution->LastResultFrameIndex ||
+	Profiler->ResultFrameIndex < Resolution->SettleFrameIndex)
+    {
+	return;
+    }
+    Resolution->LastResultFrameIndex = Profiler->ResultFrameIndex;
+
+    float Target = Resolution->TargetMilliseconds;
+    float Milliseconds = Profiler->FrameMilliseconds;
+    if (Milliseconds <= 0.0f ||
+	(Milliseconds <= Target && Milliseconds >= DYNAMIC_RESOLUTION_HEADROOM*Target))
+    {
+	return;
+    }
+
+    // NOTE: GPU time goes roughly with the pixel count, the square of the scale.
+    float Aim = 0.5f*(1.0f + DYNAMIC_RESOLUTION_HEADROOM)*Target;
+    float Scale = Resolution->Scale*sqrtf(Aim / Milliseconds);
+    Scale = Min(Scale, Resolution->Scale + DYNAMIC_RESOLUTION_MAX_STEP_UP);
+    Scale = Clamp(Scale, DYNAMIC_RESOLUTION_MIN_SCALE, DYNAMIC_RESOLUTION_MAX_SCALE);
+    if (fabsf(Scale - Resolution->Scale) < 0.01f)
+    {
+	return;
+    }
+
+    if (Profiler->Print)
+    {
+	printf("Dynamic resolution: %.3f -> %.3f (%.3f ms, target %.3f ms)\n",
+	       Resolution->Scale, Scale, Milliseconds, Target);
+    }
+    Resolution->Scale = Scale;
+    Resolution->SettleFrameIndex = Profiler->FrameIndex;
+}
+
+// NOTE: The part of a BufferWidth x BufferHeight eye buffer to render into
+// this frame; the whole buffer when dynamic resolution is off.
+void GetDynamicViewport(dynamic_resolution *Resolution, int BufferWidth, int BufferHeight,
+			int *Width, int *Height)
+{
+    *Width = BufferWidth;
+    *Height = BufferHeight;
+    if (Resolution->Enabled)
+    {
+	float Fraction = Resolution->Scale / DYNAMIC_RESOLUTION_MAX_SCALE;
+	*Width = Clamp((int)(Fraction*BufferWidth + 0.5f), 1, BufferWidth);
+	*Height = Clamp((int)(Fraction*BufferHeight + 0.5f), 1, BufferHeight);
+    }
+}
+
+#endif
@@ -0,0 +1,494 @@
+#ifndef ENTITIES_CPP__
+#define ENTITIES_CPP__
+
+#include "platform.h"
+#include "matrixMath.cpp"
+#include "culling.cpp"
+#include "bvh.cpp"
+#include "jobs.cpp"
+#include "pool.cpp"
+
+#include <string.h>
+
+// NOTE: Scene objects as structure of arrays. Each component is its own
+// array indexed by the entity's dense index, so a system only streams the
+// arrays it reads. Entities are allocated from a pool, whose items are the
+// flags; every other array moves in lockstep with it, so a removal moves the
+// last entity into the hole. Hold entity_handles, not indices, across
+// anything that can remove.
+//
+// Entities can have a parent, in which case their transform is relative to
+// it. The arrays are kept sorted by depth in the hierarchy, breadth first,
+// so one pass from the front sees every parent before its children and each
+// level is a contiguous range the workers can split. Only entities marked
+// dirty and the subtrees under them get their world transform recomputed;
+// everything else keeps the cached one.
+
+#define ENTITY_TRANSFORM_BATCH 1024
+#define ENTITY_MAX_DEPTH 16
+#define ENTITY_NO_PARENT POOL_NO_SLOT
+
+typedef pool_handle entity_handle;
+
+enum entity_flags
+{
+    // NOTE: Rasterized into the occlusion buffer and never occlusion tested.
+    ENTITY_OCCLUDER = 0x1,
+    // NOTE: Local transform changed since the last transform pass.
+    ENTITY_DIRTY = 0x2,
+    // NOTE: World transform was recomputed by the last transform pass.
+    ENTITY_MOVED = 0x4,
+    // NOTE: Expected to move all the time, so it's drawn into the per-frame
+    // shadow overlay instead of the cached shadow maps. Children of a
+    // dynamic entity should be dynamic too.
+    ENTITY_DYNAMIC = 0x8,
+    // NOTE: Never drawn into shadow maps.
+    ENTITY_NO_SHADOW = 0x10,
+};
+
+struct model;
+struct texture_material;
+struct color_material;
+
+enum material_type
+{
+    MATERIAL_LIGHT_TEXTURE,
+    MATERIAL_COLOR
+};
+
+struct entity_material
+{
+    material_type Type;
+    union
+    {
+	texture_material *Texture;
+	color_material *Color;
+    };
+};
+
+struct entity_store
+{
+    // NOTE: Items are the uint32 flags.
+    memory_pool Pool;
+
+    // NOTE: Local transform, relative to the parent if there is one. Mark
+    // the entity dirty after changing it.
+    v3 *Positions;
+    v3 *Scales;
+    v3 *Axes;
+    float *Angles;
+    mat4 *World;
+
+    // NOTE: Hierarchy. ParentIndices is derived from Parents when the
+    // arrays are sorted.
+    entity_handle *Parents;
+    uint32 *ParentIndices;
+    uint32 LevelCount;
+    uint32 LevelEnds[ENTITY_MAX_DEPTH];
+    bool32 HierarchyChanged;
+    bool32 AnyDirty;
+
+    // NOTE: Render mesh, with its bounds in model space.
+    model **Meshes;
+    aabb *LocalBounds;
+    bounding_sphere *LocalSpheres;
+
+    entity_material *Materials;
+
+    // NOTE: World space bounds, written with the world transform.
+    aabb *WorldBounds;
+    bounding_sphere *WorldSpheres;
+
+    // NOTE: Room to reorder the biggest component.
+    uint32 *SortOrder;
+    uint32 *SortIndices;
+    uint8 *SortDepths;
+    void *SortBuffer;
+};
+
+mat4 MakeObjectTransform(v3 Position, v3 Scale, v3 Axis, float Angle)
+{
+    mat4 Rotation = MakeRotation(Axis, Angle);
+    mat4 ScaleMatrix = MakeScale(Scale);
+    mat4 Translation = MakeTranslation(Position);
+    return Translation * Rotation * ScaleMatrix;
+}
+
+void InitEntityStore(entity_store *Store, memory_arena *Arena, uint32 Capacity)
+{
+    InitPool(&Store->Pool, Arena, Capacity, uint32);
+    Store->Positions = PushArray(Arena, Capacity, v3);
+    Store->Scales = PushArray(Arena, Capacity, v3);
+    Store->Axes = PushArray(Arena, Capacity, v3);
+    Store->Angles = PushArray(Arena, Capacity, float);
+    Store->World = PushArray(Arena, Capacity, mat4);
+    Store->Parents = PushArray(Arena, Capacity, entity_handle);
+    Store->ParentIndices = PushArray(Arena, Capacity, uint32);
+    Store->LevelCount = 0;
+    Store->HierarchyChanged = false;
+    Store->AnyDirty = false;
+    Store->Meshes = PushArray(Arena, Capacity, model *);
+    Store->LocalBounds = PushArray(Arena, Capacity, aabb);
+    Store->LocalSpheres = PushArray(Arena, Capacity, bounding_sphere);
+    Store->Materials = PushArray(Arena, Capacity, entity_material);
+    Store->WorldBounds = PushArray(Arena, Capacity, aabb);
+    Store->WorldSpheres = PushArray(Arena, Capacity, bounding_sphere);
+    Store->SortOrder = PushArray(Arena, Capacity, uint32);
+    Store->SortIndices = PushArray(Arena, Capacity, uint32);
+    Store->SortDepths = PushArray(Arena, Capacity, uint8);
+    Store->SortBuffer = PushArray(Arena, Capacity, mat4);
+}
+
+inline uint32 GetEntityCount(entity_store *Store)
+{
+    return Store->Pool.Count;
+}
+
+inline uint32 *GetEntityFlags(entity_store *Store)
+{
+    return GetPoolItems(&Store->Pool, uint32);
+}
+
+// NOTE: POOL_NO_SLOT for a removed entity.
+inline uint32 GetEntityIndex(entity_store *Store, entity_handle Entity)
+{
+    uint32 Result = POOL_NO_SLOT;
+    if (IsPoolHandleValid(&Store->Pool, Entity))
+    {
+	Result = Store->Pool.Slots[Entity.Slot].DenseIndex;
+    }
+    return Result;
+}
+
+inline void MarkEntityDirty(entity_store *Store, uint32 Index)
+{
+    GetEntityFlags(Store)[Index] |= ENTITY_DIRTY;
+    Store->AnyDirty = true;
+}
+
+// NOTE: The new entity is a root at the identity transform, at index
+// GetEntityCount() - 1 until the store is next sorted or something is
+// removed. A null handle when full.
+entity_handle AddEntity(entity_store *Store, model *Mesh, aabb LocalBounds, bounding_sphere LocalSphere,
+			entity_material Material, uint32 Flags)
+{
+    entity_handle Result = AllocPoolItem(&Store->Pool);
+    uint32 Index = GetEntityIndex(Store, Result);
+    if (Index == POOL_NO_SLOT)
+    {
+	return Result;
+    }
+
+    entity_handle NoParent = {0};
+    GetEntityFlags(Store)[Index] = Flags;
+    Store->Positions[Index] = V3(0.0f, 0.0f, 0.0f);
+    Store->Scales[Index] = V3(1.0f, 1.0f, 1.0f);
+    Store->Axes[Index] = V3(0.0f, 1.0f, 0.0f);
+    Store->Angles[Index] = 0.0f;
+    Store->World[Index] = MakeScale(V3(1.0f, 1.0f, 1.0f));
+    Store->Parents[Index] = NoParent;
+    Store->ParentIndices[Index] = ENTITY_NO_PARENT;
+    Store->Meshes[Index] = Mesh;
+    Store->LocalBounds[Index] = LocalBounds;
+    Store->LocalSpheres[Index] = LocalSphere;
+    Store->Materials[Index] = Material;
+    Store->WorldBounds[Index] = LocalBounds;
+    Store->WorldSpheres[Index] = LocalSphere;
+    MarkEntityDirty(Store, Index);
+    Store->HierarchyChanged = true;
+    return Result;
+}
+
+#define MoveEntityComponent(Store, Array, To, From) (Store)->Array[To] = (Store)->Array[From]
+
+// NOTE: Children of a removed entity become roots, at their local
+// transform. Returns false for a stale handle.
+bool32 RemoveEntity(entity_store *Store, entity_handle Entity)
+{
+    uint32 Index = GetEntityIndex(Store, Entity);
+    if (Index == POOL_NO_SLOT)
+    {
+	return false;
+    }
+
+    // NOTE: The pool moves the flags the same way.
+    uint32 Last = GetEntityCount(Store) - 1;
+    if (Index != Last)
+    {
+	MoveEntityComponent(Store, Positions, Index, Last);
+	MoveEntityComponent(Store, Scales, Index, Last);
+	MoveEntityComponent(Store, Axes, Index, Last);
+	MoveEntityComponent(Store, Angles, Index, Last);
+	MoveEntityComponent(Store, World, Index, Last);
+	MoveEntityComponent(Store, Parents, Index, Last);
+	MoveEntityComponent(Store, ParentIndices, Index, Last);
+	MoveEntityComponent(Store, Meshes, Index, Last);
+	MoveEntityComponent(Store, LocalBounds, Index, Last);
+	MoveEntityComponent(Store, LocalSpheres, Index, Last);
+	MoveEntityComponent(Store, Materials, Index, Last);
+	MoveEntityComponent(Store, WorldBounds, Index, Last);
+	MoveEntityComponent(Store, WorldSpheres, Index, Last);
+    }
+    Store->HierarchyChanged = true;
+    return FreePoolItem(&Store->Pool, Entity);
+}
+
+// NOTE: A null Parent makes the entity a root. Fails for a stale handle, a
+// parent that is the entity itself or one of its descendants, or one that
+// would nest it deeper than ENTITY_MAX_DEPTH.
+bool32 SetEntityParent(entity_store *Store, entity_handle Entity, entity_handle Parent)
+{
+    uint32 Index = GetEntityIndex(Store, Entity);
+    if (Index == POOL_NO_SLOT)
+    {
+	return false;
+    }
+
+    entity_handle Ancestor = Parent;
+    for(uint32 Depth = 1; Ancestor.Generation != 0; ++Depth)
+    {
+	uint32 AncestorIndex = GetEntityIndex(Store, Ancestor);
+	if (AncestorIndex == POOL_NO_SLOT || AncestorIndex == Index || Depth >= ENTITY_MAX_DEPTH)
+	{
+	    return false;
+	}
+	Ancestor = Store->Parents[AncestorIndex];
+    }
+
+    Store->Parents[Index] = Parent;
+    MarkEntityDirty(Store, Index);
+    Store->HierarchyChanged = true;
+    return true;
+}
+
+// NOTE: Scale of the matrix along each of its axes.
+v3 GetAxisScales(mat4 M)
+{
+    v3 Result;
+    for(int Col = 0; Col < 3; ++Col)
+    {
+	v3 Axis = V3(M.E[Col][0], M.E[Col][1], M.E[Col][2]);
+	Result.E[Col] = sqrtf(Dot(Axis, Axis));
+    }
+    return Result;
+}
+
+// NOTE: Needs the parent's world transform to be current.
+void ComputeEntityWorld(entity_store *Store, uint32 Index)
+{
+    mat4 World = MakeObjectTransform(Store->Positions[Index], Store->Scales[Index],
+				     Store->Axes[Index], Store->Angles[Index]);
+    v3 Scale = Store->Scales[Index];
+    uint32 Parent = Store->ParentIndices[Index];
+    if (Parent != ENTITY_NO_PARENT)
+    {
+	World = Store->World[Parent] * World;
+	Scale = GetAxisScales(World);
+    }
+    Store->World[Index] = World;
+    Store->WorldBounds[Index] = TransformAABB(Store->LocalBounds[Index], World);
+    Store->WorldSpheres[Index] = TransformBoundingSphere(Store->LocalSpheres[Index], World, Scale);
+}
+
+#define ReorderEntityComponent(Store, Array, type, Order, Count)	\
+    {									\
+	type *Sorted = (type *)(Store)->SortBuffer;			\
+	for(uint32 Index = 0; Index < (Count); ++Index)			\
+	{								\
+	    Sorted[Index] = (Store)->Array[(Order)[Index]];		\
+	}								\
+	memcpy((Store)->Array, Sorted, (Count)*sizeof(type));		\
+    }
+
+// NOTE: Resolves parents and sorts the arrays by depth, keeping the order
+// within a level. Returns true when entities moved to new indices. Only
+// does anything after the hierarchy changed.
+bool32 SortEntityHierarchy(entity_store *Store)
+{
+    if (!Store->HierarchyChanged)
+    {
+	return false;
+    }
+    TIMED_FUNCTION();
+    Store->HierarchyChanged = false;
+
+    uint32 Count = GetEntityCount(Store);
+    for(uint32 Index = 0; Index < Count; ++Index)
+    {
+	uint32 Parent = ENTITY_NO_PARENT;
+	if (Store->Parents[Index].Generation != 0)
+	{
+	    Parent = GetEntityIndex(Store, Store->Parents[Index]);
+	    if (Parent == POOL_NO_SLOT)
+	    {
+		entity_handle NoParent = {0};
+		Store->Parents[Index] = NoParent;
+		MarkEntityDirty(Store, Index);
+	    }
+	}
+	Store->ParentIndices[Index] = Parent;
+    }
+
+    uint32 LevelStarts[ENTITY_MAX_DEPTH] = {0};
+    uint32 LevelCount = Count ? 1 : 0;
+    for(uint32 Index = 0; Index < Count; ++Index)
+    {
+	uint32 Depth = 0;
+	for(uint32 Parent = Store->ParentIndices[Index]; Parent != ENTITY_NO_PARENT;
+	    Parent = Store->ParentIndices[Parent])
+	{
+	    ++Depth;
+	}
+	Assert(Depth < ENTITY_MAX_DEPTH);
+	Store->SortDepths[Index] = (uint8)Depth;
+	++LevelStarts[Depth];
+	LevelCount = Max(LevelCount, Depth + 1);
+    }
+
+    // NOTE: Counting sort. LevelStarts goes from the size of each level to
+    // where it starts, then to where it ends as it is filled.
+    uint32 Start = 0;
+    for(uint32 Level = 0; Level < LevelCount; ++Level)
+    {
+	uint32 LevelSize = LevelStarts[Level];
+	LevelStarts[Level] = Start;
+	Start += LevelSize;
+    }
+    bool32 Reordered = false;
+    for(uint32 Index = 0; Index < Count; ++Index)
+    {
+	uint32 Sorted = LevelStarts[Store->SortDepths[Index]]++;
+	Store->SortOrder[Sorted] = Index;
+	Store->SortIndices[Index] = Sorted;
+	Reordered |= (Sorted != Index);
+    }
+    Store->LevelCount = LevelCount;
+    for(uint32 Level = 0; Level < LevelCount; ++Level)
+    {
+	Store->LevelEnds[Level] = LevelStarts[Level];
+    }
+
+    if (Reordered)
+    {
+	uint32 *Order = Store->SortOrder;
+	ReorderPool(&Store->Pool, Order, Store->SortBuffer);
+	ReorderEntityComponent(Store, Positions, v3, Order, Count);
+	ReorderEntityComponent(Store, Scales, v3, Order, Count);
+	ReorderEntityComponent(Store, Axes, v3, Order, Count);
+	ReorderEntityComponent(Store, Angles, float, Order, Count);
+	ReorderEntityComponent(Store, World, mat4, Order, Count);
+	ReorderEntityComponent(Store, Parents, entity_handle, Order, Count);
+	ReorderEntityComponent(Store, ParentIndices, uint32, Order, Count);
+	ReorderEntityComponent(Store, Meshes, model *, Order, Count);
+	ReorderEntityComponent(Store, LocalBounds, aabb, Order, Count);
+	ReorderEntityComponent(Store, LocalSpheres, bounding_sphere, Order, Count);
+	ReorderEntityComponent(Store, Materials, entity_material, Order, Count);
+	ReorderEntityComponent(Store, WorldBounds, aabb, Order, Count);
+	ReorderEntityComponent(Store, WorldSpheres, bounding_sphere, Order, Count);
+	for(uint32 Index = 0; Index < Count; ++Index)
+	{
+	    uint32 Parent = Store->ParentIndices[Index];
+	    if (Parent != ENTITY_NO_PARENT)
+	    {
+		Store->ParentIndices[Index] = Store->SortIndices[Parent];
+	    }
+	}
+    }
+    return Reordered;
+}
+
+// NOTE: Transform system over [Start, End), which must not hold a parent of
+// another entity in the range. Recomputes the entities that are dirty or
+// whose parent moved and flags them as moved.
+void UpdateEntityTransforms(entity_store *Store, uint32 Start, uint32 End)
+{
+    uint32 *Flags = GetEntityFlags(Store);
+    for(uint32 Index = Start; Index < End; ++Index)
+    {
+	uint32 Parent = Store->ParentIndices[Index];
+	bool32 Moved = ((Flags[Index] & ENTITY_DIRTY) ||
+			(Parent != ENTITY_NO_PARENT && (Flags[Parent] & ENTITY_MOVED)));
+	Flags[Index] &= ~(ENTITY_DIRTY | ENTITY_MOVED);
+	if (Moved)
+	{
+	    ComputeEntityWorld(Store, Index);
+	    Flags[Index] |= ENTITY_MOVED;
+	}
+    }
+}
+
+struct entity_transform_job
+{
+    entity_store *Store;
+    uint32 First;
+};
+
+void UpdateEntityTransformsJob(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    entity_transform_job *Job = (entity_transform_job *)Data;
+    UpdateEntityTransforms(Job->Store, Job->First + Start, Job->First + End);
+}
+
+// NOTE: One level at a time, each split across the workers. Returns false
+// without touching anything when no entity is dirty; otherwise
+// ENTITY_MOVED is set on exactly the entities whose world transform
+// changed. Sort the store first.
+bool32 UpdateAllEntityTransforms(entity_store *Store, job_system *Jobs)
+{
+    TIMED_FUNCTION();
+    Assert(!Store->HierarchyChanged);
+    if (!Store->AnyDirty)
+    {
+	return false;
+    }
+    Store->AnyDirty = false;
+
+    entity_transform_job Job;
+    Job.Store = Store;
+    Job.First = 0;
+    for(uint32 Level = 0; Level < Store->LevelCount; ++Level)
+    {
+	ParallelFor(Jobs, Store->LevelEnds[Level] - Job.First, ENTITY_TRANSFORM_BATCH,
+		    UpdateEntityTransformsJob, &Job);
+	Job.First = Store->LevelEnds[Level];
+    }
+    return true;
+}
+
+#define CopyEntityComponent(Dest, Source, Array, type, Count, Arena)		\
+    (Dest)->Array = PushArray(Arena, Count, type);				\
+    memcpy((Dest)->Array, (Source)->Array, (Count)*sizeof(type))
+
+// NOTE: Copies the live entities' components, enough to render from. The
+// copy has no free list and can't add, remove or sort entities.
+void CopyEntityStore(entity_store *Dest, entity_store *Source, memory_arena *Arena)
+{
+    uint32 Count = GetEntityCount(Source);
+    *Dest = *Source;
+    Dest->Pool.Capacity = Count;
+    Dest->Pool.FreeHead = POOL_NO_SLOT;
+    Dest->Pool.Items = (uint8 *)PushArray(Arena, Count, uint32);
+    memcpy(Dest->Pool.Items, Source->Pool.Items, Count*sizeof(uint32));
+    Dest->Pool.DenseSlots = 0;
+    Dest->Pool.Slots = 0;
+    Dest->SortOrder = 0;
+    Dest->SortIndices = 0;
+    Dest->SortDepths = 0;
+    Dest->SortBuffer = 0;
+
+    CopyEntityComponent(Dest, Source, Positions, v3, Count, Arena);
+    CopyEntityComponent(Dest, Source, Scales, v3, Count, Arena);
+    CopyEntityComponent(Dest, Source, Axes, v3, Count, Arena);
+    CopyEntityComponent(Dest, Source, Angles, float, Count, Arena);
+    CopyEntityComponent(Dest, Source, World, mat4, Count, Arena);
+    CopyEntityComponent(Dest, Source, Parents, entity_handle, Count, Arena);
+    CopyEntityComponent(Dest, Source, ParentIndices, uint32, Count, Arena);
+    CopyEntityComponent(Dest, Source, Meshes, model *, Count, Arena);
+    CopyEntityComponent(Dest, Source, LocalBounds, aabb, Count, Arena);
+    CopyEntityComponent(Dest, Source, LocalSpheres, bounding_sphere, Count, Arena);
+    CopyEntityComponent(Dest, Source, Materials, entity_material, Count, Arena);
+    CopyEntityComponent(Dest, Source, WorldBounds, aabb, Count, Arena);
+    CopyEntityComponent(Dest, Source, WorldSpheres, bounding_sphere, Count, Arena);
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef FRAMETIMING_CPP__
+#define FRAMETIMING_CPP__
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <emmintrin.h>
+
+// NOTE: POSIX frame timing shared by the Linux entry points. Everything is in
+// nanoseconds on CLOCK_MONOTONIC, which never jumps with wall clock changes.
+
+#define NANOSECONDS_PER_SECOND 1000000000ull
+// NOTE: clock_nanosleep overshoots by tens of microseconds to a millisecond
+// depending on the kernel and load, so the last stretch before the deadline is
+// spun instead of slept.
+#define FRAME_PACER_SPIN_NANOSECONDS 500000ull
+#define FRAME_STATS_WINDOW 256
+
+uint64 GetNanoseconds()
+{
+    timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64)Now.tv_sec*NANOSECONDS_PER_SECOND + (uint64)Now.tv_nsec;
+}
+
+struct frame_pacer
+{
+    // NOTE: 0 means uncapped; WaitForNextFrame returns immediately.
+    uint64 TargetNanoseconds;
+    uint64 SpinNanoseconds;
+    uint64 NextFrameTime;
+    uint64 LastFrameTime;
+};
+
+void InitFramePacer(frame_pacer *Pacer, float TargetFPS)
+{
+    Pacer->TargetNanoseconds = (TargetFPS > 0.0f) ? (uint64)(NANOSECONDS_PER_SECOND / TargetFPS) : 0;
+    Pacer->SpinNanoseconds = FRAME_PACER_SPIN_NANOSECONDS;
+    Pacer->LastFrameTime = GetNanoseconds();
+    Pacer->NextFrameTime = Pacer->LastFrameTime + Pacer->TargetNanoseconds;
+}
+
+// NOTE: Blocks until the next frame deadline and returns the time since the
+// previous call. Deadlines are absolute and advance by a fixed step, so a
+// slightly late wakeup is not carried into the following frame; if a frame
+// runs more than a whole period over, the schedule restarts from now rather
+// than bursting to catch up.
+uint64 WaitForNextFrame(frame_pacer *Pacer)
+{
+    uint64 Now = GetNanoseconds();
+    if (Pacer->TargetNanoseconds)
+    {
+	if (Now + Pacer->SpinNanoseconds < Pacer->NextFrameTime)
+	{
+	    uint64 WakeTime = Pacer->NextFrameTime - Pacer->SpinNanoseconds;
+	    timespec Wake;
+	    Wake.tv_sec = WakeTime / NANOSECONDS_PER_SECOND;
+	    Wake.tv_nsec = WakeTime % NANOSECONDS_PER_SECOND;
+	    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Wake, 0) != 0)
+	    {
+		// NOTE: Interrupted by a signal, the absolute deadline is unchanged.
+	    }
+	    Now = GetNanoseconds();
+	}
+	while (Now < Pacer->NextFrameTime)
+	{
+	    _mm_pause();
+	    Now = GetNanoseconds();
+	}
+
+	Pacer->NextFrameTime += Pacer->TargetNanoseconds;
+	if (Pacer->NextFrameTime + Pacer->TargetNanoseconds < Now)
+	{
+	    Pacer->NextFrameTime = Now + Pacer->TargetNanoseconds;
+	}
+    }
+
+    uint64 Elapsed = Now - Pacer->LastFrameTime;
+    Pacer->LastFrameTime = Now;
+    return Elapsed;
+}
+
+int CompareFloats(const void *A, const void *B)
+{
+    float FA = *(const float *)A;
+    float FB = *(const float *)B;
+    return (FA > FB) - (FA < FB);
+}
+
+// NOTE: Sorts FrameMilliseconds in place. Jitter is the standard deviation of
+// the frame times; when TargetMilliseconds is given, frames more than a
+// millisecond past it are counted as late.
+void PrintFrameStats(float *FrameMilliseconds, int FrameCount, float TotalMilliseconds,
+		     float TargetMilliseconds = 0.0f)
+{
+    float Sum = 0.0f;
+    int LateCount = 0;
+    for(int FrameIndex = 0; FrameIndex < FrameCount; ++FrameIndex)
+    {
+	Sum += FrameMilliseconds[FrameIndex];
+	if (TargetMilliseconds > 0.0f && FrameMilliseconds[FrameIndex] > TargetMilliseconds + 1.0f)
+	{
+	    ++LateCount;
+	}
+    }
+    float Average = Sum / FrameCount;
+
+    float Variance = 0.0f;
+    for(int FrameIndex = 0; FrameIndex < FrameCount; ++FrameIndex)
+    {
+	float Delta = FrameMilliseconds[FrameIndex] - Average;
+	Variance += Delta*Delta;
+    }
+    Variance /= FrameCount;
+
+    qsort(FrameMilliseconds, FrameCount, sizeof(float), CompareFloats);
+
+    printf("Frames: %d in %.2f ms (%.1f fps)\n", FrameCount, TotalMilliseconds,
+	   1000.0f*FrameCount / TotalMilliseconds);
+    printf("Frame ms: avg %.3f min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f jitter %.3f",
+	   Average,
+	   FrameMilliseconds[0],
+	   FrameMilliseconds[FrameCount/2],
+	   FrameMilliseconds[(FrameCount*95)/100],
+	   FrameMilliseconds[(FrameCount*99)/100],
+	   FrameMilliseconds[FrameCount - 1],
+	   sqrtf(Variance));
+    if (TargetMilliseconds > 0.0f)
+    {
+	printf(" late %d/%d", LateCount, FrameCount);
+    }
+    printf("\n");
+}
+
+// NOTE: Rolling window for the interactive loop, printed each time it fills.
+struct frame_stats
+{
+    int Count;
+    uint64 WindowStart;
+    float FrameMilliseconds[FRAME_STATS_WINDOW];
+};
+
+void RecordFrameTime(frame_stats *Stats, uint64 FrameNanoseconds, float TargetMilliseconds)
+{
+    if (Stats->Count == 0)
+    {
+	Stats->WindowStart = GetNanoseconds() - FrameNanoseconds;
+    }
+    Stats->FrameMilliseconds[Stats->Count++] = FrameNanoseconds / 1000000.0f;
+    if (Stats->Count == FRAME_STATS_WINDOW)
+    {
+	float WindowMilliseconds = (GetNanoseconds() - Stats->WindowStart) / 1000000.0f;
+	PrintFrameStats(Stats->FrameMilliseconds, Stats->Count, WindowMilliseconds, TargetMilliseconds);
+	Stats->Count = 0;
+    }
+}
+
+#endif
@@ -1,8 +1,21 @@
 #include "glHelper.cpp"
 #include "platform.h"
+#include "profiler.cpp"
+#include "gpuProfiler.cpp"
 #include "math.cpp"
 #include "matrixMath.cpp"
 #include "camera.cpp"
+#include "culling.cpp"
+#include "jobs.cpp"
+#include "pool.cpp"
+#include "renderCommands.cpp"
+#include "bvh.cpp"
+#include "entities.cpp"
+#include "occlusion.cpp"
+#include "lightClusters.cpp"
+#include "shadows.cpp"
+#include "dynamicResolution.cpp"
+#include "resolve.cpp"
 #include "loadFBX.cpp"
 #include "game.h"
 
@@ -20,12 +33,13 @@ struct light
     float Power;
 };
 
+// NOTE: The pixels only live in the GL texture; the file contents are
+// loaded into temporary memory and dropped after the upload.
 struct texture
 {
     uint32 Height;
     uint32 Width;
     GLuint Handle;
-    uint8* Data;
 };
 
 struct color_material
@@ -75,13 +89,13 @@ light_binding CreateLightBinding(GLuint ShaderProgram)
     return LightBinding;
 }
 
-void SetPointLightUniforms(light_binding LightBinding, light Light)
+void PushPointLightUniforms(memory_arena *Buffer, light_binding LightBinding, light Light)
 {
-    glUniformVec4f(LightBinding.Position, Light.Position);
-    glUniformVec3f(LightBinding.Ambient, Light.Ambient);
-    glUniformVec3f(LightBinding.Diffuse, Light.Diffuse);
-    glUniformVec3f(LightBinding.Specular, Light.Specular);
-    glUniform1f(LightBinding.Power, 100.f);
+    PushUniform(Buffer, LightBinding.Position, Light.Position);
+    PushUniform(Buffer, LightBinding.Ambient, Light.Ambient);
+    PushUniform(Buffer, LightBinding.Diffuse, Light.Diffuse);
+    PushUniform(Buffer, LightBinding.Specular, Light.Specular);
+    PushUniform(Buffer, LightBinding.Power, Light.Power);
 }
 
 struct color_shader
@@ -89,7 +103,8 @@ struct color_shader
     GLuint Program;
     GLuint M;
     GLuint V;
-    GLuint MVP;
+    GLuint VP;
+    GLuint EyeCount;
 
     GLuint CameraPosition;
 
@@ -111,12 +126,30 @@ struct light_texture_shader
     GLuint Program;
     GLuint M;
     GLuint V;
-    GLuint MVP;
+    GLuint VP;
+    GLuint EyeCount;
     
     GLuint CameraPosition;
 
     light_binding Light;
     material_binding Material;
+    cluster_binding Clusters;
+    shadow_binding Shadows;
+};
+
+struct shadow_shader
+{
+    GLuint Program;
+    GLuint M;
+    GLuint VP;
+};
+
+struct depth_shader
+{
+    GLuint Program;
+    GLuint M;
+    GLuint VP;
+    GLuint EyeCount;
 };
 
 struct model
@@ -127,10 +160,13 @@ struct model
     GLfloat *UVs;
     GLfloat *Colors;
     
-    texture_material *Material;
-    
+    int VertexCount;
     int IndexCount;
+
+    aabb Bounds;
+    bounding_sphere BoundingSphere;
     
+    GLuint VertexArray;
     GLuint VertexBuffer;
     GLuint NormalBuffer;
     GLuint IndexBuffer;
@@ -138,42 +174,70 @@ struct model
     GLuint UVBuffer;
 };
 
-struct color_model
+// NOTE: Attribute locations are shared by every shader: 0 position, 1 UV, 2 normal.
+// The VAO captures the pointers and the index buffer once, so a draw only binds it.
+void CreateModelVertexArray(model *Model)
 {
-    model Model;
-    color_material *Material;
-};
+    glGenVertexArrays(1, &Model->VertexArray);
+    glBindVertexArray(Model->VertexArray);
 
-struct texture_model
-{
-    model Model;
-    texture_material *Material;
-};
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, Model->VertexBuffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-struct game_object
-{
-    model *Model;
-    v3 Scale;
-    v3 Position;
-    v3 Axis;
-    float Angle;
-};
+    if (Model->UVBuffer)
+    {
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, Model->UVBuffer);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
 
-struct color_game_object
+    if (Model->NormalBuffer)
+    {
+	glEnableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, Model->NormalBuffer);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Model->IndexBuffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#define MAX_SCENE_ITEMS 131072
+// NOTE: Room for a copy of every entity and the BVH at MAX_SCENE_ITEMS.
+#define SCENE_SNAPSHOT_ARENA_SIZE MEGABYTES(64)
+
+// NOTE: Everything Update writes and Render reads. SceneBVH item i is
+// entity i, the two are added and removed together. Light is the key
+// light every material shades with; the point lights only reach the
+// textured materials, through the light clusters.
+struct scene_state
 {
-    color_model *Model;
-    v3 Scale;
-    v3 Position;
-    v3 Axis;
-    float Angle;
+    camera Camera;
+    light Light;
+    point_light *PointLights;
+    int32 PointLightCount;
+    entity_store Entities;
+    // NOTE: Changes whenever a static shadow caster is added, removed or
+    // moved, which invalidates the cached shadow maps.
+    uint32 StaticVersion;
+
+    bvh SceneBVH;
 };
 
 struct game_data
 {
     bool Initialized;
+    memory_arena Arena;
+    // NOTE: Frame lifetime memory for the GL thread, reset at the start of
+    // every UpdateAndRender. Workers use their scratch arenas instead.
+    memory_arena FrameArena;
 
     light_texture_shader LightTextureShader;
     color_shader ColorShader;
+    shadow_shader ShadowShader;
+    depth_shader DepthShader;
     camera Camera;
 
     texture BoxDiffuseMap;
@@ -182,20 +246,132 @@ struct game_data
     texture_material BoxMaterial;
     color_material ColorMaterial;
     model BoxModel;
-    color_model ColorBoxModel;
     
-    //Scene
-    light Light;
-    game_object Box;
-    game_object Box2;
-    game_object LightBox;
-    color_game_object ColorBox;
-
-    float BoxRotation;
+    scene_state Scene;
+    // NOTE: Pipelined mode renders frame N from Snapshots[SnapshotIndex]
+    // while Update writes frame N+1 into Scene and then the other snapshot.
+    scene_state Snapshots[2];
+    memory_arena SnapshotArenas[2];
+    int32 SnapshotIndex;
+    bool32 SnapshotValid;
+
+    entity_handle SpinningBox;
+    // NOTE: Rides on whatever was last picked, as its child.
+    entity_handle PickMarker;
+
+    occlusion_buffer Occlusion;
+    light_clusters LightClusters;
+    shadow_maps Shadows;
+    gpu_profiler GPUProfiler;
+    dynamic_resolution DynamicResolution;
+    eye_resolve EyeResolve;
+    job_system Jobs;
+    render_commands RenderCommands;
+    cull_stats CullStats;
+    cull_stats ReportedCullStats;
+
+    // NOTE: Copied from the platform every frame.
+    bool32 DepthPrepass;
+    draw_order DrawOrder;
 };
 
-texture LoadDDS(const char * filePath)
+// NOTE: Rings of lights around the origin, alternating above and below the
+// boxes, with colours stepping around the hue wheel. Deterministic, so runs
+// with the same light count render the same.
+void PlacePointLights(point_light *Lights, int32 LightCount)
+{
+    int32 LightsPerRing = 16;
+    for(int32 LightIndex = 0; LightIndex < LightCount; ++LightIndex)
+    {
+	int32 Ring = LightIndex / LightsPerRing;
+	float Angle = (2.0f*PI*(LightIndex % LightsPerRing) + 0.37f*Ring) / LightsPerRing;
+	float Distance = 2.0f + 1.5f*Ring;
+	float Height = (LightIndex & 1) ? 1.0f : -1.0f;
+	
+	float Hue = 0.618034f*LightIndex;
+	Hue -= (int32)Hue;
+	point_light *Light = Lights + LightIndex;
+	Light->Position = V3(Distance*(float)cos(Angle), Height, Distance*(float)sin(Angle));
+	Light->Radius = 2.5f;
+	Light->Color = V3(0.5f + 0.5f*(float)cos(2.0f*PI*Hue),
+			  0.5f + 0.5f*(float)cos(2.0f*PI*(Hue - 1.0f/3.0f)),
+			  0.5f + 0.5f*(float)cos(2.0f*PI*(Hue - 2.0f/3.0f)));
+	Light->Power = 3.0f;
+    }
+}
+
+// NOTE: Turns every light about the Y axis.
+void OrbitPointLights(point_light *Lights, int32 LightCount, float Angle)
+{
+    float Cos = (float)cos(Angle);
+    float Sin = (float)sin(Angle);
+    for(int32 LightIndex = 0; LightIndex < LightCount; ++LightIndex)
+    {
+	v3 Position = Lights[LightIndex].Position;
+	Lights[LightIndex].Position = V3(Cos*Position.x - Sin*Position.z, Position.y,
+					 Sin*Position.x + Cos*Position.z);
+    }
+}
+
+// NOTE: Adds a root entity and its BVH item, placed as given. The BVH is
+// rebuilt by the next Update. Parent it afterwards with SetEntityParent.
+entity_handle SpawnEntity(scene_state *Scene, model *Mesh, entity_material Material, uint32 Flags,
+			  v3 Position, v3 Scale, v3 Axis, float Angle)
+{
+    entity_store *Entities = &Scene->Entities;
+    entity_handle Entity = AddEntity(Entities, Mesh, Mesh->Bounds, Mesh->BoundingSphere, Material, Flags);
+    uint32 Index = GetEntityIndex(Entities, Entity);
+    if (Index != POOL_NO_SLOT)
+    {
+	Entities->Positions[Index] = Position;
+	Entities->Scales[Index] = Scale;
+	Entities->Axes[Index] = Axis;
+	Entities->Angles[Index] = Angle;
+	ComputeEntityWorld(Entities, Index);
+	int32 Item = AddBVHItem(&Scene->SceneBVH, Entities->WorldBounds[Index]);
+	Assert(Item == (int32)Index);
+	(void)Item;
+	if (!(Flags & ENTITY_DYNAMIC))
+	{
+	    ++Scene->StaticVersion;
+	}
+    }
+    return Entity;
+}
+
+void DespawnEntity(scene_state *Scene, entity_handle Entity)
+{
+    uint32 Index = GetEntityIndex(&Scene->Entities, Entity);
+    if (Index != POOL_NO_SLOT)
+    {
+	if (!(GetEntityFlags(&Scene->Entities)[Index] & ENTITY_DYNAMIC))
+	{
+	    ++Scene->StaticVersion;
+	}
+	RemoveBVHItem(&Scene->SceneBVH, Index);
+	RemoveEntity(&Scene->Entities, Entity);
+    }
+}
+
+entity_material MakeTextureMaterial(texture_material *Texture)
+{
+    entity_material Result;
+    Result.Type = MATERIAL_LIGHT_TEXTURE;
+    Result.Texture = Texture;
+    return Result;
+}
+
+entity_material MakeColorMaterial(color_material *Color)
+{
+    entity_material Result;
+    Result.Type = MATERIAL_COLOR;
+    Result.Color = Color;
+    return Result;
+}
+
+texture LoadDDS(memory_arena *TempArena, const char * filePath)
 {
+    TIMED_FUNCTION();
     texture NullTexture = {0};
     int8 header[124];
 
@@ -229,7 +405,8 @@ texture LoadDDS(const char * filePath)
     fourCC[4] = '\0';
     
     uint32 bufferSize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    uint8* buffer = (uint8*)malloc(bufferSize * sizeof(uint8));
+    temporary_memory TempMemory = BeginTemporaryMemory(TempArena);
+    uint8* buffer = PushArray(TempArena, bufferSize, uint8);
     fread(buffer, 1, bufferSize, fp);
     fclose(fp);
 
@@ -250,7 +427,7 @@ texture LoadDDS(const char * filePath)
     }
     else
     {
-	free(buffer);
+	EndTemporaryMemory(TempMemory);
 	DebugLog("File not DXT compressed: %s", filePath);
 	return NullTexture;
     }
@@ -271,17 +448,17 @@ texture LoadDDS(const char * filePath)
 	w /= 2;
 	h /= 2;
     }
+    EndTemporaryMemory(TempMemory);
 
     texture Result = {
 	width,
 	height,
-	textureID,
-	buffer
+	textureID
     };
     return Result;
 }
 
-texture LoadBMP(char* filePath)
+texture LoadBMP(memory_arena *TempArena, char* filePath)
 {
     texture NullTexture = { 0 };
     uint8 header[54];
@@ -322,7 +499,8 @@ texture LoadBMP(char* filePath)
 	dataPos=54;
     }
 
-    data = (uint8*)malloc(imageSize*sizeof(uint8));
+    temporary_memory TempMemory = BeginTemporaryMemory(TempArena);
+    data = PushArray(TempArena, imageSize, uint8);
     fread(data, 1, imageSize, file);
     fclose(file);
 
@@ -335,19 +513,20 @@ texture LoadBMP(char* filePath)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glGenerateMipmap(GL_TEXTURE_2D);
 
-    //free(data);
+    EndTemporaryMemory(TempMemory);
     texture Result = {
 	width,
 	height,
-	textureID,
-	data
+	textureID
     };
     glDisable(GL_TEXTURE_2D);
     return Result;
 }
 
-GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
+GLuint LoadShaders(memory_arena *TempArena, char* vertexShaderFilePath, char* fragmentShaderFilePath)
 {
+    TIMED_FUNCTION();
+    temporary_memory TempMemory = BeginTemporaryMemory(TempArena);
     DebugLog("Loading %s & %s\n", vertexShaderFilePath, fragmentShaderFilePath);
     char* vertexShaderCode;
     GLint result = GL_FALSE;
@@ -362,7 +541,7 @@ GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
 	int32 vertexShaderFileLength = ftell(vertexShaderFile);
 	rewind(vertexShaderFile);
  
-	vertexShaderCode = (char*)malloc(vertexShaderFileLength+1);
+	vertexShaderCode = PushArray(TempArena, vertexShaderFileLength+1, char);
 	readResult = fread(vertexShaderCode, 1, vertexShaderFileLength, vertexShaderFile);
 	fclose(vertexShaderFile);
 	vertexShaderCode[vertexShaderFileLength] = '\0';
@@ -375,12 +554,10 @@ GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
 	if (infoLogLength > 0)
 	{
 	    DebugLog("Vertex Shader: %s:%ld:\n%s\n", vertexShaderFilePath, vertexShaderFileLength, vertexShaderCode);
-	    char* error = (char*)malloc(infoLogLength);
+	    char* error = PushArray(TempArena, infoLogLength, char);
 	    glGetShaderInfoLog(vertexShaderID, infoLogLength, 0, error);
 	    DebugLog("%s error:\n%s\n", vertexShaderFilePath, error);
-	    free(error);
 	}
-	free(vertexShaderCode);
     }
 
     {
@@ -389,7 +566,7 @@ GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
 	long fragmentShaderFileLength = ftell(fragmentShaderFile);
 	rewind(fragmentShaderFile);
 
-	char *fragmentShaderCode = (char*)malloc(fragmentShaderFileLength+1);
+	char *fragmentShaderCode = PushArray(TempArena, fragmentShaderFileLength+1, char);
 	readResult = fread(fragmentShaderCode, 1, fragmentShaderFileLength, fragmentShaderFile);
 	fragmentShaderCode[fragmentShaderFileLength] = '\0';
     
@@ -403,12 +580,10 @@ GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
 	if (infoLogLength > 0)
 	{
 	    DebugLog("Fragment Shader: %s:%ld:\n%s\n", fragmentShaderFilePath, fragmentShaderFileLength, fragmentShaderCode);
-	    char* error = (char*)malloc(infoLogLength+1);
+	    char* error = PushArray(TempArena, infoLogLength+1, char);
 	    glGetShaderInfoLog(fragmentShaderID, infoLogLength, 0, error);
 	    DebugLog("%s error:\n%s\n", fragmentShaderFilePath, error);
-	    free(error);
 	}
-	free(fragmentShaderCode);
     }
     
     GLuint programID = glCreateProgram();
@@ -420,12 +595,12 @@ GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
     glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
     if (infoLogLength > 0)
     {
-	char* error = (char*)malloc(infoLogLength+1);
+	char* error = PushArray(TempArena, infoLogLength+1, char);
 	glGetProgramInfoLog(programID, infoLogLength, 0, error);
 	DebugLog("%s\n%s\n%s\n", vertexShaderFilePath, fragmentShaderFilePath, error);
 	//printf("%s\n", error);
-	free(error);
     }
+    EndTemporaryMemory(TempMemory);
     
     glDetachShader(programID, vertexShaderID);
     glDetachShader(programID, fragmentShaderID);
@@ -437,6 +612,22 @@ GLuint LoadShaders(char* vertexShaderFilePath, char* fragmentShaderFilePath)
 
 void Init(platform_data* Platform, game_data *Game)
 {
+    if (Platform->CommitMemory && !Platform->CommitMemory(Game, sizeof(game_data)))
+    {
+	Assert(!"Can't commit game_data");
+    }
+    InitArena(&Game->Arena,
+	      Platform->MainMemorySize - sizeof(game_data),
+	      (uint8 *)Platform->MainMemory + sizeof(game_data));
+    Game->Arena.CommitMemory = Platform->CommitMemory;
+    InitArena(&Game->FrameArena, Platform->TempMemorySize, (uint8 *)Platform->TempMemory);
+    Game->FrameArena.CommitMemory = Platform->CommitMemory;
+    InitProfiler(&Game->Arena);
+    InitGPUProfiler(&Game->GPUProfiler);
+    InitJobSystem(&Game->Jobs, &Game->Arena, Platform->JobThreadCount);
+    BeginProfilerFrame(Platform);
+    TIMED_FUNCTION();
+
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glFrontFace(GL_CCW);
     glEnable(GL_CULL_FACE);
@@ -444,9 +635,6 @@ void Init(platform_data* Platform, game_data *Game)
 //    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
-    GLuint VertexArrayID;
-    glGenVertexArrays(1, &VertexArrayID);
-    glBindVertexArray(VertexArrayID);
     model *BoxModel = &Game->BoxModel;
     GLfloat vertexBufferData[] = {
 	//Front
@@ -481,8 +669,11 @@ void Init(platform_data* Platform, game_data *Game)
 	1.0f, -1.0f, -1.0f
     };
     size_t vertexBufferSize = sizeof(vertexBufferData);
-    BoxModel->Vertices = (GLfloat*)malloc(vertexBufferSize);
+    BoxModel->Vertices = (GLfloat*)PushSize_(&Game->Arena, vertexBufferSize);
     memcpy(BoxModel->Vertices, vertexBufferData, vertexBufferSize);
+    BoxModel->VertexCount = vertexBufferSize/(3*sizeof(GLfloat));
+    BoxModel->Bounds = ComputeAABB(BoxModel->Vertices, BoxModel->VertexCount);
+    BoxModel->BoundingSphere = ComputeBoundingSphere(BoxModel->Vertices, BoxModel->VertexCount, BoxModel->Bounds);
     glGenBuffers(1, &BoxModel->VertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER,
 		 BoxModel->VertexBuffer);
@@ -508,7 +699,7 @@ void Init(platform_data* Platform, game_data *Game)
     };
 
     size_t normalBufferSize = sizeof(normalBufferData);
-    BoxModel->Normals = (GLfloat*)malloc(normalBufferSize);
+    BoxModel->Normals = (GLfloat*)PushSize_(&Game->Arena, normalBufferSize);
     memcpy(BoxModel->Normals, normalBufferData, normalBufferSize);
 	
     glGenBuffers(1, &BoxModel->NormalBuffer);
@@ -536,7 +727,7 @@ void Init(platform_data* Platform, game_data *Game)
     BoxModel->IndexCount = sizeof(indexBufferData)/sizeof(GLushort);
 
     size_t indexBufferSize = sizeof(indexBufferData);
-    BoxModel->Indices = (GLushort*)malloc(indexBufferSize);
+    BoxModel->Indices = (GLushort*)PushSize_(&Game->Arena, indexBufferSize);
     memcpy(BoxModel->Indices, indexBufferData, indexBufferSize);
 
     glGenBuffers(1, &BoxModel->IndexBuffer);
@@ -596,54 +787,78 @@ void Init(platform_data* Platform, game_data *Game)
 
 #endif
     size_t uvBufferSize = sizeof(uvBufferData);
-    BoxModel->UVs = (GLfloat*)malloc(uvBufferSize);
+    BoxModel->UVs = (GLfloat*)PushSize_(&Game->Arena, uvBufferSize);
     memcpy(BoxModel->UVs, uvBufferData, uvBufferSize);
 	
     glGenBuffers(1, &BoxModel->UVBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, BoxModel->UVBuffer);
     glBufferData(GL_ARRAY_BUFFER, uvBufferSize, BoxModel->UVs, GL_STATIC_DRAW);
 
+    CreateModelVertexArray(BoxModel);
+
 #if DIE
-    Game->BoxDiffuseMap = LoadDDS("../res/Textures/uvtemplate.dds");
+    Game->BoxDiffuseMap = LoadDDS(&Game->FrameArena, "../res/Textures/uvtemplate.dds");
 #elif defined(CONTAINER)
-    Game->BoxDiffuseMap = LoadDDS("../res/Textures/container.dds");
+    Game->BoxDiffuseMap = LoadDDS(&Game->FrameArena, "../res/Textures/container.dds");
 #endif
 
-    Game->BoxSpecularMap = LoadDDS("../res/Textures/containerspecular.dds");
-    Game->BoxEmissiveMap = LoadDDS("../res/Textures/containeremissive.dds");
+    Game->BoxSpecularMap = LoadDDS(&Game->FrameArena, "../res/Textures/containerspecular.dds");
+    Game->BoxEmissiveMap = LoadDDS(&Game->FrameArena, "../res/Textures/containeremissive.dds");
     
     texture_material *BoxMaterial = &Game->BoxMaterial;
-    BoxModel->Material = BoxMaterial;
     BoxMaterial->DiffuseMap = Game->BoxDiffuseMap.Handle;
     BoxMaterial->SpecularMap = Game->BoxSpecularMap.Handle;
 //    BoxMaterial->EmissiveMap = Game->BoxEmissiveMap.Handle;
     BoxMaterial->Shine = 60.0f;
     
-    color_model *ColorBoxModel = &Game->ColorBoxModel;
-    ColorBoxModel->Model = *BoxModel;
     color_material *ColorMaterial = &Game->ColorMaterial;
-    ColorBoxModel->Material = ColorMaterial;
     ColorMaterial->Diffuse = V3(0.0f, 0.0f, 0.0f);
     ColorMaterial->Specular = V3(0.0f, 0.0f, 0.0f);
     ColorMaterial->Emissive = V3(1.0f, 1.0f, 1.0f);
     ColorMaterial->Shine = 0.0f;
     
     light_texture_shader Shader;
-    Shader.Program = LoadShaders("../res/Shaders/lightTextureShader.vert", "../res/Shaders/lightTextureShader.frag");
+    Shader.Program = LoadShaders(&Game->FrameArena, "../res/Shaders/lightTextureShader.vert", "../res/Shaders/lightTextureShader.frag");
     Shader.M = glGetUniformLocation(Shader.Program, "M");
     Shader.V = glGetUniformLocation(Shader.Program, "V");
-    Shader.MVP = glGetUniformLocation(Shader.Program, "MVP");
+    Shader.VP = glGetUniformLocation(Shader.Program, "VP");
+    Shader.EyeCount = glGetUniformLocation(Shader.Program, "EyeCount");
     
     Shader.CameraPosition = glGetUniformLocation(Shader.Program, "CameraPosition");
     Shader.Light = CreateLightBinding(Shader.Program);
     Shader.Material = CreateMaterialBinding(Shader.Program);
+    Shader.Clusters = CreateClusterBinding(Shader.Program);
+    SetClusterUniforms(Shader.Program, &Shader.Clusters);
+    Shader.Shadows = CreateShadowBinding(Shader.Program);
+    SetShadowUniforms(Shader.Program, &Shader.Shadows);
     Game->LightTextureShader = Shader;
 
+    shadow_shader ShadowShader;
+    ShadowShader.Program = LoadShaders(&Game->FrameArena, "../res/Shaders/shadowShader.vert", "../res/Shaders/shadowShader.frag");
+    ShadowShader.M = glGetUniformLocation(ShadowShader.Program, "M");
+    ShadowShader.VP = glGetUniformLocation(ShadowShader.Program, "VP");
+    Game->ShadowShader = ShadowShader;
+
+    depth_shader DepthShader;
+    DepthShader.Program = LoadShaders(&Game->FrameArena, "../res/Shaders/depthShader.vert", "../res/Shaders/depthShader.frag");
+    DepthShader.M = glGetUniformLocation(DepthShader.Program, "M");
+    DepthShader.VP = glGetUniformLocation(DepthShader.Program, "VP");
+    DepthShader.EyeCount = glGetUniformLocation(DepthShader.Program, "EyeCount");
+    Game->DepthShader = DepthShader;
+
+    GLuint FXAAProgram = 0;
+    if (Platform->FXAA)
+    {
+	FXAAProgram = LoadShaders(&Game->FrameArena, "../res/Shaders/fxaaShader.vert", "../res/Shaders/fxaaShader.frag");
+    }
+    InitEyeResolve(&Game->EyeResolve, Platform, FXAAProgram);
+
     color_shader ColorShader;
-    ColorShader.Program = LoadShaders("../res/Shaders/vertexShader.vert", "../res/Shaders/fragmentShader.frag");
+    ColorShader.Program = LoadShaders(&Game->FrameArena, "../res/Shaders/vertexShader.vert", "../res/Shaders/fragmentShader.frag");
     ColorShader.M = glGetUniformLocation(ColorShader.Program, "M");
     ColorShader.V = glGetUniformLocation(ColorShader.Program, "V");
-    ColorShader.MVP = glGetUniformLocation(ColorShader.Program, "MVP");
+    ColorShader.VP = glGetUniformLocation(ColorShader.Program, "VP");
+    ColorShader.EyeCount = glGetUniformLocation(ColorShader.Program, "EyeCount");
 
     ColorShader.CameraPosition = glGetUniformLocation(ColorShader.Program, "CameraPosition");
     ColorShader.Light = CreateLightBinding(ColorShader.Program);
@@ -662,7 +877,7 @@ void Init(platform_data* Platform, game_data *Game)
     Camera.Position = V3(0.0f, 0.0f, 5.0f);
     Camera.Forward = Normalize(V3(0.0f, 0.0f,-1.0f));
     Camera.Up = V3(0,1,0);
-    Game->Camera = Camera;
+    Game->Scene.Camera = Camera;
 
     light Light = { 0 };
     Light.Position = V4(4.0f, 4.0f, 4.0f, 1.0f);
@@ -670,172 +885,178 @@ void Init(platform_data* Platform, game_data *Game)
     Light.Diffuse = V3(0.5f, 0.5f, 0.5f);
     Light.Specular = V3(1.0f, 1.0f, 1.0f);
     Light.Power = 100.0f;
-    Game->Light = Light;
+    if (Platform->DirectionalLight)
+    {
+	Light.Position = V4(Normalize(V3(0.5f, 1.0f, 0.3f)), 0.0f);
+	Light.Power = 1.5f;
+    }
+    Game->Scene.Light = Light;
     
-    game_object Box = { 0 };
-    Box.Model = &Game->BoxModel;
-
-    Box.Scale = V3(1.0f, 1.0f, 1.0f);
-    Box.Position = V3(0.0f, 0.0f, 0.0f);
-    Box.Axis = V3(0.25f, 1.0f, .5f);
-    Box.Angle = 0.0f;
-    Game->Box = Box;
-
-    game_object Box2 = { 0 };
-    Box2.Model = &Game->BoxModel;
-    Box2.Scale = V3(0.5f, 0.5f, 0.5f);
-    Box2.Position = V3(4.0f, 0.0f, 0.0f);
-    Box2.Axis = V3(0.0f, 1.0f, 0.0f);
-    Box2.Angle = PI*0.25f;
-    Game->Box2 = Box2;
-
-    game_object LightBox = { 0 };
-    LightBox.Model = &Game->BoxModel;
-    LightBox.Scale = V3(0.5f, 0.5f, 0.5f);
-    LightBox.Position = V3(-4.0f, 0.0f, 0.0f);
-    LightBox.Axis = V3(0.0f, 1.0f, 0.0f);
-    LightBox.Angle = 0.0f;
-    Game->LightBox = LightBox;
-
-    color_game_object ColorBox = { 0 };
-    ColorBox.Model = &Game->ColorBoxModel;
-    ColorBox.Scale = V3(0.5f, 0.5f, 0.5f);
-    ColorBox.Position = V3(Light.Position);
-    ColorBox.Axis = V3(0.0f, 1.0f, 0.0f);
-    Box2.Angle = 0.0f;
-    Game->ColorBox = ColorBox;
+    scene_state *Scene = &Game->Scene;
+    Scene->PointLights = PushArray(&Game->Arena, MAX_POINT_LIGHTS, point_light);
+    Scene->PointLightCount = Clamp(Platform->PointLightCount, 0, MAX_POINT_LIGHTS);
+    PlacePointLights(Scene->PointLights, Scene->PointLightCount);
+    InitEntityStore(&Scene->Entities, &Game->Arena, MAX_SCENE_ITEMS);
+    InitBVH(&Scene->SceneBVH, &Game->Arena, MAX_SCENE_ITEMS);
+
+    Game->SpinningBox = SpawnEntity(Scene, BoxModel, MakeTextureMaterial(BoxMaterial), ENTITY_OCCLUDER | ENTITY_DYNAMIC,
+				    V3(0.0f, 0.0f, 0.0f), V3(1.0f, 1.0f, 1.0f), V3(0.25f, 1.0f, .5f), 0.0f);
+    SpawnEntity(Scene, BoxModel, MakeTextureMaterial(BoxMaterial), 0,
+		V3(4.0f, 0.0f, 0.0f), V3(0.5f, 0.5f, 0.5f), V3(0.0f, 1.0f, 0.0f), PI*0.25f);
+    SpawnEntity(Scene, BoxModel, MakeTextureMaterial(BoxMaterial), 0,
+		V3(-4.0f, 0.0f, 0.0f), V3(0.5f, 0.5f, 0.5f), V3(0.0f, 1.0f, 0.0f), 0.0f);
+    if (Light.Position.w != 0.0f)
+    {
+	SpawnEntity(Scene, BoxModel, MakeColorMaterial(ColorMaterial), ENTITY_NO_SHADOW,
+		    V3(Light.Position), V3(0.5f, 0.5f, 0.5f), V3(0.0f, 1.0f, 0.0f), 0.0f);
+    }
+    // NOTE: Something for the sun's cascades to fall on. Only with the sun,
+    // so the default scene stays comparable with older captures.
+    if (Platform->DirectionalLight && Platform->Shadows)
+    {
+	SpawnEntity(Scene, BoxModel, MakeTextureMaterial(BoxMaterial), 0,
+		    V3(0.0f, -2.0f, 0.0f), V3(12.0f, 0.1f, 12.0f), V3(0.0f, 1.0f, 0.0f), 0.0f);
+    }
+    BuildBVH(&Scene->SceneBVH);
+
+    InitOcclusionBuffer(&Game->Occlusion, &Game->Arena);
+    InitLightClusters(&Game->LightClusters, &Game->Arena);
+    InitShadowMaps(&Game->Shadows, Platform->Shadows);
+    InitDynamicResolution(&Game->DynamicResolution, Platform);
+    InitRenderCommands(&Game->RenderCommands, &Game->Arena);
+    for(int SnapshotIndex = 0; SnapshotIndex < 2; ++SnapshotIndex)
+    {
+	Game->SnapshotArenas[SnapshotIndex] = PushArena(&Game->Arena, SCENE_SNAPSHOT_ARENA_SIZE);
+    }
     
     Game->Initialized = true;
 }
 
-void RenderObject(color_game_object GameObject, camera Camera, light Light, mat4 Projection, mat4 View, color_shader Shader)
+// NOTE: What one scene pass renders. EyeCount 2 is the single pass stereo
+// mode: every draw is instanced once per eye into a side-by-side target.
+struct render_view
 {
-    mat4 Rotation = MakeRotation(GameObject.Axis, GameObject.Angle);
-    mat4 Scale = MakeScale(GameObject.Scale);
-    mat4 Translation = MakeTranslation(GameObject.Position);
-    mat4 Model = Translation * Rotation * Scale;
-    mat4 MVP = Projection * View * Model;
+    int32 EyeCount;
+    mat4 Projection;
+    mat4 View[2];
+    mat4 ViewProjection[2];
+    // NOTE: Per eye, for the specular highlights.
+    v3 CameraPosition[2];
+    // NOTE: Light cluster eye of this view's first eye, see Render.
+    int32 FirstClusterEye;
+};
 
-    glUseProgram(Shader.Program);
-    glUniformMatrix4fv(Shader.M, 1, GL_FALSE, &Model.E[0][0]);
-    glUniformMatrix4fv(Shader.V, 1, GL_FALSE, &View.E[0][0]);
-    glUniformMatrix4fv(Shader.MVP, 1, GL_FALSE, &MVP.E[0][0]);
+render_view MakeRenderView(mat4 Projection, mat4 View, v3 CameraPosition)
+{
+    render_view Result = {0};
+    Result.EyeCount = 1;
+    Result.Projection = Projection;
+    Result.View[0] = View;
+    Result.ViewProjection[0] = Projection * View;
+    Result.CameraPosition[0] = CameraPosition;
+    return Result;
+}
 
-    glUniformVec3f(Shader.CameraPosition, Camera.Position);
-    
-    SetPointLightUniforms(Shader.Light, Light);
+render_view MakeStereoRenderView(mat4 Projection, mat4 LeftView, mat4 RightView,
+				 v3 LeftPosition, v3 RightPosition)
+{
+    render_view Result = MakeRenderView(Projection, LeftView, LeftPosition);
+    Result.EyeCount = 2;
+    Result.View[1] = RightView;
+    Result.ViewProjection[1] = Projection * RightView;
+    Result.CameraPosition[1] = RightPosition;
+    return Result;
+}
 
-    color_material *Material = GameObject.Model->Material;
-    glUniformVec3f(Shader.Material.Diffuse, Material->Diffuse);
-    glUniformVec3f(Shader.Material.Emissive, Material->Emissive);
-    glUniformVec3f(Shader.Material.Specular, Material->Specular);
-    glUniform1f(Shader.Material.Shine, Material->Shine);
+// NOTE: What a slice last bound, so only changes are recorded. Uniforms set
+// by an earlier slice stay on the program, but slices don't rely on it.
+struct record_state
+{
+    GLuint Program;
+    void *Material;
+};
 
-    model ObjectModel = GameObject.Model->Model;
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjectModel.VertexBuffer);
-    glVertexAttribPointer(0,
-			  3,
-			  GL_FLOAT,
-			  GL_FALSE,
-			  0,
-			  (void*)0
-	);
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, ObjectModel.NormalBuffer);
-    glVertexAttribPointer(2,
-			  3,
-			  GL_FLOAT,
-			  GL_FALSE,
-			  0,
-			  (void*)0
-	);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ObjectModel.IndexBuffer);
-    glDrawElements(GL_TRIANGLES,
-		   ObjectModel.IndexCount,
-		   GL_UNSIGNED_SHORT,
-		   (void*)0
-	);
-    
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+void PushViewUniforms(memory_arena *Buffer, record_state *State, GLuint Program,
+		      GLuint V, GLuint VP, GLuint EyeCount, GLuint CameraPosition,
+		      light_binding LightBinding, render_view *View, light Light)
+{
+    if (State->Program == Program)
+    {
+	return;
+    }
+    PushUseProgram(Buffer, Program);
+    PushUniform(Buffer, V, RenderUniform_Mat4, &View->View[0].E[0][0]);
+    PushUniform(Buffer, VP, RenderUniform_Mat4, &View->ViewProjection[0].E[0][0], 2);
+    PushUniform(Buffer, EyeCount, View->EyeCount);
+    float CameraPositions[6];
+    for(int32 Eye = 0; Eye < 2; ++Eye)
+    {
+	CameraPositions[3*Eye] = View->CameraPosition[Eye].x;
+	CameraPositions[3*Eye + 1] = View->CameraPosition[Eye].y;
+	CameraPositions[3*Eye + 2] = View->CameraPosition[Eye].z;
+    }
+    PushUniform(Buffer, CameraPosition, RenderUniform_Vec3, CameraPositions, 2);
+    PushPointLightUniforms(Buffer, LightBinding, Light);
+    State->Program = Program;
+    State->Material = 0;
 }
 
-void RenderObject(game_object GameObject, camera Camera, light Light, mat4 Projection, mat4 View, light_texture_shader Shader)
+void RecordColorMaterial(memory_arena *Buffer, record_state *State, color_material *Material,
+			 render_view *View, light Light, color_shader *Shader)
 {
-    mat4 Rotation = MakeRotation(GameObject.Axis, GameObject.Angle);
-    mat4 Scale = MakeScale(GameObject.Scale);
-    mat4 Translation = MakeTranslation(GameObject.Position);
-    mat4 Model = Translation * Rotation * Scale;
-    mat4 MVP = Projection * View * Model;
-    
-    glUseProgram(Shader.Program);
-    glUniformMatrix4fv(Shader.M, 1, GL_FALSE, &Model.E[0][0]);
-    glUniformMatrix4fv(Shader.V, 1, GL_FALSE, &View.E[0][0]);
-    glUniformMatrix4fv(Shader.MVP, 1, GL_FALSE, &MVP.E[0][0]);
-
-    glUniformVec3f(Shader.CameraPosition, Camera.Position);
-
-    SetPointLightUniforms(Shader.Light, Light);
-
-    texture_material *Material = GameObject.Model->Material;
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Material->DiffuseMap);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, Material->SpecularMap);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, Material->EmissiveMap);
-    
-    glUniform1i(Shader.Material.Diffuse, 0);
-    glUniform1i(Shader.Material.Specular, 1);
-    glUniform1f(Shader.Material.Shine, Material->Shine);
-    glUniform1i(Shader.Material.Emissive, 2);
+    PushViewUniforms(Buffer, State, Shader->Program, Shader->V, Shader->VP, Shader->EyeCount,
+		     Shader->CameraPosition, Shader->Light, View, Light);
+    if (State->Material != Material)
+    {
+	PushUniform(Buffer, Shader->Material.Diffuse, Material->Diffuse);
+	PushUniform(Buffer, Shader->Material.Emissive, Material->Emissive);
+	PushUniform(Buffer, Shader->Material.Specular, Material->Specular);
+	PushUniform(Buffer, Shader->Material.Shine, Material->Shine);
+	State->Material = Material;
+    }
+}
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, GameObject.Model->VertexBuffer);
-    glVertexAttribPointer(0,
-			  3,
-			  GL_FLOAT,
-			  GL_FALSE,
-			  0,
-			  (void*)0
-	);
-    
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, GameObject.Model->UVBuffer);
-    glVertexAttribPointer(1,
-			  2,
-			  GL_FLOAT,
-			  GL_FALSE,
-			  0,
-			  (void*)0
-	);
-    
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, GameObject.Model->NormalBuffer);
-    glVertexAttribPointer(2,
-			  3,
-			  GL_FLOAT,
-			  GL_FALSE,
-			  0,
-			  (void*)0
-	);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GameObject.Model->IndexBuffer);
-    glDrawElements(GL_TRIANGLES,
-		   GameObject.Model->IndexCount,
-		   GL_UNSIGNED_SHORT,
-		   (void*)0
-	);
-    
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
+void RecordTextureMaterial(memory_arena *Buffer, record_state *State, texture_material *Material,
+			   render_view *View, light Light, light_texture_shader *Shader)
+{
+    PushViewUniforms(Buffer, State, Shader->Program, Shader->V, Shader->VP, Shader->EyeCount,
+		     Shader->CameraPosition, Shader->Light, View, Light);
+    if (State->Material != Material)
+    {
+	GLuint Textures[3] = { Material->DiffuseMap, Material->SpecularMap, Material->EmissiveMap };
+	PushBindTextures(Buffer, Textures, 3);
+	PushUniform(Buffer, Shader->Material.Diffuse, 0);
+	PushUniform(Buffer, Shader->Material.Specular, 1);
+	PushUniform(Buffer, Shader->Material.Shine, Material->Shine);
+	PushUniform(Buffer, Shader->Material.Emissive, 2);
+	State->Material = Material;
+    }
+}
+
+void RecordEntity(memory_arena *Buffer, record_state *State, game_data *Game, entity_store *Entities,
+		  uint32 Index, render_view *View, light Light)
+{
+    entity_material Material = Entities->Materials[Index];
+    GLuint M;
+    if (Material.Type == MATERIAL_COLOR)
+    {
+	RecordColorMaterial(Buffer, State, Material.Color, View, Light, &Game->ColorShader);
+	M = Game->ColorShader.M;
+    }
+    else
+    {
+	RecordTextureMaterial(Buffer, State, Material.Texture, View, Light, &Game->LightTextureShader);
+	M = Game->LightTextureShader.M;
+    }
+
+    PushUniform(Buffer, M, RenderUniform_Mat4, &Entities->World[Index].E[0][0]);
+    model *Mesh = Entities->Meshes[Index];
+    PushDrawElements(Buffer, Mesh->VertexArray, Mesh->IndexCount, View->EyeCount);
 }
 
 void Update(platform_data *Platform, game_data *Game)
 {
+    TIMED_FUNCTION();
     input *LastInput = Platform->LastInput;
     input *Input = Platform->NewInput;
     controller OldKeyboard = LastInput->Keyboard;
@@ -843,110 +1064,663 @@ void Update(platform_data *Platform, game_data *Game)
     
     if (Keyboard.Left.Down)
     {
-	CameraStrafe(&Game->Camera, Input->dT, -3.0f);
+	CameraStrafe(&Game->Scene.Camera, Input->dT, -3.0f);
     }
     else if (Keyboard.Right.Down)	
     {
-	CameraStrafe(&Game->Camera, Input->dT, 3.0f);
+	CameraStrafe(&Game->Scene.Camera, Input->dT, 3.0f);
     }
 
     if (Keyboard.Forward.Down)
     {
-	CameraMoveForward(&Game->Camera, Input->dT, 3.0f);
+	CameraMoveForward(&Game->Scene.Camera, Input->dT, 3.0f);
     }
     else if (Keyboard.Back.Down)
     {
-	CameraMoveForward(&Game->Camera, Input->dT, -3.0f);
+	CameraMoveForward(&Game->Scene.Camera, Input->dT, -3.0f);
     }
     
     if (Keyboard.Up.Down)
     {
-	CameraMoveUp(&Game->Camera, Input->dT, 3.0f);
+	CameraMoveUp(&Game->Scene.Camera, Input->dT, 3.0f);
     }
     else if (Keyboard.Down.Down)
     {
-	CameraMoveUp(&Game->Camera, Input->dT, -3.0f);
+	CameraMoveUp(&Game->Scene.Camera, Input->dT, -3.0f);
     }
 
     if (Keyboard.UpperLeft.Down)
     {
-	RollCamera(&Game->Camera, Input->dT, 0.5f);
+	RollCamera(&Game->Scene.Camera, Input->dT, 0.5f);
     }
     else if (Keyboard.UpperRight.Down)
     {
-	RollCamera(&Game->Camera, Input->dT, -0.5f);
+	RollCamera(&Game->Scene.Camera, Input->dT, -0.5f);
     }
 
-    TurnCamera(&Game->Camera,
+    TurnCamera(&Game->Scene.Camera,
 	       Keyboard.RightStick.X / 100.0f,
 	       Keyboard.RightStick.Y / 100.0f,
 	       Input->dT*1.0f);
 
-    Game->Box.Angle += PI*(1.0f/120.0f);
+    OrbitPointLights(Game->Scene.PointLights, Game->Scene.PointLightCount, Input->dT*0.25f);
+
+    entity_store *Entities = &Game->Scene.Entities;
+    bvh *SceneBVH = &Game->Scene.SceneBVH;
+    // NOTE: Clicking picks whatever is straight ahead of the camera, where a
+    // headset user is looking, sets it spinning instead and moves the marker
+    // over to it. This runs before the hierarchy pass so the marker follows
+    // its new parent from this frame on; until then the BVH is still the one
+    // built at the end of last frame, which matches the entity indices.
+    if (Input->Mouse.Mouse1.Down && !LastInput->Mouse.Mouse1.Down)
+    {
+	camera *Camera = &Game->Scene.Camera;
+	ray Gaze = { Camera->Position, Normalize(Camera->Forward) };
+	int32 Picked = QueryBVHRay(SceneBVH, Gaze, Camera->Far, 0);
+	if (Picked >= 0 && (uint32)Picked != GetEntityIndex(Entities, Game->PickMarker))
+	{
+	    entity_handle PickedEntity = GetPoolHandle(&Entities->Pool, Picked);
+	    uint32 Flags = ENTITY_NO_SHADOW | (GetEntityFlags(Entities)[Picked] & ENTITY_DYNAMIC);
+	    Game->SpinningBox = PickedEntity;
+	    DespawnEntity(&Game->Scene, Game->PickMarker);
+	    Game->PickMarker = SpawnEntity(&Game->Scene, &Game->BoxModel, MakeColorMaterial(&Game->ColorMaterial), Flags,
+					   V3(0.0f, 1.5f, 0.0f), V3(0.25f, 0.25f, 0.25f), V3(0.0f, 1.0f, 0.0f), 0.0f);
+	    SetEntityParent(Entities, Game->PickMarker, PickedEntity);
+	}
+    }
+
+    uint32 SpinningBox = GetEntityIndex(Entities, Game->SpinningBox);
+    if (SpinningBox != POOL_NO_SLOT)
+    {
+	Entities->Angles[SpinningBox] += PI*(1.0f/120.0f);
+	MarkEntityDirty(Entities, SpinningBox);
+    }
+
+    if (SortEntityHierarchy(Entities))
+    {
+	ResetBVHItems(SceneBVH, Entities->WorldBounds, GetEntityCount(Entities));
+    }
+    if (UpdateAllEntityTransforms(Entities, &Game->Jobs))
+    {
+	uint32 *EntityFlags = GetEntityFlags(Entities);
+	bool32 StaticMoved = false;
+	for(uint32 Index = 0; Index < GetEntityCount(Entities); ++Index)
+	{
+	    if (EntityFlags[Index] & ENTITY_MOVED)
+	    {
+		UpdateBVHItem(SceneBVH, Index, Entities->WorldBounds[Index]);
+		StaticMoved |= !(EntityFlags[Index] & ENTITY_DYNAMIC);
+	    }
+	}
+	if (StaticMoved)
+	{
+	    ++Game->Scene.StaticVersion;
+	}
+    }
+
+    if (BVHNeedsRebuild(SceneBVH))
+    {
+	BuildBVH(SceneBVH);
+    }
+}
+
+// NOTE: Draws are sorted by program then material so each slice switches
+// state as little as possible, or by Depth, the view depth of the nearest
+// point of the bounding sphere, to draw front to back.
+struct draw_item
+{
+    GLuint Program;
+    void *Material;
+    int32 Item;
+    float Depth;
+};
+
+int CompareDrawItems(const void *A, const void *B)
+{
+    const draw_item *DrawA = (const draw_item *)A;
+    const draw_item *DrawB = (const draw_item *)B;
+    if (DrawA->Program != DrawB->Program)
+    {
+	return (DrawA->Program < DrawB->Program) ? -1 : 1;
+    }
+    if (DrawA->Material != DrawB->Material)
+    {
+	return ((uintptr_t)DrawA->Material < (uintptr_t)DrawB->Material) ? -1 : 1;
+    }
+    return DrawA->Item - DrawB->Item;
+}
+
+int CompareDrawItemsFrontToBack(const void *A, const void *B)
+{
+    const draw_item *DrawA = (const draw_item *)A;
+    const draw_item *DrawB = (const draw_item *)B;
+    if (DrawA->Depth != DrawB->Depth)
+    {
+	return (DrawA->Depth < DrawB->Depth) ? -1 : 1;
+    }
+    return DrawA->Item - DrawB->Item;
+}
+
+struct record_scene_job
+{
+    game_data *Game;
+    scene_state *Scene;
+    render_view *View;
+    draw_item *Draws;
+};
+
+// NOTE: Runs on any worker; reads the scene and shaders, touches no GL.
+void RecordSceneCommands(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    TIMED_FUNCTION();
+    record_scene_job *Job = (record_scene_job *)Data;
+    game_data *Game = Job->Game;
+    scene_state *Scene = Job->Scene;
+    for(int32 SliceStart = Start; SliceStart < End; SliceStart += RENDER_COMMAND_DRAWS_PER_SLICE)
+    {
+	memory_arena *Buffer = Game->RenderCommands.Slices + SliceStart / RENDER_COMMAND_DRAWS_PER_SLICE;
+	int32 SliceEnd = Min(SliceStart + RENDER_COMMAND_DRAWS_PER_SLICE, End);
+	record_state State = {0};
+	for(int32 DrawIndex = SliceStart; DrawIndex < SliceEnd; ++DrawIndex)
+	{
+	    RecordEntity(Buffer, &State, Game, &Scene->Entities, Job->Draws[DrawIndex].Item,
+			 Job->View, Scene->Light);
+	}
+    }
+}
+
+struct record_shadow_job
+{
+    game_data *Game;
+    entity_store *Entities;
+    mat4 *ViewProjection;
+    int32 *Casters;
+};
+
+void RecordShadowCasters(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    TIMED_FUNCTION();
+    record_shadow_job *Job = (record_shadow_job *)Data;
+    shadow_shader *Shader = &Job->Game->ShadowShader;
+    entity_store *Entities = Job->Entities;
+    for(int32 SliceStart = Start; SliceStart < End; SliceStart += RENDER_COMMAND_DRAWS_PER_SLICE)
+    {
+	memory_arena *Buffer = Job->Game->RenderCommands.Slices + SliceStart / RENDER_COMMAND_DRAWS_PER_SLICE;
+	int32 SliceEnd = Min(SliceStart + RENDER_COMMAND_DRAWS_PER_SLICE, End);
+	PushUseProgram(Buffer, Shader->Program);
+	PushUniform(Buffer, Shader->VP, RenderUniform_Mat4, &Job->ViewProjection->E[0][0]);
+	for(int32 CasterIndex = SliceStart; CasterIndex < SliceEnd; ++CasterIndex)
+	{
+	    int32 Item = Job->Casters[CasterIndex];
+	    model *Mesh = Entities->Meshes[Item];
+	    PushUniform(Buffer, Shader->M, RenderUniform_Mat4, &Entities->World[Item].E[0][0]);
+	    PushDrawElements(Buffer, Mesh->VertexArray, Mesh->IndexCount, 1);
+	}
+    }
+}
+
+// NOTE: Draws whichever shadow maps PrepareShadowPasses asked for: the
+// static casters into maps whose cache went stale, the dynamic ones into
+// the overlays. Padding covers stereo eyes offset from the scene camera.
+void RenderShadowMaps(game_data *Game, scene_state *Scene, float Padding)
+{
+    TIMED_FUNCTION();
+    shadow_maps *Shadows = &Game->Shadows;
+    PrepareShadowPasses(Shadows, Scene->Light.Position, Scene->StaticVersion, Scene->Camera, Padding);
+    if (Shadows->PassCount == 0)
+    {
+	return;
+    }
+
+    GPU_TIMED_BLOCK(&Game->GPUProfiler, "Shadows");
+    entity_store *Entities = &Scene->Entities;
+    uint32 *EntityFlags = GetEntityFlags(Entities);
+    int32 MaxCasters = GetEntityCount(Entities);
+    temporary_memory CasterMemory = BeginTemporaryMemory(&Game->FrameArena);
+    int32 *Casters = PushArray(&Game->FrameArena, MaxCasters, int32);
+    BeginShadowPasses(Shadows);
+    for(int32 PassIndex = 0; PassIndex < Shadows->PassCount; ++PassIndex)
+    {
+	shadow_pass *Pass = Shadows->Passes + PassIndex;
+	uint32 Wanted = (Pass->Kind == SHADOW_DYNAMIC) ? ENTITY_DYNAMIC : 0;
+	int32 CandidateCount = QueryBVHFrustum(&Scene->SceneBVH, &Pass->Frustum, Casters, MaxCasters);
+	int32 CasterCount = 0;
+	for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+	{
+	    uint32 Flags = EntityFlags[Casters[CandidateIndex]];
+	    if ((Flags & (ENTITY_DYNAMIC | ENTITY_NO_SHADOW)) == Wanted)
+	    {
+		Casters[CasterCount++] = Casters[CandidateIndex];
+	    }
+	}
+
+	if (BeginShadowPass(Shadows, Pass, CasterCount))
+	{
+	    record_shadow_job RecordJob;
+	    RecordJob.Game = Game;
+	    RecordJob.Entities = Entities;
+	    RecordJob.ViewProjection = &Pass->ViewProjection;
+	    RecordJob.Casters = Casters;
+	    BeginRenderCommands(&Game->RenderCommands, CasterCount);
+	    ParallelFor(&Game->Jobs, CasterCount, RENDER_COMMAND_DRAWS_PER_SLICE, RecordShadowCasters, &RecordJob);
+	    ExecuteRenderCommands(&Game->RenderCommands);
+	}
+    }
+    EndShadowPasses();
+    EndTemporaryMemory(CasterMemory);
+}
+
+struct record_depth_job
+{
+    game_data *Game;
+    entity_store *Entities;
+    render_view *View;
+    draw_item *Draws;
+};
+
+void RecordDepthCommands(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    TIMED_FUNCTION();
+    record_depth_job *Job = (record_depth_job *)Data;
+    depth_shader *Shader = &Job->Game->DepthShader;
+    entity_store *Entities = Job->Entities;
+    render_view *View = Job->View;
+    for(int32 SliceStart = Start; SliceStart < End; SliceStart += RENDER_COMMAND_DRAWS_PER_SLICE)
+    {
+	memory_arena *Buffer = Job->Game->RenderCommands.Slices + SliceStart / RENDER_COMMAND_DRAWS_PER_SLICE;
+	int32 SliceEnd = Min(SliceStart + RENDER_COMMAND_DRAWS_PER_SLICE, End);
+	PushUseProgram(Buffer, Shader->Program);
+	PushUniform(Buffer, Shader->VP, RenderUniform_Mat4, &View->ViewProjection[0].E[0][0], 2);
+	PushUniform(Buffer, Shader->EyeCount, View->EyeCount);
+	for(int32 DrawIndex = SliceStart; DrawIndex < SliceEnd; ++DrawIndex)
+	{
+	    int32 Item = Job->Draws[DrawIndex].Item;
+	    model *Mesh = Entities->Meshes[Item];
+	    PushUniform(Buffer, Shader->M, RenderUniform_Mat4, &Entities->World[Item].E[0][0]);
+	    PushDrawElements(Buffer, Mesh->VertexArray, Mesh->IndexCount, View->EyeCount);
+	}
+    }
+}
+
+// NOTE: Depth only, nearest first, with colour writes off. The colour pass
+// then tests GL_LEQUAL against it without writing depth, so each pixel is
+// shaded once.
+void RenderDepthPrepass(game_data *Game, entity_store *Entities, render_view *View,
+			draw_item *Draws, int32 DrawCount, memory_arena *Arena)
+{
+    TIMED_FUNCTION();
+    GPU_TIMED_BLOCK(&Game->GPUProfiler, "Depth Prepass");
+    draw_item *DepthDraws = PushArray(Arena, DrawCount, draw_item);
+    memcpy(DepthDraws, Draws, DrawCount*sizeof(draw_item));
+    qsort(DepthDraws, DrawCount, sizeof(draw_item), CompareDrawItemsFrontToBack);
+
+    record_depth_job RecordJob;
+    RecordJob.Game = Game;
+    RecordJob.Entities = Entities;
+    RecordJob.View = View;
+    RecordJob.Draws = DepthDraws;
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    BeginRenderCommands(&Game->RenderCommands, DrawCount);
+    ParallelFor(&Game->Jobs, DrawCount, RENDER_COMMAND_DRAWS_PER_SLICE, RecordDepthCommands, &RecordJob);
+    ExecuteRenderCommands(&Game->RenderCommands);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
 
-void RenderScene(game_data *Game, mat4 Projection, mat4 View)
+void RenderScene(game_data *Game, scene_state *Scene, render_view *View)
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    TIMED_FUNCTION();
+    {
+	GPU_TIMED_BLOCK(&Game->GPUProfiler, "Clear");
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
     glEnable(GL_DEPTH_TEST);
-    RenderObject(Game->Box, Game->Camera, Game->Light, Projection, View, Game->LightTextureShader);
-    RenderObject(Game->Box2, Game->Camera, Game->Light, Projection, View, Game->LightTextureShader);
-    RenderObject(Game->LightBox, Game->Camera, Game->Light, Projection, View, Game->LightTextureShader);
-    RenderObject(Game->ColorBox, Game->Camera, Game->Light, Projection, View, Game->ColorShader);
+
+    frustum Frustum = ExtractFrustumPlanes(View->ViewProjection[0]);
+    if (View->EyeCount == 2)
+    {
+	Frustum = MergeStereoFrustum(Frustum, ExtractFrustumPlanes(View->ViewProjection[1]));
+    }
+
+    // NOTE: Every entity can be in view at once, so the per-view arrays are
+    // sized by the live entity count rather than a fixed cap.
+    entity_store *Entities = &Scene->Entities;
+    uint32 *EntityFlags = GetEntityFlags(Entities);
+    int32 MaxCandidates = GetEntityCount(Entities);
+    memory_arena *Arena = &Game->FrameArena;
+    temporary_memory ViewMemory = BeginTemporaryMemory(Arena);
+    int32 *Candidates = PushArray(Arena, MaxCandidates, int32);
+    int32 CandidateCount = QueryBVHFrustum(&Scene->SceneBVH, &Frustum, Candidates, MaxCandidates);
+
+    cull_list CullList;
+    InitCullList(&CullList, Arena, CandidateCount);
+    for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+    {
+	AddCullSphere(&CullList, Entities->WorldSpheres[Candidates[CandidateIndex]]);
+    }
+    CullSpheres(&CullList, &Frustum);
+
+    // NOTE: Occlusion is only valid from the viewpoint it was rasterized for,
+    // so in stereo an object has to be hidden from both eyes to be dropped.
+    uint32 *Hidden = PushArray(Arena, CandidateCount, uint32);
+    for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+    {
+	bool32 IsOccluder = EntityFlags[Candidates[CandidateIndex]] & ENTITY_OCCLUDER;
+	Hidden[CandidateIndex] = CullList.Visible[CandidateIndex] && !IsOccluder;
+    }
+
+    occlusion_buffer *Occlusion = &Game->Occlusion;
+    for(int32 Eye = 0; Eye < View->EyeCount; ++Eye)
+    {
+	mat4 ViewProjection = View->ViewProjection[Eye];
+	ClearOcclusionBuffer(Occlusion);
+	for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+	{
+	    int32 Item = Candidates[CandidateIndex];
+	    if (CullList.Visible[CandidateIndex] && (EntityFlags[Item] & ENTITY_OCCLUDER))
+	    {
+		model *Mesh = Entities->Meshes[Item];
+		AddOccluderMesh(Occlusion, Mesh->Vertices, Mesh->Indices, Mesh->IndexCount,
+				ViewProjection * Entities->World[Item]);
+	    }
+	}
+	RasterizeOcclusionBuffer(Occlusion, &Game->Jobs);
+
+	for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+	{
+	    int32 Item = Candidates[CandidateIndex];
+	    if (Hidden[CandidateIndex] &&
+		!IsOccluded(Occlusion, Scene->SceneBVH.ItemBounds[Item], ViewProjection))
+	    {
+		Hidden[CandidateIndex] = 0;
+	    }
+	}
+    }
+
+    cull_stats *Stats = &Game->CullStats;
+    for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+    {
+	if (Hidden[CandidateIndex])
+	{
+	    CullList.Visible[CandidateIndex] = 0;
+	    ++Stats->Occluded;
+	}
+    }
+
+    draw_item *Draws = PushArray(Arena, CandidateCount, draw_item);
+    int32 DrawCount = 0;
+    for(int32 CandidateIndex = 0; CandidateIndex < CandidateCount; ++CandidateIndex)
+    {
+	if (!CullList.Visible[CandidateIndex])
+	{
+	    continue;
+	}
+
+	draw_item *Draw = Draws + DrawCount++;
+	Draw->Item = Candidates[CandidateIndex];
+	bounding_sphere Sphere = Entities->WorldSpheres[Draw->Item];
+	Draw->Depth = -TransformPoint(View->View[0], Sphere.Center).z - Sphere.Radius;
+	entity_material Material = Entities->Materials[Draw->Item];
+	if (Material.Type == MATERIAL_COLOR)
+	{
+	    Draw->Program = Game->ColorShader.Program;
+	    Draw->Material = Material.Color;
+	}
+	else
+	{
+	    Draw->Program = Game->LightTextureShader.Program;
+	    Draw->Material = Material.Texture;
+	}
+    }
+    bool32 FrontToBack = !Game->DepthPrepass && Game->DrawOrder == DRAW_ORDER_FRONT_TO_BACK;
+    qsort(Draws, DrawCount, sizeof(draw_item),
+	  FrontToBack ? CompareDrawItemsFrontToBack : CompareDrawItems);
+
+    if (Game->DepthPrepass)
+    {
+	RenderDepthPrepass(Game, Entities, View, Draws, DrawCount, Arena);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
+    }
+
+    glUseProgram(Game->LightTextureShader.Program);
+    glUniform1i(Game->LightTextureShader.Clusters.PointLightCount, Game->LightClusters.LightCount);
+    glUniform1i(Game->LightTextureShader.Clusters.ClusterFirstEye, View->FirstClusterEye);
+
+    record_scene_job RecordJob;
+    RecordJob.Game = Game;
+    RecordJob.Scene = Scene;
+    RecordJob.View = View;
+    RecordJob.Draws = Draws;
+    BeginRenderCommands(&Game->RenderCommands, DrawCount);
+    ParallelFor(&Game->Jobs, DrawCount, RENDER_COMMAND_DRAWS_PER_SLICE, RecordSceneCommands, &RecordJob);
+    ExecuteRenderCommands(&Game->RenderCommands);
+    EndTemporaryMemory(ViewMemory);
+    if (Game->DepthPrepass)
+    {
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+    }
+
+    Stats->Tested += GetEntityCount(Entities);
+    Stats->Drawn += DrawCount;
+    Stats->Culled = Stats->Tested - Stats->Drawn;
 }
 
-void RenderToTarget(platform_data *Platform, game_data *Game, mat4 Projection, mat4 View, FramebufferDesc *TargetBuffer, int BufferWidth, int BufferHeight)
+void RenderToTarget(platform_data *Platform, game_data *Game, scene_state *Scene, render_view *View, FramebufferDesc *TargetBuffer, int BufferWidth, int BufferHeight)
 {
+    TIMED_FUNCTION();
+    gpu_profiler *GPUProfiler = &Game->GPUProfiler;
+    int Width, Height;
+    GetDynamicViewport(&Game->DynamicResolution, BufferWidth, BufferHeight, &Width, &Height);
+    bool32 Scaled = (Width != BufferWidth || Height != BufferHeight);
     
     glEnable(GL_MULTISAMPLE);
     
     glBindFramebuffer(GL_FRAMEBUFFER, TargetBuffer->RenderFramebufferId);
-    glViewport(0, 0, BufferWidth, BufferHeight);
-    RenderScene(Game, Projection, View);
+    glViewport(0, 0, Width, Height);
+    if (Scaled)
+    {
+	// NOTE: Keeps the clear to the part that gets drawn.
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, Width, Height);
+    }
+    {
+	GPU_TIMED_BLOCK(GPUProfiler, (TargetBuffer == Platform->LeftEye) ? "Left Eye" : "Right Eye");
+	RenderScene(Game, Scene, View);
+    }
+    glDisable(GL_SCISSOR_TEST);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     
     glDisable(GL_MULTISAMPLE);
 
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, TargetBuffer->RenderFramebufferId);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, TargetBuffer->ResolveFramebufferId);
-    glBlitFramebuffer(0, 0, BufferWidth, BufferHeight,
-		      0, 0, BufferWidth, BufferHeight,
-		      GL_COLOR_BUFFER_BIT, GL_LINEAR);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);    
+    GPU_TIMED_BLOCK(GPUProfiler, "Resolve");
+    ResolveEyes(&Game->EyeResolve, TargetBuffer, Width, Height, &TargetBuffer, 1, BufferWidth, BufferHeight);
+}
+
+// NOTE: Both eyes in one pass into the double-width StereoTarget, resolved
+// straight into the per-eye textures the compositor expects.
+void RenderStereoToTarget(platform_data *Platform, game_data *Game, scene_state *Scene, render_view *View)
+{
+    TIMED_FUNCTION();
+    int EyeWidth = Platform->VRBufferWidth;
+    int EyeHeight = Platform->VRBufferHeight;
+    FramebufferDesc *StereoTarget = Platform->StereoTarget;
+    int Width, Height;
+    GetDynamicViewport(&Game->DynamicResolution, EyeWidth, EyeHeight, &Width, &Height);
+    bool32 Scaled = (Width != EyeWidth || Height != EyeHeight);
+
+    glEnable(GL_MULTISAMPLE);
+    glEnable(GL_CLIP_DISTANCE0);
+    glBindFramebuffer(GL_FRAMEBUFFER, StereoTarget->RenderFramebufferId);
+    glViewport(0, 0, 2*Width, Height);
+    if (Scaled)
+    {
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, 2*Width, Height);
+    }
+    {
+	GPU_TIMED_BLOCK(&Game->GPUProfiler, "Stereo");
+	RenderScene(Game, Scene, View);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_CLIP_DISTANCE0);
+    glDisable(GL_MULTISAMPLE);
+
+    GPU_TIMED_BLOCK(&Game->GPUProfiler, "Resolve");
+    FramebufferDesc *Eyes[2] = { Platform->LeftEye, Platform->RightEye };
+    ResolveEyes(&Game->EyeResolve, StereoTarget, Width, Height, Eyes, 2, EyeWidth, EyeHeight);
 }
 
-void Render(platform_data *Platform, game_data *Game)
+void Render(platform_data *Platform, game_data *Game, scene_state *Scene)
 {
+    TIMED_FUNCTION();
     float EyeDistance = 1.0f;
-    camera LeftEyeCamera = Game->Camera;
+    camera LeftEyeCamera = Scene->Camera;
     LeftEyeCamera.Position = LeftEyeCamera.Position + -EyeDistance*Cross(LeftEyeCamera.Forward,
 									LeftEyeCamera.Up);
-    camera RightEyeCamera = Game->Camera;
+    camera RightEyeCamera = Scene->Camera;
     RightEyeCamera.Position = RightEyeCamera.Position + EyeDistance*Cross(RightEyeCamera.Forward,
 									   RightEyeCamera.Up);
-    mat4 Projection = GenerateCameraPerspective(Game->Camera);
+    mat4 Projection = GenerateCameraPerspective(Scene->Camera);
     
-    mat4 View = GenerateCameraView(Game->Camera);
+    mat4 View = GenerateCameraView(Scene->Camera);
     mat4 LeftEyeView = GenerateCameraView(LeftEyeCamera);
     mat4 RightEyeView = GenerateCameraView(RightEyeCamera);
+
+    bool32 Stereo = Platform->LeftEye && Platform->RightEye;
+    bool32 Mirror = Stereo && Platform->StereoMode == STEREO_INSTANCED && Platform->StereoTarget;
+    RenderShadowMaps(Game, Scene, Stereo ? EyeDistance : 0.0f);
+    BindShadowMaps(&Game->Shadows, Game->LightTextureShader.Program, &Game->LightTextureShader.Shadows);
+
+    // NOTE: One cluster build for every view of the frame: the eyes, then
+    // the desktop view unless the left eye is mirrored in its place. The
+    // clusters are bound to units the material textures don't use, so they
+    // stay bound through all the passes.
+    mat4 ClusterViews[CLUSTER_MAX_EYES] = { LeftEyeView, RightEyeView, View };
+    int32 DesktopClusterEye = 2;
+    if (!Stereo)
+    {
+	ClusterViews[0] = View;
+	DesktopClusterEye = 0;
+    }
+    BuildLightClusters(&Game->LightClusters, &Game->Jobs, Scene->PointLights, Scene->PointLightCount,
+		       Projection, ClusterViews, Mirror ? 2 : DesktopClusterEye + 1);
     
-    if (Platform->LeftEye && Platform->RightEye)
+    if (Stereo)
     {
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	
-	RenderToTarget(Platform, Game, Projection, LeftEyeView, Platform->LeftEye, Platform->VRBufferWidth, Platform->VRBufferHeight);
-	RenderToTarget(Platform, Game, Projection, RightEyeView, Platform->RightEye, Platform->VRBufferWidth, Platform->VRBufferHeight);
+
+	if (Mirror)
+	{
+	    render_view StereoView = MakeStereoRenderView(Projection, LeftEyeView, RightEyeView,
+							  LeftEyeCamera.Position, RightEyeCamera.Position);
+	    RenderStereoToTarget(Platform, Game, Scene, &StereoView);
+
+	    // NOTE: Mirror the resolved left eye to the window instead of
+	    // drawing the scene a third time.
+	    GPU_TIMED_BLOCK(&Game->GPUProfiler, "Mirror");
+	    glBindFramebuffer(GL_READ_FRAMEBUFFER, Platform->LeftEye->ResolveFramebufferId);
+	    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, Platform->WindowFramebuffer);
+	    glBlitFramebuffer(0, 0, Platform->VRBufferWidth, Platform->VRBufferHeight,
+			      0, 0, Platform->WindowWidth, Platform->WindowHeight,
+			      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	    return;
+	}
+
+	render_view LeftView = MakeRenderView(Projection, LeftEyeView, LeftEyeCamera.Position);
+	render_view RightView = MakeRenderView(Projection, RightEyeView, RightEyeCamera.Position);
+	RightView.FirstClusterEye = 1;
+	RenderToTarget(Platform, Game, Scene, &LeftView, Platform->LeftEye, Platform->VRBufferWidth, Platform->VRBufferHeight);
+	RenderToTarget(Platform, Game, Scene, &RightView, Platform->RightEye, Platform->VRBufferWidth, Platform->VRBufferHeight);
     }
     
+    GPU_TIMED_BLOCK(&Game->GPUProfiler, "Desktop");
+    glBindFramebuffer(GL_FRAMEBUFFER, Platform->WindowFramebuffer);
     glViewport(0, 0, Platform->WindowWidth, Platform->WindowHeight);
-    RenderScene(Game, Projection, View);
+    render_view DesktopView = MakeRenderView(Projection, View, Scene->Camera.Position);
+    DesktopView.FirstClusterEye = DesktopClusterEye;
+    RenderScene(Game, Scene, &DesktopView);
+}
+
+// NOTE: Deep copy of the scene for the renderer. The snapshot's arena is
+// rewound every time, nothing else points into it.
+void WriteSceneSnapshot(game_data *Game, int32 SnapshotIndex)
+{
+    TIMED_FUNCTION();
+    memory_arena *Arena = Game->SnapshotArenas + SnapshotIndex;
+    ResetArena(Arena);
+    scene_state *Snapshot = Game->Snapshots + SnapshotIndex;
+    *Snapshot = Game->Scene;
+    CopyEntityStore(&Snapshot->Entities, &Game->Scene.Entities, Arena);
+    Snapshot->PointLights = PushArray(Arena, Game->Scene.PointLightCount, point_light);
+    memcpy(Snapshot->PointLights, Game->Scene.PointLights, Game->Scene.PointLightCount*sizeof(point_light));
+    CopyBVH(&Snapshot->SceneBVH, &Game->Scene.SceneBVH, Arena);
+}
+
+// NOTE: 0 when the platform gives no clock.
+inline uint64 ReadGameClock(platform_data *Platform)
+{
+    return Platform->ReadClock ? Platform->ReadClock() : 0;
+}
+
+inline float GetGameMilliseconds(platform_data *Platform, uint64 Start)
+{
+    return Platform->ReadClock ? (Platform->ReadClock() - Start) / 1000000.0f : 0.0f;
+}
+
+struct update_job
+{
+    platform_data *Platform;
+    game_data *Game;
+    int32 SnapshotIndex;
+};
+
+void RunUpdateJob(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    update_job *Job = (update_job *)Data;
+    uint64 UpdateStart = ReadGameClock(Job->Platform);
+    Update(Job->Platform, Job->Game);
+    WriteSceneSnapshot(Job->Game, Job->SnapshotIndex);
+    Job->Platform->UpdateMilliseconds = GetGameMilliseconds(Job->Platform, UpdateStart);
+}
+
+// NOTE: Update for the next frame runs as a background job, which only the
+// other workers pick up, while this thread submits the current frame from
+// its snapshot; with a single thread it runs first, and nothing overlaps.
+// The two share nothing but the read-only models and shaders. The input
+// pointers stay valid because the update is waited on before returning to
+// the platform, which is when it swaps them.
+void UpdateAndRenderPipelined(platform_data *Platform, game_data *Game)
+{
+    if (!Game->SnapshotValid)
+    {
+	Game->SnapshotIndex = 0;
+	WriteSceneSnapshot(Game, Game->SnapshotIndex);
+	Game->SnapshotValid = true;
+    }
+
+    update_job UpdateJob;
+    UpdateJob.Platform = Platform;
+    UpdateJob.Game = Game;
+    UpdateJob.SnapshotIndex = 1 - Game->SnapshotIndex;
+    job_counter UpdateCounter;
+    UpdateCounter.Count.store(0);
+    KickBackgroundJob(&Game->Jobs, RunUpdateJob, &UpdateJob, 0, 0, &UpdateCounter);
+
+    uint64 RenderStart = ReadGameClock(Platform);
+    Render(Platform, Game, Game->Snapshots + Game->SnapshotIndex);
+    Platform->RenderMilliseconds = GetGameMilliseconds(Platform, RenderStart);
+
+    WaitForCounter(&Game->Jobs, &UpdateCounter);
+    Game->SnapshotIndex = UpdateJob.SnapshotIndex;
 }
 
 void UpdateAndRender(platform_data *Platform)
 {
     game_data* Game = (game_data*)(((char*)Platform->MainMemory)+0);
 
+    BeginGLTraceFrame(Platform->ShowGLStats);
     if (!Game->Initialized)
     {
 	Init(Platform, Game);
@@ -954,7 +1728,123 @@ void UpdateAndRender(platform_data *Platform)
 	GLErrorShow();
 	
     }
+    gl_state_stats GLStats = BeginGLStateFrame();
+    if (Platform->ShowGLStats)
+    {
+	printf("GL state calls: %u issued, %u dropped\n", GLStats.Issued, GLStats.Dropped);
+    }
+    ResetArena(&Game->FrameArena);
+    BeginProfilerFrame(Platform);
+    Game->GPUProfiler.Print = Platform->ShowGPUTimings;
+    Game->DepthPrepass = Platform->DepthPrepass;
+    Game->DrawOrder = Platform->DrawOrder;
+    BeginGPUFrame(&Game->GPUProfiler);
+    UpdateDynamicResolution(&Game->DynamicResolution, &Game->GPUProfiler);
+
+    {
+	TIMED_BLOCK("Frame");
+	cull_stats ZeroStats = {0};
+	Game->CullStats = ZeroStats;
+
+	if (Platform->PipelinedUpdate)
+	{
+	    UpdateAndRenderPipelined(Platform, Game);
+	}
+	else
+	{
+	    Game->SnapshotValid = false;
+	    uint64 UpdateStart = ReadGameClock(Platform);
+	    Update(Platform, Game);
+	    Platform->UpdateMilliseconds = GetGameMilliseconds(Platform, UpdateStart);
+	    uint64 RenderStart = ReadGameClock(Platform);
+	    Render(Platform, Game, &Game->Scene);
+	    Platform->RenderMilliseconds = GetGameMilliseconds(Platform, RenderStart);
+	}
+    }
+    EndGPUFrame(&Game->GPUProfiler);
+    EndProfilerFrame();
+
+    cull_stats Stats = Game->CullStats;
+    cull_stats Reported = Game->ReportedCullStats;
+    if (Stats.Drawn != Reported.Drawn || Stats.Culled != Reported.Culled ||
+	Stats.Occluded != Reported.Occluded)
+    {
+	DebugLog("Culling: %u drawn, %u culled (%u occluded) of %u tested\n",
+		 Stats.Drawn, Stats.Culled, Stats.Occluded, Stats.Tested);
+	Game->ReportedCullStats = Stats;
+    }
+}
+
+#define DRAW_BENCH_ROUNDS 5
+
+// NOTE: Issues DrawCount draws of Model and returns how long submitting
+// them took. Either through the model's VAO, or the way draws were made
+// before models had one: enabling and pointing every attribute on a shared
+// VAO and binding the index buffer around each draw.
+float TimeModelDraws(platform_data *Platform, model *Model, GLuint SharedVertexArray,
+		     int32 DrawCount, bool32 PerDrawAttributes)
+{
+    (glFinish)();
+    uint64 Start = ReadGameClock(Platform);
+    for(int32 Draw = 0; Draw < DrawCount; ++Draw)
+    {
+	if (!PerDrawAttributes)
+	{
+	    (glBindVertexArray)(Model->VertexArray);
+	    (glDrawElementsInstanced)(GL_TRIANGLES, Model->IndexCount, GL_UNSIGNED_SHORT, (void*)0, 1);
+	    continue;
+	}
+	(glBindVertexArray)(SharedVertexArray);
+	(glEnableVertexAttribArray)(0);
+	(glBindBuffer)(GL_ARRAY_BUFFER, Model->VertexBuffer);
+	(glVertexAttribPointer)(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	(glEnableVertexAttribArray)(1);
+	(glBindBuffer)(GL_ARRAY_BUFFER, Model->UVBuffer);
+	(glVertexAttribPointer)(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	(glEnableVertexAttribArray)(2);
+	(glBindBuffer)(GL_ARRAY_BUFFER, Model->NormalBuffer);
+	(glVertexAttribPointer)(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	(glBindBuffer)(GL_ELEMENT_ARRAY_BUFFER, Model->IndexBuffer);
+	(glDrawElementsInstanced)(GL_TRIANGLES, Model->IndexCount, GL_UNSIGNED_SHORT, (void*)0, 1);
+	(glDisableVertexAttribArray)(0);
+	(glDisableVertexAttribArray)(1);
+	(glDisableVertexAttribArray)(2);
+    }
+    return GetGameMilliseconds(Platform, Start);
+}
+
+// NOTE: CPU cost per draw of the box with and without its VAO, the best of
+// DRAW_BENCH_ROUNDS alternating rounds each. Calls go around the state
+// cache so both paths pay for every one, and the cache is invalidated
+// afterwards. The shared VAO is left to the context's teardown, as
+// glDeleteVertexArrays isn't loaded. Needs the platform's clock; the
+// headless --draw-bench runs it after the last frame.
+void BenchmarkModelDraws(platform_data *Platform, int32 DrawCount)
+{
+    game_data* Game = (game_data*)(((char*)Platform->MainMemory)+0);
+    model *Model = &Game->BoxModel;
+    if (!Platform->ReadClock || DrawCount <= 0)
+    {
+	return;
+    }
+
+    GLuint SharedVertexArray;
+    glGenVertexArrays(1, &SharedVertexArray);
+    (glUseProgram)(Game->DepthShader.Program);
+
+    float VertexArrayMilliseconds = FLT_MAX;
+    float AttributeMilliseconds = FLT_MAX;
+    for(int32 Round = 0; Round < DRAW_BENCH_ROUNDS; ++Round)
+    {
+	VertexArrayMilliseconds = Min(VertexArrayMilliseconds,
+				      TimeModelDraws(Platform, Model, SharedVertexArray, DrawCount, false));
+	AttributeMilliseconds = Min(AttributeMilliseconds,
+				    TimeModelDraws(Platform, Model, SharedVertexArray, DrawCount, true));
+    }
+    (glFinish)();
 
-    Update(Platform, Game);
-    Render(Platform, Game);
+    (glBindVertexArray)(0);
+    InvalidateGLStateCache();
+    printf("CPU per draw over %d draws: %.0f ns with the model's VAO, %.0f ns setting attributes per draw\n",
+	   DrawCount, 1000000.0f*VertexArrayMilliseconds / DrawCount, 1000000.0f*AttributeMilliseconds / DrawCount);
 }
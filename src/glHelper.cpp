@@ -3,6 +3,8 @@
 
 #include "matrixMath.cpp"
 
+#include <string.h>
+
 #if defined(LINUX)
 #define GL_GLEXT_PROTOTYPES
 #define GLX_GLXEXT_PROTOTYPES
@@ -18,9 +20,15 @@ void* GetGLFuncAddress(const char* name)
 #define GL_INVALID_FRAMEBUFFER_OPERATION  0x0506
 
 #define GL_MULTISAMPLE                    0x809D
+#define GL_CLIP_DISTANCE0                 0x3000
+#define GL_QUERY_RESULT                   0x8866
+#define GL_QUERY_RESULT_AVAILABLE         0x8867
+#define GL_TIMESTAMP                      0x8E28
 
 #define GL_BGR                            0x80E0
 #define GL_BGRA                           0x80E1
+#define GL_RG                             0x8227
+#define GL_HALF_FLOAT                     0x140B
 
 #define GL_TEXTURE_MAX_LEVEL              0x813D
 
@@ -46,6 +54,24 @@ void* GetGLFuncAddress(const char* name)
 #define GL_ELEMENT_ARRAY_BUFFER           0x8893
 
 #define GL_STATIC_DRAW                    0x88E4
+#define GL_STREAM_DRAW                    0x88E0
+
+#define GL_TEXTURE_BUFFER                 0x8C2A
+#define GL_R32UI                          0x8236
+#define GL_RG32UI                         0x823C
+#define GL_RGBA32F                        0x8814
+
+#define GL_CLAMP_TO_EDGE                  0x812F
+#define GL_TEXTURE_WRAP_R                 0x8072
+#define GL_TEXTURE_CUBE_MAP               0x8513
+#define GL_TEXTURE_CUBE_MAP_POSITIVE_X    0x8515
+#define GL_TEXTURE_CUBE_MAP_SEAMLESS      0x884F
+#define GL_TEXTURE_2D_ARRAY               0x8C1A
+#define GL_DEPTH_COMPONENT24              0x81A6
+#define GL_TEXTURE_COMPARE_MODE           0x884C
+#define GL_TEXTURE_COMPARE_FUNC           0x884D
+#define GL_COMPARE_REF_TO_TEXTURE         0x884E
+#define GL_DEPTH_CLAMP                    0x864F
 
 #define GL_TEXTURE0                       0x84C0
 #define GL_TEXTURE1                       0x84C1
@@ -137,6 +163,7 @@ void* GetGLFuncAddress(const char* name)
 #define WGL_SAMPLES_ARB                   0x2042
 
 #define GL_TEXTURE_2D_MULTISAMPLE         0x9100
+#define GL_MAX_SAMPLES                    0x8D57
 #define WGL_CONTEXT_PROFILE_MASK_ARB      0x9126
 #define WGL_CONTEXT_CORE_PROFILE_BIT_ARB  0x00000001
 
@@ -148,18 +175,56 @@ void* GetGLFuncAddress(const char* name)
 typedef ptrdiff_t GLsizeiptr;
 typedef ptrdiff_t GLintptr;
 typedef char GLchar;
+typedef __int64 GLint64;
+typedef unsigned __int64 GLuint64;
+
+void *GetGLFuncAddress(const char *name)
+{
+    void *p = (void *)wglGetProcAddress(name);
+    if (p == 0 ||
+       (p == (void*)0x1) || (p == (void*)0x2) || (p == (void*)0x3) ||
+       (p == (void*)-1))
+    {
+	HMODULE module = LoadLibraryA("opengl32.dll");
+	p = (void *)GetProcAddress(module, name);
+    }
 
+    return p;
+}
+
+/*The Pain*/
+typedef HGLRC GLDECL CreateContextAttribsARBGLProc (HDC hDC, HGLRC hShareContext, const int *attribList);
+static CreateContextAttribsARBGLProc *wglCreateContextAttribsARB;
+
+typedef BOOL GLDECL ChoosePixelFormatARBGLProc (HDC hdc, const int *piAttribIList, const FLOAT *pfAttribFList, UINT nMaxFormats, int *piFormats, UINT *nNumFormats);
+static ChoosePixelFormatARBGLProc *wglChoosePixelFormatARB;
+
+void LoadWGLBullshit()
+{
+    wglCreateContextAttribsARB = (CreateContextAttribsARBGLProc*)GetGLFuncAddress("wglCreateContextAttribsARB");
+    wglChoosePixelFormatARB = (ChoosePixelFormatARBGLProc*)GetGLFuncAddress("wglChoosePixelFormatARB");
+}
+#endif
+
+// NOTE: Entry points past GL 1.1; Windows loads these by hand.
 #define GLExtensionList \
     GLE(GLint, GetUniformLocation, GLuint program, const GLchar *name) \
     GLE(void, Uniform1i, GLint location, GLint v0) \
     GLE(void, Uniform1f, GLint location, GLfloat v0) \
+    GLE(void, Uniform2f, GLint location, GLfloat v0, GLfloat v1) \
+    GLE(void, Uniform3i, GLint location, GLint v0, GLint v1, GLint v2) \
     GLE(void, Uniform3f, GLint location, GLfloat v0, GLfloat v1, GLfloat v2) \
     GLE(void, Uniform4f, GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) \
+    GLE(void, Uniform1iv, GLint location, GLsizei count, const GLint *value) \
+    GLE(void, Uniform1fv, GLint location, GLsizei count, const GLfloat *value) \
+    GLE(void, Uniform3fv, GLint location, GLsizei count, const GLfloat *value) \
+    GLE(void, Uniform4fv, GLint location, GLsizei count, const GLfloat *value) \
     GLE(void, UniformMatrix4fv, GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) \
     GLE(void, CompressedTexImage2D, GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data) \
     GLE(void, TexImage2DMultisample, GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLboolean fixedsamplelocations) \
     GLE(void, TextureParameteri, GLuint texture, GLenum pname, GLint param) \
     GLE(void, GenerateMipmap, GLenum target) \
+    GLE(void, TexBuffer, GLenum target, GLenum internalformat, GLuint buffer) \
     GLE(GLuint, CreateShader, GLenum type) \
     GLE(void, DeleteShader, GLuint shader) \
     GLE(void, ShaderSource, GLuint shader, GLsizei count, const GLchar *const*string, const GLint *length) \
@@ -186,44 +251,56 @@ typedef char GLchar;
     GLE(void, ActiveTexture, GLenum texture) \
     GLE(void, GenFramebuffers, GLsizei n, GLuint *framebuffers) \
     GLE(void, FramebufferTexture2D, GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) \
+    GLE(void, FramebufferTextureLayer, GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer) \
+    GLE(void, TexImage3D, GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels) \
     GLE(GLenum, CheckFramebufferStatus, GLenum target) \
     GLE(void, BindFramebuffer, GLenum target, GLuint framebuffer) \
     GLE(void, DeleteFramebuffers, GLsizei n, const GLuint *framebuffers) \
     GLE(void, GenRenderbuffers, GLsizei n, GLuint *renderbuffers) \
     GLE(void, BindRenderbuffer, GLenum target, GLuint renderbuffer) \
     GLE(void, DeleteRenderbuffers, GLsizei n, const GLuint *renderbuffers) \
+    GLE(void, RenderbufferStorage, GLenum target, GLenum internalformat, GLsizei width, GLsizei height) \
     GLE(void, RenderbufferStorageMultisample, GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height) \
     GLE(void, FramebufferRenderbuffer, GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) \
-    GLE(void, BlitFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
-
-void *GetGLFuncAddress(const char *name)
-{
-    void *p = (void *)wglGetProcAddress(name);
-    if (p == 0 ||
-       (p == (void*)0x1) || (p == (void*)0x2) || (p == (void*)0x3) ||
-       (p == (void*)-1))
-    {
-	HMODULE module = LoadLibraryA("opengl32.dll");
-	p = (void *)GetProcAddress(module, name);
-    }
-
-    return p;
-}
-
-/*The Pain*/
-typedef HGLRC GLDECL CreateContextAttribsARBGLProc (HDC hDC, HGLRC hShareContext, const int *attribList);
-static CreateContextAttribsARBGLProc *wglCreateContextAttribsARB;
-
-typedef BOOL GLDECL ChoosePixelFormatARBGLProc (HDC hdc, const int *piAttribIList, const FLOAT *pfAttribFList, UINT nMaxFormats, int *piFormats, UINT *nNumFormats);
-static ChoosePixelFormatARBGLProc *wglChoosePixelFormatARB;
-
-void LoadWGLBullshit()
-{
-    wglCreateContextAttribsARB = (CreateContextAttribsARBGLProc*)GetGLFuncAddress("wglCreateContextAttribsARB");
-    wglChoosePixelFormatARB = (ChoosePixelFormatARBGLProc*)GetGLFuncAddress("wglChoosePixelFormatARB");
-}
-#endif
-
+    GLE(void, InvalidateFramebuffer, GLenum target, GLsizei numAttachments, const GLenum *attachments) \
+    GLE(void, BlitFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) \
+    GLE(void, DrawElementsInstanced, GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount) \
+    GLE(void, GenQueries, GLsizei n, GLuint *ids) \
+    GLE(void, QueryCounter, GLuint id, GLenum target) \
+    GLE(void, GetQueryObjectiv, GLuint id, GLenum pname, GLint *params) \
+    GLE(void, GetQueryObjectui64v, GLuint id, GLenum pname, GLuint64 *params) \
+    GLE(void, GetInteger64v, GLenum pname, GLint64 *data)
+
+// NOTE: GL 1.1 entry points, which opengl32.dll and libGL export directly so
+// they are never loaded. Listed so GL_TRACE builds wrap them like the rest.
+#define GLCoreList \
+    GLE(void, BindTexture, GLenum target, GLuint texture) \
+    GLE(void, GenTextures, GLsizei n, GLuint *textures) \
+    GLE(void, TexParameteri, GLenum target, GLenum pname, GLint param) \
+    GLE(void, TexImage2D, GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) \
+    GLE(void, Enable, GLenum cap) \
+    GLE(void, Disable, GLenum cap) \
+    GLE(void, Viewport, GLint x, GLint y, GLsizei width, GLsizei height) \
+    GLE(void, Scissor, GLint x, GLint y, GLsizei width, GLsizei height) \
+    GLE(void, GetIntegerv, GLenum pname, GLint *data) \
+    GLE(void, DepthFunc, GLenum func) \
+    GLE(void, DepthMask, GLboolean flag) \
+    GLE(void, ColorMask, GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) \
+    GLE(void, FrontFace, GLenum mode) \
+    GLE(void, PolygonMode, GLenum face, GLenum mode) \
+    GLE(void, PolygonOffset, GLfloat factor, GLfloat units) \
+    GLE(void, ClearColor, GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) \
+    GLE(void, Clear, GLbitfield mask) \
+    GLE(void, DrawArrays, GLenum mode, GLint first, GLsizei count) \
+    GLE(void, ReadBuffer, GLenum src) \
+    GLE(void, DrawBuffer, GLenum buf) \
+    GLE(void, ReadPixels, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels) \
+    GLE(void, Finish) \
+    GLE(void, Flush)
+
+// NOTE: Only Windows loads entry points by hand; on Linux GL_GLEXT_PROTOTYPES
+// already declares everything and libGL resolves it.
+#if defined(WINDOWS)
 #define GLE(retType, procName, ...) typedef retType GLDECL procName##GLProc(__VA_ARGS__); static procName##GLProc * gl##procName;
 GLExtensionList
 
@@ -235,8 +312,12 @@ GLE(GLubyte*, GetStringi, GLenum name, GLuint index)
 static void LoadGLExtensions()
 {
     GLExtensionList
-#undef GLExtensionList
 }
+#else
+static void LoadGLExtensions()
+{
+}
+#endif
 
 static void PrintGLVersion()
 {
@@ -247,7 +328,9 @@ static void PrintGLVersion()
 }
 static void PrintAvailableGLExtensions()
 {   
+#if defined(WINDOWS)
     GLE(Glubyte*, GetStringi, GLenum name, GLuint index);
+#endif
     int numGLExtensions;
     glGetIntegerv(GL_NUM_EXTENSIONS, &numGLExtensions);
     printf("%d\n", numGLExtensions);
@@ -256,8 +339,32 @@ static void PrintAvailableGLExtensions()
 	printf("%s\n", glGetStringi(GL_EXTENSIONS, i));
     }
 }
+
+// NOTE: Whether the context lists Name among its extensions.
+static bool HasGLExtension(const char *Name)
+{
+    int ExtensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &ExtensionCount);
+    for(int ExtensionIndex = 0; ExtensionIndex < ExtensionCount; ++ExtensionIndex)
+    {
+	if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, ExtensionIndex), Name) == 0)
+	{
+	    return true;
+	}
+    }
+    return false;
+}
+#if defined(WINDOWS)
 #undef GLE
+#endif
+
+// NOTE: Everything from here on, and every file including this one, goes
+// through the state cache, and in GL_TRACE builds the tracer.
+#include "glTrace.cpp"
+#include "glStateCache.cpp"
 
+// NOTE: Samples is 0 when the render target isn't multisampled; it's still
+// a separate texture from the resolve target, which the resolve copies into.
 struct FramebufferDesc
 {
     GLuint DepthBufferId;
@@ -265,8 +372,71 @@ struct FramebufferDesc
     GLuint RenderFramebufferId;
     GLuint ResolveTextureId;
     GLuint ResolveFramebufferId;
+    int Samples;
 };
 
+// NOTE: Samples is clamped to what the driver supports; under 2 means no MSAA.
+bool CreateFramebuffer(int Width, int Height, int Samples, FramebufferDesc *BufferDesc)
+{
+    GLint MaxSamples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &MaxSamples);
+    if (Samples > MaxSamples)
+    {
+	Samples = MaxSamples;
+    }
+    if (Samples < 2)
+    {
+	Samples = 0;
+    }
+    BufferDesc->Samples = Samples;
+    
+    glGenFramebuffers(1, &BufferDesc->RenderFramebufferId);
+    glBindFramebuffer(GL_FRAMEBUFFER, BufferDesc->RenderFramebufferId);
+    glGenRenderbuffers(1, &BufferDesc->DepthBufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, BufferDesc->DepthBufferId);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, Samples, GL_DEPTH_COMPONENT, Width, Height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, BufferDesc->DepthBufferId);
+    
+    glGenTextures(1, &BufferDesc->RenderTextureId);
+    if (Samples)
+    {
+	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, BufferDesc->RenderTextureId);
+	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, Samples, GL_RGBA8, Width, Height, 1);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, BufferDesc->RenderTextureId, 0);
+    }
+    else
+    {
+	glBindTexture(GL_TEXTURE_2D, BufferDesc->RenderTextureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, BufferDesc->RenderTextureId, 0);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+	return false;
+    }
+
+    glGenFramebuffers(1, &BufferDesc->ResolveFramebufferId);
+    glBindFramebuffer(GL_FRAMEBUFFER, BufferDesc->ResolveFramebufferId);
+    glGenTextures(1, &BufferDesc->ResolveTextureId);
+    glBindTexture(GL_TEXTURE_2D, BufferDesc->ResolveTextureId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, BufferDesc->ResolveTextureId, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+	return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+    return true;
+}
+
 void glUniformVec3f(GLuint location, v3 vec)
 {
     glUniform3f(location, vec.x, vec.y, vec.z);
@@ -0,0 +1,632 @@
+#ifndef GLREPLAY_CPP__
+#define GLREPLAY_CPP__
+
+#include "platform.h"
+#include "frameTiming.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOTE: Plays back a trace written by a GL_TRACE build (see glTrace.cpp) on
+// the current context, with nothing of the game running, so the GL side of a
+// frame can be timed and profiled on its own. Calls are made as (glName)(...)
+// so neither the state cache nor the tracer sees them.
+//
+// Neither object names nor uniform locations are remapped: a fresh context
+// handing out names in the same order as the recording one, and the driver
+// assigning the same locations, is what makes the arguments line up. That
+// means replaying on the driver the trace was recorded on. Every Gen* call is
+// checked against the names it generated when recorded, and the replay says
+// so when they differ. Records whose argument count or payload size doesn't
+// add up, or that would overrun the replay's fixed arrays, are rejected and
+// counted rather than made.
+
+#define GL_REPLAY_MAX_NAMES 64
+#define GL_REPLAY_MAX_SOURCES 16
+#define GL_REPLAY_MAX_IMAGE_SIZE 16384
+
+struct gl_replay
+{
+    GLuint Names[GL_REPLAY_MAX_NAMES];
+    // NOTE: Where Get* calls write; nothing reads it.
+    GLint64 Scratch[16];
+    GLubyte *Pixels;
+    GLuint PixelBytes;
+
+    GLuint Calls;
+    GLuint SkippedCalls;
+    GLuint RejectedCalls;
+    GLuint NameMismatches;
+};
+
+inline GLfloat GetReplayFloat(GLuint64 Bits)
+{
+    GLuint Word = (GLuint)Bits;
+    GLfloat Result;
+    memcpy(&Result, &Word, sizeof(Result));
+    return Result;
+}
+
+// NOTE: How many arguments each function's records carry, counted off the
+// parameter list the function is declared with.
+template<typename Result, typename... Params>
+constexpr GLubyte GetReplayArgCount(Result (*)(Params...))
+{
+    return (GLubyte)sizeof...(Params);
+}
+
+const GLubyte GLReplayArgCounts[GLTrace_Count] =
+{
+#define GLE(retType, procName, ...) GetReplayArgCount((retType (*)(__VA_ARGS__))0),
+    GLExtensionList
+    GLCoreList
+#undef GLE
+};
+
+// NOTE: Only for counts IsReplayRecordValid let through.
+GLuint *GetReplayNames(gl_replay *Replay, GLuint64 Count)
+{
+    Assert(Count <= GL_REPLAY_MAX_NAMES);
+    return Replay->Names;
+}
+
+// NOTE: Whether a payload holds exactly Count elements. Count is compared
+// first so a made up one can't overflow the multiply.
+inline bool IsReplayPayloadSize(GLuint PayloadBytes, GLuint64 Count, GLuint64 ElementBytes)
+{
+    return (Count <= PayloadBytes && Count*ElementBytes == PayloadBytes);
+}
+
+// NOTE: GetGLPixelBytes in 64 bits, or ~0 past GL_REPLAY_MAX_IMAGE_SIZE,
+// which no payload can match.
+GLuint64 GetReplayPixelBytes(GLuint64 Format, GLuint64 Type, GLuint64 Width, GLuint64 Height, GLuint64 Depth)
+{
+    if (Width > GL_REPLAY_MAX_IMAGE_SIZE || Height > GL_REPLAY_MAX_IMAGE_SIZE ||
+	Depth > GL_REPLAY_MAX_IMAGE_SIZE)
+    {
+	return ~(GLuint64)0;
+    }
+    GLuint64 RowBytes = GetGLPixelBytes((GLenum)Format, (GLenum)Type, (GLsizei)Width, 1, 1);
+    return RowBytes*Height*Depth;
+}
+
+// NOTE: Splits a ShaderSource payload into its strings. False if a length
+// runs past the payload or the strings don't fill it.
+bool GetReplaySources(const GLuint64 *Args, const GLubyte *Payload, GLuint PayloadBytes,
+		      const GLchar **Strings, GLint *Lengths)
+{
+    if (Args[1] > GL_REPLAY_MAX_SOURCES)
+    {
+	return false;
+    }
+    GLuint At = 0;
+    for(GLuint Index = 0; Index < (GLuint)Args[1]; ++Index)
+    {
+	GLuint Length;
+	if (PayloadBytes - At < sizeof(Length))
+	{
+	    return false;
+	}
+	memcpy(&Length, Payload + At, sizeof(Length));
+	At += sizeof(Length);
+	if (Length > PayloadBytes - At || Length > 0x7FFFFFFF)
+	{
+	    return false;
+	}
+	Strings[Index] = (const GLchar *)(Payload + At);
+	Lengths[Index] = (GLint)Length;
+	At += Length;
+    }
+    return (At == PayloadBytes);
+}
+
+// NOTE: False for a record whose argument count isn't its function's, whose
+// payload isn't the size its arguments say, or with more names, shader
+// strings or pixels than the replay has room for. Every pointer the replay
+// hands GL points into a payload this checked.
+bool IsReplayRecordValid(int Function, const GLuint64 *Args, GLuint ArgCount,
+			 const GLubyte *Payload, GLuint PayloadBytes)
+{
+    if (Function < 0)
+    {
+	return true;
+    }
+    if (ArgCount != GLReplayArgCounts[Function])
+    {
+	return false;
+    }
+    switch(Function)
+    {
+    case GLTrace_GetUniformLocation:
+	return (PayloadBytes > 0 && Payload[PayloadBytes - 1] == 0);
+    case GLTrace_Uniform1iv:
+    case GLTrace_Uniform1fv:
+	return IsReplayPayloadSize(PayloadBytes, Args[1], 4);
+    case GLTrace_Uniform3fv:
+	return IsReplayPayloadSize(PayloadBytes, Args[1], 12);
+    case GLTrace_Uniform4fv:
+	return IsReplayPayloadSize(PayloadBytes, Args[1], 16);
+    case GLTrace_UniformMatrix4fv:
+	return IsReplayPayloadSize(PayloadBytes, Args[1], 64);
+    case GLTrace_GenVertexArrays:
+    case GLTrace_GenBuffers:
+    case GLTrace_GenFramebuffers:
+    case GLTrace_GenRenderbuffers:
+    case GLTrace_GenQueries:
+    case GLTrace_GenTextures:
+	return (Args[0] <= GL_REPLAY_MAX_NAMES &&
+		IsReplayPayloadSize(PayloadBytes, Args[0], sizeof(GLuint)));
+    case GLTrace_DeleteBuffers:
+    case GLTrace_DeleteFramebuffers:
+    case GLTrace_DeleteRenderbuffers:
+	return IsReplayPayloadSize(PayloadBytes, Args[0], sizeof(GLuint));
+    case GLTrace_InvalidateFramebuffer:
+	return IsReplayPayloadSize(PayloadBytes, Args[1], sizeof(GLenum));
+    case GLTrace_ShaderSource:
+    {
+	const GLchar *Strings[GL_REPLAY_MAX_SOURCES];
+	GLint Lengths[GL_REPLAY_MAX_SOURCES];
+	return GetReplaySources(Args, Payload, PayloadBytes, Strings, Lengths);
+    }
+    // NOTE: No payload means the data pointer was null, or an offset into
+    // a bound buffer; GL reads nothing of ours either way.
+    case GLTrace_BufferData:
+	return (PayloadBytes == 0 || PayloadBytes == Args[1]);
+    case GLTrace_CompressedTexImage2D:
+	return (PayloadBytes == 0 || PayloadBytes == Args[6]);
+    case GLTrace_TexImage2D:
+	return (PayloadBytes == 0 ||
+		PayloadBytes == GetReplayPixelBytes(Args[6], Args[7], Args[3], Args[4], 1));
+    case GLTrace_TexImage3D:
+	return (PayloadBytes == 0 ||
+		PayloadBytes == GetReplayPixelBytes(Args[7], Args[8], Args[3], Args[4], Args[5]));
+    case GLTrace_ReadPixels:
+	return (GetReplayPixelBytes(Args[4], Args[5], Args[2], Args[3], 1) <= 0xFFFFFFFF);
+    }
+    return true;
+}
+
+void CheckReplayNames(gl_replay *Replay, GLuint64 Count, const GLubyte *Payload, GLuint PayloadBytes)
+{
+    if (!IsReplayPayloadSize(PayloadBytes, Count, sizeof(GLuint)) ||
+	memcmp(Replay->Names, Payload, PayloadBytes) != 0)
+    {
+	++Replay->NameMismatches;
+    }
+}
+
+void ReplayShaderSource(const GLuint64 *Args, const GLubyte *Payload, GLuint PayloadBytes)
+{
+    const GLchar *Strings[GL_REPLAY_MAX_SOURCES];
+    GLint Lengths[GL_REPLAY_MAX_SOURCES];
+    bool Valid = GetReplaySources(Args, Payload, PayloadBytes, Strings, Lengths);
+    Assert(Valid);
+    (void)Valid;
+    (glShaderSource)((GLuint)Args[0], (GLsizei)Args[1], Strings, Lengths);
+}
+
+void ReplayGLCall(gl_replay *Replay, int Function, const GLuint64 *Args,
+		  const GLubyte *Payload, GLuint PayloadBytes)
+{
+    const void *Data = PayloadBytes ? Payload : 0;
+    switch(Function)
+    {
+    case GLTrace_GetUniformLocation:
+	(glGetUniformLocation)((GLuint)Args[0], (const GLchar *)Payload);
+	break;
+    case GLTrace_Uniform1i:
+	(glUniform1i)((GLint)Args[0], (GLint)Args[1]);
+	break;
+    case GLTrace_Uniform1f:
+	(glUniform1f)((GLint)Args[0], GetReplayFloat(Args[1]));
+	break;
+    case GLTrace_Uniform2f:
+	(glUniform2f)((GLint)Args[0], GetReplayFloat(Args[1]), GetReplayFloat(Args[2]));
+	break;
+    case GLTrace_Uniform3i:
+	(glUniform3i)((GLint)Args[0], (GLint)Args[1], (GLint)Args[2], (GLint)Args[3]);
+	break;
+    case GLTrace_Uniform3f:
+	(glUniform3f)((GLint)Args[0], GetReplayFloat(Args[1]), GetReplayFloat(Args[2]), GetReplayFloat(Args[3]));
+	break;
+    case GLTrace_Uniform4f:
+	(glUniform4f)((GLint)Args[0], GetReplayFloat(Args[1]), GetReplayFloat(Args[2]),
+		      GetReplayFloat(Args[3]), GetReplayFloat(Args[4]));
+	break;
+    case GLTrace_Uniform1iv:
+	(glUniform1iv)((GLint)Args[0], (GLsizei)Args[1], (const GLint *)Payload);
+	break;
+    case GLTrace_Uniform1fv:
+	(glUniform1fv)((GLint)Args[0], (GLsizei)Args[1], (const GLfloat *)Payload);
+	break;
+    case GLTrace_Uniform3fv:
+	(glUniform3fv)((GLint)Args[0], (GLsizei)Args[1], (const GLfloat *)Payload);
+	break;
+    case GLTrace_Uniform4fv:
+	(glUniform4fv)((GLint)Args[0], (GLsizei)Args[1], (const GLfloat *)Payload);
+	break;
+    case GLTrace_UniformMatrix4fv:
+	(glUniformMatrix4fv)((GLint)Args[0], (GLsizei)Args[1], (GLboolean)Args[2], (const GLfloat *)Payload);
+	break;
+    case GLTrace_CompressedTexImage2D:
+	(glCompressedTexImage2D)((GLenum)Args[0], (GLint)Args[1], (GLenum)Args[2], (GLsizei)Args[3],
+				 (GLsizei)Args[4], (GLint)Args[5], (GLsizei)Args[6], Data);
+	break;
+    case GLTrace_TexImage2DMultisample:
+	(glTexImage2DMultisample)((GLenum)Args[0], (GLsizei)Args[1], (GLenum)Args[2], (GLsizei)Args[3],
+				  (GLsizei)Args[4], (GLboolean)Args[5]);
+	break;
+    case GLTrace_TextureParameteri:
+	(glTextureParameteri)((GLuint)Args[0], (GLenum)Args[1], (GLint)Args[2]);
+	break;
+    case GLTrace_GenerateMipmap:
+	(glGenerateMipmap)((GLenum)Args[0]);
+	break;
+    case GLTrace_TexBuffer:
+	(glTexBuffer)((GLenum)Args[0], (GLenum)Args[1], (GLuint)Args[2]);
+	break;
+    case GLTrace_CreateShader:
+	(glCreateShader)((GLenum)Args[0]);
+	break;
+    case GLTrace_DeleteShader:
+	(glDeleteShader)((GLuint)Args[0]);
+	break;
+    case GLTrace_ShaderSource:
+	ReplayShaderSource(Args, Payload, PayloadBytes);
+	break;
+    case GLTrace_CompileShader:
+	(glCompileShader)((GLuint)Args[0]);
+	break;
+    case GLTrace_AttachShader:
+	(glAttachShader)((GLuint)Args[0], (GLuint)Args[1]);
+	break;
+    case GLTrace_DetachShader:
+	(glDetachShader)((GLuint)Args[0], (GLuint)Args[1]);
+	break;
+    case GLTrace_GetShaderiv:
+	(glGetShaderiv)((GLuint)Args[0], (GLenum)Args[1], (GLint *)Replay->Scratch);
+	break;
+    case GLTrace_CreateProgram:
+	(glCreateProgram)();
+	break;
+    case GLTrace_DeleteProgram:
+	(glDeleteProgram)((GLuint)Args[0]);
+	break;
+    case GLTrace_LinkProgram:
+	(glLinkProgram)((GLuint)Args[0]);
+	break;
+    case GLTrace_GetProgramiv:
+	(glGetProgramiv)((GLuint)Args[0], (GLenum)Args[1], (GLint *)Replay->Scratch);
+	break;
+    case GLTrace_UseProgram:
+	(glUseProgram)((GLuint)Args[0]);
+	break;
+    case GLTrace_GenVertexArrays:
+	(glGenVertexArrays)((GLsizei)Args[0], GetReplayNames(Replay, Args[0]));
+	CheckReplayNames(Replay, Args[0], Payload, PayloadBytes);
+	break;
+    case GLTrace_BindVertexArray:
+	(glBindVertexArray)((GLuint)Args[0]);
+	break;
+    case GLTrace_EnableVertexAttribArray:
+	(glEnableVertexAttribArray)((GLuint)Args[0]);
+	break;
+    case GLTrace_DisableVertexAttribArray:
+	(glDisableVertexAttribArray)((GLuint)Args[0]);
+	break;
+    case GLTrace_GenBuffers:
+	(glGenBuffers)((GLsizei)Args[0], GetReplayNames(Replay, Args[0]));
+	CheckReplayNames(Replay, Args[0], Payload, PayloadBytes);
+	break;
+    case GLTrace_BindBuffer:
+	(glBindBuffer)((GLenum)Args[0], (GLuint)Args[1]);
+	break;
+    case GLTrace_DeleteBuffers:
+	(glDeleteBuffers)((GLsizei)Args[0], (const GLuint *)Payload);
+	break;
+    case GLTrace_BufferData:
+	(glBufferData)((GLenum)Args[0], (GLsizeiptr)Args[1], Data, (GLenum)Args[3]);
+	break;
+    case GLTrace_VertexAttribPointer:
+	// NOTE: The pointer is an offset into the bound buffer.
+	(glVertexAttribPointer)((GLuint)Args[0], (GLint)Args[1], (GLenum)Args[2], (GLboolean)Args[3],
+				(GLsizei)Args[4], (const void *)Args[5]);
+	break;
+    case GLTrace_ActiveTexture:
+	(glActiveTexture)((GLenum)Args[0]);
+	break;
+    case GLTrace_GenFramebuffers:
+	(glGenFramebuffers)((GLsizei)Args[0], GetReplayNames(Replay, Args[0]));
+	CheckReplayNames(Replay, Args[0], Payload, PayloadBytes);
+	break;
+    case GLTrace_FramebufferTexture2D:
+	(glFramebufferTexture2D)((GLenum)Args[0], (GLenum)Args[1], (GLenum)Args[2], (GLuint)Args[3], (GLint)Args[4]);
+	break;
+    case GLTrace_FramebufferTextureLayer:
+	(glFramebufferTextureLayer)((GLenum)Args[0], (GLenum)Args[1], (GLuint)Args[2], (GLint)Args[3], (GLint)Args[4]);
+	break;
+    case GLTrace_TexImage3D:
+	(glTexImage3D)((GLenum)Args[0], (GLint)Args[1], (GLint)Args[2], (GLsizei)Args[3], (GLsizei)Args[4],
+		       (GLsizei)Args[5], (GLint)Args[6], (GLenum)Args[7], (GLenum)Args[8], Data);
+	break;
+    case GLTrace_CheckFramebufferStatus:
+	(glCheckFramebufferStatus)((GLenum)Args[0]);
+	break;
+    case GLTrace_BindFramebuffer:
+	(glBindFramebuffer)((GLenum)Args[0], (GLuint)Args[1]);
+	break;
+    case GLTrace_DeleteFramebuffers:
+	(glDeleteFramebuffers)((GLsizei)Args[0], (const GLuint *)Payload);
+	break;
+    case GLTrace_GenRenderbuffers:
+	(glGenRenderbuffers)((GLsizei)Args[0], GetReplayNames(Replay, Args[0]));
+	CheckReplayNames(Replay, Args[0], Payload, PayloadBytes);
+	break;
+    case GLTrace_BindRenderbuffer:
+	(glBindRenderbuffer)((GLenum)Args[0], (GLuint)Args[1]);
+	break;
+    case GLTrace_DeleteRenderbuffers:
+	(glDeleteRenderbuffers)((GLsizei)Args[0], (const GLuint *)Payload);
+	break;
+    case GLTrace_RenderbufferStorage:
+	(glRenderbufferStorage)((GLenum)Args[0], (GLenum)Args[1], (GLsizei)Args[2], (GLsizei)Args[3]);
+	break;
+    case GLTrace_RenderbufferStorageMultisample:
+	(glRenderbufferStorageMultisample)((GLenum)Args[0], (GLsizei)Args[1], (GLenum)Args[2],
+					   (GLsizei)Args[3], (GLsizei)Args[4]);
+	break;
+    case GLTrace_FramebufferRenderbuffer:
+	(glFramebufferRenderbuffer)((GLenum)Args[0], (GLenum)Args[1], (GLenum)Args[2], (GLuint)Args[3]);
+	break;
+    case GLTrace_InvalidateFramebuffer:
+	(glInvalidateFramebuffer)((GLenum)Args[0], (GLsizei)Args[1], (const GLenum *)Payload);
+	break;
+    case GLTrace_BlitFramebuffer:
+	(glBlitFramebuffer)((GLint)Args[0], (GLint)Args[1], (GLint)Args[2], (GLint)Args[3],
+			    (GLint)Args[4], (GLint)Args[5], (GLint)Args[6], (GLint)Args[7],
+			    (GLbitfield)Args[8], (GLenum)Args[9]);
+	break;
+    case GLTrace_DrawElementsInstanced:
+	// NOTE: The indices pointer is an offset into the element buffer.
+	(glDrawElementsInstanced)((GLenum)Args[0], (GLsizei)Args[1], (GLenum)Args[2],
+				  (const void *)Args[3], (GLsizei)Args[4]);
+	break;
+    case GLTrace_GenQueries:
+	(glGenQueries)((GLsizei)Args[0], GetReplayNames(Replay, Args[0]));
+	CheckReplayNames(Replay, Args[0], Payload, PayloadBytes);
+	break;
+    case GLTrace_QueryCounter:
+	(glQueryCounter)((GLuint)Args[0], (GLenum)Args[1]);
+	break;
+    case GLTrace_GetQueryObjectiv:
+	(glGetQueryObjectiv)((GLuint)Args[0], (GLenum)Args[1], (GLint *)Replay->Scratch);
+	break;
+    case GLTrace_GetQueryObjectui64v:
+	(glGetQueryObjectui64v)((GLuint)Args[0], (GLenum)Args[1], (GLuint64 *)Replay->Scratch);
+	break;
+    case GLTrace_GetInteger64v:
+	(glGetInteger64v)((GLenum)Args[0], Replay->Scratch);
+	break;
+    case GLTrace_BindTexture:
+	(glBindTexture)((GLenum)Args[0], (GLuint)Args[1]);
+	break;
+    case GLTrace_GenTextures:
+	(glGenTextures)((GLsizei)Args[0], GetReplayNames(Replay, Args[0]));
+	CheckReplayNames(Replay, Args[0], Payload, PayloadBytes);
+	break;
+    case GLTrace_TexParameteri:
+	(glTexParameteri)((GLenum)Args[0], (GLenum)Args[1], (GLint)Args[2]);
+	break;
+    case GLTrace_TexImage2D:
+	(glTexImage2D)((GLenum)Args[0], (GLint)Args[1], (GLint)Args[2], (GLsizei)Args[3], (GLsizei)Args[4],
+		       (GLint)Args[5], (GLenum)Args[6], (GLenum)Args[7], Data);
+	break;
+    case GLTrace_Enable:
+	(glEnable)((GLenum)Args[0]);
+	break;
+    case GLTrace_Disable:
+	(glDisable)((GLenum)Args[0]);
+	break;
+    case GLTrace_Viewport:
+	(glViewport)((GLint)Args[0], (GLint)Args[1], (GLsizei)Args[2], (GLsizei)Args[3]);
+	break;
+    case GLTrace_Scissor:
+	(glScissor)((GLint)Args[0], (GLint)Args[1], (GLsizei)Args[2], (GLsizei)Args[3]);
+	break;
+    case GLTrace_GetIntegerv:
+	(glGetIntegerv)((GLenum)Args[0], (GLint *)Replay->Scratch);
+	break;
+    case GLTrace_DepthFunc:
+	(glDepthFunc)((GLenum)Args[0]);
+	break;
+    case GLTrace_DepthMask:
+	(glDepthMask)((GLboolean)Args[0]);
+	break;
+    case GLTrace_ColorMask:
+	(glColorMask)((GLboolean)Args[0], (GLboolean)Args[1], (GLboolean)Args[2], (GLboolean)Args[3]);
+	break;
+    case GLTrace_FrontFace:
+	(glFrontFace)((GLenum)Args[0]);
+	break;
+    case GLTrace_PolygonMode:
+	(glPolygonMode)((GLenum)Args[0], (GLenum)Args[1]);
+	break;
+    case GLTrace_PolygonOffset:
+	(glPolygonOffset)(GetReplayFloat(Args[0]), GetReplayFloat(Args[1]));
+	break;
+    case GLTrace_ClearColor:
+	(glClearColor)(GetReplayFloat(Args[0]), GetReplayFloat(Args[1]),
+		       GetReplayFloat(Args[2]), GetReplayFloat(Args[3]));
+	break;
+    case GLTrace_Clear:
+	(glClear)((GLbitfield)Args[0]);
+	break;
+    case GLTrace_DrawArrays:
+	(glDrawArrays)((GLenum)Args[0], (GLint)Args[1], (GLsizei)Args[2]);
+	break;
+    case GLTrace_ReadBuffer:
+	(glReadBuffer)((GLenum)Args[0]);
+	break;
+    case GLTrace_DrawBuffer:
+	(glDrawBuffer)((GLenum)Args[0]);
+	break;
+    case GLTrace_ReadPixels:
+    {
+	GLuint Bytes = (GLuint)GetReplayPixelBytes(Args[4], Args[5], Args[2], Args[3], 1);
+	if (Bytes > Replay->PixelBytes)
+	{
+	    free(Replay->Pixels);
+	    Replay->Pixels = (GLubyte *)malloc(Bytes);
+	    Replay->PixelBytes = Bytes;
+	}
+	(glReadPixels)((GLint)Args[0], (GLint)Args[1], (GLsizei)Args[2], (GLsizei)Args[3],
+		       (GLenum)Args[4], (GLenum)Args[5], Replay->Pixels);
+    } break;
+    case GLTrace_Finish:
+	(glFinish)();
+	break;
+    case GLTrace_Flush:
+	(glFlush)();
+	break;
+    default:
+	// NOTE: Info logs change nothing, and functions this build doesn't
+	// know can't be made.
+	++Replay->SkippedCalls;
+	return;
+    }
+    ++Replay->Calls;
+}
+
+// NOTE: The first frame (from the start of the trace to its second frame
+// marker) holds the context setup and Init and is reported on its own, like
+// the headless run does.
+bool ReplayGLTrace(const char *Path)
+{
+    FILE *File = fopen(Path, "rb");
+    if (!File)
+    {
+	printf("Can't open GL trace %s\n", Path);
+	return false;
+    }
+    fseek(File, 0, SEEK_END);
+    size_t Size = (size_t)ftell(File);
+    fseek(File, 0, SEEK_SET);
+    GLubyte *Trace = (GLubyte *)malloc(Size);
+    bool Read = (fread(Trace, 1, Size, File) == Size);
+    fclose(File);
+
+    gl_trace_file_header *Header = (gl_trace_file_header *)Trace;
+    if (!Read || Size < sizeof(*Header) ||
+	Header->Magic != GL_TRACE_MAGIC || Header->Version != GL_TRACE_VERSION)
+    {
+	printf("%s is not a GL trace\n", Path);
+	free(Trace);
+	return false;
+    }
+
+    // NOTE: The trace's function numbers to this build's, by name.
+    int *Functions = (int *)malloc(Header->FunctionCount*sizeof(int));
+    const char *Name = (const char *)(Header + 1);
+    for(GLuint TraceFunction = 0; TraceFunction < Header->FunctionCount; ++TraceFunction)
+    {
+	Functions[TraceFunction] = -1;
+	for(int Function = 0; Function < GLTrace_Count; ++Function)
+	{
+	    if (strcmp(Name, GLTraceNames[Function]) == 0)
+	    {
+		Functions[TraceFunction] = Function;
+		break;
+	    }
+	}
+	Name += strlen(Name) + 1;
+    }
+
+    gl_replay *Replay = (gl_replay *)calloc(1, sizeof(gl_replay));
+    int FrameCapacity = 256;
+    int FrameCount = 0;
+    float *FrameMilliseconds = (float *)malloc(FrameCapacity*sizeof(float));
+    float InitMilliseconds = 0.0f;
+    int Markers = 0;
+
+    GLubyte *At = Trace + sizeof(*Header) + AlignGLTraceBytes(Header->NameBytes);
+    GLubyte *End = Trace + Size;
+    uint64 RunStart = GetNanoseconds();
+    uint64 FrameStart = RunStart;
+    for(;;)
+    {
+	gl_trace_record *Record = (gl_trace_record *)At;
+	bool Done = (At + sizeof(*Record) > End);
+	if (Done || Record->Function == GL_TRACE_FRAME_MARKER)
+	{
+	    // NOTE: Records before the first marker are the platform's setup,
+	    // which counts towards the init frame.
+	    if (Done || Markers++ > 0)
+	    {
+		uint64 Now = GetNanoseconds();
+		float Milliseconds = (Now - FrameStart) / 1000000.0f;
+		if (Markers <= 2 && !Done)
+		{
+		    InitMilliseconds = Milliseconds;
+		    RunStart = Now;
+		}
+		else
+		{
+		    if (FrameCount == FrameCapacity)
+		    {
+			FrameCapacity *= 2;
+			FrameMilliseconds = (float *)realloc(FrameMilliseconds, FrameCapacity*sizeof(float));
+		    }
+		    FrameMilliseconds[FrameCount++] = Milliseconds;
+		}
+		FrameStart = Now;
+	    }
+	    if (Done)
+	    {
+		break;
+	    }
+	    At += sizeof(*Record);
+	    continue;
+	}
+
+	const GLuint64 *Args = (const GLuint64 *)(Record + 1);
+	const GLubyte *Payload = (const GLubyte *)(Args + Record->ArgCount);
+	At = (GLubyte *)Payload + AlignGLTraceBytes(Record->PayloadBytes);
+	if (At > End)
+	{
+	    printf("GL trace %s is truncated\n", Path);
+	    break;
+	}
+	int Function = (Record->Function < Header->FunctionCount) ? Functions[Record->Function] : -1;
+	if (!IsReplayRecordValid(Function, Args, Record->ArgCount, Payload, Record->PayloadBytes))
+	{
+	    ++Replay->RejectedCalls;
+	    continue;
+	}
+	ReplayGLCall(Replay, Function, Args, Payload, Record->PayloadBytes);
+    }
+    (glFinish)();
+    float TotalMilliseconds = (GetNanoseconds() - RunStart) / 1000000.0f;
+
+    printf("Replayed %s: %u calls, %u skipped, %u rejected\n", Path, Replay->Calls,
+	   Replay->SkippedCalls, Replay->RejectedCalls);
+    if (Replay->NameMismatches)
+    {
+	printf("%u generated object names differ from the trace; the replay doesn't match it\n",
+	       Replay->NameMismatches);
+    }
+    printf("First frame (init): %.3f ms\n", InitMilliseconds);
+    if (FrameCount)
+    {
+	PrintFrameStats(FrameMilliseconds, FrameCount, TotalMilliseconds);
+    }
+
+    free(FrameMilliseconds);
+    free(Replay->Pixels);
+    free(Replay);
+    free(Functions);
+    free(Trace);
+    return true;
+}
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef GLSTATECACHE_CPP__
+#define GLSTATECACHE_CPP__
+
+// NOTE: Shadow copy of the GL binding and enable state, so calls that
+// wouldn't change anything never reach the driver. The calls below are
+// redirected by function-like macros over their gl names, which catches the
+// Windows GLE pointers and the Linux prototypes alike. The cache's own calls
+// are compiled before those macros exist, so they reach the real entry
+// points, or the tracer's wrappers when glTrace.cpp has redirected them.
+//
+// Only the state listed here is tracked; anything else goes straight through.
+// GL_ELEMENT_ARRAY_BUFFER isn't cached because it belongs to the bound VAO.
+// The cache starts out with a fresh context's bindings (all 0) and with the
+// viewport, enable bits and active texture unknown, so their first call
+// always goes through. Anything that changes state behind the cache's back
+// (the OpenVR compositor, deleting a bound object) must be followed by
+// InvalidateGLStateCache, which forgets everything.
+//
+// Built with NO_GL_STATE_CACHE every call goes through but is still
+// counted, so the two builds can be compared.
+
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+#define GL_STATE_TEXTURE_UNITS 16
+
+enum gl_state_texture_target
+{
+    GLStateTexture_2D,
+    GLStateTexture_CubeMap,
+    GLStateTexture_2DArray,
+    GLStateTexture_Buffer,
+    GLStateTexture_2DMultisample,
+    GLStateTexture_Count
+};
+
+enum gl_state_capability
+{
+    GLStateCap_DepthTest,
+    GLStateCap_CullFace,
+    GLStateCap_Multisample,
+    GLStateCap_ScissorTest,
+    GLStateCap_ClipDistance0,
+    GLStateCap_DepthClamp,
+    GLStateCap_PolygonOffsetFill,
+    GLStateCap_Blend,
+    GLStateCap_Count
+};
+
+struct gl_state_stats
+{
+    GLuint Issued;
+    GLuint Dropped;
+};
+
+struct gl_state_cache
+{
+    GLuint Program;
+    GLuint VertexArray;
+    GLuint ArrayBuffer;
+    GLuint TextureBuffer;
+    GLuint ReadFramebuffer;
+    GLuint DrawFramebuffer;
+    GLenum ActiveTexture;
+    GLuint Textures[GL_STATE_TEXTURE_UNITS][GLStateTexture_Count];
+
+    bool ViewportKnown;
+    GLint Viewport[4];
+
+    GLuint CapsKnown;
+    GLuint CapsEnabled;
+
+    // NOTE: Since the last BeginGLStateFrame.
+    gl_state_stats Stats;
+};
+
+static gl_state_cache GLStateCache;
+
+void InvalidateGLStateCache()
+{
+    gl_state_stats Stats = GLStateCache.Stats;
+    memset(&GLStateCache, 0xFF, sizeof(GLStateCache));
+    GLStateCache.ViewportKnown = false;
+    GLStateCache.CapsKnown = 0;
+    GLStateCache.Stats = Stats;
+}
+
+// NOTE: Returns last frame's counts and starts counting again.
+gl_state_stats BeginGLStateFrame()
+{
+    gl_state_stats Result = GLStateCache.Stats;
+    GLStateCache.Stats.Issued = 0;
+    GLStateCache.Stats.Dropped = 0;
+    return Result;
+}
+
+// NOTE: Counts the call, and says whether to make it.
+inline bool IssueGLCall(bool Redundant)
+{
+#if !defined(NO_GL_STATE_CACHE)
+    if (Redundant)
+    {
+	++GLStateCache.Stats.Dropped;
+	return false;
+    }
+#endif
+    ++GLStateCache.Stats.Issued;
+    return true;
+}
+
+// NOTE: True when the call has to be made; stores Value as the new state.
+inline bool GLStateChanged(GLuint *Cached, GLuint Value)
+{
+    bool Redundant = (*Cached == Value);
+    *Cached = Value;
+    return IssueGLCall(Redundant);
+}
+
+// NOTE: 0 for state the cache doesn't track, which always goes through.
+GLuint *GetCachedBufferBinding(GLenum Target)
+{
+    switch(Target)
+    {
+    case GL_ARRAY_BUFFER: return &GLStateCache.ArrayBuffer;
+    case GL_TEXTURE_BUFFER: return &GLStateCache.TextureBuffer;
+    default: return 0;
+    }
+}
+
+GLuint *GetCachedTextureBinding(GLenum Target)
+{
+    GLuint Unit = GLStateCache.ActiveTexture - GL_TEXTURE0;
+    if (GLStateCache.ActiveTexture == GL_STATE_UNKNOWN || Unit >= GL_STATE_TEXTURE_UNITS)
+    {
+	return 0;
+    }
+    GLuint *Textures = GLStateCache.Textures[Unit];
+    switch(Target)
+    {
+    case GL_TEXTURE_2D: return Textures + GLStateTexture_2D;
+    case GL_TEXTURE_CUBE_MAP: return Textures + GLStateTexture_CubeMap;
+    case GL_TEXTURE_2D_ARRAY: return Textures + GLStateTexture_2DArray;
+    case GL_TEXTURE_BUFFER: return Textures + GLStateTexture_Buffer;
+    case GL_TEXTURE_2D_MULTISAMPLE: return Textures + GLStateTexture_2DMultisample;
+    default: return 0;
+    }
+}
+
+int GetCachedCapability(GLenum Capability)
+{
+    switch(Capability)
+    {
+    case GL_DEPTH_TEST: return GLStateCap_DepthTest;
+    case GL_CULL_FACE: return GLStateCap_CullFace;
+    case GL_MULTISAMPLE: return GLStateCap_Multisample;
+    case GL_SCISSOR_TEST: return GLStateCap_ScissorTest;
+    case GL_CLIP_DISTANCE0: return GLStateCap_ClipDistance0;
+    case GL_DEPTH_CLAMP: return GLStateCap_DepthClamp;
+    case GL_POLYGON_OFFSET_FILL: return GLStateCap_PolygonOffsetFill;
+    case GL_BLEND: return GLStateCap_Blend;
+    default: return -1;
+    }
+}
+
+void CachedUseProgram(GLuint Program)
+{
+    if (GLStateChanged(&GLStateCache.Program, Program))
+    {
+	glUseProgram(Program);
+    }
+}
+
+void CachedBindVertexArray(GLuint VertexArray)
+{
+    if (GLStateChanged(&GLStateCache.VertexArray, VertexArray))
+    {
+	glBindVertexArray(VertexArray);
+    }
+}
+
+void CachedBindBuffer(GLenum Target, GLuint Buffer)
+{
+    GLuint *Cached = GetCachedBufferBinding(Target);
+    if (Cached ? GLStateChanged(Cached, Buffer) : IssueGLCall(false))
+    {
+	glBindBuffer(Target, Buffer);
+    }
+}
+
+void CachedActiveTexture(GLenum Texture)
+{
+    if (GLStateChanged(&GLStateCache.ActiveTexture, Texture))
+    {
+	glActiveTexture(Texture);
+    }
+}
+
+void CachedBindTexture(GLenum Target, GLuint Texture)
+{
+    GLuint *Cached = GetCachedTextureBinding(Target);
+    if (Cached ? GLStateChanged(Cached, Texture) : IssueGLCall(false))
+    {
+	glBindTexture(Target, Texture);
+    }
+}
+
+void CachedBindFramebuffer(GLenum Target, GLuint Framebuffer)
+{
+    bool Redundant;
+    if (Target == GL_FRAMEBUFFER)
+    {
+	Redundant = (GLStateCache.ReadFramebuffer == Framebuffer &&
+		     GLStateCache.DrawFramebuffer == Framebuffer);
+	GLStateCache.ReadFramebuffer = Framebuffer;
+	GLStateCache.DrawFramebuffer = Framebuffer;
+    }
+    else
+    {
+	GLuint *Cached = (Target == GL_READ_FRAMEBUFFER) ?
+	    &GLStateCache.ReadFramebuffer : &GLStateCache.DrawFramebuffer;
+	Redundant = (*Cached == Framebuffer);
+	*Cached = Framebuffer;
+    }
+    if (IssueGLCall(Redundant))
+    {
+	glBindFramebuffer(Target, Framebuffer);
+    }
+}
+
+void CachedViewport(GLint X, GLint Y, GLsizei Width, GLsizei Height)
+{
+    GLint *Viewport = GLStateCache.Viewport;
+    bool Redundant = (GLStateCache.ViewportKnown &&
+		      Viewport[0] == X && Viewport[1] == Y &&
+		      Viewport[2] == Width && Viewport[3] == Height);
+    Viewport[0] = X;
+    Viewport[1] = Y;
+    Viewport[2] = Width;
+    Viewport[3] = Height;
+    GLStateCache.ViewportKnown = true;
+    if (IssueGLCall(Redundant))
+    {
+	glViewport(X, Y, Width, Height);
+    }
+}
+
+// NOTE: True when the call has to be made.
+bool SetCachedCapability(GLenum Capability, bool Enabled)
+{
+    int Index = GetCachedCapability(Capability);
+    if (Index < 0)
+    {
+	return IssueGLCall(false);
+    }
+    GLuint Bit = 1u << Index;
+    bool Redundant = ((GLStateCache.CapsKnown & Bit) &&
+		      ((GLStateCache.CapsEnabled & Bit) != 0) == Enabled);
+    GLStateCache.CapsKnown |= Bit;
+    if (Enabled)
+    {
+	GLStateCache.CapsEnabled |= Bit;
+    }
+    else
+    {
+	GLStateCache.CapsEnabled &= ~Bit;
+    }
+    return IssueGLCall(Redundant);
+}
+
+void CachedEnable(GLenum Capability)
+{
+    if (SetCachedCapability(Capability, true))
+    {
+	glEnable(Capability);
+    }
+}
+
+void CachedDisable(GLenum Capability)
+{
+    if (SetCachedCapability(Capability, false))
+    {
+	glDisable(Capability);
+    }
+}
+
+// NOTE: GL_TRACE builds have these redirected to the tracer already.
+#undef glUseProgram
+#undef glBindVertexArray
+#undef glBindBuffer
+#undef glActiveTexture
+#undef glBindTexture
+#undef glBindFramebuffer
+#undef glViewport
+#undef glEnable
+#undef glDisable
+
+#define glUseProgram(Program) CachedUseProgram(Program)
+#define glBindVertexArray(VertexArray) CachedBindVertexArray(VertexArray)
+#define glBindBuffer(Target, Buffer) CachedBindBuffer(Target, Buffer)
+#define glActiveTexture(Texture) CachedActiveTexture(Texture)
+#define glBindTexture(Target, Texture) CachedBindTexture(Target, Texture)
+#define glBindFramebuffer(Target, Framebuffer) CachedBindFramebuffer(Target, Framebuffer)
+#define glViewport(X, Y, Width, Height) CachedViewport(X, Y, Width, Height)
+#define glEnable(Capability) CachedEnable(Capability)
+#define glDisable(Capability) CachedDisable(Capability)
+
+#endif
@@ -0,0 +1,1075 @@
+#ifndef GLTRACE_CPP__
+#define GLTRACE_CPP__
+
+// NOTE: GL call tracing, compiled in with -DGL_TRACE. Every function in
+// GLExtensionList and GLCoreList is redirected by a function-like macro over
+// its gl name to a wrapper that counts the call and times it with rdtsc, so
+// a frame's GL cost can be broken down by function; calls the state cache
+// drops never reach the wrapper. BeginGLTraceFrame prints the last frame's
+// table: calls and CPU time in GL, draws, binds, uniform uploads and bytes
+// handed to glBufferData, then the most expensive functions.
+//
+// Given a path, BeginGLTrace also writes each call to a binary file that
+// glReplay.cpp plays back without the game: a header naming every function,
+// then per call a gl_trace_record, its arguments widened to 64 bits (floats
+// and doubles by their bits), and whatever the call read or wrote through a
+// pointer (uniform values, uploads, shader sources, generated names). The
+// record is written after the call returns, so Gen* names are in it. Each
+// record is padded to 8 bytes; GL_TRACE_FRAME_MARKER records split frames.
+//
+// Without GL_TRACE only the file layout is defined, for the replayer, and
+// the entry points are empty.
+
+#define GL_TRACE_MAGIC 0x52544C47
+#define GL_TRACE_VERSION 1
+#define GL_TRACE_FRAME_MARKER 0xFFFF
+#define GL_TRACE_MAX_ARGS 16
+#define GL_TRACE_SUMMARY_ROWS 8
+
+enum gl_trace_function
+{
+#define GLE(retType, procName, ...) GLTrace_##procName,
+    GLExtensionList
+    GLCoreList
+#undef GLE
+    GLTrace_Count
+};
+
+// NOTE: Also read by glReplay.cpp, which isn't built with GL_TRACE, so
+// not static: builds without either would warn about it being unused.
+const char *GLTraceNames[GLTrace_Count] =
+{
+#define GLE(retType, procName, ...) "gl" #procName,
+    GLExtensionList
+    GLCoreList
+#undef GLE
+};
+
+// NOTE: Followed by the GLTrace_Count names, each zero terminated, in
+// NameBytes padded to 8. The replayer matches functions by name, so traces
+// survive the lists being reordered.
+struct gl_trace_file_header
+{
+    GLuint Magic;
+    GLuint Version;
+    GLuint FunctionCount;
+    GLuint NameBytes;
+};
+
+// NOTE: Followed by ArgCount 64 bit arguments, then PayloadBytes padded to 8.
+struct gl_trace_record
+{
+    GLushort Function;
+    GLubyte ArgCount;
+    GLubyte Padding;
+    GLuint PayloadBytes;
+};
+
+inline GLuint AlignGLTraceBytes(GLuint Bytes)
+{
+    return (Bytes + 7) & ~7u;
+}
+
+// NOTE: Size of the client memory a glTexImage or glReadPixels call reads or
+// writes, with the default pack and unpack alignment of 4.
+GLuint GetGLPixelBytes(GLenum Format, GLenum Type, GLsizei Width, GLsizei Height, GLsizei Depth)
+{
+    GLuint Components = 4;
+    switch(Format)
+    {
+    case GL_RED: case GL_DEPTH_COMPONENT: Components = 1; break;
+    case GL_RG: Components = 2; break;
+    case GL_RGB: case GL_BGR: Components = 3; break;
+    }
+    GLuint ComponentBytes = 1;
+    switch(Type)
+    {
+    case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: ComponentBytes = 2; break;
+    case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: ComponentBytes = 4; break;
+    }
+    GLuint RowBytes = ((GLuint)Width*Components*ComponentBytes + 3) & ~3u;
+    return RowBytes*(GLuint)Height*(GLuint)Depth;
+}
+
+#if defined(GL_TRACE)
+
+#include <initializer_list>
+#include <stdio.h>
+#if defined(WINDOWS)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <time.h>
+#endif
+
+enum gl_trace_category
+{
+    GLTraceCategory_Other,
+    GLTraceCategory_Draw,
+    GLTraceCategory_Bind,
+    GLTraceCategory_Uniform,
+};
+
+struct gl_trace_function_stats
+{
+    GLuint Calls;
+    GLuint64 Ticks;
+};
+
+struct gl_tracer
+{
+    FILE *File;
+    const char *Path;
+    GLuint Frames;
+    GLuint64 Calls;
+    GLuint64 BytesWritten;
+
+    // NOTE: Since the last BeginGLTraceFrame.
+    gl_trace_function_stats Functions[GLTrace_Count];
+    GLuint64 BufferBytes;
+
+    // NOTE: rdtsc is converted to milliseconds with the rate measured against
+    // the monotonic clock since BeginGLTrace.
+    GLuint64 StartTicks;
+    GLuint64 StartNanoseconds;
+};
+
+static gl_tracer GLTracer;
+
+GLuint64 ReadGLTraceNanoseconds()
+{
+#if defined(WINDOWS)
+    LARGE_INTEGER Frequency, Counter;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    return (GLuint64)((double)Counter.QuadPart * 1000000000.0 / (double)Frequency.QuadPart);
+#else
+    timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (GLuint64)Now.tv_sec*1000000000ull + (GLuint64)Now.tv_nsec;
+#endif
+}
+
+gl_trace_category GetGLTraceCategory(int Function)
+{
+    switch(Function)
+    {
+    case GLTrace_DrawArrays:
+    case GLTrace_DrawElementsInstanced:
+	return GLTraceCategory_Draw;
+    case GLTrace_UseProgram:
+    case GLTrace_BindVertexArray:
+    case GLTrace_BindBuffer:
+    case GLTrace_ActiveTexture:
+    case GLTrace_BindTexture:
+    case GLTrace_BindFramebuffer:
+    case GLTrace_BindRenderbuffer:
+	return GLTraceCategory_Bind;
+    case GLTrace_Uniform1i:
+    case GLTrace_Uniform1f:
+    case GLTrace_Uniform2f:
+    case GLTrace_Uniform3i:
+    case GLTrace_Uniform3f:
+    case GLTrace_Uniform4f:
+    case GLTrace_Uniform1iv:
+    case GLTrace_Uniform1fv:
+    case GLTrace_Uniform3fv:
+    case GLTrace_Uniform4fv:
+    case GLTrace_UniformMatrix4fv:
+	return GLTraceCategory_Uniform;
+    default:
+	return GLTraceCategory_Other;
+    }
+}
+
+// NOTE: One argument, widened so every record has the same layout.
+struct gl_trace_arg
+{
+    GLuint64 Bits;
+
+    gl_trace_arg(int Value) { Bits = (GLuint64)(long long)Value; }
+    gl_trace_arg(unsigned int Value) { Bits = Value; }
+    gl_trace_arg(long Value) { Bits = (GLuint64)(long long)Value; }
+    gl_trace_arg(unsigned long Value) { Bits = Value; }
+    gl_trace_arg(long long Value) { Bits = (GLuint64)Value; }
+    gl_trace_arg(unsigned long long Value) { Bits = Value; }
+    gl_trace_arg(float Value) { GLuint Word; memcpy(&Word, &Value, sizeof(Word)); Bits = Word; }
+    gl_trace_arg(double Value) { memcpy(&Bits, &Value, sizeof(Bits)); }
+    gl_trace_arg(const void *Value) { Bits = (GLuint64)(size_t)Value; }
+};
+
+void WriteGLTraceBytes(const void *Data, GLuint Bytes)
+{
+    static const GLubyte Zeros[8] = {};
+    fwrite(Data, 1, Bytes, GLTracer.File);
+    fwrite(Zeros, 1, AlignGLTraceBytes(Bytes) - Bytes, GLTracer.File);
+    GLTracer.BytesWritten += AlignGLTraceBytes(Bytes);
+}
+
+// NOTE: The memory behind Args' pointers that replaying the call needs.
+GLuint GetGLTracePayload(int Function, const GLuint64 *Args, const void **Payload)
+{
+    *Payload = 0;
+    switch(Function)
+    {
+    case GLTrace_GetUniformLocation:
+	*Payload = (const void *)Args[1];
+	return (GLuint)strlen((const char *)Args[1]) + 1;
+    case GLTrace_Uniform1iv:
+    case GLTrace_Uniform1fv:
+	*Payload = (const void *)Args[2];
+	return (GLuint)Args[1]*4;
+    case GLTrace_Uniform3fv:
+	*Payload = (const void *)Args[2];
+	return (GLuint)Args[1]*12;
+    case GLTrace_Uniform4fv:
+	*Payload = (const void *)Args[2];
+	return (GLuint)Args[1]*16;
+    case GLTrace_UniformMatrix4fv:
+	*Payload = (const void *)Args[3];
+	return (GLuint)Args[1]*64;
+    case GLTrace_CompressedTexImage2D:
+	*Payload = (const void *)Args[7];
+	return (GLuint)Args[6];
+    case GLTrace_GenVertexArrays:
+    case GLTrace_GenBuffers:
+    case GLTrace_GenFramebuffers:
+    case GLTrace_GenRenderbuffers:
+    case GLTrace_GenQueries:
+    case GLTrace_GenTextures:
+    case GLTrace_DeleteBuffers:
+    case GLTrace_DeleteFramebuffers:
+    case GLTrace_DeleteRenderbuffers:
+	*Payload = (const void *)Args[1];
+	return (GLuint)Args[0]*sizeof(GLuint);
+    case GLTrace_BufferData:
+	*Payload = (const void *)Args[2];
+	return Args[2] ? (GLuint)Args[1] : 0;
+    case GLTrace_InvalidateFramebuffer:
+	*Payload = (const void *)Args[2];
+	return (GLuint)Args[1]*sizeof(GLenum);
+    case GLTrace_TexImage2D:
+	*Payload = (const void *)Args[8];
+	return Args[8] ? GetGLPixelBytes((GLenum)Args[6], (GLenum)Args[7], (GLsizei)Args[3], (GLsizei)Args[4], 1) : 0;
+    case GLTrace_TexImage3D:
+	*Payload = (const void *)Args[9];
+	return Args[9] ? GetGLPixelBytes((GLenum)Args[7], (GLenum)Args[8], (GLsizei)Args[3], (GLsizei)Args[4], (GLsizei)Args[5]) : 0;
+    default:
+	return 0;
+    }
+}
+
+// NOTE: Shader sources go out as a 32 bit length and the text, per string.
+void WriteGLTraceShaderSource(const GLuint64 *Args)
+{
+    GLsizei Count = (GLsizei)Args[1];
+    const GLchar *const *Strings = (const GLchar *const *)Args[2];
+    const GLint *Lengths = (const GLint *)Args[3];
+    GLuint PayloadBytes = 0;
+    for(GLsizei Index = 0; Index < Count; ++Index)
+    {
+	GLuint Length = (Lengths && Lengths[Index] >= 0) ? Lengths[Index] : (GLuint)strlen(Strings[Index]);
+	PayloadBytes += sizeof(GLuint) + Length;
+    }
+
+    gl_trace_record Record = { GLTrace_ShaderSource, 4, 0, PayloadBytes };
+    fwrite(&Record, sizeof(Record), 1, GLTracer.File);
+    fwrite(Args, sizeof(GLuint64), 4, GLTracer.File);
+    for(GLsizei Index = 0; Index < Count; ++Index)
+    {
+	GLuint Length = (Lengths && Lengths[Index] >= 0) ? Lengths[Index] : (GLuint)strlen(Strings[Index]);
+	fwrite(&Length, sizeof(Length), 1, GLTracer.File);
+	fwrite(Strings[Index], 1, Length, GLTracer.File);
+    }
+    static const GLubyte Zeros[8] = {};
+    fwrite(Zeros, 1, AlignGLTraceBytes(PayloadBytes) - PayloadBytes, GLTracer.File);
+    GLTracer.BytesWritten += sizeof(Record) + 4*sizeof(GLuint64) + AlignGLTraceBytes(PayloadBytes);
+}
+
+void WriteGLTraceRecord(int Function, const GLuint64 *Values, int ArgCount)
+{
+    if (Function == GLTrace_ShaderSource)
+    {
+	WriteGLTraceShaderSource(Values);
+	return;
+    }
+
+    const void *Payload;
+    GLuint PayloadBytes = GetGLTracePayload(Function, Values, &Payload);
+    gl_trace_record Record = { (GLushort)Function, (GLubyte)ArgCount, 0, PayloadBytes };
+    fwrite(&Record, sizeof(Record), 1, GLTracer.File);
+    fwrite(Values, sizeof(GLuint64), ArgCount, GLTracer.File);
+    GLTracer.BytesWritten += sizeof(Record) + ArgCount*sizeof(GLuint64);
+    if (PayloadBytes)
+    {
+	WriteGLTraceBytes(Payload, PayloadBytes);
+    }
+}
+
+// NOTE: Lives for the full expression around one traced call, so the
+// destructor runs once the call has returned. The arguments are copied out
+// of the initializer list, whose array only lives as long as the
+// constructor call.
+struct gl_trace_call
+{
+    int Function;
+    int ArgCount;
+    GLuint64 Values[GL_TRACE_MAX_ARGS];
+    GLuint64 Start;
+
+    gl_trace_call(int CallFunction, std::initializer_list<gl_trace_arg> CallArgs)
+    {
+	Function = CallFunction;
+	ArgCount = 0;
+	for(const gl_trace_arg *Arg = CallArgs.begin();
+	    Arg != CallArgs.end() && ArgCount < GL_TRACE_MAX_ARGS; ++Arg)
+	{
+	    Values[ArgCount++] = Arg->Bits;
+	}
+	Start = __rdtsc();
+    }
+
+    ~gl_trace_call()
+    {
+	gl_trace_function_stats *Stats = GLTracer.Functions + Function;
+	++Stats->Calls;
+	Stats->Ticks += __rdtsc() - Start;
+	++GLTracer.Calls;
+	if (Function == GLTrace_BufferData && Values[2])
+	{
+	    GLTracer.BufferBytes += Values[1];
+	}
+	if (GLTracer.File)
+	{
+	    WriteGLTraceRecord(Function, Values, ArgCount);
+	}
+    }
+};
+
+// NOTE: Path can be 0, which only counts. Call before the context exists so
+// the trace holds every object the replay needs.
+void BeginGLTrace(const char *Path)
+{
+    GLTracer.StartTicks = __rdtsc();
+    GLTracer.StartNanoseconds = ReadGLTraceNanoseconds();
+    if (!Path)
+    {
+	return;
+    }
+    GLTracer.File = fopen(Path, "wb");
+    if (!GLTracer.File)
+    {
+	printf("Can't open GL trace %s\n", Path);
+	return;
+    }
+    GLTracer.Path = Path;
+
+    GLuint NameBytes = 0;
+    for(int Function = 0; Function < GLTrace_Count; ++Function)
+    {
+	NameBytes += (GLuint)strlen(GLTraceNames[Function]) + 1;
+    }
+    gl_trace_file_header Header = { GL_TRACE_MAGIC, GL_TRACE_VERSION, GLTrace_Count, NameBytes };
+    fwrite(&Header, sizeof(Header), 1, GLTracer.File);
+    for(int Function = 0; Function < GLTrace_Count; ++Function)
+    {
+	fwrite(GLTraceNames[Function], 1, strlen(GLTraceNames[Function]) + 1, GLTracer.File);
+    }
+    static const GLubyte Zeros[8] = {};
+    fwrite(Zeros, 1, AlignGLTraceBytes(NameBytes) - NameBytes, GLTracer.File);
+    GLTracer.BytesWritten = sizeof(Header) + AlignGLTraceBytes(NameBytes);
+}
+
+void PrintGLTraceFrame()
+{
+    double TicksPerMillisecond = 0.0;
+    GLuint64 Nanoseconds = ReadGLTraceNanoseconds() - GLTracer.StartNanoseconds;
+    if (Nanoseconds)
+    {
+	TicksPerMillisecond = (double)(__rdtsc() - GLTracer.StartTicks) * 1000000.0 / (double)Nanoseconds;
+    }
+
+    GLuint Calls = 0;
+    GLuint64 Ticks = 0;
+    GLuint CategoryCalls[4] = {};
+    for(int Function = 0; Function < GLTrace_Count; ++Function)
+    {
+	gl_trace_function_stats *Stats = GLTracer.Functions + Function;
+	Calls += Stats->Calls;
+	Ticks += Stats->Ticks;
+	CategoryCalls[GetGLTraceCategory(Function)] += Stats->Calls;
+    }
+    printf("GL frame %u: %u calls, %.3f ms | %u draws, %u binds, %u uniforms, %llu buffer bytes\n",
+	   GLTracer.Frames, Calls, TicksPerMillisecond ? Ticks / TicksPerMillisecond : 0.0,
+	   CategoryCalls[GLTraceCategory_Draw], CategoryCalls[GLTraceCategory_Bind],
+	   CategoryCalls[GLTraceCategory_Uniform], (unsigned long long)GLTracer.BufferBytes);
+
+    // NOTE: The most expensive functions, picking the largest left each row.
+    bool Printed[GLTrace_Count] = {};
+    for(int Row = 0; Row < GL_TRACE_SUMMARY_ROWS; ++Row)
+    {
+	int Largest = -1;
+	for(int Function = 0; Function < GLTrace_Count; ++Function)
+	{
+	    if (!Printed[Function] && GLTracer.Functions[Function].Calls &&
+		(Largest < 0 || GLTracer.Functions[Function].Ticks > GLTracer.Functions[Largest].Ticks))
+	    {
+		Largest = Function;
+	    }
+	}
+	if (Largest < 0)
+	{
+	    break;
+	}
+	Printed[Largest] = true;
+	gl_trace_function_stats *Stats = GLTracer.Functions + Largest;
+	printf("    %-32s %6u calls %9.3f ms\n", GLTraceNames[Largest], Stats->Calls,
+	       TicksPerMillisecond ? Stats->Ticks / TicksPerMillisecond : 0.0);
+    }
+}
+
+// NOTE: Call at the start of each frame; Print shows the frame that ended.
+void BeginGLTraceFrame(bool Print)
+{
+    if (!GLTracer.StartTicks)
+    {
+	GLTracer.StartTicks = __rdtsc();
+	GLTracer.StartNanoseconds = ReadGLTraceNanoseconds();
+    }
+    if (Print && GLTracer.Frames)
+    {
+	PrintGLTraceFrame();
+    }
+    if (GLTracer.File)
+    {
+	gl_trace_record Marker = { GL_TRACE_FRAME_MARKER, 0, 0, 0 };
+	fwrite(&Marker, sizeof(Marker), 1, GLTracer.File);
+	GLTracer.BytesWritten += sizeof(Marker);
+    }
+    memset(GLTracer.Functions, 0, sizeof(GLTracer.Functions));
+    GLTracer.BufferBytes = 0;
+    ++GLTracer.Frames;
+}
+
+void EndGLTrace()
+{
+    if (GLTracer.File)
+    {
+	fclose(GLTracer.File);
+	GLTracer.File = 0;
+	printf("GL trace: %u frames, %llu calls, %llu bytes written to %s\n", GLTracer.Frames,
+	       (unsigned long long)GLTracer.Calls, (unsigned long long)GLTracer.BytesWritten, GLTracer.Path);
+    }
+}
+
+inline GLint TracedGetUniformLocation(GLuint program, const GLchar *name)
+{
+    gl_trace_call Call(GLTrace_GetUniformLocation, {program, name});
+    return (glGetUniformLocation)(program, name);
+}
+
+inline void TracedUniform1i(GLint location, GLint v0)
+{
+    gl_trace_call Call(GLTrace_Uniform1i, {location, v0});
+    return (glUniform1i)(location, v0);
+}
+
+inline void TracedUniform1f(GLint location, GLfloat v0)
+{
+    gl_trace_call Call(GLTrace_Uniform1f, {location, v0});
+    return (glUniform1f)(location, v0);
+}
+
+inline void TracedUniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+    gl_trace_call Call(GLTrace_Uniform2f, {location, v0, v1});
+    return (glUniform2f)(location, v0, v1);
+}
+
+inline void TracedUniform3i(GLint location, GLint v0, GLint v1, GLint v2)
+{
+    gl_trace_call Call(GLTrace_Uniform3i, {location, v0, v1, v2});
+    return (glUniform3i)(location, v0, v1, v2);
+}
+
+inline void TracedUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    gl_trace_call Call(GLTrace_Uniform3f, {location, v0, v1, v2});
+    return (glUniform3f)(location, v0, v1, v2);
+}
+
+inline void TracedUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+{
+    gl_trace_call Call(GLTrace_Uniform4f, {location, v0, v1, v2, v3});
+    return (glUniform4f)(location, v0, v1, v2, v3);
+}
+
+inline void TracedUniform1iv(GLint location, GLsizei count, const GLint *value)
+{
+    gl_trace_call Call(GLTrace_Uniform1iv, {location, count, value});
+    return (glUniform1iv)(location, count, value);
+}
+
+inline void TracedUniform1fv(GLint location, GLsizei count, const GLfloat *value)
+{
+    gl_trace_call Call(GLTrace_Uniform1fv, {location, count, value});
+    return (glUniform1fv)(location, count, value);
+}
+
+inline void TracedUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+{
+    gl_trace_call Call(GLTrace_Uniform3fv, {location, count, value});
+    return (glUniform3fv)(location, count, value);
+}
+
+inline void TracedUniform4fv(GLint location, GLsizei count, const GLfloat *value)
+{
+    gl_trace_call Call(GLTrace_Uniform4fv, {location, count, value});
+    return (glUniform4fv)(location, count, value);
+}
+
+inline void TracedUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    gl_trace_call Call(GLTrace_UniformMatrix4fv, {location, count, transpose, value});
+    return (glUniformMatrix4fv)(location, count, transpose, value);
+}
+
+inline void TracedCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data)
+{
+    gl_trace_call Call(GLTrace_CompressedTexImage2D, {target, level, internalformat, width, height, border, imageSize, data});
+    return (glCompressedTexImage2D)(target, level, internalformat, width, height, border, imageSize, data);
+}
+
+inline void TracedTexImage2DMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height, GLboolean fixedsamplelocations)
+{
+    gl_trace_call Call(GLTrace_TexImage2DMultisample, {target, samples, internalformat, width, height, fixedsamplelocations});
+    return (glTexImage2DMultisample)(target, samples, internalformat, width, height, fixedsamplelocations);
+}
+
+inline void TracedTextureParameteri(GLuint texture, GLenum pname, GLint param)
+{
+    gl_trace_call Call(GLTrace_TextureParameteri, {texture, pname, param});
+    return (glTextureParameteri)(texture, pname, param);
+}
+
+inline void TracedGenerateMipmap(GLenum target)
+{
+    gl_trace_call Call(GLTrace_GenerateMipmap, {target});
+    return (glGenerateMipmap)(target);
+}
+
+inline void TracedTexBuffer(GLenum target, GLenum internalformat, GLuint buffer)
+{
+    gl_trace_call Call(GLTrace_TexBuffer, {target, internalformat, buffer});
+    return (glTexBuffer)(target, internalformat, buffer);
+}
+
+inline GLuint TracedCreateShader(GLenum type)
+{
+    gl_trace_call Call(GLTrace_CreateShader, {type});
+    return (glCreateShader)(type);
+}
+
+inline void TracedDeleteShader(GLuint shader)
+{
+    gl_trace_call Call(GLTrace_DeleteShader, {shader});
+    return (glDeleteShader)(shader);
+}
+
+inline void TracedShaderSource(GLuint shader, GLsizei count, const GLchar *const*string, const GLint *length)
+{
+    gl_trace_call Call(GLTrace_ShaderSource, {shader, count, string, length});
+    return (glShaderSource)(shader, count, string, length);
+}
+
+inline void TracedCompileShader(GLuint shader)
+{
+    gl_trace_call Call(GLTrace_CompileShader, {shader});
+    return (glCompileShader)(shader);
+}
+
+inline void TracedAttachShader(GLuint program, GLuint shader)
+{
+    gl_trace_call Call(GLTrace_AttachShader, {program, shader});
+    return (glAttachShader)(program, shader);
+}
+
+inline void TracedDetachShader(GLuint program, GLuint shader)
+{
+    gl_trace_call Call(GLTrace_DetachShader, {program, shader});
+    return (glDetachShader)(program, shader);
+}
+
+inline void TracedGetShaderiv(GLuint shader, GLenum pname, GLint *params)
+{
+    gl_trace_call Call(GLTrace_GetShaderiv, {shader, pname, params});
+    return (glGetShaderiv)(shader, pname, params);
+}
+
+inline void TracedGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+    gl_trace_call Call(GLTrace_GetShaderInfoLog, {shader, bufSize, length, infoLog});
+    return (glGetShaderInfoLog)(shader, bufSize, length, infoLog);
+}
+
+inline GLuint TracedCreateProgram()
+{
+    gl_trace_call Call(GLTrace_CreateProgram, {});
+    return (glCreateProgram)();
+}
+
+inline void TracedDeleteProgram(GLuint program)
+{
+    gl_trace_call Call(GLTrace_DeleteProgram, {program});
+    return (glDeleteProgram)(program);
+}
+
+inline void TracedLinkProgram(GLuint program)
+{
+    gl_trace_call Call(GLTrace_LinkProgram, {program});
+    return (glLinkProgram)(program);
+}
+
+inline void TracedGetProgramiv(GLuint program, GLenum pname, GLint *params)
+{
+    gl_trace_call Call(GLTrace_GetProgramiv, {program, pname, params});
+    return (glGetProgramiv)(program, pname, params);
+}
+
+inline void TracedGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+    gl_trace_call Call(GLTrace_GetProgramInfoLog, {program, bufSize, length, infoLog});
+    return (glGetProgramInfoLog)(program, bufSize, length, infoLog);
+}
+
+inline void TracedUseProgram(GLuint program)
+{
+    gl_trace_call Call(GLTrace_UseProgram, {program});
+    return (glUseProgram)(program);
+}
+
+inline void TracedGenVertexArrays(GLsizei n, GLuint *arrays)
+{
+    gl_trace_call Call(GLTrace_GenVertexArrays, {n, arrays});
+    return (glGenVertexArrays)(n, arrays);
+}
+
+inline void TracedBindVertexArray(GLuint array)
+{
+    gl_trace_call Call(GLTrace_BindVertexArray, {array});
+    return (glBindVertexArray)(array);
+}
+
+inline void TracedEnableVertexAttribArray(GLuint index)
+{
+    gl_trace_call Call(GLTrace_EnableVertexAttribArray, {index});
+    return (glEnableVertexAttribArray)(index);
+}
+
+inline void TracedDisableVertexAttribArray(GLuint index)
+{
+    gl_trace_call Call(GLTrace_DisableVertexAttribArray, {index});
+    return (glDisableVertexAttribArray)(index);
+}
+
+inline void TracedGenBuffers(GLsizei n, GLuint *buffers)
+{
+    gl_trace_call Call(GLTrace_GenBuffers, {n, buffers});
+    return (glGenBuffers)(n, buffers);
+}
+
+inline void TracedBindBuffer(GLenum target, GLuint buffer)
+{
+    gl_trace_call Call(GLTrace_BindBuffer, {target, buffer});
+    return (glBindBuffer)(target, buffer);
+}
+
+inline void TracedDeleteBuffers(GLsizei n, const GLuint *buffer)
+{
+    gl_trace_call Call(GLTrace_DeleteBuffers, {n, buffer});
+    return (glDeleteBuffers)(n, buffer);
+}
+
+inline void TracedBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+    gl_trace_call Call(GLTrace_BufferData, {target, size, data, usage});
+    return (glBufferData)(target, size, data, usage);
+}
+
+inline void TracedVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer)
+{
+    gl_trace_call Call(GLTrace_VertexAttribPointer, {index, size, type, normalized, stride, pointer});
+    return (glVertexAttribPointer)(index, size, type, normalized, stride, pointer);
+}
+
+inline void TracedActiveTexture(GLenum texture)
+{
+    gl_trace_call Call(GLTrace_ActiveTexture, {texture});
+    return (glActiveTexture)(texture);
+}
+
+inline void TracedGenFramebuffers(GLsizei n, GLuint *framebuffers)
+{
+    gl_trace_call Call(GLTrace_GenFramebuffers, {n, framebuffers});
+    return (glGenFramebuffers)(n, framebuffers);
+}
+
+inline void TracedFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+{
+    gl_trace_call Call(GLTrace_FramebufferTexture2D, {target, attachment, textarget, texture, level});
+    return (glFramebufferTexture2D)(target, attachment, textarget, texture, level);
+}
+
+inline void TracedFramebufferTextureLayer(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer)
+{
+    gl_trace_call Call(GLTrace_FramebufferTextureLayer, {target, attachment, texture, level, layer});
+    return (glFramebufferTextureLayer)(target, attachment, texture, level, layer);
+}
+
+inline void TracedTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels)
+{
+    gl_trace_call Call(GLTrace_TexImage3D, {target, level, internalformat, width, height, depth, border, format, type, pixels});
+    return (glTexImage3D)(target, level, internalformat, width, height, depth, border, format, type, pixels);
+}
+
+inline GLenum TracedCheckFramebufferStatus(GLenum target)
+{
+    gl_trace_call Call(GLTrace_CheckFramebufferStatus, {target});
+    return (glCheckFramebufferStatus)(target);
+}
+
+inline void TracedBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    gl_trace_call Call(GLTrace_BindFramebuffer, {target, framebuffer});
+    return (glBindFramebuffer)(target, framebuffer);
+}
+
+inline void TracedDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+    gl_trace_call Call(GLTrace_DeleteFramebuffers, {n, framebuffers});
+    return (glDeleteFramebuffers)(n, framebuffers);
+}
+
+inline void TracedGenRenderbuffers(GLsizei n, GLuint *renderbuffers)
+{
+    gl_trace_call Call(GLTrace_GenRenderbuffers, {n, renderbuffers});
+    return (glGenRenderbuffers)(n, renderbuffers);
+}
+
+inline void TracedBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+    gl_trace_call Call(GLTrace_BindRenderbuffer, {target, renderbuffer});
+    return (glBindRenderbuffer)(target, renderbuffer);
+}
+
+inline void TracedDeleteRenderbuffers(GLsizei n, const GLuint *renderbuffers)
+{
+    gl_trace_call Call(GLTrace_DeleteRenderbuffers, {n, renderbuffers});
+    return (glDeleteRenderbuffers)(n, renderbuffers);
+}
+
+inline void TracedRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+{
+    gl_trace_call Call(GLTrace_RenderbufferStorage, {target, internalformat, width, height});
+    return (glRenderbufferStorage)(target, internalformat, width, height);
+}
+
+inline void TracedRenderbufferStorageMultisample(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
+{
+    gl_trace_call Call(GLTrace_RenderbufferStorageMultisample, {target, samples, internalformat, width, height});
+    return (glRenderbufferStorageMultisample)(target, samples, internalformat, width, height);
+}
+
+inline void TracedFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
+{
+    gl_trace_call Call(GLTrace_FramebufferRenderbuffer, {target, attachment, renderbuffertarget, renderbuffer});
+    return (glFramebufferRenderbuffer)(target, attachment, renderbuffertarget, renderbuffer);
+}
+
+inline void TracedInvalidateFramebuffer(GLenum target, GLsizei numAttachments, const GLenum *attachments)
+{
+    gl_trace_call Call(GLTrace_InvalidateFramebuffer, {target, numAttachments, attachments});
+    return (glInvalidateFramebuffer)(target, numAttachments, attachments);
+}
+
+inline void TracedBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
+{
+    gl_trace_call Call(GLTrace_BlitFramebuffer, {srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter});
+    return (glBlitFramebuffer)(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+}
+
+inline void TracedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount)
+{
+    gl_trace_call Call(GLTrace_DrawElementsInstanced, {mode, count, type, indices, instancecount});
+    return (glDrawElementsInstanced)(mode, count, type, indices, instancecount);
+}
+
+inline void TracedGenQueries(GLsizei n, GLuint *ids)
+{
+    gl_trace_call Call(GLTrace_GenQueries, {n, ids});
+    return (glGenQueries)(n, ids);
+}
+
+inline void TracedQueryCounter(GLuint id, GLenum target)
+{
+    gl_trace_call Call(GLTrace_QueryCounter, {id, target});
+    return (glQueryCounter)(id, target);
+}
+
+inline void TracedGetQueryObjectiv(GLuint id, GLenum pname, GLint *params)
+{
+    gl_trace_call Call(GLTrace_GetQueryObjectiv, {id, pname, params});
+    return (glGetQueryObjectiv)(id, pname, params);
+}
+
+inline void TracedGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params)
+{
+    gl_trace_call Call(GLTrace_GetQueryObjectui64v, {id, pname, params});
+    return (glGetQueryObjectui64v)(id, pname, params);
+}
+
+inline void TracedGetInteger64v(GLenum pname, GLint64 *data)
+{
+    gl_trace_call Call(GLTrace_GetInteger64v, {pname, data});
+    return (glGetInteger64v)(pname, data);
+}
+
+inline void TracedBindTexture(GLenum target, GLuint texture)
+{
+    gl_trace_call Call(GLTrace_BindTexture, {target, texture});
+    return (glBindTexture)(target, texture);
+}
+
+inline void TracedGenTextures(GLsizei n, GLuint *textures)
+{
+    gl_trace_call Call(GLTrace_GenTextures, {n, textures});
+    return (glGenTextures)(n, textures);
+}
+
+inline void TracedTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    gl_trace_call Call(GLTrace_TexParameteri, {target, pname, param});
+    return (glTexParameteri)(target, pname, param);
+}
+
+inline void TracedTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels)
+{
+    gl_trace_call Call(GLTrace_TexImage2D, {target, level, internalformat, width, height, border, format, type, pixels});
+    return (glTexImage2D)(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+inline void TracedEnable(GLenum cap)
+{
+    gl_trace_call Call(GLTrace_Enable, {cap});
+    return (glEnable)(cap);
+}
+
+inline void TracedDisable(GLenum cap)
+{
+    gl_trace_call Call(GLTrace_Disable, {cap});
+    return (glDisable)(cap);
+}
+
+inline void TracedViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    gl_trace_call Call(GLTrace_Viewport, {x, y, width, height});
+    return (glViewport)(x, y, width, height);
+}
+
+inline void TracedScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    gl_trace_call Call(GLTrace_Scissor, {x, y, width, height});
+    return (glScissor)(x, y, width, height);
+}
+
+inline void TracedGetIntegerv(GLenum pname, GLint *data)
+{
+    gl_trace_call Call(GLTrace_GetIntegerv, {pname, data});
+    return (glGetIntegerv)(pname, data);
+}
+
+inline void TracedDepthFunc(GLenum func)
+{
+    gl_trace_call Call(GLTrace_DepthFunc, {func});
+    return (glDepthFunc)(func);
+}
+
+inline void TracedDepthMask(GLboolean flag)
+{
+    gl_trace_call Call(GLTrace_DepthMask, {flag});
+    return (glDepthMask)(flag);
+}
+
+inline void TracedColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    gl_trace_call Call(GLTrace_ColorMask, {red, green, blue, alpha});
+    return (glColorMask)(red, green, blue, alpha);
+}
+
+inline void TracedFrontFace(GLenum mode)
+{
+    gl_trace_call Call(GLTrace_FrontFace, {mode});
+    return (glFrontFace)(mode);
+}
+
+inline void TracedPolygonMode(GLenum face, GLenum mode)
+{
+    gl_trace_call Call(GLTrace_PolygonMode, {face, mode});
+    return (glPolygonMode)(face, mode);
+}
+
+inline void TracedPolygonOffset(GLfloat factor, GLfloat units)
+{
+    gl_trace_call Call(GLTrace_PolygonOffset, {factor, units});
+    return (glPolygonOffset)(factor, units);
+}
+
+inline void TracedClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    gl_trace_call Call(GLTrace_ClearColor, {red, green, blue, alpha});
+    return (glClearColor)(red, green, blue, alpha);
+}
+
+inline void TracedClear(GLbitfield mask)
+{
+    gl_trace_call Call(GLTrace_Clear, {mask});
+    return (glClear)(mask);
+}
+
+inline void TracedDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    gl_trace_call Call(GLTrace_DrawArrays, {mode, first, count});
+    return (glDrawArrays)(mode, first, count);
+}
+
+inline void TracedReadBuffer(GLenum src)
+{
+    gl_trace_call Call(GLTrace_ReadBuffer, {src});
+    return (glReadBuffer)(src);
+}
+
+inline void TracedDrawBuffer(GLenum buf)
+{
+    gl_trace_call Call(GLTrace_DrawBuffer, {buf});
+    return (glDrawBuffer)(buf);
+}
+
+inline void TracedReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels)
+{
+    gl_trace_call Call(GLTrace_ReadPixels, {x, y, width, height, format, type, pixels});
+    return (glReadPixels)(x, y, width, height, format, type, pixels);
+}
+
+inline void TracedFinish()
+{
+    gl_trace_call Call(GLTrace_Finish, {});
+    return (glFinish)();
+}
+
+inline void TracedFlush()
+{
+    gl_trace_call Call(GLTrace_Flush, {});
+    return (glFlush)();
+}
+
+#define glGetUniformLocation(...) TracedGetUniformLocation(__VA_ARGS__)
+#define glUniform1i(...) TracedUniform1i(__VA_ARGS__)
+#define glUniform1f(...) TracedUniform1f(__VA_ARGS__)
+#define glUniform2f(...) TracedUniform2f(__VA_ARGS__)
+#define glUniform3i(...) TracedUniform3i(__VA_ARGS__)
+#define glUniform3f(...) TracedUniform3f(__VA_ARGS__)
+#define glUniform4f(...) TracedUniform4f(__VA_ARGS__)
+#define glUniform1iv(...) TracedUniform1iv(__VA_ARGS__)
+#define glUniform1fv(...) TracedUniform1fv(__VA_ARGS__)
+#define glUniform3fv(...) TracedUniform3fv(__VA_ARGS__)
+#define glUniform4fv(...) TracedUniform4fv(__VA_ARGS__)
+#define glUniformMatrix4fv(...) TracedUniformMatrix4fv(__VA_ARGS__)
+#define glCompressedTexImage2D(...) TracedCompressedTexImage2D(__VA_ARGS__)
+#define glTexImage2DMultisample(...) TracedTexImage2DMultisample(__VA_ARGS__)
+#define glTextureParameteri(...) TracedTextureParameteri(__VA_ARGS__)
+#define glGenerateMipmap(...) TracedGenerateMipmap(__VA_ARGS__)
+#define glTexBuffer(...) TracedTexBuffer(__VA_ARGS__)
+#define glCreateShader(...) TracedCreateShader(__VA_ARGS__)
+#define glDeleteShader(...) TracedDeleteShader(__VA_ARGS__)
+#define glShaderSource(...) TracedShaderSource(__VA_ARGS__)
+#define glCompileShader(...) TracedCompileShader(__VA_ARGS__)
+#define glAttachShader(...) TracedAttachShader(__VA_ARGS__)
+#define glDetachShader(...) TracedDetachShader(__VA_ARGS__)
+#define glGetShaderiv(...) TracedGetShaderiv(__VA_ARGS__)
+#define glGetShaderInfoLog(...) TracedGetShaderInfoLog(__VA_ARGS__)
+#define glCreateProgram(...) TracedCreateProgram(__VA_ARGS__)
+#define glDeleteProgram(...) TracedDeleteProgram(__VA_ARGS__)
+#define glLinkProgram(...) TracedLinkProgram(__VA_ARGS__)
+#define glGetProgramiv(...) TracedGetProgramiv(__VA_ARGS__)
+#define glGetProgramInfoLog(...) TracedGetProgramInfoLog(__VA_ARGS__)
+#define glUseProgram(...) TracedUseProgram(__VA_ARGS__)
+#define glGenVertexArrays(...) TracedGenVertexArrays(__VA_ARGS__)
+#define glBindVertexArray(...) TracedBindVertexArray(__VA_ARGS__)
+#define glEnableVertexAttribArray(...) TracedEnableVertexAttribArray(__VA_ARGS__)
+#define glDisableVertexAttribArray(...) TracedDisableVertexAttribArray(__VA_ARGS__)
+#define glGenBuffers(...) TracedGenBuffers(__VA_ARGS__)
+#define glBindBuffer(...) TracedBindBuffer(__VA_ARGS__)
+#define glDeleteBuffers(...) TracedDeleteBuffers(__VA_ARGS__)
+#define glBufferData(...) TracedBufferData(__VA_ARGS__)
+#define glVertexAttribPointer(...) TracedVertexAttribPointer(__VA_ARGS__)
+#define glActiveTexture(...) TracedActiveTexture(__VA_ARGS__)
+#define glGenFramebuffers(...) TracedGenFramebuffers(__VA_ARGS__)
+#define glFramebufferTexture2D(...) TracedFramebufferTexture2D(__VA_ARGS__)
+#define glFramebufferTextureLayer(...) TracedFramebufferTextureLayer(__VA_ARGS__)
+#define glTexImage3D(...) TracedTexImage3D(__VA_ARGS__)
+#define glCheckFramebufferStatus(...) TracedCheckFramebufferStatus(__VA_ARGS__)
+#define glBindFramebuffer(...) TracedBindFramebuffer(__VA_ARGS__)
+#define glDeleteFramebuffers(...) TracedDeleteFramebuffers(__VA_ARGS__)
+#define glGenRenderbuffers(...) TracedGenRenderbuffers(__VA_ARGS__)
+#define glBindRenderbuffer(...) TracedBindRenderbuffer(__VA_ARGS__)
+#define glDeleteRenderbuffers(...) TracedDeleteRenderbuffers(__VA_ARGS__)
+#define glRenderbufferStorage(...) TracedRenderbufferStorage(__VA_ARGS__)
+#define glRenderbufferStorageMultisample(...) TracedRenderbufferStorageMultisample(__VA_ARGS__)
+#define glFramebufferRenderbuffer(...) TracedFramebufferRenderbuffer(__VA_ARGS__)
+#define glInvalidateFramebuffer(...) TracedInvalidateFramebuffer(__VA_ARGS__)
+#define glBlitFramebuffer(...) TracedBlitFramebuffer(__VA_ARGS__)
+#define glDrawElementsInstanced(...) TracedDrawElementsInstanced(__VA_ARGS__)
+#define glGenQueries(...) TracedGenQueries(__VA_ARGS__)
+#define glQueryCounter(...) TracedQueryCounter(__VA_ARGS__)
+#define glGetQueryObjectiv(...) TracedGetQueryObjectiv(__VA_ARGS__)
+#define glGetQueryObjectui64v(...) TracedGetQueryObjectui64v(__VA_ARGS__)
+#define glGetInteger64v(...) TracedGetInteger64v(__VA_ARGS__)
+#define glBindTexture(...) TracedBindTexture(__VA_ARGS__)
+#define glGenTextures(...) TracedGenTextures(__VA_ARGS__)
+#define glTexParameteri(...) TracedTexParameteri(__VA_ARGS__)
+#define glTexImage2D(...) TracedTexImage2D(__VA_ARGS__)
+#define glEnable(...) TracedEnable(__VA_ARGS__)
+#define glDisable(...) TracedDisable(__VA_ARGS__)
+#define glViewport(...) TracedViewport(__VA_ARGS__)
+#define glScissor(...) TracedScissor(__VA_ARGS__)
+#define glGetIntegerv(...) TracedGetIntegerv(__VA_ARGS__)
+#define glDepthFunc(...) TracedDepthFunc(__VA_ARGS__)
+#define glDepthMask(...) TracedDepthMask(__VA_ARGS__)
+#define glColorMask(...) TracedColorMask(__VA_ARGS__)
+#define glFrontFace(...) TracedFrontFace(__VA_ARGS__)
+#define glPolygonMode(...) TracedPolygonMode(__VA_ARGS__)
+#define glPolygonOffset(...) TracedPolygonOffset(__VA_ARGS__)
+#define glClearColor(...) TracedClearColor(__VA_ARGS__)
+#define glClear(...) TracedClear(__VA_ARGS__)
+#define glDrawArrays(...) TracedDrawArrays(__VA_ARGS__)
+#define glReadBuffer(...) TracedReadBuffer(__VA_ARGS__)
+#define glDrawBuffer(...) TracedDrawBuffer(__VA_ARGS__)
+#define glReadPixels(...) TracedReadPixels(__VA_ARGS__)
+#define glFinish(...) TracedFinish(__VA_ARGS__)
+#define glFlush(...) TracedFlush(__VA_ARGS__)
+
+#else
+
+inline void BeginGLTrace(const char *Path)
+{
+    if (Path)
+    {
+	printf("GL tracing needs a GL_TRACE build; %s not written\n", Path);
+    }
+}
+inline void BeginGLTraceFrame(bool Print) {}
+inline void EndGLTrace() {}
+
+#endif
+
+#endif
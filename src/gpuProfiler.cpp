@@ -0,0 +1,208 @@
+#ifndef GPUPROFILER_CPP__
+#define GPUPROFILER_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+#include "profiler.cpp"
+
+#include <stdio.h>
+
+// NOTE: GPU pass timing with GL_TIMESTAMP queries. Each zone writes a begin
+// and end timestamp into the current frame's slot of a small ring; a slot is
+// read back when the ring comes round to it again, GPU_PROFILER_LATENCY frames
+// later, so the CPU never waits on the GPU. A slot whose results still aren't
+// available then is dropped instead of stalling. Unlike the CPU profiler this
+// stays in RELEASE builds, since the timings drive runtime decisions.
+
+#define GPU_PROFILER_LATENCY 4
+#define GPU_PROFILER_MAX_ZONES 16
+
+struct gpu_zone
+{
+    const char *Name;
+    GLuint BeginQuery;
+    GLuint EndQuery;
+    int32 Depth;
+};
+
+struct gpu_frame
+{
+    int64 FrameIndex;
+    int32 ZoneCount;
+    // NOTE: Zones nest, so the last end query issued isn't necessarily the
+    // last zone's; that's the one checked for availability.
+    int32 LastEndedZone;
+    bool32 Pending;
+    // NOTE: Issued while a CPU capture was running, so it goes in the trace.
+    bool32 Profiled;
+    gpu_zone Zones[GPU_PROFILER_MAX_ZONES];
+};
+
+struct gpu_zone_result
+{
+    const char *Name;
+    int32 Depth;
+    float Milliseconds;
+};
+
+struct gpu_profiler
+{
+    bool32 Initialized;
+    bool32 Print;
+    int64 FrameIndex;
+    int32 Depth;
+    int32 DroppedFrames;
+    gpu_frame Frames[GPU_PROFILER_LATENCY];
+
+    // NOTE: Most recent frame read back.
+    int64 ResultFrameIndex;
+    int32 ResultCount;
+    gpu_zone_result Results[GPU_PROFILER_MAX_ZONES];
+    float FrameMilliseconds;
+};
+
+void InitGPUProfiler(gpu_profiler *Profiler)
+{
+    for(int FrameIndex = 0; FrameIndex < GPU_PROFILER_LATENCY; ++FrameIndex)
+    {
+	gpu_frame *Frame = Profiler->Frames + FrameIndex;
+	for(int ZoneIndex = 0; ZoneIndex < GPU_PROFILER_MAX_ZONES; ++ZoneIndex)
+	{
+	    glGenQueries(1, &Frame->Zones[ZoneIndex].BeginQuery);
+	    glGenQueries(1, &Frame->Zones[ZoneIndex].EndQuery);
+	}
+    }
+    Profiler->ResultFrameIndex = -1;
+    Profiler->Initialized = true;
+}
+
+void PrintGPUFrame(gpu_profiler *Profiler)
+{
+    printf("GPU frame %lld:", (long long)Profiler->ResultFrameIndex);
+    for(int ZoneIndex = 0; ZoneIndex < Profiler->ResultCount; ++ZoneIndex)
+    {
+	gpu_zone_result *Result = Profiler->Results + ZoneIndex;
+	printf(" %*s%s %.3f", Result->Depth, "", Result->Name, Result->Milliseconds);
+    }
+    printf(" | total %.3f ms\n", Profiler->FrameMilliseconds);
+}
+
+void ReadGPUFrame(gpu_profiler *Profiler, gpu_frame *Frame)
+{
+    GLint Available = 0;
+    glGetQueryObjectiv(Frame->Zones[Frame->LastEndedZone].EndQuery, GL_QUERY_RESULT_AVAILABLE, &Available);
+    if (!Available)
+    {
+	++Profiler->DroppedFrames;
+	return;
+    }
+
+    GLuint64 FrameBegin = 0;
+    GLuint64 FrameEnd = 0;
+    for(int ZoneIndex = 0; ZoneIndex < Frame->ZoneCount; ++ZoneIndex)
+    {
+	gpu_zone *Zone = Frame->Zones + ZoneIndex;
+	GLuint64 Begin, End;
+	glGetQueryObjectui64v(Zone->BeginQuery, GL_QUERY_RESULT, &Begin);
+	glGetQueryObjectui64v(Zone->EndQuery, GL_QUERY_RESULT, &End);
+
+	gpu_zone_result *Result = Profiler->Results + ZoneIndex;
+	Result->Name = Zone->Name;
+	Result->Depth = Zone->Depth;
+	Result->Milliseconds = (End - Begin) / 1000000.0f;
+
+	if (ZoneIndex == 0 || Begin < FrameBegin)
+	{
+	    FrameBegin = Begin;
+	}
+	if (End > FrameEnd)
+	{
+	    FrameEnd = End;
+	}
+	if (Frame->Profiled)
+	{
+	    RecordGPUProfilerEvent(Zone->Name, Begin, End);
+	}
+    }
+    Profiler->ResultFrameIndex = Frame->FrameIndex;
+    Profiler->ResultCount = Frame->ZoneCount;
+    Profiler->FrameMilliseconds = (FrameEnd - FrameBegin) / 1000000.0f;
+
+    if (Profiler->Print)
+    {
+	PrintGPUFrame(Profiler);
+    }
+}
+
+void BeginGPUFrame(gpu_profiler *Profiler)
+{
+    gpu_frame *Frame = Profiler->Frames + (Profiler->FrameIndex % GPU_PROFILER_LATENCY);
+    if (Frame->Pending)
+    {
+	ReadGPUFrame(Profiler, Frame);
+    }
+    Frame->FrameIndex = Profiler->FrameIndex;
+    Frame->ZoneCount = 0;
+    Frame->Pending = false;
+    Profiler->Depth = 0;
+}
+
+void EndGPUFrame(gpu_profiler *Profiler)
+{
+    gpu_frame *Frame = Profiler->Frames + (Profiler->FrameIndex % GPU_PROFILER_LATENCY);
+    Frame->Pending = (Frame->ZoneCount > 0);
+    Frame->Profiled = IsProfilerRecording();
+    ++Profiler->FrameIndex;
+}
+
+// NOTE: Returns the zone index to pass to EndGPUZone, -1 when the frame is
+// out of zones.
+int32 BeginGPUZone(gpu_profiler *Profiler, const char *Name)
+{
+    gpu_frame *Frame = Profiler->Frames + (Profiler->FrameIndex % GPU_PROFILER_LATENCY);
+    if (!Profiler->Initialized || Frame->ZoneCount >= GPU_PROFILER_MAX_ZONES)
+    {
+	return -1;
+    }
+    int32 ZoneIndex = Frame->ZoneCount++;
+    gpu_zone *Zone = Frame->Zones + ZoneIndex;
+    Zone->Name = Name;
+    Zone->Depth = Profiler->Depth++;
+    glQueryCounter(Zone->BeginQuery, GL_TIMESTAMP);
+    return ZoneIndex;
+}
+
+void EndGPUZone(gpu_profiler *Profiler, int32 ZoneIndex)
+{
+    if (ZoneIndex < 0)
+    {
+	return;
+    }
+    gpu_frame *Frame = Profiler->Frames + (Profiler->FrameIndex % GPU_PROFILER_LATENCY);
+    glQueryCounter(Frame->Zones[ZoneIndex].EndQuery, GL_TIMESTAMP);
+    Frame->LastEndedZone = ZoneIndex;
+    --Profiler->Depth;
+}
+
+struct gpu_timed_block
+{
+    gpu_profiler *Profiler;
+    int32 ZoneIndex;
+
+    gpu_timed_block(gpu_profiler *BlockProfiler, const char *Name)
+    {
+	Profiler = BlockProfiler;
+	ZoneIndex = BeginGPUZone(Profiler, Name);
+    }
+
+    ~gpu_timed_block()
+    {
+	EndGPUZone(Profiler, ZoneIndex);
+    }
+};
+
+#define GPU_TIMED_BLOCK__(Profiler, Name, Line) gpu_timed_block GPUTimedBlock_##Line(Profiler, Name)
+#define GPU_TIMED_BLOCK_(Profiler, Name, Line) GPU_TIMED_BLOCK__(Profiler, Name, Line)
+#define GPU_TIMED_BLOCK(Profiler, Name) GPU_TIMED_BLOCK_(Profiler, Name, __LINE__)
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef INPUTRECORDING_CPP__
+#define INPUTRECORDING_CPP__
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// NOTE: Records the input Update sees each frame, dT included, and plays it
+// back, so the same camera path can be run through a scene before and after a
+// change and the frame times compared. The file is a header and then one
+// input struct per frame, written as it is in memory (a little over a hundred
+// bytes a frame). Frames are counted from the file size, so a recording
+// stopped by exit() is still whole.
+//
+// Given the same input, Update does the same thing, so a replay with the
+// recorded timestep repeats the recorded run exactly, whatever the frame rate
+// of the replay. The fixed timestep drives the same inputs at a steady
+// INPUT_REPLAY_FIXED_DELTA_TIME instead, for runs that shouldn't depend on
+// how fast the recording machine was.
+
+#define INPUT_RECORDING_MAGIC 0x54504E49
+#define INPUT_RECORDING_VERSION 1
+#define INPUT_REPLAY_FIXED_DELTA_TIME (1.0f/60.0f)
+
+enum input_recording_mode
+{
+    INPUT_RECORDING_OFF,
+    INPUT_RECORDING_RECORD,
+    INPUT_RECORDING_REPLAY
+};
+
+// NOTE: A recording only replays on a build with the same input layout.
+struct input_recording_header
+{
+    uint32 Magic;
+    uint32 Version;
+    uint32 InputSize;
+    uint32 Reserved;
+};
+
+struct input_recording
+{
+    const char *Path;
+    input_recording_mode Mode;
+    bool32 FixedTimestep;
+
+    FILE *File;
+    // NOTE: Frames written or read so far, and for a replay, in the file.
+    int32 FrameIndex;
+    int32 FrameCount;
+};
+
+// NOTE: Recognizes "--record-input PATH", "--replay-input PATH" and
+// "--replay-timestep recorded|fixed". Returns how many arguments were
+// consumed, 0 if Argument isn't ours.
+int ParseInputRecordingArgument(input_recording *Recording, int ArgCount, char **Args)
+{
+    if (strcmp(Args[0], "--record-input") == 0 && ArgCount > 1)
+    {
+	Recording->Mode = INPUT_RECORDING_RECORD;
+	Recording->Path = Args[1];
+	return 2;
+    }
+    if (strcmp(Args[0], "--replay-input") == 0 && ArgCount > 1)
+    {
+	Recording->Mode = INPUT_RECORDING_REPLAY;
+	Recording->Path = Args[1];
+	return 2;
+    }
+    if (strcmp(Args[0], "--replay-timestep") == 0 && ArgCount > 1)
+    {
+	Recording->FixedTimestep = (strcmp(Args[1], "fixed") == 0);
+	return 2;
+    }
+    return 0;
+}
+
+// NOTE: Opens the file for the mode the arguments asked for; false when it
+// can't be, or isn't a recording this build can replay.
+bool BeginInputRecording(input_recording *Recording)
+{
+    if (Recording->Mode == INPUT_RECORDING_RECORD)
+    {
+	Recording->File = fopen(Recording->Path, "wb");
+	if (!Recording->File)
+	{
+	    printf("Can't open %s to record input\n", Recording->Path);
+	    return false;
+	}
+	input_recording_header Header = { INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION, sizeof(input), 0 };
+	fwrite(&Header, sizeof(Header), 1, Recording->File);
+	printf("Recording input to %s\n", Recording->Path);
+    }
+    else if (Recording->Mode == INPUT_RECORDING_REPLAY)
+    {
+	Recording->File = fopen(Recording->Path, "rb");
+	if (!Recording->File)
+	{
+	    printf("Can't open input recording %s\n", Recording->Path);
+	    return false;
+	}
+	input_recording_header Header;
+	if (fread(&Header, sizeof(Header), 1, Recording->File) != 1 ||
+	    Header.Magic != INPUT_RECORDING_MAGIC || Header.Version != INPUT_RECORDING_VERSION ||
+	    Header.InputSize != sizeof(input))
+	{
+	    printf("%s isn't an input recording this build can replay\n", Recording->Path);
+	    fclose(Recording->File);
+	    Recording->File = 0;
+	    return false;
+	}
+	fseek(Recording->File, 0, SEEK_END);
+	long Size = ftell(Recording->File);
+	fseek(Recording->File, sizeof(Header), SEEK_SET);
+	Recording->FrameCount = (int32)((Size - (long)sizeof(Header)) / sizeof(input));
+	printf("Replaying %d frames of input from %s (%s timestep)\n", Recording->FrameCount,
+	       Recording->Path, Recording->FixedTimestep ? "fixed" : "recorded");
+    }
+    return true;
+}
+
+// NOTE: Call once a frame with the input Update is about to see. Recording
+// writes it; replaying replaces it with the recorded frame, and returns false
+// once the recording has run out.
+bool UpdateInputRecording(input_recording *Recording, input *Input)
+{
+    if (!Recording->File)
+    {
+	return true;
+    }
+    if (Recording->Mode == INPUT_RECORDING_RECORD)
+    {
+	fwrite(Input, sizeof(input), 1, Recording->File);
+    }
+    else
+    {
+	if (Recording->FrameIndex >= Recording->FrameCount ||
+	    fread(Input, sizeof(input), 1, Recording->File) != 1)
+	{
+	    return false;
+	}
+	if (Recording->FixedTimestep)
+	{
+	    Input->dT = INPUT_REPLAY_FIXED_DELTA_TIME;
+	}
+    }
+    ++Recording->FrameIndex;
+    return true;
+}
+
+void EndInputRecording(input_recording *Recording)
+{
+    if (Recording->File)
+    {
+	fclose(Recording->File);
+	Recording->File = 0;
+	if (Recording->Mode == INPUT_RECORDING_RECORD)
+	{
+	    printf("Recorded %d frames of input to %s\n", Recording->FrameIndex, Recording->Path);
+	}
+    }
+}
+
+#endif
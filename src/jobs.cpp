@@ -0,0 +1,472 @@
+#ifndef JOBS_CPP__
+#define JOBS_CPP__
+
+#include "platform.h"
+#include "profiler.cpp"
+
+#include <stdio.h>
+#include <atomic>
+#include <emmintrin.h>
+#if defined(WINDOWS)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+#endif
+
+// NOTE: Work-stealing job system. Every thread, the main thread included as
+// worker 0, owns a Chase-Lev deque: it pushes and pops at the bottom, idle
+// workers steal from the top of a random victim. A job decrements its counter
+// when it finishes and WaitForCounter runs other jobs until the counter hits
+// zero, so waiting never blocks a thread that could be working; a job that
+// depends on others kicks them and waits on their counter. Workers that find
+// nothing to do spin briefly and then sleep on a semaphore.
+//
+// KickBackgroundJob queues a job only the other workers take, for work the
+// main thread should overlap with rather than run itself: its own deque
+// would hand the job back to it at its next wait.
+//
+// Each worker has a scratch arena that is rewound after every job, so a job
+// can push temporaries freely but must not keep pointers into it.
+
+// NOTE: Power of two. A full deque runs new jobs inline.
+#define JOB_DEQUE_SIZE 4096
+#define JOB_SCRATCH_SIZE MEGABYTES(1)
+#define JOB_SPIN_COUNT 1024
+
+typedef void job_function(void *Data, int32 Start, int32 End, memory_arena *Scratch);
+
+struct job_counter
+{
+    std::atomic<int32> Count;
+};
+
+struct job
+{
+    job_function *Function;
+    void *Data;
+    int32 Start;
+    int32 End;
+    job_counter *Counter;
+};
+
+// NOTE: Jobs are stored by value. The owner only writes the slot at Bottom,
+// which no thief can be reading while the deque isn't full, and a thief copies
+// its job out before the CAS that claims it, so a copy that raced the owner is
+// thrown away with the failed CAS.
+struct job_deque
+{
+    std::atomic<int64> Top;
+    std::atomic<int64> Bottom;
+    job Jobs[JOB_DEQUE_SIZE];
+};
+
+struct job_system;
+
+struct job_worker
+{
+    int32 Index;
+    job_system *System;
+    job_deque Deque;
+    uint32 RandomState;
+    memory_arena Scratch;
+};
+
+struct job_system
+{
+    int32 ThreadCount;
+    job_worker *Workers;
+    std::atomic<int32> SleepingCount;
+    // NOTE: Worker 0 owns it but only pushes; everyone else steals from it
+    // before trying the other workers' deques.
+    job_deque BackgroundJobs;
+#if defined(WINDOWS)
+    HANDLE WakeSemaphore;
+#else
+    sem_t WakeSemaphore;
+#endif
+};
+
+thread_local job_worker *CurrentJobWorker;
+
+// NOTE: The calling thread's scratch arena, for code that isn't handed one
+// by a job. Any thread in the job system has one, the main thread included;
+// scope each use with BeginTemporaryMemory/EndTemporaryMemory.
+inline memory_arena *GetScratchArena()
+{
+    Assert(CurrentJobWorker);
+    return &CurrentJobWorker->Scratch;
+}
+
+// NOTE: Owner only.
+bool32 PushJob(job_deque *Deque, job *Job)
+{
+    int64 Bottom = Deque->Bottom.load(std::memory_order_relaxed);
+    int64 Top = Deque->Top.load(std::memory_order_acquire);
+    if (Bottom - Top >= JOB_DEQUE_SIZE)
+    {
+	return false;
+    }
+    Deque->Jobs[Bottom & (JOB_DEQUE_SIZE - 1)] = *Job;
+    std::atomic_thread_fence(std::memory_order_release);
+    Deque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// NOTE: Owner only. Races thieves for the last job with a CAS on Top.
+bool32 PopJob(job_deque *Deque, job *Job)
+{
+    int64 Bottom = Deque->Bottom.load(std::memory_order_relaxed) - 1;
+    Deque->Bottom.store(Bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 Top = Deque->Top.load(std::memory_order_relaxed);
+
+    bool32 Result = false;
+    if (Top <= Bottom)
+    {
+	*Job = Deque->Jobs[Bottom & (JOB_DEQUE_SIZE - 1)];
+	Result = true;
+	if (Top == Bottom)
+	{
+	    if (!Deque->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst,
+						    std::memory_order_relaxed))
+	    {
+		Result = false;
+	    }
+	    Deque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+	}
+    }
+    else
+    {
+	Deque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+    }
+    return Result;
+}
+
+// NOTE: Any thread. Fails when empty or when another thief won.
+bool32 StealJob(job_deque *Deque, job *Job)
+{
+    int64 Top = Deque->Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 Bottom = Deque->Bottom.load(std::memory_order_acquire);
+
+    bool32 Result = false;
+    if (Top < Bottom)
+    {
+	*Job = Deque->Jobs[Top & (JOB_DEQUE_SIZE - 1)];
+	Result = Deque->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst,
+						    std::memory_order_relaxed);
+    }
+    return Result;
+}
+
+void RunJob(job_worker *Worker, job *Job)
+{
+    TIMED_BLOCK("Job");
+    temporary_memory ScratchMemory = BeginTemporaryMemory(&Worker->Scratch);
+    Job->Function(Job->Data, Job->Start, Job->End, &Worker->Scratch);
+    EndTemporaryMemory(ScratchMemory);
+    if (Job->Counter)
+    {
+	Job->Counter->Count.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// NOTE: xorshift, only used to spread thieves over victims.
+uint32 NextVictim(job_worker *Worker)
+{
+    uint32 X = Worker->RandomState;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    Worker->RandomState = X;
+    return X;
+}
+
+bool32 TryRunJob(job_worker *Worker)
+{
+    job Job;
+    bool32 Found = PopJob(&Worker->Deque, &Job);
+    job_system *System = Worker->System;
+    if (!Found && Worker->Index != 0)
+    {
+	Found = StealJob(&System->BackgroundJobs, &Job);
+    }
+    if (!Found)
+    {
+	uint32 First = NextVictim(Worker);
+	for(int32 Offset = 0; Offset < System->ThreadCount && !Found; ++Offset)
+	{
+	    int32 Victim = (First + Offset) % System->ThreadCount;
+	    if (Victim != Worker->Index)
+	    {
+		Found = StealJob(&System->Workers[Victim].Deque, &Job);
+	    }
+	}
+    }
+    if (Found)
+    {
+	RunJob(Worker, &Job);
+    }
+    return Found;
+}
+
+// NOTE: Gives the core to a thread that may be holding a stolen job, which
+// matters once there are more threads than free cores.
+void YieldJobThread()
+{
+#if defined(WINDOWS)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void WaitForWake(job_system *System)
+{
+#if defined(WINDOWS)
+    WaitForSingleObject(System->WakeSemaphore, INFINITE);
+#else
+    while (sem_wait(&System->WakeSemaphore) != 0)
+    {
+    }
+#endif
+}
+
+// NOTE: Claims a sleeper by taking it off SleepingCount before posting, so
+// posts never pile up past the number of threads actually waiting.
+bool32 ClaimSleepingWorker(job_system *System)
+{
+    int32 Sleeping = System->SleepingCount.load();
+    while (Sleeping > 0)
+    {
+	if (System->SleepingCount.compare_exchange_weak(Sleeping, Sleeping - 1))
+	{
+	    return true;
+	}
+    }
+    return false;
+}
+
+void WakeJobWorkers(job_system *System, int32 JobCount)
+{
+    for(int32 Wake = 0; Wake < JobCount && ClaimSleepingWorker(System); ++Wake)
+    {
+#if defined(WINDOWS)
+	ReleaseSemaphore(System->WakeSemaphore, 1, 0);
+#else
+	sem_post(&System->WakeSemaphore);
+#endif
+    }
+}
+
+#if defined(WINDOWS)
+DWORD WINAPI JobWorkerThread(void *Parameter)
+#else
+void *JobWorkerThread(void *Parameter)
+#endif
+{
+    job_worker *Worker = (job_worker *)Parameter;
+    job_system *System = Worker->System;
+    CurrentJobWorker = Worker;
+    SetProfilerThreadName("Worker", Worker->Index);
+
+    int32 Spins = 0;
+    while(1)
+    {
+	if (TryRunJob(Worker))
+	{
+	    Spins = 0;
+	    continue;
+	}
+	if (++Spins < JOB_SPIN_COUNT)
+	{
+	    _mm_pause();
+	    continue;
+	}
+
+	// NOTE: Announce the sleep before the last look, so a job pushed in
+	// between either gets found here or sees us sleeping and posts. If the
+	// last look finds work but a waker already claimed a sleeper, that post
+	// is ours and has to be consumed.
+	System->SleepingCount.fetch_add(1);
+	if (!TryRunJob(Worker) || !ClaimSleepingWorker(System))
+	{
+	    WaitForWake(System);
+	}
+	Spins = 0;
+    }
+    return 0;
+}
+
+int32 GetProcessorCount()
+{
+#if defined(WINDOWS)
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return (int32)Info.dwNumberOfProcessors;
+#else
+    return (int32)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+// NOTE: ThreadCount includes the calling thread, which becomes worker 0;
+// 0 or less means one thread per processor.
+void InitJobSystem(job_system *System, memory_arena *Arena, int32 ThreadCount)
+{
+    if (ThreadCount <= 0)
+    {
+	ThreadCount = GetProcessorCount();
+    }
+    ThreadCount = Clamp(ThreadCount, 1, MAX_JOB_THREADS);
+
+    System->ThreadCount = ThreadCount;
+    System->Workers = PushArray(Arena, ThreadCount, job_worker);
+#if defined(WINDOWS)
+    System->WakeSemaphore = CreateSemaphore(0, 0, MAX_JOB_THREADS*JOB_DEQUE_SIZE, 0);
+#else
+    sem_init(&System->WakeSemaphore, 0, 0);
+#endif
+
+    for(int32 WorkerIndex = 0; WorkerIndex < ThreadCount; ++WorkerIndex)
+    {
+	job_worker *Worker = System->Workers + WorkerIndex;
+	Worker->Index = WorkerIndex;
+	Worker->System = System;
+	Worker->RandomState = 0x9E3779B9u*(WorkerIndex + 1);
+	Worker->Scratch = PushArena(Arena, JOB_SCRATCH_SIZE);
+    }
+    CurrentJobWorker = System->Workers;
+    SetProfilerThreadName("Main", 0);
+
+    for(int32 WorkerIndex = 1; WorkerIndex < ThreadCount; ++WorkerIndex)
+    {
+#if defined(WINDOWS)
+	DWORD ThreadID;
+	CreateThread(0, 0, JobWorkerThread, System->Workers + WorkerIndex, 0, &ThreadID);
+#else
+	pthread_t Thread;
+	pthread_create(&Thread, 0, JobWorkerThread, System->Workers + WorkerIndex);
+	pthread_detach(Thread);
+#endif
+    }
+    printf("Job system: %d threads\n", ThreadCount);
+}
+
+// NOTE: Queues Function over [Start, End) on the calling thread's deque, or
+// runs it right away if the deque is full. Only worker threads (the main
+// thread is worker 0) can kick or wait.
+void KickJob(job_system *System, job_function *Function, void *Data,
+	     int32 Start, int32 End, job_counter *Counter)
+{
+    job_worker *Worker = CurrentJobWorker;
+    Assert(Worker);
+    if (Counter)
+    {
+	Counter->Count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    job Job;
+    Job.Function = Function;
+    Job.Data = Data;
+    Job.Start = Start;
+    Job.End = End;
+    Job.Counter = Counter;
+
+    if (PushJob(&Worker->Deque, &Job))
+    {
+	WakeJobWorkers(System, 1);
+    }
+    else
+    {
+	RunJob(Worker, &Job);
+    }
+}
+
+// NOTE: Queues Function for any worker but the main thread, which can then
+// wait on Counter knowing the job runs alongside whatever it does until
+// then. Only worker 0 can kick these; with no other workers, or the queue
+// full, the job runs right away.
+void KickBackgroundJob(job_system *System, job_function *Function, void *Data,
+		       int32 Start, int32 End, job_counter *Counter)
+{
+    job_worker *Worker = CurrentJobWorker;
+    Assert(Worker && Worker->Index == 0);
+    if (Counter)
+    {
+	Counter->Count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    job Job;
+    Job.Function = Function;
+    Job.Data = Data;
+    Job.Start = Start;
+    Job.End = End;
+    Job.Counter = Counter;
+
+    if (System->ThreadCount > 1 && PushJob(&System->BackgroundJobs, &Job))
+    {
+	WakeJobWorkers(System, 1);
+    }
+    else
+    {
+	RunJob(Worker, &Job);
+    }
+}
+
+// NOTE: Helps with queued jobs, stolen or our own, until Counter is zero.
+void WaitForCounter(job_system *System, job_counter *Counter)
+{
+    job_worker *Worker = CurrentJobWorker;
+    Assert(Worker);
+    int32 Spins = 0;
+    while (Counter->Count.load(std::memory_order_acquire) > 0)
+    {
+	if (TryRunJob(Worker))
+	{
+	    Spins = 0;
+	}
+	else if (++Spins < JOB_SPIN_COUNT)
+	{
+	    _mm_pause();
+	}
+	else
+	{
+	    YieldJobThread();
+	}
+    }
+}
+
+// NOTE: Splits [0, Count) into batches of at least BatchSize, runs them across
+// the workers and returns when all are done.
+void ParallelFor(job_system *System, int32 Count, int32 BatchSize,
+		 job_function *Function, void *Data)
+{
+    if (Count <= 0)
+    {
+	return;
+    }
+    BatchSize = Max(BatchSize, 1);
+    int32 BatchCount = (Count + BatchSize - 1) / BatchSize;
+    if (BatchCount == 1 || System->ThreadCount == 1)
+    {
+	job_worker *Worker = CurrentJobWorker;
+	Assert(Worker);
+	temporary_memory ScratchMemory = BeginTemporaryMemory(&Worker->Scratch);
+	Function(Data, 0, Count, &Worker->Scratch);
+	EndTemporaryMemory(ScratchMemory);
+	return;
+    }
+
+    job_counter Counter;
+    Counter.Count.store(0, std::memory_order_relaxed);
+    for(int32 Start = 0; Start < Count; Start += BatchSize)
+    {
+	KickJob(System, Function, Data, Start, Min(Start + BatchSize, Count), &Counter);
+    }
+    WaitForCounter(System, &Counter);
+}
+
+#endif
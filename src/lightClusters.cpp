@@ -0,0 +1,475 @@
+#ifndef LIGHTCLUSTERS_CPP__
+#define LIGHTCLUSTERS_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+#include "profiler.cpp"
+#include "matrixMath.cpp"
+#include "culling.cpp"
+#include "bvh.cpp"
+#include "jobs.cpp"
+
+#include <emmintrin.h>
+#include <string.h>
+
+// NOTE: Clustered forward shading for point lights. Each eye's view is
+// split into a grid of clusters, screen tiles by depth slices, and every
+// cluster gets the list of lights whose sphere touches it. The fragment
+// shader finds its cluster from its position and loops over just that
+// list. Slices are exponential in view depth, so clusters stay roughly
+// cube shaped; everything nearer than CLUSTER_NEAR is the first slice and
+// everything past CLUSTER_FAR the last.
+//
+// Lights are assigned on the job workers a few slices at a time. A job
+// asks a BVH over the lights' world bounds for the ones near each slice,
+// keeps those overlapping the slice's depth range and tests them against
+// each cluster's view space bounds four at a time. The lists are
+// then packed and uploaded as texture buffers: the lights, each cluster's
+// offset and count, and the packed light indices.
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_SLICE_SIZE (CLUSTER_TILES_X*CLUSTER_TILES_Y)
+#define CLUSTER_COUNT (CLUSTER_SLICE_SIZE*CLUSTER_SLICES)
+// NOTE: Both headset eyes and the desktop view, which are all built in one
+// pass at the start of the frame.
+#define CLUSTER_MAX_EYES 3
+#define CLUSTER_NEAR 0.1f
+#define CLUSTER_FAR 100.0f
+// NOTE: Lights past this in one cluster are dropped.
+#define CLUSTER_MAX_LIGHTS 128
+#define CLUSTER_SLICES_PER_JOB 4
+#define MAX_POINT_LIGHTS 1024
+// NOTE: The three buffer textures are bound from this unit up, after the
+// material textures.
+#define CLUSTER_TEXTURE_UNIT 3
+
+struct point_light
+{
+    v3 Position;
+    float Radius;
+    v3 Color;
+    float Power;
+};
+
+// NOTE: Sampler and grid uniforms are fixed, so they are set once.
+struct cluster_binding
+{
+    GLuint PointLightCount;
+    GLuint PointLights;
+    GLuint ClusterGrid;
+    GLuint ClusterLightIndices;
+    GLuint ClusterCounts;
+    GLuint ClusterDepthParams;
+    GLuint ClusterFirstEye;
+};
+
+struct light_clusters
+{
+    int32 EyeCount;
+    int32 LightCount;
+    // NOTE: View space light spheres per eye, SoA and padded to 4.
+    float *LightX[CLUSTER_MAX_EYES];
+    float *LightY[CLUSTER_MAX_EYES];
+    float *LightZ[CLUSTER_MAX_EYES];
+    float *LightRadius;
+
+    // NOTE: World bounds of every light, refit as the lights move.
+    bvh LightBVH;
+    aabb *LightBounds;
+    // NOTE: Sphere around each slice of each eye, in world space.
+    bounding_sphere SliceSpheres[CLUSTER_MAX_EYES][CLUSTER_SLICES];
+
+    // NOTE: Bounds of each cluster of one eye in its view space; the
+    // projection is the same for both eyes.
+    aabb *Bounds;
+    float SliceDepths[CLUSTER_SLICES + 1];
+    bounding_sphere ViewSliceSpheres[CLUSTER_SLICES];
+    mat4 BoundsProjection;
+
+    // NOTE: CLUSTER_MAX_LIGHTS light indices for each cluster of each eye,
+    // as the jobs find them.
+    uint16 *ClusterLights;
+    uint32 *ClusterLightCounts;
+
+    // NOTE: What's uploaded.
+    float *LightData;
+    uint32 *Grid;
+    uint32 *Indices;
+    int32 IndexCount;
+    int32 Overflowed;
+
+    GLuint LightBuffer;
+    GLuint GridBuffer;
+    GLuint IndexBuffer;
+    GLuint Textures[3];
+};
+
+cluster_binding CreateClusterBinding(GLuint ShaderProgram)
+{
+    cluster_binding Binding = {0};
+    Binding.PointLightCount = glGetUniformLocation(ShaderProgram, "PointLightCount");
+    Binding.PointLights = glGetUniformLocation(ShaderProgram, "PointLights");
+    Binding.ClusterGrid = glGetUniformLocation(ShaderProgram, "ClusterGrid");
+    Binding.ClusterLightIndices = glGetUniformLocation(ShaderProgram, "ClusterLightIndices");
+    Binding.ClusterCounts = glGetUniformLocation(ShaderProgram, "ClusterCounts");
+    Binding.ClusterDepthParams = glGetUniformLocation(ShaderProgram, "ClusterDepthParams");
+    Binding.ClusterFirstEye = glGetUniformLocation(ShaderProgram, "ClusterFirstEye");
+    return Binding;
+}
+
+// NOTE: Slice k >= 1 starts at CLUSTER_NEAR*(CLUSTER_FAR/CLUSTER_NEAR)^((k-1)/(SLICES-1)),
+// the shader inverts that with log(Depth)*Scale + Bias.
+void SetClusterUniforms(GLuint Program, cluster_binding *Binding)
+{
+    float DepthScale = (CLUSTER_SLICES - 1) / logf(CLUSTER_FAR / CLUSTER_NEAR);
+    float DepthBias = -logf(CLUSTER_NEAR)*DepthScale;
+    glUseProgram(Program);
+    glUniform1i(Binding->PointLightCount, 0);
+    glUniform1i(Binding->PointLights, CLUSTER_TEXTURE_UNIT);
+    glUniform1i(Binding->ClusterGrid, CLUSTER_TEXTURE_UNIT + 1);
+    glUniform1i(Binding->ClusterLightIndices, CLUSTER_TEXTURE_UNIT + 2);
+    glUniform3i(Binding->ClusterCounts, CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+    glUniform2f(Binding->ClusterDepthParams, DepthScale, DepthBias);
+    glUniform1i(Binding->ClusterFirstEye, 0);
+    glUseProgram(0);
+}
+
+// NOTE: The buffer has to exist before it can back a texture, so it gets
+// an empty store here; BuildLightClusters respecifies it every frame.
+GLuint CreateBufferTexture(GLuint Buffer, GLenum Format)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, Buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, 0, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    GLuint Texture;
+    glGenTextures(1, &Texture);
+    glBindTexture(GL_TEXTURE_BUFFER, Texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, Format, Buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return Texture;
+}
+
+// NOTE: Just the CPU side, enough for AssignLightClusters.
+void InitLightClusterLists(light_clusters *Clusters, memory_arena *Arena)
+{
+    int32 PaddedLights = (MAX_POINT_LIGHTS + 3) & ~3;
+    for(int32 Eye = 0; Eye < CLUSTER_MAX_EYES; ++Eye)
+    {
+	Clusters->LightX[Eye] = PushArray(Arena, PaddedLights, float);
+	Clusters->LightY[Eye] = PushArray(Arena, PaddedLights, float);
+	Clusters->LightZ[Eye] = PushArray(Arena, PaddedLights, float);
+    }
+    Clusters->LightRadius = PushArray(Arena, PaddedLights, float);
+    InitBVH(&Clusters->LightBVH, Arena, MAX_POINT_LIGHTS);
+    Clusters->LightBounds = PushArray(Arena, MAX_POINT_LIGHTS, aabb);
+    Clusters->Bounds = PushArray(Arena, CLUSTER_COUNT, aabb);
+    memset(&Clusters->BoundsProjection, 0, sizeof(mat4));
+    Clusters->ClusterLights = PushArray(Arena, CLUSTER_MAX_EYES*CLUSTER_COUNT*CLUSTER_MAX_LIGHTS, uint16);
+    Clusters->ClusterLightCounts = PushArray(Arena, CLUSTER_MAX_EYES*CLUSTER_COUNT, uint32);
+    Clusters->LightData = PushArray(Arena, 8*MAX_POINT_LIGHTS, float);
+    Clusters->Grid = PushArray(Arena, 2*CLUSTER_MAX_EYES*CLUSTER_COUNT, uint32);
+    Clusters->Indices = PushArray(Arena, CLUSTER_MAX_EYES*CLUSTER_COUNT*CLUSTER_MAX_LIGHTS, uint32);
+    Clusters->LightCount = 0;
+    Clusters->EyeCount = 0;
+}
+
+void InitLightClusters(light_clusters *Clusters, memory_arena *Arena)
+{
+    InitLightClusterLists(Clusters, Arena);
+    glGenBuffers(1, &Clusters->LightBuffer);
+    glGenBuffers(1, &Clusters->GridBuffer);
+    glGenBuffers(1, &Clusters->IndexBuffer);
+    Clusters->Textures[0] = CreateBufferTexture(Clusters->LightBuffer, GL_RGBA32F);
+    Clusters->Textures[1] = CreateBufferTexture(Clusters->GridBuffer, GL_RG32UI);
+    Clusters->Textures[2] = CreateBufferTexture(Clusters->IndexBuffer, GL_R32UI);
+}
+
+// NOTE: Only redone when the projection changes. A view space point at
+// depth D lands on NDC x where x*D = P00*X - P20*D.
+void ComputeClusterBounds(light_clusters *Clusters, mat4 Projection)
+{
+    if (memcmp(&Clusters->BoundsProjection, &Projection, sizeof(mat4)) == 0)
+    {
+	return;
+    }
+    Clusters->BoundsProjection = Projection;
+
+    float Far = Projection.E[3][2] / (Projection.E[2][2] + 1.0f);
+    Clusters->SliceDepths[0] = 0.0f;
+    for(int32 Slice = 1; Slice < CLUSTER_SLICES; ++Slice)
+    {
+	Clusters->SliceDepths[Slice] = CLUSTER_NEAR*powf(CLUSTER_FAR / CLUSTER_NEAR,
+							  (float)(Slice - 1) / (CLUSTER_SLICES - 1));
+    }
+    Clusters->SliceDepths[CLUSTER_SLICES] = Max(Far, CLUSTER_FAR);
+
+    for(int32 Slice = 0; Slice < CLUSTER_SLICES; ++Slice)
+    {
+	float Depths[2] = { Clusters->SliceDepths[Slice], Clusters->SliceDepths[Slice + 1] };
+	aabb SliceBounds = EmptyAABB();
+	for(int32 TileY = 0; TileY < CLUSTER_TILES_Y; ++TileY)
+	{
+	    float NDCY[2] = { -1.0f + 2.0f*TileY / CLUSTER_TILES_Y, -1.0f + 2.0f*(TileY + 1) / CLUSTER_TILES_Y };
+	    for(int32 TileX = 0; TileX < CLUSTER_TILES_X; ++TileX)
+	    {
+		float NDCX[2] = { -1.0f + 2.0f*TileX / CLUSTER_TILES_X, -1.0f + 2.0f*(TileX + 1) / CLUSTER_TILES_X };
+		aabb Bounds;
+		Bounds.Min = V3(FLT_MAX, FLT_MAX, -Depths[1]);
+		Bounds.Max = V3(-FLT_MAX, -FLT_MAX, -Depths[0]);
+		for(int32 Corner = 0; Corner < 8; ++Corner)
+		{
+		    float Depth = Depths[Corner & 1];
+		    float X = Depth*(NDCX[(Corner >> 1) & 1] + Projection.E[2][0]) / Projection.E[0][0];
+		    float Y = Depth*(NDCY[(Corner >> 2) & 1] + Projection.E[2][1]) / Projection.E[1][1];
+		    Bounds.Min.x = Min(Bounds.Min.x, X);
+		    Bounds.Max.x = Max(Bounds.Max.x, X);
+		    Bounds.Min.y = Min(Bounds.Min.y, Y);
+		    Bounds.Max.y = Max(Bounds.Max.y, Y);
+		}
+		Clusters->Bounds[(Slice*CLUSTER_TILES_Y + TileY)*CLUSTER_TILES_X + TileX] = Bounds;
+		SliceBounds = UnionAABB(SliceBounds, Bounds);
+	    }
+	}
+	Clusters->ViewSliceSpheres[Slice].Center = AABBCentroid(SliceBounds);
+	Clusters->ViewSliceSpheres[Slice].Radius = 0.5f*Length(SliceBounds.Max - SliceBounds.Min);
+    }
+}
+
+// NOTE: Back from view space to world space, for a view without scale:
+// the transposed rotation applied to the point less the translation.
+v3 UntransformViewPoint(mat4 View, v3 Point)
+{
+    v3 Offset = V3(Point.x - View.E[3][0], Point.y - View.E[3][1], Point.z - View.E[3][2]);
+    return V3(View.E[0][0]*Offset.x + View.E[0][1]*Offset.y + View.E[0][2]*Offset.z,
+	      View.E[1][0]*Offset.x + View.E[1][1]*Offset.y + View.E[1][2]*Offset.z,
+	      View.E[2][0]*Offset.x + View.E[2][1]*Offset.y + View.E[2][2]*Offset.z);
+}
+
+// NOTE: Job over eye/slice pairs, Index = Eye*CLUSTER_SLICES + Slice.
+void AssignClusterLights(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    TIMED_FUNCTION();
+    light_clusters *Clusters = (light_clusters *)Data;
+    int32 PaddedLights = (Clusters->LightCount + 3) & ~3;
+    float *SliceX = PushArray(Scratch, PaddedLights, float);
+    float *SliceY = PushArray(Scratch, PaddedLights, float);
+    float *SliceZ = PushArray(Scratch, PaddedLights, float);
+    float *SliceRadius = PushArray(Scratch, PaddedLights, float);
+    uint16 *SliceLights = PushArray(Scratch, PaddedLights, uint16);
+    int32 *NearLights = PushArray(Scratch, Clusters->LightCount, int32);
+    // NOTE: The BVH returns lights in tree order; marking them and walking
+    // the marks keeps each cluster's list in light order, so the shading
+    // doesn't depend on how the tree came out.
+    int32 MaskWords = (Clusters->LightCount + 31) / 32;
+    uint32 *NearMask = PushArray(Scratch, MaskWords, uint32);
+
+    for(int32 Index = Start; Index < End; ++Index)
+    {
+	int32 Eye = Index / CLUSTER_SLICES;
+	int32 Slice = Index % CLUSTER_SLICES;
+	float *LightX = Clusters->LightX[Eye];
+	float *LightY = Clusters->LightY[Eye];
+	float *LightZ = Clusters->LightZ[Eye];
+
+	float SliceNear = Clusters->SliceDepths[Slice];
+	float SliceFar = Clusters->SliceDepths[Slice + 1];
+	int32 NearCount = QueryBVHSphere(&Clusters->LightBVH, Clusters->SliceSpheres[Eye][Slice],
+					 NearLights, Clusters->LightCount);
+	memset(NearMask, 0, MaskWords*sizeof(uint32));
+	for(int32 Near = 0; Near < NearCount; ++Near)
+	{
+	    NearMask[NearLights[Near] / 32] |= 1u << (NearLights[Near] % 32);
+	}
+
+	int32 SliceCount = 0;
+	for(int32 Word = 0; Word < MaskWords; ++Word)
+	{
+	    for(int32 Bit = 0; Bit < 32 && (NearMask[Word] >> Bit); ++Bit)
+	    {
+		int32 Light = Word*32 + Bit;
+		if (!(NearMask[Word] & (1u << Bit)))
+		{
+		    continue;
+		}
+		float Depth = -LightZ[Light];
+		float Radius = Clusters->LightRadius[Light];
+		if (Depth + Radius >= SliceNear && Depth - Radius <= SliceFar)
+		{
+		    SliceX[SliceCount] = LightX[Light];
+		    SliceY[SliceCount] = LightY[Light];
+		    SliceZ[SliceCount] = LightZ[Light];
+		    SliceRadius[SliceCount] = Radius*Radius;
+		    SliceLights[SliceCount] = (uint16)Light;
+		    ++SliceCount;
+		}
+	    }
+	}
+	for(int32 Pad = SliceCount; Pad < ((SliceCount + 3) & ~3); ++Pad)
+	{
+	    SliceX[Pad] = SliceY[Pad] = SliceZ[Pad] = SliceRadius[Pad] = 0.0f;
+	}
+
+	for(int32 Tile = 0; Tile < CLUSTER_SLICE_SIZE; ++Tile)
+	{
+	    int32 Cluster = Slice*CLUSTER_SLICE_SIZE + Tile;
+	    int32 GlobalCluster = Eye*CLUSTER_COUNT + Cluster;
+	    uint16 *Lights = Clusters->ClusterLights + GlobalCluster*CLUSTER_MAX_LIGHTS;
+	    uint32 Count = 0;
+
+	    aabb Bounds = Clusters->Bounds[Cluster];
+	    __m128 MinX = _mm_set1_ps(Bounds.Min.x), MaxX = _mm_set1_ps(Bounds.Max.x);
+	    __m128 MinY = _mm_set1_ps(Bounds.Min.y), MaxY = _mm_set1_ps(Bounds.Max.y);
+	    __m128 MinZ = _mm_set1_ps(Bounds.Min.z), MaxZ = _mm_set1_ps(Bounds.Max.z);
+	    __m128 Zero = _mm_setzero_ps();
+	    for(int32 Light = 0; Light < SliceCount; Light += 4)
+	    {
+		__m128 X = _mm_loadu_ps(SliceX + Light);
+		__m128 Y = _mm_loadu_ps(SliceY + Light);
+		__m128 Z = _mm_loadu_ps(SliceZ + Light);
+		__m128 DX = _mm_max_ps(_mm_max_ps(_mm_sub_ps(MinX, X), _mm_sub_ps(X, MaxX)), Zero);
+		__m128 DY = _mm_max_ps(_mm_max_ps(_mm_sub_ps(MinY, Y), _mm_sub_ps(Y, MaxY)), Zero);
+		__m128 DZ = _mm_max_ps(_mm_max_ps(_mm_sub_ps(MinZ, Z), _mm_sub_ps(Z, MaxZ)), Zero);
+		__m128 DistanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(DX, DX), _mm_mul_ps(DY, DY)),
+						    _mm_mul_ps(DZ, DZ));
+		int32 Hits = _mm_movemask_ps(_mm_cmple_ps(DistanceSquared, _mm_loadu_ps(SliceRadius + Light)));
+		for(int32 Lane = 0; Lane < 4 && Light + Lane < SliceCount; ++Lane)
+		{
+		    if ((Hits & (1 << Lane)) && Count < CLUSTER_MAX_LIGHTS)
+		    {
+			Lights[Count++] = SliceLights[Light + Lane];
+		    }
+		}
+	    }
+	    Clusters->ClusterLightCounts[GlobalCluster] = Count;
+	}
+    }
+}
+
+// NOTE: Fills ClusterLights and ClusterLightCounts for every view of the
+// frame, one eye per view. The views share the projection.
+void AssignLightClusters(light_clusters *Clusters, job_system *Jobs, point_light *Lights, int32 LightCount,
+			 mat4 Projection, mat4 *Views, int32 EyeCount)
+{
+    Assert(EyeCount <= CLUSTER_MAX_EYES);
+    LightCount = Min(LightCount, MAX_POINT_LIGHTS);
+    Clusters->LightCount = LightCount;
+    Clusters->EyeCount = EyeCount;
+    if (LightCount == 0)
+    {
+	return;
+    }
+
+    ComputeClusterBounds(Clusters, Projection);
+    for(int32 Light = 0; Light < LightCount; ++Light)
+    {
+	point_light *PointLight = Lights + Light;
+	for(int32 Eye = 0; Eye < EyeCount; ++Eye)
+	{
+	    v3 ViewPosition = TransformPoint(Views[Eye], PointLight->Position);
+	    Clusters->LightX[Eye][Light] = ViewPosition.x;
+	    Clusters->LightY[Eye][Light] = ViewPosition.y;
+	    Clusters->LightZ[Eye][Light] = ViewPosition.z;
+	}
+	Clusters->LightRadius[Light] = PointLight->Radius;
+	v3 Extent = V3(PointLight->Radius, PointLight->Radius, PointLight->Radius);
+	Clusters->LightBounds[Light].Min = PointLight->Position - Extent;
+	Clusters->LightBounds[Light].Max = PointLight->Position + Extent;
+
+	float *Data = Clusters->LightData + 8*Light;
+	Data[0] = PointLight->Position.x;
+	Data[1] = PointLight->Position.y;
+	Data[2] = PointLight->Position.z;
+	Data[3] = PointLight->Radius;
+	Data[4] = PointLight->Color.x;
+	Data[5] = PointLight->Color.y;
+	Data[6] = PointLight->Color.z;
+	Data[7] = PointLight->Power;
+    }
+
+    bvh *LightBVH = &Clusters->LightBVH;
+    if (LightBVH->ItemCount != LightCount)
+    {
+	ResetBVHItems(LightBVH, Clusters->LightBounds, LightCount);
+    }
+    else
+    {
+	for(int32 Light = 0; Light < LightCount; ++Light)
+	{
+	    UpdateBVHItem(LightBVH, Light, Clusters->LightBounds[Light]);
+	}
+    }
+    if (BVHNeedsRebuild(LightBVH))
+    {
+	BuildBVH(LightBVH);
+    }
+    for(int32 Eye = 0; Eye < EyeCount; ++Eye)
+    {
+	for(int32 Slice = 0; Slice < CLUSTER_SLICES; ++Slice)
+	{
+	    bounding_sphere *Sphere = &Clusters->SliceSpheres[Eye][Slice];
+	    Sphere->Center = UntransformViewPoint(Views[Eye], Clusters->ViewSliceSpheres[Slice].Center);
+	    Sphere->Radius = Clusters->ViewSliceSpheres[Slice].Radius;
+	}
+    }
+
+    ParallelFor(Jobs, EyeCount*CLUSTER_SLICES, CLUSTER_SLICES_PER_JOB, AssignClusterLights, Clusters);
+}
+
+// NOTE: Rebuilds and uploads the lists for every view of the frame, and
+// leaves the buffer textures bound from CLUSTER_TEXTURE_UNIT. Runs on the
+// GL thread, once per frame.
+void BuildLightClusters(light_clusters *Clusters, job_system *Jobs, point_light *Lights, int32 LightCount,
+			mat4 Projection, mat4 *Views, int32 EyeCount)
+{
+    TIMED_FUNCTION();
+    AssignLightClusters(Clusters, Jobs, Lights, LightCount, Projection, Views, EyeCount);
+    LightCount = Clusters->LightCount;
+    if (LightCount == 0)
+    {
+	return;
+    }
+
+    int32 IndexCount = 0;
+    int32 Overflowed = 0;
+    for(int32 Cluster = 0; Cluster < EyeCount*CLUSTER_COUNT; ++Cluster)
+    {
+	uint32 Count = Clusters->ClusterLightCounts[Cluster];
+	uint16 *ClusterLights = Clusters->ClusterLights + Cluster*CLUSTER_MAX_LIGHTS;
+	Clusters->Grid[2*Cluster] = IndexCount;
+	Clusters->Grid[2*Cluster + 1] = Count;
+	for(uint32 Light = 0; Light < Count; ++Light)
+	{
+	    Clusters->Indices[IndexCount++] = ClusterLights[Light];
+	}
+	Overflowed += (Count == CLUSTER_MAX_LIGHTS);
+    }
+    Clusters->IndexCount = IndexCount;
+    if (Overflowed && !Clusters->Overflowed)
+    {
+	DebugLog("%d light clusters are full, lights are being dropped\n", Overflowed);
+    }
+    Clusters->Overflowed = Overflowed;
+
+    {
+	TIMED_BLOCK("Upload Light Clusters");
+	glBindBuffer(GL_TEXTURE_BUFFER, Clusters->LightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, 8*LightCount*sizeof(float), Clusters->LightData, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, Clusters->GridBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, 2*EyeCount*CLUSTER_COUNT*sizeof(uint32), Clusters->Grid, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, Clusters->IndexBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, Max(IndexCount, 1)*sizeof(uint32), Clusters->Indices, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    for(int32 Texture = 0; Texture < 3; ++Texture)
+    {
+	glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + Texture);
+	glBindTexture(GL_TEXTURE_BUFFER, Clusters->Textures[Texture]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+#endif
@@ -4,6 +4,10 @@
 #include "test.cpp"
 #endif
 #include "game.cpp"
+#include "mockHmd.cpp"
+#include "frameTiming.cpp"
+#include "virtualMemory.cpp"
+#include "inputRecording.cpp"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,7 +15,6 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <sys/time.h>
 
 #include <X11/Xlib.h>
 #include <X11/XKBlib.h>
@@ -85,10 +88,53 @@ GLXFBConfig ChooseFBConfig(Display *display, int screen)
     return ret;
 }
 
-float ElapsedMilliseconds(timeval *start, timeval *stop)
+enum swap_mode
 {
-    return ((stop->tv_sec - start->tv_sec) * 1000.0f +
-	    (stop->tv_usec - start->tv_usec) / 1000.0f);
+    SWAP_IMMEDIATE,
+    SWAP_VSYNC,
+    // NOTE: Vsync while the frame is on time, tears instead of waiting a whole
+    // extra refresh when it's late (GLX_EXT_swap_control_tear).
+    SWAP_ADAPTIVE
+};
+
+// NOTE: Returns the mode actually in effect, which falls back from adaptive to
+// vsync without the tear extension. Without any swap control extension the
+// driver default is left alone and reported as immediate, so the caller paces
+// in software.
+swap_mode SetSwapMode(Display *display, int screen, Window window, swap_mode Mode)
+{
+    typedef void (*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+    typedef int (*glXSwapIntervalMESAProc)(unsigned int);
+
+    const char *extensions = glXQueryExtensionsString(display, screen);
+    if (Mode == SWAP_ADAPTIVE && !strstr(extensions, "GLX_EXT_swap_control_tear"))
+    {
+	printf("GLX_EXT_swap_control_tear not supported, using vsync.\n");
+	Mode = SWAP_VSYNC;
+    }
+    int interval = (Mode == SWAP_ADAPTIVE) ? -1 : (Mode == SWAP_VSYNC) ? 1 : 0;
+
+    if (strstr(extensions, "GLX_EXT_swap_control"))
+    {
+	glXSwapIntervalEXTProc glXSwapIntervalEXT =
+	    (glXSwapIntervalEXTProc)glXGetProcAddress((const GLubyte *)"glXSwapIntervalEXT");
+	if (glXSwapIntervalEXT)
+	{
+	    glXSwapIntervalEXT(display, window, interval);
+	    return Mode;
+	}
+    }
+    if (strstr(extensions, "GLX_MESA_swap_control") && Mode != SWAP_ADAPTIVE)
+    {
+	glXSwapIntervalMESAProc glXSwapIntervalMESA =
+	    (glXSwapIntervalMESAProc)glXGetProcAddress((const GLubyte *)"glXSwapIntervalMESA");
+	if (glXSwapIntervalMESA && glXSwapIntervalMESA(interval) == 0)
+	{
+	    return Mode;
+	}
+    }
+    printf("No GLX swap control extension, pacing in software.\n");
+    return SWAP_IMMEDIATE;
 }
 
 GLXContext CreateContext(Display *display, int screen,
@@ -138,7 +184,10 @@ GLXContext CreateContext(Display *display, int screen,
     return context;
 }
 
-void KeyboardCB(KeySym sym, unsigned char key, bool32 Press, controller* Keyboard)
+// NOTE: Frames captured by the profiler hotkey.
+#define PROFILE_HOTKEY_FRAMES 60
+
+void KeyboardCB(KeySym sym, unsigned char key, bool32 Press, controller* Keyboard, int32 *ProfileFrameCount)
 {
     switch(tolower(key))
     {
@@ -151,6 +200,13 @@ void KeyboardCB(KeySym sym, unsigned char key, bool32 Press, controller* Keyboar
     {
 	break;
     }
+    case 'p':
+    {
+	if (Press)
+	{
+	    *ProfileFrameCount = PROFILE_HOTKEY_FRAMES;
+	}
+    } break;
     case 'w':
     {
 	Keyboard->Forward.Down = Press;
@@ -216,7 +272,7 @@ void ReshapeCB(int width, int height)
     glViewport(0, 0, width, height);
 }
 
-void ProcessXEvents(input* Input, Atom wm_protocols, Atom wm_delete_window, int* displayed, Display* display, Window window, int WindowWidth, int WindowHeight)
+void ProcessXEvents(input* Input, int32 *ProfileFrameCount, Atom wm_protocols, Atom wm_delete_window, int* displayed, Display* display, Window window, int WindowWidth, int WindowHeight)
 {
     while (XEventsQueued(display, QueuedAfterFlush))
     {
@@ -244,7 +300,7 @@ void ProcessXEvents(input* Input, Atom wm_protocols, Atom wm_delete_window, int*
 	    KeySym symbol;
 	    XComposeStatus status;
 	    XLookupString(&event.xkey, &chr, 1, &symbol, &status);
-	    KeyboardCB(symbol, chr, 1, &Input->Keyboard);
+	    KeyboardCB(symbol, chr, 1, &Input->Keyboard, ProfileFrameCount);
 	} break;
 	case KeyRelease:
 	{
@@ -252,7 +308,7 @@ void ProcessXEvents(input* Input, Atom wm_protocols, Atom wm_delete_window, int*
 	    KeySym symbol;
 	    XComposeStatus status;
 	    XLookupString(&event.xkey, &chr, 1, &symbol, &status);
-	    KeyboardCB(symbol, chr, 0, &Input->Keyboard);
+	    KeyboardCB(symbol, chr, 0, &Input->Keyboard, ProfileFrameCount);
 	} break;
 	case MotionNotify:
 	{
@@ -298,6 +354,163 @@ int Main(int argc, char *argv[])
     int WindowWidth = 800;
     int WindowHeight = 600;
 
+    // NOTE: With vsync the swap does the pacing, so the software cap only
+    // applies when --fps is given explicitly. --benchmark runs uncapped with
+    // vsync off and prints frame stats.
+    swap_mode SwapMode = SWAP_VSYNC;
+    float TargetFPS = 60.0f;
+    bool32 TargetFPSGiven = false;
+    bool32 ShowFrameStats = false;
+    int32 ProfileFrameCount = 0;
+    const char *ProfilePath = 0;
+    bool32 ShowGPUTimings = false;
+    bool32 ShowGLStats = false;
+    const char *GLTracePath = 0;
+    int32 JobThreadCount = 0;
+    bool32 PipelinedUpdate = false;
+    int32 PointLightCount = 0;
+    bool32 Shadows = true;
+    bool32 DirectionalLight = false;
+    bool32 DepthPrepass = false;
+    draw_order DrawOrder = DRAW_ORDER_STATE;
+    float DynamicResolutionTargetMs = 0.0f;
+    int32 MSAASamples = 4;
+    bool32 FXAA = false;
+    huge_page_mode HugePages = HUGE_PAGES_TRANSPARENT;
+
+    mock_hmd MockHMD = {0};
+    input_recording InputRecording = {0};
+    for(int ArgIndex = 1; ArgIndex < argc;)
+    {
+	int Consumed = ParseMockHMDArgument(&MockHMD, argc - ArgIndex, argv + ArgIndex);
+	if (!Consumed)
+	{
+	    Consumed = ParseInputRecordingArgument(&InputRecording, argc - ArgIndex, argv + ArgIndex);
+	}
+	if (Consumed)
+	{
+	    ArgIndex += Consumed;
+	}
+	else if (strcmp(argv[ArgIndex], "--vsync") == 0 && ArgIndex + 1 < argc)
+	{
+	    const char *Mode = argv[ArgIndex + 1];
+	    SwapMode = (strcmp(Mode, "off") == 0) ? SWAP_IMMEDIATE :
+		(strcmp(Mode, "adaptive") == 0) ? SWAP_ADAPTIVE : SWAP_VSYNC;
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--fps") == 0 && ArgIndex + 1 < argc)
+	{
+	    TargetFPS = atof(argv[ArgIndex + 1]);
+	    TargetFPSGiven = true;
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--benchmark") == 0)
+	{
+	    SwapMode = SWAP_IMMEDIATE;
+	    TargetFPS = 0.0f;
+	    TargetFPSGiven = true;
+	    ShowFrameStats = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--frame-stats") == 0)
+	{
+	    ShowFrameStats = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--profile") == 0 && ArgIndex + 1 < argc)
+	{
+	    ProfileFrameCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--profile-out") == 0 && ArgIndex + 1 < argc)
+	{
+	    ProfilePath = argv[ArgIndex + 1];
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--threads") == 0 && ArgIndex + 1 < argc)
+	{
+	    JobThreadCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--huge-pages") == 0 && ArgIndex + 1 < argc)
+	{
+	    const char *Mode = argv[ArgIndex + 1];
+	    HugePages = (strcmp(Mode, "off") == 0) ? HUGE_PAGES_OFF :
+		(strcmp(Mode, "hugetlb") == 0) ? HUGE_PAGES_HUGETLB : HUGE_PAGES_TRANSPARENT;
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--pipelined") == 0)
+	{
+	    PipelinedUpdate = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--lights") == 0 && ArgIndex + 1 < argc)
+	{
+	    PointLightCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--shadows") == 0 && ArgIndex + 1 < argc)
+	{
+	    Shadows = (strcmp(argv[ArgIndex + 1], "off") != 0);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--sun") == 0)
+	{
+	    DirectionalLight = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--prepass") == 0)
+	{
+	    DepthPrepass = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--draw-order") == 0 && ArgIndex + 1 < argc)
+	{
+	    DrawOrder = (strcmp(argv[ArgIndex + 1], "front-to-back") == 0) ? DRAW_ORDER_FRONT_TO_BACK : DRAW_ORDER_STATE;
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--dynamic-res") == 0 && ArgIndex + 1 < argc)
+	{
+	    DynamicResolutionTargetMs = (float)atof(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--msaa") == 0 && ArgIndex + 1 < argc)
+	{
+	    MSAASamples = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--fxaa") == 0)
+	{
+	    FXAA = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--gpu-timings") == 0)
+	{
+	    ShowGPUTimings = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--gl-stats") == 0)
+	{
+	    ShowGLStats = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--gl-trace") == 0 && ArgIndex + 1 < argc)
+	{
+	    GLTracePath = argv[ArgIndex + 1];
+	    ArgIndex += 2;
+	}
+	else
+	{
+	    ArgIndex += 1;
+	}
+    }
+
+    if (!BeginInputRecording(&InputRecording))
+    {
+	exit(EXIT_FAILURE);
+    }
+    BeginGLTrace(GLTracePath);
+
     display = XOpenDisplay(0);
     if (!display) 
     {
@@ -364,12 +577,21 @@ int Main(int argc, char *argv[])
 
     int displayed = 0;
 
-    float targetFPS = 60.0f;
-    float msPerFrame = 1000.0f/targetFPS;
-
-    timeval last_xcheck;
-    gettimeofday(&last_xcheck, 0);
-    timeval now;
+    SwapMode = SetSwapMode(display, screen, window, SwapMode);
+    if (SwapMode != SWAP_IMMEDIATE && !TargetFPSGiven)
+    {
+	TargetFPS = 0.0f;
+    }
+    printf("Swap mode: %s, frame cap: ",
+	   SwapMode == SWAP_ADAPTIVE ? "adaptive" : SwapMode == SWAP_VSYNC ? "vsync" : "immediate");
+    if (TargetFPS > 0.0f)
+    {
+	printf("%.1f fps\n", TargetFPS);
+    }
+    else
+    {
+	printf("none\n");
+    }
 
     input Input0 = {0};
     input Input1 = {0};
@@ -379,17 +601,52 @@ int Main(int argc, char *argv[])
     PlatformData.NewInput = &Input1;
 
     PlatformData.MainMemorySize = GIGABYTES(1);
-    PlatformData.MainMemory = calloc(1, PlatformData.MainMemorySize);
     PlatformData.TempMemorySize = MEGABYTES(512);
-    PlatformData.TempMemory = malloc(PlatformData.TempMemorySize);
+    if (!SetupPlatformMemory(&PlatformData, HugePages))
+    {
+	printf("Failed to reserve game memory.\n");
+	return EXIT_FAILURE;
+    }
+    PlatformData.WindowWidth = WindowWidth;
+    PlatformData.WindowHeight = WindowHeight;
+    PlatformData.ProfileFrameCount = ProfileFrameCount;
+    PlatformData.ProfilePath = ProfilePath;
+    PlatformData.ShowGPUTimings = ShowGPUTimings;
+    PlatformData.ShowGLStats = ShowGLStats;
+    PlatformData.JobThreadCount = JobThreadCount;
+    PlatformData.PipelinedUpdate = PipelinedUpdate;
+    PlatformData.PointLightCount = PointLightCount;
+    PlatformData.Shadows = Shadows;
+    PlatformData.DirectionalLight = DirectionalLight;
+    PlatformData.DepthPrepass = DepthPrepass;
+    PlatformData.DrawOrder = DrawOrder;
+    PlatformData.DynamicResolutionTargetMs = DynamicResolutionTargetMs;
+    PlatformData.MSAASamples = MSAASamples;
+    PlatformData.FXAA = FXAA;
+
+    if (MockHMD.Enabled)
+    {
+	if (!SetupMockStereoRenderTargets(&MockHMD, &PlatformData))
+	{
+	    printf("Failed to setup mock HMD render targets!\n");
+	}
+	printf("Mock HMD eye size: %d x %d (%s)\n", MockHMD.EyeWidth, MockHMD.EyeHeight,
+	       MockHMD.StereoMode == STEREO_INSTANCED ? "instanced" : "multipass");
+    }
 
     XWarpPointer(display, 0, 0, 0, 0, 0, 0,
 		 WindowWidth/2, WindowHeight/2);
+
+    frame_pacer Pacer;
+    InitFramePacer(&Pacer, TargetFPS);
+    frame_stats FrameStats = {0};
+    float TargetMilliseconds = Pacer.TargetNanoseconds / 1000000.0f;
     while(1)
     {
 	PlatformData.NewInput->Keyboard.RightStick.X = 0.0f;
 	PlatformData.NewInput->Keyboard.RightStick.Y = 0.0f;
 	ProcessXEvents(PlatformData.NewInput,
+		       &PlatformData.ProfileFrameCount,
 		       wm_protocols,
 		       wm_delete_window,
 		       &displayed,
@@ -397,28 +654,31 @@ int Main(int argc, char *argv[])
 		       window,
 		       WindowWidth,
 		       WindowHeight);
+	if (!UpdateInputRecording(&InputRecording, PlatformData.NewInput))
+	{
+	    printf("Input replay finished after %d frames\n", InputRecording.FrameIndex);
+	    break;
+	}
 	
 	UpdateAndRender(&PlatformData);
 	glXSwapBuffers(display, window);
-	
-	float elapsedTime = 0;
 
-	while(elapsedTime < msPerFrame)
+	uint64 FrameNanoseconds = WaitForNextFrame(&Pacer);
+	if (ShowFrameStats)
 	{
-	    gettimeofday(&now, 0);
-	    elapsedTime = ElapsedMilliseconds(&last_xcheck, &now);
-	    if (elapsedTime <= msPerFrame)
+	    RecordFrameTime(&FrameStats, FrameNanoseconds, TargetMilliseconds);
+	    if (FrameStats.Count == 0)
 	    {
-		sleep((msPerFrame - elapsedTime)/1000.0f);
+		PrintMemoryStats(&GlobalVirtualMemory, "window");
 	    }
 	}
 
-	
 	*PlatformData.LastInput = *PlatformData.NewInput;
-	PlatformData.NewInput->dT = elapsedTime/1000.0f;
-	last_xcheck = now;
+	PlatformData.NewInput->dT = (float)FrameNanoseconds / NANOSECONDS_PER_SECOND;
     }
 
+    EndInputRecording(&InputRecording);
+    EndGLTrace();
     return EXIT_SUCCESS;
 }
 
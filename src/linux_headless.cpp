@@ -0,0 +1,436 @@
+#define LINUX
+
+// NOTE: Headless entry point for benchmarks and CI. Creates a GL context
+// through EGL with no display (Mesa surfaceless, falling back to a pbuffer),
+// renders a fixed number of frames into an offscreen framebuffer and prints
+// frame time statistics.
+
+#include "game.cpp"
+#include "mockHmd.cpp"
+#include "frameTiming.cpp"
+#include "virtualMemory.cpp"
+#include "inputRecording.cpp"
+#include "glReplay.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+struct headless_framebuffer
+{
+    GLuint Framebuffer;
+    GLuint ColorBuffer;
+    GLuint DepthBuffer;
+};
+
+EGLDisplay OpenHeadlessDisplay()
+{
+    EGLDisplay Display = EGL_NO_DISPLAY;
+    const char *ClientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (ClientExtensions && strstr(ClientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+	    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplayEXT)
+	{
+	    Display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	}
+    }
+    if (Display == EGL_NO_DISPLAY)
+    {
+	Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    return Display;
+}
+
+EGLContext CreateHeadlessContext(EGLDisplay Display, int Width, int Height)
+{
+    EGLint Major, Minor;
+    if (!eglInitialize(Display, &Major, &Minor))
+    {
+	printf("eglInitialize failed.\n");
+	exit(EXIT_FAILURE);
+    }
+    printf("EGL %d.%d: %s\n", Major, Minor, eglQueryString(Display, EGL_VENDOR));
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+	printf("EGL can't bind desktop OpenGL.\n");
+	exit(EXIT_FAILURE);
+    }
+
+    static const EGLint ConfigAttributes[] =
+    {
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	EGL_RED_SIZE, 8,
+	EGL_GREEN_SIZE, 8,
+	EGL_BLUE_SIZE, 8,
+	EGL_ALPHA_SIZE, 8,
+	EGL_DEPTH_SIZE, 24,
+	EGL_NONE
+    };
+    EGLConfig Config;
+    EGLint ConfigCount = 0;
+    if (!eglChooseConfig(Display, ConfigAttributes, &Config, 1, &ConfigCount) || ConfigCount < 1)
+    {
+	printf("Failed to get an EGLConfig.\n");
+	exit(EXIT_FAILURE);
+    }
+
+    static const EGLint ContextAttributes[] =
+    {
+	EGL_CONTEXT_MAJOR_VERSION, 3,
+	EGL_CONTEXT_MINOR_VERSION, 3,
+	EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+	EGL_NONE
+    };
+    EGLContext Context = eglCreateContext(Display, Config, EGL_NO_CONTEXT, ContextAttributes);
+    if (Context == EGL_NO_CONTEXT)
+    {
+	printf("Failed to allocate a GL context.\n");
+	exit(EXIT_FAILURE);
+    }
+
+    // NOTE: The game always renders into its own FBO here, so the surface only
+    // has to exist when the driver can't do surfaceless.
+    const char *DisplayExtensions = eglQueryString(Display, EGL_EXTENSIONS);
+    bool32 Surfaceless = DisplayExtensions && strstr(DisplayExtensions, "EGL_KHR_surfaceless_context");
+    EGLSurface Surface = EGL_NO_SURFACE;
+    if (!Surfaceless)
+    {
+	EGLint PbufferAttributes[] =
+	{
+	    EGL_WIDTH, Width,
+	    EGL_HEIGHT, Height,
+	    EGL_NONE
+	};
+	Surface = eglCreatePbufferSurface(Display, Config, PbufferAttributes);
+    }
+
+    if (!eglMakeCurrent(Display, Surface, Surface, Context))
+    {
+	printf("eglMakeCurrent failed.\n");
+	exit(EXIT_FAILURE);
+    }
+    printf("GL renderer: %s (%s)\n", glGetString(GL_RENDERER), Surfaceless ? "surfaceless" : "pbuffer");
+    return Context;
+}
+
+bool CreateHeadlessFramebuffer(int Width, int Height, headless_framebuffer *Buffer)
+{
+    glGenFramebuffers(1, &Buffer->Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, Buffer->Framebuffer);
+
+    glGenRenderbuffers(1, &Buffer->ColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, Buffer->ColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, Buffer->ColorBuffer);
+
+    glGenRenderbuffers(1, &Buffer->DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, Buffer->DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, Buffer->DepthBuffer);
+
+    GLenum FramebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return FramebufferStatus == GL_FRAMEBUFFER_COMPLETE;
+}
+
+int main(int argc, char *argv[])
+{
+    int WindowWidth = 800;
+    int WindowHeight = 600;
+    int FrameCount = 300;
+    int32 ProfileFrameCount = 0;
+    const char *ProfilePath = 0;
+    bool32 ShowGPUTimings = false;
+    bool32 ShowGLStats = false;
+    const char *GLTracePath = 0;
+    const char *GLReplayPath = 0;
+    int32 JobThreadCount = 0;
+    bool32 PipelinedUpdate = false;
+    int32 DrawBenchCount = 0;
+    int32 PointLightCount = 0;
+    bool32 Shadows = true;
+    bool32 DirectionalLight = false;
+    bool32 DepthPrepass = false;
+    draw_order DrawOrder = DRAW_ORDER_STATE;
+    float DynamicResolutionTargetMs = 0.0f;
+    int32 MSAASamples = 4;
+    bool32 FXAA = false;
+    huge_page_mode HugePages = HUGE_PAGES_TRANSPARENT;
+    float FixedDeltaTime = 1.0f/60.0f;
+
+    mock_hmd MockHMD = {0};
+    input_recording InputRecording = {0};
+    for(int ArgIndex = 1; ArgIndex < argc;)
+    {
+	int Consumed = ParseMockHMDArgument(&MockHMD, argc - ArgIndex, argv + ArgIndex);
+	if (!Consumed)
+	{
+	    Consumed = ParseInputRecordingArgument(&InputRecording, argc - ArgIndex, argv + ArgIndex);
+	}
+	if (Consumed)
+	{
+	    ArgIndex += Consumed;
+	}
+	else if (strcmp(argv[ArgIndex], "--frames") == 0 && ArgIndex + 1 < argc)
+	{
+	    FrameCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--profile") == 0 && ArgIndex + 1 < argc)
+	{
+	    ProfileFrameCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--profile-out") == 0 && ArgIndex + 1 < argc)
+	{
+	    ProfilePath = argv[ArgIndex + 1];
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--threads") == 0 && ArgIndex + 1 < argc)
+	{
+	    JobThreadCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--huge-pages") == 0 && ArgIndex + 1 < argc)
+	{
+	    const char *Mode = argv[ArgIndex + 1];
+	    HugePages = (strcmp(Mode, "off") == 0) ? HUGE_PAGES_OFF :
+		(strcmp(Mode, "hugetlb") == 0) ? HUGE_PAGES_HUGETLB : HUGE_PAGES_TRANSPARENT;
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--pipelined") == 0)
+	{
+	    PipelinedUpdate = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--draw-bench") == 0 && ArgIndex + 1 < argc)
+	{
+	    DrawBenchCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--lights") == 0 && ArgIndex + 1 < argc)
+	{
+	    PointLightCount = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--shadows") == 0 && ArgIndex + 1 < argc)
+	{
+	    Shadows = (strcmp(argv[ArgIndex + 1], "off") != 0);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--sun") == 0)
+	{
+	    DirectionalLight = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--prepass") == 0)
+	{
+	    DepthPrepass = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--draw-order") == 0 && ArgIndex + 1 < argc)
+	{
+	    DrawOrder = (strcmp(argv[ArgIndex + 1], "front-to-back") == 0) ? DRAW_ORDER_FRONT_TO_BACK : DRAW_ORDER_STATE;
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--dynamic-res") == 0 && ArgIndex + 1 < argc)
+	{
+	    DynamicResolutionTargetMs = (float)atof(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--msaa") == 0 && ArgIndex + 1 < argc)
+	{
+	    MSAASamples = atoi(argv[ArgIndex + 1]);
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--fxaa") == 0)
+	{
+	    FXAA = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--gpu-timings") == 0)
+	{
+	    ShowGPUTimings = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--gl-stats") == 0)
+	{
+	    ShowGLStats = true;
+	    ArgIndex += 1;
+	}
+	else if (strcmp(argv[ArgIndex], "--gl-trace") == 0 && ArgIndex + 1 < argc)
+	{
+	    GLTracePath = argv[ArgIndex + 1];
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--replay-gl") == 0 && ArgIndex + 1 < argc)
+	{
+	    GLReplayPath = argv[ArgIndex + 1];
+	    ArgIndex += 2;
+	}
+	else if (strcmp(argv[ArgIndex], "--size") == 0 && ArgIndex + 1 < argc)
+	{
+	    sscanf(argv[ArgIndex + 1], "%dx%d", &WindowWidth, &WindowHeight);
+	    ArgIndex += 2;
+	}
+	else
+	{
+	    printf("Usage: %s [--frames N] [--size WxH] [--profile N] [--profile-out PATH] [--gpu-timings] [--gl-stats] [--gl-trace PATH] [--replay-gl PATH] [--threads N] [--pipelined] [--draw-bench DRAWS] [--lights N] [--shadows on|off] [--sun] [--prepass] [--draw-order state|front-to-back] [--dynamic-res TARGET_MS] [--msaa SAMPLES] [--fxaa] [--huge-pages off|thp|hugetlb] [--mock-hmd WxH] [--stereo multipass|instanced] [--record-input PATH] [--replay-input PATH] [--replay-timestep recorded|fixed]\n", argv[0]);
+	    return EXIT_FAILURE;
+	}
+    }
+    if (!BeginInputRecording(&InputRecording))
+    {
+	return EXIT_FAILURE;
+    }
+    // NOTE: A replay runs the whole recording; its first frame is the init.
+    if (InputRecording.Mode == INPUT_RECORDING_REPLAY)
+    {
+	FrameCount = InputRecording.FrameCount - 1;
+    }
+    if (FrameCount < 1)
+    {
+	FrameCount = 1;
+    }
+
+    if (!GLReplayPath)
+    {
+	BeginGLTrace(GLTracePath);
+    }
+
+    EGLDisplay Display = OpenHeadlessDisplay();
+    if (Display == EGL_NO_DISPLAY)
+    {
+	fprintf(stderr, "Cannot open an EGL display\n");
+	return EXIT_FAILURE;
+    }
+    CreateHeadlessContext(Display, WindowWidth, WindowHeight);
+
+    if (GLReplayPath)
+    {
+	bool Replayed = ReplayGLTrace(GLReplayPath);
+	printf("GL Errors:\n");
+	GLErrorShow();
+	eglTerminate(Display);
+	return Replayed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    headless_framebuffer Window = {0};
+    if (!CreateHeadlessFramebuffer(WindowWidth, WindowHeight, &Window))
+    {
+	printf("Failed to create the offscreen framebuffer.\n");
+	return EXIT_FAILURE;
+    }
+
+    input Input0 = {0};
+    input Input1 = {0};
+
+    platform_data PlatformData = {0};
+    PlatformData.LastInput = &Input0;
+    PlatformData.NewInput = &Input1;
+
+    PlatformData.MainMemorySize = GIGABYTES(1);
+    PlatformData.TempMemorySize = MEGABYTES(512);
+    if (!SetupPlatformMemory(&PlatformData, HugePages))
+    {
+	printf("Failed to reserve game memory.\n");
+	return EXIT_FAILURE;
+    }
+    PlatformData.WindowWidth = WindowWidth;
+    PlatformData.WindowHeight = WindowHeight;
+    PlatformData.WindowFramebuffer = Window.Framebuffer;
+    PlatformData.ProfileFrameCount = ProfileFrameCount;
+    PlatformData.ProfilePath = ProfilePath;
+    PlatformData.ShowGPUTimings = ShowGPUTimings;
+    PlatformData.ShowGLStats = ShowGLStats;
+    PlatformData.JobThreadCount = JobThreadCount;
+    PlatformData.PipelinedUpdate = PipelinedUpdate;
+    PlatformData.ReadClock = GetNanoseconds;
+    PlatformData.PointLightCount = PointLightCount;
+    PlatformData.Shadows = Shadows;
+    PlatformData.DirectionalLight = DirectionalLight;
+    PlatformData.DepthPrepass = DepthPrepass;
+    PlatformData.DrawOrder = DrawOrder;
+    PlatformData.DynamicResolutionTargetMs = DynamicResolutionTargetMs;
+    PlatformData.MSAASamples = MSAASamples;
+    PlatformData.FXAA = FXAA;
+
+    if (MockHMD.Enabled)
+    {
+	if (!SetupMockStereoRenderTargets(&MockHMD, &PlatformData))
+	{
+	    printf("Failed to setup mock HMD render targets!\n");
+	    return EXIT_FAILURE;
+	}
+	printf("Mock HMD eye size: %d x %d (%s)\n", MockHMD.EyeWidth, MockHMD.EyeHeight,
+	       MockHMD.StereoMode == STEREO_INSTANCED ? "instanced" : "multipass");
+    }
+
+    // NOTE: The first frame pays for Init (shader compiles, texture uploads),
+    // so it is run and reported on its own.
+    uint64 InitStart = GetNanoseconds();
+    PlatformData.NewInput->dT = FixedDeltaTime;
+    UpdateInputRecording(&InputRecording, PlatformData.NewInput);
+    UpdateAndRender(&PlatformData);
+    glFinish();
+    printf("First frame (init): %.3f ms\n", (GetNanoseconds() - InitStart) / 1000000.0f);
+    PrintMemoryStats(&GlobalVirtualMemory, "init");
+    memory_stats RunStartMemory;
+    GetMemoryStats(&GlobalVirtualMemory, &RunStartMemory);
+
+    float *FrameMilliseconds = (float *)malloc(FrameCount*sizeof(float));
+    // NOTE: CPU side only, without the glFinish, so that with --pipelined
+    // the part of Update and Render that ran side by side shows up as the
+    // difference between their sum and the time UpdateAndRender took.
+    float UpdateMilliseconds = 0.0f;
+    float RenderMilliseconds = 0.0f;
+    float SubmitMilliseconds = 0.0f;
+    uint64 RunStart = GetNanoseconds();
+    for(int FrameIndex = 0; FrameIndex < FrameCount; ++FrameIndex)
+    {
+	uint64 FrameStart = GetNanoseconds();
+	*PlatformData.LastInput = *PlatformData.NewInput;
+	PlatformData.NewInput->dT = FixedDeltaTime;
+	if (!UpdateInputRecording(&InputRecording, PlatformData.NewInput))
+	{
+	    FrameCount = FrameIndex;
+	    break;
+	}
+	uint64 SubmitStart = GetNanoseconds();
+	UpdateAndRender(&PlatformData);
+	SubmitMilliseconds += (GetNanoseconds() - SubmitStart) / 1000000.0f;
+	UpdateMilliseconds += PlatformData.UpdateMilliseconds;
+	RenderMilliseconds += PlatformData.RenderMilliseconds;
+	glFinish();
+	FrameMilliseconds[FrameIndex] = (GetNanoseconds() - FrameStart) / 1000000.0f;
+    }
+    float TotalMilliseconds = (GetNanoseconds() - RunStart) / 1000000.0f;
+    BenchmarkModelDraws(&PlatformData, DrawBenchCount);
+
+    printf("GL Errors:\n");
+    GLErrorShow();
+    if (FrameCount > 0)
+    {
+	PrintFrameStats(FrameMilliseconds, FrameCount, TotalMilliseconds);
+	UpdateMilliseconds /= FrameCount;
+	RenderMilliseconds /= FrameCount;
+	SubmitMilliseconds /= FrameCount;
+	printf("CPU ms per frame (%s): update %.3f render %.3f, UpdateAndRender %.3f, %.3f overlapped\n",
+	       PipelinedUpdate ? "pipelined" : "serial", UpdateMilliseconds, RenderMilliseconds,
+	       SubmitMilliseconds, Max(UpdateMilliseconds + RenderMilliseconds - SubmitMilliseconds, 0.0f));
+    }
+    PrintMemoryStats(&GlobalVirtualMemory, "frames", &RunStartMemory);
+
+    free(FrameMilliseconds);
+    EndInputRecording(&InputRecording);
+    EndGLTrace();
+    eglTerminate(Display);
+    return EXIT_SUCCESS;
+}
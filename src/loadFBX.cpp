@@ -4,7 +4,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "platform.h"
 #include "matrixMath.cpp"
+#include "profiler.cpp"
 
 #define MAX_TOKEN_LENGTH 1024
 
@@ -28,6 +30,8 @@ struct fbx_parse_info
 {
     FILE* File;
     char* Token;
+    // NOTE: Model arrays are pushed here and live as long as it does.
+    memory_arena *Arena;
 };
 
 int IsAlpha(char c)
@@ -308,7 +312,7 @@ FBXModel ParseModel(fbx_parse_info *Info)
 	}
 	
 	fseek(Info->File, Start, SEEK_SET);
-	Model.Vertices = (float *)malloc(sizeof(float)*Model.VertexCount);
+	Model.Vertices = PushArray(Info->Arena, Model.VertexCount, float);
 	float *Pointer = Model.Vertices;
 	while(1)
 	{
@@ -363,7 +367,7 @@ FBXModel ParseModel(fbx_parse_info *Info)
 	    }
 	}
 	fseek(Info->File, Start, SEEK_SET);
-	Model.Indices = (int *)malloc(sizeof(int)*Model.IndexCount);
+	Model.Indices = PushArray(Info->Arena, Model.IndexCount, int);
 	int *Pointer = Model.Indices;
 	while(1)
 	{
@@ -419,7 +423,7 @@ FBXModel ParseModel(fbx_parse_info *Info)
 	    }
 	}
 	fseek(Info->File, Start, SEEK_SET);
-	Model.Normals = (float*)malloc(sizeof(float)*Model.NormalCount);
+	Model.Normals = PushArray(Info->Arena, Model.NormalCount, float);
     }
 
     return Model;
@@ -447,13 +451,15 @@ void ParseObjects(fbx_parse_info *Info)
     }
 }
 
-FBXModel ParseFBX(FILE* File)
+FBXModel ParseFBX(FILE* File, memory_arena *Arena)
 {
+    TIMED_FUNCTION();
     fbx_token_type TokenType;    
     char Token[MAX_TOKEN_LENGTH];
     fbx_parse_info Info = {
 	File,
-	Token
+	Token,
+	Arena
     };
 
     while(1)
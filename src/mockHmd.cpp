@@ -0,0 +1,80 @@
+#ifndef MOCKHMD_CPP__
+#define MOCKHMD_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// NOTE: Stands in for the OpenVR runtime on machines without a headset. It
+// only supplies eye buffer sizes, so the stereo paths can be exercised and
+// timed anywhere; nothing is submitted to a compositor.
+struct mock_hmd
+{
+    bool32 Enabled;
+    int EyeWidth;
+    int EyeHeight;
+    stereo_mode StereoMode;
+
+    FramebufferDesc LeftEye;
+    FramebufferDesc RightEye;
+    FramebufferDesc StereoTarget;
+};
+
+// NOTE: Recognizes "--mock-hmd WxH" and "--stereo multipass|instanced".
+// Returns how many arguments were consumed, 0 if Argument isn't ours.
+int ParseMockHMDArgument(mock_hmd *HMD, int ArgCount, char **Args)
+{
+    if (strcmp(Args[0], "--mock-hmd") == 0 && ArgCount > 1)
+    {
+	if (sscanf(Args[1], "%dx%d", &HMD->EyeWidth, &HMD->EyeHeight) == 2)
+	{
+	    HMD->Enabled = true;
+	}
+	return 2;
+    }
+    if (strcmp(Args[0], "--stereo") == 0 && ArgCount > 1)
+    {
+	HMD->StereoMode = (strcmp(Args[1], "instanced") == 0) ? STEREO_INSTANCED : STEREO_MULTIPASS;
+	return 2;
+    }
+    return 0;
+}
+
+// NOTE: Reads Platform->DynamicResolutionTargetMs and MSAASamples, so set
+// those first.
+bool SetupMockStereoRenderTargets(mock_hmd *HMD, platform_data *Platform)
+{
+    if (!HMD->Enabled)
+    {
+	return false;
+    }
+
+    int Width = HMD->EyeWidth;
+    int Height = HMD->EyeHeight;
+    if (Platform->DynamicResolutionTargetMs > 0.0f)
+    {
+	Width = (int)(DYNAMIC_RESOLUTION_MAX_SCALE*Width);
+	Height = (int)(DYNAMIC_RESOLUTION_MAX_SCALE*Height);
+    }
+    bool Result = (CreateFramebuffer(Width, Height, Platform->MSAASamples, &HMD->LeftEye) &&
+		   CreateFramebuffer(Width, Height, Platform->MSAASamples, &HMD->RightEye));
+    if (Result && HMD->StereoMode == STEREO_INSTANCED)
+    {
+	Result = CreateFramebuffer(2*Width, Height, Platform->MSAASamples, &HMD->StereoTarget);
+	if (Result)
+	{
+	    Platform->StereoTarget = &HMD->StereoTarget;
+	}
+    }
+
+    Platform->VRBufferWidth = Width;
+    Platform->VRBufferHeight = Height;
+    Platform->LeftEye = &HMD->LeftEye;
+    Platform->RightEye = &HMD->RightEye;
+    Platform->StereoMode = HMD->StereoMode;
+    return Result;
+}
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef OCCLUSION_CPP__
+#define OCCLUSION_CPP__
+
+#include "platform.h"
+#include "matrixMath.cpp"
+#include "culling.cpp"
+#include "jobs.cpp"
+
+#include <emmintrin.h>
+#include <math.h>
+
+// NOTE: Low resolution software depth buffer for occlusion culling. Occluders
+// are rasterized conservatively so the buffer can only under-estimate
+// occlusion: triangles crossing the near plane are dropped, never clipped,
+// a pixel is only covered when the triangle covers all of it, and it takes
+// the farthest depth the triangle has over it.
+// Depth is window-space [0,1], larger is farther, cleared to 1.
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_SIZE 8
+#define OCCLUSION_BAND_HEIGHT 32
+#define OCCLUSION_BAND_COUNT (OCCLUSION_HEIGHT / OCCLUSION_BAND_HEIGHT)
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE)
+#define MAX_OCCLUDER_TRIANGLES 8192
+// NOTE: Below this the bands are cheaper to rasterize than to hand out.
+#define OCCLUSION_PARALLEL_TRIANGLES 256
+
+struct occluder_triangle
+{
+    // NOTE: x,y in pixels, z in window depth.
+    v3 V[3];
+    int32 MinY;
+    int32 MaxY;
+};
+
+struct occlusion_buffer
+{
+    float *Depth;
+    // NOTE: Farthest depth in each tile, the coarse level of the hierarchy.
+    float *TileMaxDepth;
+
+    int32 TriangleCount;
+    occluder_triangle *Triangles;
+};
+
+void InitOcclusionBuffer(occlusion_buffer *Buffer, memory_arena *Arena)
+{
+    Buffer->Depth = PushArray(Arena, OCCLUSION_WIDTH*OCCLUSION_HEIGHT, float);
+    Buffer->TileMaxDepth = PushArray(Arena, OCCLUSION_TILES_X*OCCLUSION_TILES_Y, float);
+    Buffer->Triangles = PushArray(Arena, MAX_OCCLUDER_TRIANGLES, occluder_triangle);
+    Buffer->TriangleCount = 0;
+}
+
+void ClearOcclusionBuffer(occlusion_buffer *Buffer)
+{
+    Buffer->TriangleCount = 0;
+}
+
+v4 TransformPoint4(mat4 M, v3 P)
+{
+    v4 Result;
+    for(int Row = 0; Row < 4; ++Row)
+    {
+	Result.E[Row] = M.E[0][Row]*P.x + M.E[1][Row]*P.y + M.E[2][Row]*P.z + M.E[3][Row];
+    }
+    return Result;
+}
+
+v3 ClipToOcclusionWindow(v4 Clip)
+{
+    float InvW = 1.0f / Clip.w;
+    v3 Result;
+    Result.x = (Clip.x*InvW*0.5f + 0.5f)*OCCLUSION_WIDTH;
+    Result.y = (Clip.y*InvW*0.5f + 0.5f)*OCCLUSION_HEIGHT;
+    Result.z = Clip.z*InvW*0.5f + 0.5f;
+    return Result;
+}
+
+#define OCCLUSION_MIN_W 1e-4f
+
+void AddOccluderMesh(occlusion_buffer *Buffer, float *Vertices, uint16 *Indices, int IndexCount, mat4 MVP)
+{
+    for(int Index = 0; Index + 2 < IndexCount; Index += 3)
+    {
+	v4 Clip[3];
+	bool32 CrossesNear = false;
+	for(int Corner = 0; Corner < 3; ++Corner)
+	{
+	    float *P = Vertices + 3*Indices[Index + Corner];
+	    Clip[Corner] = TransformPoint4(MVP, V3(P[0], P[1], P[2]));
+	    if (Clip[Corner].w < OCCLUSION_MIN_W || Clip[Corner].z < -Clip[Corner].w)
+	    {
+		CrossesNear = true;
+	    }
+	}
+	if (CrossesNear)
+	{
+	    continue;
+	}
+
+	occluder_triangle Triangle;
+	for(int Corner = 0; Corner < 3; ++Corner)
+	{
+	    Triangle.V[Corner] = ClipToOcclusionWindow(Clip[Corner]);
+	}
+
+	v3 A = Triangle.V[0];
+	v3 B = Triangle.V[1];
+	v3 C = Triangle.V[2];
+	float Area = (B.x - A.x)*(C.y - A.y) - (C.x - A.x)*(B.y - A.y);
+	if (Area <= 0.0f)
+	{
+	    // NOTE: Back facing or degenerate. Occluders are closed, so the front
+	    // faces already cover anything the back faces would.
+	    continue;
+	}
+
+	float MinY = Min(Min(A.y, B.y), C.y);
+	float MaxY = Max(Max(A.y, B.y), C.y);
+	float MinX = Min(Min(A.x, B.x), C.x);
+	float MaxX = Max(Max(A.x, B.x), C.x);
+	if (MaxY < 0.0f || MinY >= OCCLUSION_HEIGHT || MaxX < 0.0f || MinX >= OCCLUSION_WIDTH)
+	{
+	    continue;
+	}
+	Triangle.MinY = Max((int32)MinY, 0);
+	Triangle.MaxY = Min((int32)MaxY, OCCLUSION_HEIGHT - 1);
+
+	if (Buffer->TriangleCount < MAX_OCCLUDER_TRIANGLES)
+	{
+	    Buffer->Triangles[Buffer->TriangleCount++] = Triangle;
+	}
+    }
+}
+
+// NOTE: Rasterizes every occluder triangle into one horizontal band and then
+// rebuilds that band's tile depths. Bands share no pixels, so they can be
+// handed to different threads.
+void RasterizeOcclusionBand(occlusion_buffer *Buffer, int32 Band)
+{
+    int32 BandMinY = Band*OCCLUSION_BAND_HEIGHT;
+    int32 BandMaxY = BandMinY + OCCLUSION_BAND_HEIGHT - 1;
+
+    __m128 One = _mm_set1_ps(1.0f);
+    for(int32 Y = BandMinY; Y <= BandMaxY; ++Y)
+    {
+	float *Row = Buffer->Depth + Y*OCCLUSION_WIDTH;
+	for(int32 X = 0; X < OCCLUSION_WIDTH; X += 4)
+	{
+	    _mm_storeu_ps(Row + X, One);
+	}
+    }
+
+    __m128 LaneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 Zero = _mm_setzero_ps();
+    for(int32 TriangleIndex = 0; TriangleIndex < Buffer->TriangleCount; ++TriangleIndex)
+    {
+	occluder_triangle *Triangle = Buffer->Triangles + TriangleIndex;
+	int32 MinY = Max(Triangle->MinY, BandMinY);
+	int32 MaxY = Min(Triangle->MaxY, BandMaxY);
+	if (MinY > MaxY)
+	{
+	    continue;
+	}
+
+	v3 V0 = Triangle->V[0];
+	v3 V1 = Triangle->V[1];
+	v3 V2 = Triangle->V[2];
+	int32 MinX = Max((int32)Min(Min(V0.x, V1.x), V2.x), 0) & ~3;
+	int32 MaxX = Min((int32)Max(Max(V0.x, V1.x), V2.x), OCCLUSION_WIDTH - 1);
+
+	// NOTE: Edge i is opposite vertex i, written as E(x,y) = A*x + B*y + C so
+	// that E is the unnormalized barycentric weight of that vertex.
+	v3 Edge[3][2] = {{V1, V2}, {V2, V0}, {V0, V1}};
+	float A[3], B[3], C[3];
+	for(int EdgeIndex = 0; EdgeIndex < 3; ++EdgeIndex)
+	{
+	    v3 From = Edge[EdgeIndex][0];
+	    v3 To = Edge[EdgeIndex][1];
+	    A[EdgeIndex] = From.y - To.y;
+	    B[EdgeIndex] = To.x - From.x;
+	    C[EdgeIndex] = -(A[EdgeIndex]*From.x + B[EdgeIndex]*From.y);
+	}
+	float InvArea = 1.0f / (A[0]*V0.x + B[0]*V0.y + C[0]);
+	// NOTE: Depth is affine in screen space, fold it into one plane equation.
+	float ZA = (A[0]*V0.z + A[1]*V1.z + A[2]*V2.z)*InvArea;
+	float ZB = (B[0]*V0.z + B[1]*V1.z + B[2]*V2.z)*InvArea;
+	float ZC = (C[0]*V0.z + C[1]*V1.z + C[2]*V2.z)*InvArea;
+
+	// NOTE: The edges and depth are evaluated at pixel centres. Moving each
+	// edge in by half a pixel along both axes leaves only pixels entirely
+	// inside, and the depth plane's largest rise over half a pixel turns
+	// the centre depth into the farthest one in the pixel.
+	for(int EdgeIndex = 0; EdgeIndex < 3; ++EdgeIndex)
+	{
+	    C[EdgeIndex] -= 0.5f*(fabsf(A[EdgeIndex]) + fabsf(B[EdgeIndex]));
+	}
+	ZC += 0.5f*(fabsf(ZA) + fabsf(ZB));
+
+	__m128 EdgeA0 = _mm_set1_ps(A[0]), EdgeA1 = _mm_set1_ps(A[1]), EdgeA2 = _mm_set1_ps(A[2]);
+	__m128 DepthA = _mm_set1_ps(ZA);
+	for(int32 Y = MinY; Y <= MaxY; ++Y)
+	{
+	    float PY = Y + 0.5f;
+	    __m128 Row0 = _mm_set1_ps(B[0]*PY + C[0]);
+	    __m128 Row1 = _mm_set1_ps(B[1]*PY + C[1]);
+	    __m128 Row2 = _mm_set1_ps(B[2]*PY + C[2]);
+	    __m128 RowZ = _mm_set1_ps(ZB*PY + ZC);
+	    float *Row = Buffer->Depth + Y*OCCLUSION_WIDTH;
+	    for(int32 X = MinX; X <= MaxX; X += 4)
+	    {
+		__m128 PX = _mm_add_ps(_mm_set1_ps((float)X), LaneOffsets);
+		__m128 W0 = _mm_add_ps(_mm_mul_ps(EdgeA0, PX), Row0);
+		__m128 W1 = _mm_add_ps(_mm_mul_ps(EdgeA1, PX), Row1);
+		__m128 W2 = _mm_add_ps(_mm_mul_ps(EdgeA2, PX), Row2);
+		__m128 Inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(W0, Zero),
+						      _mm_cmpge_ps(W1, Zero)),
+					   _mm_cmpge_ps(W2, Zero));
+		if (_mm_movemask_ps(Inside) == 0)
+		{
+		    continue;
+		}
+
+		__m128 Z = _mm_add_ps(_mm_mul_ps(DepthA, PX), RowZ);
+		__m128 Old = _mm_loadu_ps(Row + X);
+		__m128 New = _mm_min_ps(Old, Z);
+		_mm_storeu_ps(Row + X, _mm_or_ps(_mm_and_ps(Inside, New),
+						 _mm_andnot_ps(Inside, Old)));
+	    }
+	}
+    }
+
+    for(int32 TileY = BandMinY / OCCLUSION_TILE_SIZE;
+	TileY <= BandMaxY / OCCLUSION_TILE_SIZE;
+	++TileY)
+    {
+	for(int32 TileX = 0; TileX < OCCLUSION_TILES_X; ++TileX)
+	{
+	    __m128 TileMax = _mm_setzero_ps();
+	    for(int32 Y = 0; Y < OCCLUSION_TILE_SIZE; ++Y)
+	    {
+		float *Row = Buffer->Depth + (TileY*OCCLUSION_TILE_SIZE + Y)*OCCLUSION_WIDTH + TileX*OCCLUSION_TILE_SIZE;
+		for(int32 X = 0; X < OCCLUSION_TILE_SIZE; X += 4)
+		{
+		    TileMax = _mm_max_ps(TileMax, _mm_loadu_ps(Row + X));
+		}
+	    }
+	    TileMax = _mm_max_ps(TileMax, _mm_shuffle_ps(TileMax, TileMax, _MM_SHUFFLE(1, 0, 3, 2)));
+	    TileMax = _mm_max_ps(TileMax, _mm_shuffle_ps(TileMax, TileMax, _MM_SHUFFLE(2, 3, 0, 1)));
+	    Buffer->TileMaxDepth[TileY*OCCLUSION_TILES_X + TileX] = _mm_cvtss_f32(TileMax);
+	}
+    }
+}
+
+void RasterizeOcclusionBands(void *Data, int32 FirstBand, int32 EndBand, memory_arena *Scratch)
+{
+    for(int32 Band = FirstBand; Band < EndBand; ++Band)
+    {
+	RasterizeOcclusionBand((occlusion_buffer *)Data, Band);
+    }
+}
+
+// NOTE: Bands don't share pixels or tiles, so they rasterize in parallel.
+void RasterizeOcclusionBuffer(occlusion_buffer *Buffer, job_system *Jobs)
+{
+    TIMED_FUNCTION();
+    int32 BatchSize = (Buffer->TriangleCount < OCCLUSION_PARALLEL_TRIANGLES) ? OCCLUSION_BAND_COUNT : 1;
+    ParallelFor(Jobs, OCCLUSION_BAND_COUNT, BatchSize, RasterizeOcclusionBands, Buffer);
+}
+
+// NOTE: An occludee is hidden only if its nearest depth lies behind the
+// farthest occluder depth of every tile its screen rectangle touches.
+bool32 IsOccluded(occlusion_buffer *Buffer, aabb Box, mat4 ViewProjection)
+{
+    float MinX = OCCLUSION_WIDTH, MinY = OCCLUSION_HEIGHT, MinZ = 1.0f;
+    float MaxX = 0.0f, MaxY = 0.0f;
+    for(int Corner = 0; Corner < 8; ++Corner)
+    {
+	v3 P = V3((Corner & 1) ? Box.Max.x : Box.Min.x,
+		  (Corner & 2) ? Box.Max.y : Box.Min.y,
+		  (Corner & 4) ? Box.Max.z : Box.Min.z);
+	v4 Clip = TransformPoint4(ViewProjection, P);
+	if (Clip.w < OCCLUSION_MIN_W || Clip.z < -Clip.w)
+	{
+	    return false;
+	}
+	v3 Window = ClipToOcclusionWindow(Clip);
+	MinX = Min(MinX, Window.x);
+	MaxX = Max(MaxX, Window.x);
+	MinY = Min(MinY, Window.y);
+	MaxY = Max(MaxY, Window.y);
+	MinZ = Min(MinZ, Window.z);
+    }
+
+    int32 TileMinX = Clamp((int32)MinX, 0, OCCLUSION_WIDTH - 1) / OCCLUSION_TILE_SIZE;
+    int32 TileMaxX = Clamp((int32)MaxX, 0, OCCLUSION_WIDTH - 1) / OCCLUSION_TILE_SIZE;
+    int32 TileMinY = Clamp((int32)MinY, 0, OCCLUSION_HEIGHT - 1) / OCCLUSION_TILE_SIZE;
+    int32 TileMaxY = Clamp((int32)MaxY, 0, OCCLUSION_HEIGHT - 1) / OCCLUSION_TILE_SIZE;
+    for(int32 TileY = TileMinY; TileY <= TileMaxY; ++TileY)
+    {
+	for(int32 TileX = TileMinX; TileX <= TileMaxX; ++TileX)
+	{
+	    if (MinZ <= Buffer->TileMaxDepth[TileY*OCCLUSION_TILES_X + TileX])
+	    {
+		return false;
+	    }
+	}
+    }
+    return true;
+}
+
+#endif
@@ -8,6 +8,9 @@ typedef int8_t int8;
 typedef uint8_t uint8;
 typedef uint8_t byte;
 
+typedef int16_t int16;
+typedef uint16_t uint16;
+
 typedef int32_t int32;
 typedef uint32_t uint32;
 
@@ -44,7 +47,7 @@ typedef int32_t bool32;
     printf("%s:%d: " Format, __FILE__, __LINE__, __VA_ARGS__);
 
 #else
-#define Assert(Expression, Message) {};
+#define Assert(Expression) {};
 #define DebugLog(Format, ...) {};
 #endif
 
@@ -55,11 +58,30 @@ struct stack
     void* Base;
 };
 
+// NOTE: Makes reserved address space usable; false when the system is out
+// of memory.
+typedef bool32 platform_commit_memory(void *Address, size_t Size);
+
+// NOTE: Monotonic time in nanoseconds.
+typedef uint64 platform_read_clock();
+
+// NOTE: How much a reserved arena commits at least each time it grows.
+#define ARENA_COMMIT_SIZE (MEGABYTES(2))
+
 typedef struct memory_arena
 {
     size_t Size;
     uint8 *Base;
     size_t Used;
+    // NOTE: Set for memory the platform only reserved; Committed bytes from
+    // Base are usable and pushes past that commit more, at least
+    // ARENA_COMMIT_SIZE at a time. Arenas pushed out of this one are skipped
+    // over and commit their own memory as they grow.
+    platform_commit_memory *CommitMemory;
+    size_t Committed;
+    // NOTE: Open BeginTemporaryMemory scopes, which must be closed before
+    // the arena is reset.
+    int32 TempCount;
 } memory_arena;
 
 #define PushSize(Arena, type) (type *)PushSize_(Arena, sizeof(type))
@@ -68,6 +90,17 @@ void*
 PushSize_(memory_arena *Arena, size_t Size)
 {
     Assert((Arena->Used + Size) <= (Arena->Size));
+    if (Arena->CommitMemory && Arena->Used + Size > Arena->Committed)
+    {
+	size_t CommitStart = Max(Arena->Committed, Arena->Used);
+	size_t CommitSize = Max(Arena->Used + Size - CommitStart, (size_t)ARENA_COMMIT_SIZE);
+	CommitSize = Min(CommitSize, Arena->Size - CommitStart);
+	if (!Arena->CommitMemory(Arena->Base + CommitStart, CommitSize))
+	{
+	    Assert(!"Can't commit arena memory");
+	}
+	Arena->Committed = CommitStart + CommitSize;
+    }
     void *NewSpace = Arena->Base + Arena->Used;
     Arena->Used += Size;
     
@@ -80,6 +113,9 @@ InitArena(memory_arena *Arena, size_t Size, uint8 *Base)
     Arena->Size = Size;
     Arena->Base = Base;
     Arena->Used = 0;
+    Arena->TempCount = 0;
+    Arena->CommitMemory = 0;
+    Arena->Committed = 0;
 }
 
 inline memory_arena
@@ -88,7 +124,17 @@ PushArena(memory_arena *Arena, size_t Size)
     memory_arena Result = {0};
     Result.Size = Size;
     Result.Used = 0;
-    Result.Base = (uint8 *)PushSize_(Arena, Size);
+    if (Arena->CommitMemory)
+    {
+	Assert((Arena->Used + Size) <= (Arena->Size));
+	Result.Base = Arena->Base + Arena->Used;
+	Result.CommitMemory = Arena->CommitMemory;
+	Arena->Used += Size;
+    }
+    else
+    {
+	Result.Base = (uint8 *)PushSize_(Arena, Size);
+    }
     return Result;
 }
 
@@ -97,6 +143,41 @@ size_t ArenaSizeRemaining(memory_arena *Arena)
     return Arena->Size - Arena->Used;
 }
 
+// NOTE: Everything pushed between Begin and End is given back by End.
+// Scopes nest and have to end in the reverse order they began.
+struct temporary_memory
+{
+    memory_arena *Arena;
+    size_t Used;
+};
+
+inline temporary_memory
+BeginTemporaryMemory(memory_arena *Arena)
+{
+    temporary_memory Result;
+    Result.Arena = Arena;
+    Result.Used = Arena->Used;
+    ++Arena->TempCount;
+    return Result;
+}
+
+inline void
+EndTemporaryMemory(temporary_memory TempMemory)
+{
+    memory_arena *Arena = TempMemory.Arena;
+    Assert(Arena->Used >= TempMemory.Used);
+    Assert(Arena->TempCount > 0);
+    Arena->Used = TempMemory.Used;
+    --Arena->TempCount;
+}
+
+inline void
+ResetArena(memory_arena *Arena)
+{
+    Assert(Arena->TempCount == 0);
+    Arena->Used = 0;
+}
+
 struct button_state 
 {
     bool32 Down;
@@ -184,6 +265,32 @@ typedef struct platform_functions
     
 } platform_functions;
 
+// NOTE: Most threads the job system runs, the calling thread included. The
+// profiler keeps an event buffer for each.
+#define MAX_JOB_THREADS 16
+
+// NOTE: With dynamic resolution on, eye buffers are allocated this many
+// times the size the headset asks for, so there's room to supersample when
+// the GPU has time to spare.
+#define DYNAMIC_RESOLUTION_MAX_SCALE 1.25f
+
+enum stereo_mode
+{
+    STEREO_MULTIPASS,
+    // NOTE: Both eyes drawn in one pass into StereoTarget (2*VRBufferWidth wide),
+    // then split into LeftEye/RightEye by the resolve.
+    STEREO_INSTANCED
+};
+
+// NOTE: Order of the opaque draws: grouped by program and material for the
+// fewest state changes, or nearest first so early depth testing throws away
+// more of the hidden fragments. Only matters without the depth pre-pass.
+enum draw_order
+{
+    DRAW_ORDER_STATE,
+    DRAW_ORDER_FRONT_TO_BACK
+};
+
 typedef struct platform_data
 {
     int32 MainMemorySize;
@@ -191,17 +298,64 @@ typedef struct platform_data
     int32 TempMemorySize;
     void* TempMemory;
     int32 TotalMemorySize;
+    // NOTE: 0 when MainMemory and TempMemory come fully committed.
+    platform_commit_memory *CommitMemory;
 
     input *LastInput;
     input *NewInput;
 
     int WindowWidth;
     int WindowHeight;
+    // NOTE: 0 for a real window, an offscreen FBO when running headless.
+    GLuint WindowFramebuffer;
     
     int VRBufferWidth;
     int VRBufferHeight;
     FramebufferDesc *LeftEye;
     FramebufferDesc *RightEye;
+    stereo_mode StereoMode;
+    FramebufferDesc *StereoTarget;
+
+    // NOTE: Set by the platform to capture this many frames with the profiler,
+    // cleared by the game once the capture starts. 0 path means the default.
+    int32 ProfileFrameCount;
+    const char *ProfilePath;
+    // NOTE: Print the GPU pass timings as each frame is read back.
+    bool32 ShowGPUTimings;
+    // NOTE: Print how many state calls the GL state cache let through and
+    // dropped over the previous frame.
+    bool32 ShowGLStats;
+    // NOTE: Job system threads including the main thread, 0 for one per core.
+    int32 JobThreadCount;
+    // NOTE: Update the next frame on a worker while this one renders from a
+    // snapshot; adds a frame of latency.
+    bool32 PipelinedUpdate;
+    // NOTE: When the platform sets ReadClock, the game writes how long the
+    // frame's Update and Render took, so a run can show how much of them
+    // pipelining overlaps. The pipelined update is the next frame's.
+    platform_read_clock *ReadClock;
+    float UpdateMilliseconds;
+    float RenderMilliseconds;
+    // NOTE: Extra point lights to scatter around the scene, shaded through
+    // the light clusters.
+    int32 PointLightCount;
+    // NOTE: Shadow maps for the key light; a directional key light gets
+    // cascades instead of the point light's cube map.
+    bool32 Shadows;
+    bool32 DirectionalLight;
+    // NOTE: Lay down depth with a position only pass first, so the colour
+    // pass only shades the fragments that end up visible.
+    bool32 DepthPrepass;
+    draw_order DrawOrder;
+    // NOTE: GPU frame budget the eye viewport is scaled to fit, 0 for off.
+    // Must be set before the eye buffers are allocated, which then come out
+    // DYNAMIC_RESOLUTION_MAX_SCALE times larger.
+    float DynamicResolutionTargetMs;
+    // NOTE: Eye buffer anti-aliasing, also fixed once they're allocated:
+    // MSAA samples (0 for none) and an FXAA pass in the resolve instead of
+    // a plain blit, for when MSAA's bandwidth is too much.
+    int32 MSAASamples;
+    bool32 FXAA;
 } platform_data;
 
 #endif
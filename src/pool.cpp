@@ -0,0 +1,194 @@
+#ifndef POOL_CPP__
+#define POOL_CPP__
+
+#include "platform.h"
+
+#include <string.h>
+
+// NOTE: Fixed capacity pool of same sized items for things with their own
+// lifetimes (spawned objects, streamed resources). Live items are kept packed
+// at the front of Items, so update loops walk a dense array; freeing moves
+// the last item into the hole. Because items move, they are referred to by
+// handle: a slot index plus the slot's generation, which is bumped on every
+// alloc and every free so stale handles stop resolving. Generations are odd
+// while the slot is live and even while it's free, so a handle can't resolve
+// to a free slot either. Free slots form a list threaded through the slot
+// array itself. Alloc, free and lookup are O(1).
+
+struct pool_handle
+{
+    uint32 Slot;
+    // NOTE: Always odd for a live item, so a zeroed handle is always invalid.
+    uint32 Generation;
+};
+
+struct pool_slot
+{
+    uint32 Generation;
+    union
+    {
+	uint32 DenseIndex;
+	uint32 NextFree;
+    };
+};
+
+#define POOL_NO_SLOT 0xFFFFFFFF
+
+struct memory_pool
+{
+    size_t ItemSize;
+    uint32 Capacity;
+    uint32 Count;
+    uint32 FreeHead;
+    uint8 *Items;
+    // NOTE: Slot of each dense item, to fix up the slot of the item moved by
+    // a free.
+    uint32 *DenseSlots;
+    pool_slot *Slots;
+};
+
+void InitPool_(memory_pool *Pool, memory_arena *Arena, uint32 Capacity, size_t ItemSize)
+{
+    Pool->ItemSize = ItemSize;
+    Pool->Capacity = Capacity;
+    Pool->Count = 0;
+    Pool->Items = (uint8 *)PushSize_(Arena, Capacity*ItemSize);
+    Pool->DenseSlots = PushArray(Arena, Capacity, uint32);
+    Pool->Slots = PushArray(Arena, Capacity, pool_slot);
+    for(uint32 SlotIndex = 0; SlotIndex < Capacity; ++SlotIndex)
+    {
+	Pool->Slots[SlotIndex].Generation = 0;
+	Pool->Slots[SlotIndex].NextFree = (SlotIndex + 1 < Capacity) ? SlotIndex + 1 : POOL_NO_SLOT;
+    }
+    Pool->FreeHead = Capacity ? 0 : POOL_NO_SLOT;
+}
+
+#define InitPool(Pool, Arena, Capacity, type) InitPool_(Pool, Arena, Capacity, sizeof(type))
+
+inline void *GetPoolItemAt_(memory_pool *Pool, uint32 DenseIndex)
+{
+    Assert(DenseIndex < Pool->Count);
+    return Pool->Items + DenseIndex*Pool->ItemSize;
+}
+
+// NOTE: Dense iteration: for DenseIndex in [0, Pool->Count).
+#define GetPoolItemAt(Pool, DenseIndex, type) ((type *)GetPoolItemAt_(Pool, DenseIndex))
+#define GetPoolItems(Pool, type) ((type *)(Pool)->Items)
+
+inline bool32 IsPoolHandleValid(memory_pool *Pool, pool_handle Handle)
+{
+    return (Handle.Slot < Pool->Capacity &&
+	    (Handle.Generation & 1) &&
+	    Pool->Slots[Handle.Slot].Generation == Handle.Generation);
+}
+
+// NOTE: 0 for a stale or null handle. The pointer is only good until the
+// next free from this pool.
+inline void *GetPoolItem_(memory_pool *Pool, pool_handle Handle)
+{
+    void *Result = 0;
+    if (IsPoolHandleValid(Pool, Handle))
+    {
+	Result = Pool->Items + Pool->Slots[Handle.Slot].DenseIndex*Pool->ItemSize;
+    }
+    return Result;
+}
+
+#define GetPoolItem(Pool, Handle, type) ((type *)GetPoolItem_(Pool, Handle))
+
+inline pool_handle GetPoolHandle(memory_pool *Pool, uint32 DenseIndex)
+{
+    Assert(DenseIndex < Pool->Count);
+    pool_handle Result;
+    Result.Slot = Pool->DenseSlots[DenseIndex];
+    Result.Generation = Pool->Slots[Result.Slot].Generation;
+    return Result;
+}
+
+// NOTE: The new item is zeroed. Returns a null handle when the pool is full.
+pool_handle AllocPoolItem(memory_pool *Pool)
+{
+    pool_handle Result = {0};
+    if (Pool->FreeHead == POOL_NO_SLOT)
+    {
+	Assert(!"Pool is full");
+	return Result;
+    }
+
+    uint32 SlotIndex = Pool->FreeHead;
+    pool_slot *Slot = Pool->Slots + SlotIndex;
+    Pool->FreeHead = Slot->NextFree;
+    ++Slot->Generation;
+
+    uint32 DenseIndex = Pool->Count++;
+    Slot->DenseIndex = DenseIndex;
+    Pool->DenseSlots[DenseIndex] = SlotIndex;
+    memset(Pool->Items + DenseIndex*Pool->ItemSize, 0, Pool->ItemSize);
+
+    Result.Slot = SlotIndex;
+    Result.Generation = Slot->Generation;
+    return Result;
+}
+
+// NOTE: Moves the last item into the freed one's place. Returns false for a
+// stale handle, which is otherwise ignored.
+bool32 FreePoolItem(memory_pool *Pool, pool_handle Handle)
+{
+    if (!IsPoolHandleValid(Pool, Handle))
+    {
+	return false;
+    }
+
+    pool_slot *Slot = Pool->Slots + Handle.Slot;
+    uint32 DenseIndex = Slot->DenseIndex;
+    uint32 LastIndex = --Pool->Count;
+    if (DenseIndex != LastIndex)
+    {
+	memcpy(Pool->Items + DenseIndex*Pool->ItemSize,
+	       Pool->Items + LastIndex*Pool->ItemSize,
+	       Pool->ItemSize);
+	uint32 MovedSlot = Pool->DenseSlots[LastIndex];
+	Pool->DenseSlots[DenseIndex] = MovedSlot;
+	Pool->Slots[MovedSlot].DenseIndex = DenseIndex;
+    }
+
+    ++Slot->Generation;
+    Slot->NextFree = Pool->FreeHead;
+    Pool->FreeHead = Handle.Slot;
+    return true;
+}
+
+// NOTE: Rearranges the dense items so the new item i is the old item
+// Order[i]; handles keep resolving to the same items. Temp holds at least
+// Count items.
+void ReorderPool(memory_pool *Pool, uint32 *Order, void *Temp)
+{
+    uint8 *TempItems = (uint8 *)Temp;
+    for(uint32 DenseIndex = 0; DenseIndex < Pool->Count; ++DenseIndex)
+    {
+	memcpy(TempItems + DenseIndex*Pool->ItemSize, Pool->Items + Order[DenseIndex]*Pool->ItemSize,
+	       Pool->ItemSize);
+    }
+    memcpy(Pool->Items, TempItems, Pool->Count*Pool->ItemSize);
+
+    uint32 *TempSlots = (uint32 *)Temp;
+    for(uint32 DenseIndex = 0; DenseIndex < Pool->Count; ++DenseIndex)
+    {
+	TempSlots[DenseIndex] = Pool->DenseSlots[Order[DenseIndex]];
+    }
+    for(uint32 DenseIndex = 0; DenseIndex < Pool->Count; ++DenseIndex)
+    {
+	Pool->DenseSlots[DenseIndex] = TempSlots[DenseIndex];
+	Pool->Slots[TempSlots[DenseIndex]].DenseIndex = DenseIndex;
+    }
+}
+
+void ClearPool(memory_pool *Pool)
+{
+    while (Pool->Count)
+    {
+	FreePoolItem(Pool, GetPoolHandle(Pool, Pool->Count - 1));
+    }
+}
+
+#endif
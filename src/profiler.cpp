@@ -0,0 +1,340 @@
+#ifndef PROFILER_CPP__
+#define PROFILER_CPP__
+
+#include "platform.h"
+
+#include <stdio.h>
+
+// NOTE: CPU zone profiler. TIMED_BLOCK("Name") records one complete event
+// (name, start, end) when its scope closes, into a buffer owned by the calling
+// thread, so recording never takes a lock. Nothing is recorded until a capture
+// is requested; a capture runs for N frames and is then written out as Chrome
+// trace_event JSON (load it in chrome://tracing or Perfetto). GPU zones from
+// gpuProfiler.cpp go on their own track; they are read back a few frames late,
+// so the file is written PROFILER_GPU_FLUSH_FRAMES after the capture ends.
+// Built with RELEASE the macros and entry points are empty.
+
+#ifndef RELEASE
+
+#include <atomic>
+#if defined(WINDOWS)
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <time.h>
+#endif
+
+#define PROFILER_MAX_THREADS MAX_JOB_THREADS
+#define PROFILER_EVENTS_PER_THREAD 16384
+#define PROFILER_DEFAULT_PATH "trace.json"
+// NOTE: Matches GPU_PROFILER_LATENCY, the frames before a GPU zone is read.
+#define PROFILER_GPU_FLUSH_FRAMES 4
+
+struct profiler_event
+{
+    const char *Name;
+    uint64 Start;
+    uint64 End;
+};
+
+struct profiler_thread
+{
+    int32 ThreadIndex;
+    // NOTE: Whatever the claiming thread called itself, "Thread" if nothing.
+    const char *Name;
+    int32 NameNumber;
+    int32 Count;
+    int32 Dropped;
+    profiler_event *Events;
+};
+
+struct profiler
+{
+    bool32 Initialized;
+    std::atomic<int32> Recording;
+    std::atomic<int32> ThreadCount;
+    profiler_thread Threads[PROFILER_MAX_THREADS];
+    // NOTE: Start and End are GPU timestamps in nanoseconds here.
+    profiler_thread GPUTrack;
+
+    int32 FramesRequested;
+    int32 FramesRecorded;
+    int32 FlushFramesRemaining;
+    const char *OutputPath;
+
+    // NOTE: rdtsc is converted to microseconds with the rate measured against
+    // the monotonic clock over the capture itself.
+    uint64 StartTicks;
+    uint64 StartNanoseconds;
+    uint64 EndTicks;
+    uint64 EndNanoseconds;
+    // NOTE: The GL clock has its own base, lined up with the CPU at the start.
+    GLint64 GPUStartNanoseconds;
+};
+
+profiler GlobalProfiler;
+thread_local profiler_thread *ProfilerThread;
+thread_local const char *ProfilerThreadName;
+thread_local int32 ProfilerThreadNumber;
+
+inline uint64 ReadProfilerTicks()
+{
+    return __rdtsc();
+}
+
+uint64 ReadProfilerNanoseconds()
+{
+#if defined(WINDOWS)
+    LARGE_INTEGER Frequency, Counter;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    return (uint64)((double)Counter.QuadPart * 1000000000.0 / (double)Frequency.QuadPart);
+#else
+    timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64)Now.tv_sec*1000000000ull + (uint64)Now.tv_nsec;
+#endif
+}
+
+void InitProfiler(memory_arena *Arena)
+{
+    profiler *Profiler = &GlobalProfiler;
+    for(int ThreadIndex = 0; ThreadIndex < PROFILER_MAX_THREADS; ++ThreadIndex)
+    {
+	profiler_thread *Thread = Profiler->Threads + ThreadIndex;
+	Thread->ThreadIndex = ThreadIndex;
+	Thread->Events = PushArray(Arena, PROFILER_EVENTS_PER_THREAD, profiler_event);
+    }
+    Profiler->GPUTrack.ThreadIndex = PROFILER_MAX_THREADS;
+    Profiler->GPUTrack.Events = PushArray(Arena, PROFILER_EVENTS_PER_THREAD, profiler_event);
+    Profiler->Initialized = true;
+}
+
+// NOTE: Labels the calling thread's track "Name Number" in the trace. Call
+// before the thread records anything; Name has to outlive the profiler.
+inline void SetProfilerThreadName(const char *Name, int32 Number)
+{
+    ProfilerThreadName = Name;
+    ProfilerThreadNumber = Number;
+}
+
+// NOTE: Each thread claims a buffer the first time it records and keeps it;
+// threads past PROFILER_MAX_THREADS are not recorded.
+inline void RecordProfilerEvent(const char *Name, uint64 Start, uint64 End)
+{
+    profiler_thread *Thread = ProfilerThread;
+    if (!Thread)
+    {
+	int32 ThreadIndex = GlobalProfiler.ThreadCount.fetch_add(1);
+	if (ThreadIndex >= PROFILER_MAX_THREADS)
+	{
+	    return;
+	}
+	Thread = GlobalProfiler.Threads + ThreadIndex;
+	Thread->Name = ProfilerThreadName ? ProfilerThreadName : "Thread";
+	Thread->NameNumber = ProfilerThreadName ? ProfilerThreadNumber : ThreadIndex;
+	ProfilerThread = Thread;
+    }
+
+    if (Thread->Count < PROFILER_EVENTS_PER_THREAD)
+    {
+	profiler_event *Event = Thread->Events + Thread->Count++;
+	Event->Name = Name;
+	Event->Start = Start;
+	Event->End = End;
+    }
+    else
+    {
+	++Thread->Dropped;
+    }
+}
+
+struct timed_block
+{
+    const char *Name;
+    uint64 Start;
+
+    timed_block(const char *BlockName)
+    {
+	Name = BlockName;
+	Start = GlobalProfiler.Recording.load(std::memory_order_relaxed) ? ReadProfilerTicks() : 0;
+    }
+
+    ~timed_block()
+    {
+	if (Start && GlobalProfiler.Recording.load(std::memory_order_relaxed))
+	{
+	    RecordProfilerEvent(Name, Start, ReadProfilerTicks());
+	}
+    }
+};
+
+inline bool32 IsProfilerRecording()
+{
+    return GlobalProfiler.Recording.load(std::memory_order_relaxed);
+}
+
+// NOTE: Called from the GL thread only, while recording or flushing.
+void RecordGPUProfilerEvent(const char *Name, uint64 Start, uint64 End)
+{
+    profiler_thread *Track = &GlobalProfiler.GPUTrack;
+    if (Track->Count < PROFILER_EVENTS_PER_THREAD)
+    {
+	profiler_event *Event = Track->Events + Track->Count++;
+	Event->Name = Name;
+	Event->Start = Start;
+	Event->End = End;
+    }
+    else
+    {
+	++Track->Dropped;
+    }
+}
+
+#define TIMED_BLOCK__(Name, Line) timed_block TimedBlock_##Line(Name)
+#define TIMED_BLOCK_(Name, Line) TIMED_BLOCK__(Name, Line)
+#define TIMED_BLOCK(Name) TIMED_BLOCK_(Name, __LINE__)
+#define TIMED_FUNCTION() TIMED_BLOCK(__FUNCTION__)
+
+void WriteChromeTrace(profiler *Profiler)
+{
+    uint64 EndTicks = Profiler->EndTicks;
+    uint64 EndNanoseconds = Profiler->EndNanoseconds;
+    FILE *File = fopen(Profiler->OutputPath, "w");
+    if (!File)
+    {
+	DebugLog("Can't open %s for the trace\n", Profiler->OutputPath);
+	return;
+    }
+
+    double MicrosecondsPerTick = 0.0;
+    if (EndTicks > Profiler->StartTicks)
+    {
+	MicrosecondsPerTick = ((double)(EndNanoseconds - Profiler->StartNanoseconds) / 1000.0) /
+	    (double)(EndTicks - Profiler->StartTicks);
+    }
+
+    int32 ThreadCount = Min(Profiler->ThreadCount.load(), PROFILER_MAX_THREADS);
+    int32 EventCount = 0;
+    int32 DroppedCount = 0;
+    fprintf(File, "{\"traceEvents\":[\n");
+    bool32 First = true;
+    for(int ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+    {
+	profiler_thread *Thread = Profiler->Threads + ThreadIndex;
+	fprintf(File, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+		"\"args\":{\"name\":\"%s %d\"}}",
+		First ? "" : ",\n", Thread->ThreadIndex, Thread->Name, Thread->NameNumber);
+	First = false;
+
+	for(int EventIndex = 0; EventIndex < Thread->Count; ++EventIndex)
+	{
+	    profiler_event *Event = Thread->Events + EventIndex;
+	    // NOTE: Events opened before the capture started have no start.
+	    if (Event->Start < Profiler->StartTicks)
+	    {
+		continue;
+	    }
+	    double Timestamp = (Event->Start - Profiler->StartTicks) * MicrosecondsPerTick;
+	    double Duration = (Event->End - Event->Start) * MicrosecondsPerTick;
+	    fprintf(File, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+		    Event->Name, Thread->ThreadIndex, Timestamp, Duration);
+	    ++EventCount;
+	}
+	DroppedCount += Thread->Dropped;
+    }
+
+    profiler_thread *Track = &Profiler->GPUTrack;
+    if (Track->Count)
+    {
+	fprintf(File, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+		"\"args\":{\"name\":\"GPU\"}}", Track->ThreadIndex);
+    }
+    for(int EventIndex = 0; EventIndex < Track->Count; ++EventIndex)
+    {
+	profiler_event *Event = Track->Events + EventIndex;
+	double Timestamp = ((int64)Event->Start - Profiler->GPUStartNanoseconds) / 1000.0;
+	double Duration = (Event->End - Event->Start) / 1000.0;
+	fprintf(File, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+		Event->Name, Track->ThreadIndex, Timestamp, Duration);
+	++EventCount;
+    }
+    DroppedCount += Track->Dropped;
+    fprintf(File, "\n]}\n");
+    fclose(File);
+
+    printf("Profiler: %d frames, %d events (%d dropped) written to %s\n",
+	   Profiler->FramesRecorded, EventCount, DroppedCount, Profiler->OutputPath);
+}
+
+// NOTE: Starts a pending capture at a frame boundary. Worker threads must be
+// idle here and in EndProfilerFrame, since their buffers are reset and read
+// without synchronization.
+void BeginProfilerFrame(platform_data *Platform)
+{
+    profiler *Profiler = &GlobalProfiler;
+    if (!Profiler->Initialized || Profiler->Recording.load() || Profiler->FlushFramesRemaining ||
+	Platform->ProfileFrameCount <= 0)
+    {
+	return;
+    }
+
+    Profiler->FramesRequested = Platform->ProfileFrameCount;
+    Profiler->FramesRecorded = 0;
+    Profiler->OutputPath = Platform->ProfilePath ? Platform->ProfilePath : PROFILER_DEFAULT_PATH;
+    Platform->ProfileFrameCount = 0;
+
+    for(int ThreadIndex = 0; ThreadIndex < PROFILER_MAX_THREADS; ++ThreadIndex)
+    {
+	Profiler->Threads[ThreadIndex].Count = 0;
+	Profiler->Threads[ThreadIndex].Dropped = 0;
+    }
+    Profiler->GPUTrack.Count = 0;
+    Profiler->GPUTrack.Dropped = 0;
+    glGetInteger64v(GL_TIMESTAMP, &Profiler->GPUStartNanoseconds);
+    Profiler->StartNanoseconds = ReadProfilerNanoseconds();
+    Profiler->StartTicks = ReadProfilerTicks();
+    Profiler->Recording.store(1);
+}
+
+void EndProfilerFrame()
+{
+    profiler *Profiler = &GlobalProfiler;
+    if (Profiler->FlushFramesRemaining)
+    {
+	if (--Profiler->FlushFramesRemaining == 0)
+	{
+	    WriteChromeTrace(Profiler);
+	}
+	return;
+    }
+    if (!Profiler->Recording.load())
+    {
+	return;
+    }
+
+    if (++Profiler->FramesRecorded >= Profiler->FramesRequested)
+    {
+	Profiler->Recording.store(0);
+	Profiler->EndTicks = ReadProfilerTicks();
+	Profiler->EndNanoseconds = ReadProfilerNanoseconds();
+	Profiler->FlushFramesRemaining = PROFILER_GPU_FLUSH_FRAMES;
+    }
+}
+
+#else
+
+#define TIMED_BLOCK(Name)
+#define TIMED_FUNCTION()
+
+inline void InitProfiler(memory_arena *Arena) {}
+inline void SetProfilerThreadName(const char *Name, int32 Number) {}
+inline void BeginProfilerFrame(platform_data *Platform) {}
+inline void EndProfilerFrame() {}
+inline bool32 IsProfilerRecording() { return false; }
+inline void RecordGPUProfilerEvent(const char *Name, uint64 Start, uint64 End) {}
+
+#endif
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef RENDERCOMMANDS_CPP__
+#define RENDERCOMMANDS_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+#include "math.cpp"
+#include "profiler.cpp"
+
+#include <string.h>
+
+// NOTE: GL calls are only legal on the context thread, so draw preparation
+// is recorded instead: each worker writes a slice of the visible objects into
+// its own command buffer (matrices built, uniforms packed), then the GL thread
+// replays the slices in order and only issues the calls. A command is a
+// header followed by its payload, both carved from the slice's arena; the
+// arena is rewound when the slice is recorded again.
+
+#define RENDER_COMMAND_DRAWS_PER_SLICE 64
+// NOTE: Slices made up front; a pass with more draws adds more.
+#define RENDER_COMMAND_INITIAL_SLICES 16
+#define RENDER_COMMAND_SLICE_SIZE KILOBYTES(64)
+#define RENDER_COMMAND_MAX_TEXTURES 4
+#define RENDER_COMMAND_ALIGNMENT 8
+
+enum render_command_type
+{
+    RenderCommand_UseProgram,
+    RenderCommand_BindTextures,
+    RenderCommand_Uniform,
+    RenderCommand_DrawElements,
+};
+
+enum render_uniform_type
+{
+    RenderUniform_Int,
+    RenderUniform_Float,
+    RenderUniform_Vec3,
+    RenderUniform_Vec4,
+    RenderUniform_Mat4,
+};
+
+struct render_command_header
+{
+    uint16 Type;
+    uint16 Size;
+};
+
+struct render_command_use_program
+{
+    GLuint Program;
+};
+
+struct render_command_bind_textures
+{
+    int32 Count;
+    GLuint Textures[RENDER_COMMAND_MAX_TEXTURES];
+};
+
+// NOTE: Followed by Count values of the type, packed.
+struct render_command_uniform
+{
+    GLint Location;
+    uint16 Type;
+    uint16 Count;
+};
+
+struct render_command_draw_elements
+{
+    GLuint VertexArray;
+    GLsizei IndexCount;
+    GLsizei InstanceCount;
+};
+
+struct render_commands
+{
+    int32 SliceCount;
+    int32 MaxSlices;
+    memory_arena *Slices;
+    // NOTE: Where more slices come from. Only the GL thread grows it, and
+    // nothing else pushes to it after init.
+    memory_arena *Arena;
+};
+
+void InitRenderCommands(render_commands *Commands, memory_arena *Arena)
+{
+    Commands->Arena = Arena;
+    Commands->MaxSlices = RENDER_COMMAND_INITIAL_SLICES;
+    Commands->Slices = PushArray(Arena, Commands->MaxSlices, memory_arena);
+    for(int SliceIndex = 0; SliceIndex < Commands->MaxSlices; ++SliceIndex)
+    {
+	Commands->Slices[SliceIndex] = PushArena(Arena, RENDER_COMMAND_SLICE_SIZE);
+    }
+    Commands->SliceCount = 0;
+}
+
+// NOTE: DrawCount draws are split into RENDER_COMMAND_DRAWS_PER_SLICE sized
+// slices, slice i recorded by whichever worker gets draws i*N to (i + 1)*N.
+// Past the slices there are, the slice array is at least doubled and the
+// new slices pushed; the old array is left behind in the arena, so growing
+// costs a little memory once per doubling and the high water mark is kept.
+void BeginRenderCommands(render_commands *Commands, int32 DrawCount)
+{
+    Commands->SliceCount = (DrawCount + RENDER_COMMAND_DRAWS_PER_SLICE - 1) / RENDER_COMMAND_DRAWS_PER_SLICE;
+    if (Commands->SliceCount > Commands->MaxSlices)
+    {
+	int32 MaxSlices = Max(2*Commands->MaxSlices, Commands->SliceCount);
+	memory_arena *Slices = PushArray(Commands->Arena, MaxSlices, memory_arena);
+	memcpy(Slices, Commands->Slices, Commands->MaxSlices*sizeof(memory_arena));
+	for(int SliceIndex = Commands->MaxSlices; SliceIndex < MaxSlices; ++SliceIndex)
+	{
+	    Slices[SliceIndex] = PushArena(Commands->Arena, RENDER_COMMAND_SLICE_SIZE);
+	}
+	DebugLog("Render commands grown to %d slices\n", MaxSlices);
+	Commands->Slices = Slices;
+	Commands->MaxSlices = MaxSlices;
+    }
+    for(int SliceIndex = 0; SliceIndex < Commands->SliceCount; ++SliceIndex)
+    {
+	ResetArena(Commands->Slices + SliceIndex);
+    }
+}
+
+void *PushRenderCommand(memory_arena *Buffer, render_command_type Type, size_t Size)
+{
+    size_t TotalSize = sizeof(render_command_header) + Size;
+    TotalSize = (TotalSize + RENDER_COMMAND_ALIGNMENT - 1) & ~(size_t)(RENDER_COMMAND_ALIGNMENT - 1);
+    render_command_header *Header = (render_command_header *)PushSize_(Buffer, TotalSize);
+    Header->Type = (uint16)Type;
+    Header->Size = (uint16)TotalSize;
+    return Header + 1;
+}
+
+void PushUseProgram(memory_arena *Buffer, GLuint Program)
+{
+    render_command_use_program *Command = (render_command_use_program *)
+	PushRenderCommand(Buffer, RenderCommand_UseProgram, sizeof(render_command_use_program));
+    Command->Program = Program;
+}
+
+// NOTE: Texture i is bound to unit i.
+void PushBindTextures(memory_arena *Buffer, GLuint *Textures, int32 Count)
+{
+    Assert(Count <= RENDER_COMMAND_MAX_TEXTURES);
+    render_command_bind_textures *Command = (render_command_bind_textures *)
+	PushRenderCommand(Buffer, RenderCommand_BindTextures, sizeof(render_command_bind_textures));
+    Command->Count = Count;
+    for(int TextureIndex = 0; TextureIndex < Count; ++TextureIndex)
+    {
+	Command->Textures[TextureIndex] = Textures[TextureIndex];
+    }
+}
+
+size_t GetRenderUniformSize(render_uniform_type Type)
+{
+    size_t Result = 0;
+    switch(Type)
+    {
+    case RenderUniform_Int: Result = sizeof(GLint); break;
+    case RenderUniform_Float: Result = sizeof(float); break;
+    case RenderUniform_Vec3: Result = 3*sizeof(float); break;
+    case RenderUniform_Vec4: Result = 4*sizeof(float); break;
+    case RenderUniform_Mat4: Result = 16*sizeof(float); break;
+    }
+    return Result;
+}
+
+void PushUniform(memory_arena *Buffer, GLint Location, render_uniform_type Type, void *Values, int32 Count = 1)
+{
+    size_t ValueSize = Count*GetRenderUniformSize(Type);
+    render_command_uniform *Command = (render_command_uniform *)
+	PushRenderCommand(Buffer, RenderCommand_Uniform, sizeof(render_command_uniform) + ValueSize);
+    Command->Location = Location;
+    Command->Type = (uint16)Type;
+    Command->Count = (uint16)Count;
+    memcpy(Command + 1, Values, ValueSize);
+}
+
+inline void PushUniform(memory_arena *Buffer, GLint Location, int32 Value)
+{
+    PushUniform(Buffer, Location, RenderUniform_Int, &Value);
+}
+
+inline void PushUniform(memory_arena *Buffer, GLint Location, float Value)
+{
+    PushUniform(Buffer, Location, RenderUniform_Float, &Value);
+}
+
+inline void PushUniform(memory_arena *Buffer, GLint Location, v3 Value)
+{
+    float Values[3] = { Value.x, Value.y, Value.z };
+    PushUniform(Buffer, Location, RenderUniform_Vec3, Values);
+}
+
+inline void PushUniform(memory_arena *Buffer, GLint Location, v4 Value)
+{
+    float Values[4] = { Value.x, Value.y, Value.z, Value.w };
+    PushUniform(Buffer, Location, RenderUniform_Vec4, Values);
+}
+
+void PushDrawElements(memory_arena *Buffer, GLuint VertexArray, GLsizei IndexCount, GLsizei InstanceCount)
+{
+    render_command_draw_elements *Command = (render_command_draw_elements *)
+	PushRenderCommand(Buffer, RenderCommand_DrawElements, sizeof(render_command_draw_elements));
+    Command->VertexArray = VertexArray;
+    Command->IndexCount = IndexCount;
+    Command->InstanceCount = InstanceCount;
+}
+
+void ExecuteUniform(render_command_uniform *Command)
+{
+    void *Values = Command + 1;
+    switch(Command->Type)
+    {
+    case RenderUniform_Int:
+	glUniform1iv(Command->Location, Command->Count, (GLint *)Values);
+	break;
+    case RenderUniform_Float:
+	glUniform1fv(Command->Location, Command->Count, (GLfloat *)Values);
+	break;
+    case RenderUniform_Vec3:
+	glUniform3fv(Command->Location, Command->Count, (GLfloat *)Values);
+	break;
+    case RenderUniform_Vec4:
+	glUniform4fv(Command->Location, Command->Count, (GLfloat *)Values);
+	break;
+    case RenderUniform_Mat4:
+	glUniformMatrix4fv(Command->Location, Command->Count, GL_FALSE, (GLfloat *)Values);
+	break;
+    default:
+	Assert(!"Unknown uniform type");
+	break;
+    }
+}
+
+// NOTE: GL thread only.
+void ExecuteRenderCommands(render_commands *Commands)
+{
+    TIMED_FUNCTION();
+    for(int SliceIndex = 0; SliceIndex < Commands->SliceCount; ++SliceIndex)
+    {
+	memory_arena *Slice = Commands->Slices + SliceIndex;
+	uint8 *At = Slice->Base;
+	uint8 *End = Slice->Base + Slice->Used;
+	while (At < End)
+	{
+	    render_command_header *Header = (render_command_header *)At;
+	    void *Command = Header + 1;
+	    switch(Header->Type)
+	    {
+	    case RenderCommand_UseProgram:
+	    {
+		glUseProgram(((render_command_use_program *)Command)->Program);
+	    } break;
+	    case RenderCommand_BindTextures:
+	    {
+		render_command_bind_textures *Bind = (render_command_bind_textures *)Command;
+		for(int TextureIndex = 0; TextureIndex < Bind->Count; ++TextureIndex)
+		{
+		    glActiveTexture(GL_TEXTURE0 + TextureIndex);
+		    glBindTexture(GL_TEXTURE_2D, Bind->Textures[TextureIndex]);
+		}
+	    } break;
+	    case RenderCommand_Uniform:
+	    {
+		ExecuteUniform((render_command_uniform *)Command);
+	    } break;
+	    case RenderCommand_DrawElements:
+	    {
+		render_command_draw_elements *Draw = (render_command_draw_elements *)Command;
+		glBindVertexArray(Draw->VertexArray);
+		glDrawElementsInstanced(GL_TRIANGLES, Draw->IndexCount, GL_UNSIGNED_SHORT,
+					(void*)0, Draw->InstanceCount);
+	    } break;
+	    default:
+	    {
+		Assert(!"Unknown render command");
+	    } break;
+	    }
+	    At += Header->Size;
+	}
+    }
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef RESOLVE_CPP__
+#define RESOLVE_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+
+// NOTE: Turns what was rendered into an eye's render target into the resolve
+// texture the compositor reads. Three ways, cheapest first:
+//  - a blit: the multisample resolve, or a plain copy without MSAA;
+//  - FXAA: a full screen pass that smooths edges in the single sampled image,
+//    for targets that can't afford the bandwidth of MSAA at eye resolution;
+//  - either of those stretching a reduced dynamic resolution viewport.
+// A multisampled image can't be scaled or sampled as a plain texture, so with
+// MSAA the last two go through a scratch texture resolved at the rendered size.
+//
+// The render target's depth and colour are dead after the resolve; saying so
+// with glInvalidateFramebuffer lets tiled GPUs skip writing them back.
+
+#define RESOLVE_TEXTURE_UNIT 10
+
+struct fxaa_pass
+{
+    GLuint Program;
+    GLint Source;
+    GLint SourceRect;
+    GLint TexelSize;
+    // NOTE: Core profile wants something bound; the triangle comes from gl_VertexID.
+    GLuint VertexArray;
+};
+
+struct eye_resolve
+{
+    bool32 FXAA;
+    // NOTE: glInvalidateFramebuffer is GL 4.3 or ARB_invalidate_subdata.
+    bool32 CanInvalidate;
+
+    GLuint ScratchFramebuffer;
+    GLuint ScratchTexture;
+    int ScratchWidth;
+    int ScratchHeight;
+
+    fxaa_pass FXAAPass;
+};
+
+// NOTE: FXAAProgram is only used when Platform->FXAA is set.
+void InitEyeResolve(eye_resolve *Resolve, platform_data *Platform, GLuint FXAAProgram)
+{
+    GLint MajorVersion = 0;
+    GLint MinorVersion = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &MajorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &MinorVersion);
+    Resolve->CanInvalidate = ((MajorVersion > 4 || (MajorVersion == 4 && MinorVersion >= 3)) ||
+			      HasGLExtension("GL_ARB_invalidate_subdata"));
+    if (!Platform->LeftEye)
+    {
+	return;
+    }
+
+    Resolve->FXAA = Platform->FXAA;
+    if (Resolve->FXAA)
+    {
+	fxaa_pass *Pass = &Resolve->FXAAPass;
+	Pass->Program = FXAAProgram;
+	Pass->Source = glGetUniformLocation(FXAAProgram, "Source");
+	Pass->SourceRect = glGetUniformLocation(FXAAProgram, "SourceRect");
+	Pass->TexelSize = glGetUniformLocation(FXAAProgram, "TexelSize");
+	glGenVertexArrays(1, &Pass->VertexArray);
+	glUseProgram(FXAAProgram);
+	glUniform1i(Pass->Source, RESOLVE_TEXTURE_UNIT);
+	glUseProgram(0);
+    }
+
+    bool32 Multisampled = Platform->LeftEye->Samples ||
+	(Platform->StereoTarget && Platform->StereoTarget->Samples);
+    if (Multisampled && (Resolve->FXAA || Platform->DynamicResolutionTargetMs > 0.0f))
+    {
+	Resolve->ScratchWidth = Platform->StereoTarget ? 2*Platform->VRBufferWidth : Platform->VRBufferWidth;
+	Resolve->ScratchHeight = Platform->VRBufferHeight;
+	glGenFramebuffers(1, &Resolve->ScratchFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, Resolve->ScratchFramebuffer);
+	glGenTextures(1, &Resolve->ScratchTexture);
+	glBindTexture(GL_TEXTURE_2D, Resolve->ScratchTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Resolve->ScratchWidth, Resolve->ScratchHeight,
+		     0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Resolve->ScratchTexture, 0);
+	Assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
+
+// NOTE: Reads the Width x Height rectangle at (X, 0) of Texture, which is
+// TextureWidth x TextureHeight, and writes it anti-aliased over the whole of
+// the bound draw framebuffer's TargetWidth x TargetHeight.
+void ApplyFXAA(fxaa_pass *Pass, GLuint Texture, int TextureWidth, int TextureHeight,
+	       int X, int Width, int Height, int TargetWidth, int TargetHeight)
+{
+    glViewport(0, 0, TargetWidth, TargetHeight);
+    glUseProgram(Pass->Program);
+    glUniform4f(Pass->SourceRect, (float)X / TextureWidth, 0.0f,
+		(float)Width / TextureWidth, (float)Height / TextureHeight);
+    glUniform2f(Pass->TexelSize, 1.0f / TextureWidth, 1.0f / TextureHeight);
+    glActiveTexture(GL_TEXTURE0 + RESOLVE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, Texture);
+    glBindVertexArray(Pass->VertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void InvalidateAttachments(eye_resolve *Resolve, GLuint Framebuffer, GLenum *Attachments, int AttachmentCount)
+{
+    if (Resolve->CanInvalidate)
+    {
+	glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+	glInvalidateFramebuffer(GL_FRAMEBUFFER, AttachmentCount, Attachments);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
+
+// NOTE: Source holds EyeCount images side by side, each Width x Height from
+// the bottom left; each is resolved over the whole EyeWidth x EyeHeight of
+// its eye's resolve texture. Source's attachments are invalidated afterwards.
+void ResolveEyes(eye_resolve *Resolve, FramebufferDesc *Source, int Width, int Height,
+		 FramebufferDesc **Eyes, int EyeCount, int EyeWidth, int EyeHeight)
+{
+    bool32 Scaled = (Width != EyeWidth || Height != EyeHeight);
+    GLuint ReadFramebuffer = Source->RenderFramebufferId;
+    GLuint ReadTexture = Source->RenderTextureId;
+    int ReadWidth = EyeCount*EyeWidth;
+    int ReadHeight = EyeHeight;
+    if (Source->Samples && (Scaled || Resolve->FXAA))
+    {
+	Assert(Resolve->ScratchFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, Source->RenderFramebufferId);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, Resolve->ScratchFramebuffer);
+	glBlitFramebuffer(0, 0, EyeCount*Width, Height,
+			  0, 0, EyeCount*Width, Height,
+			  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	ReadFramebuffer = Resolve->ScratchFramebuffer;
+	ReadTexture = Resolve->ScratchTexture;
+	ReadWidth = Resolve->ScratchWidth;
+	ReadHeight = Resolve->ScratchHeight;
+    }
+
+    if (Resolve->FXAA)
+    {
+	glDisable(GL_DEPTH_TEST);
+	for(int Eye = 0; Eye < EyeCount; ++Eye)
+	{
+	    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, Eyes[Eye]->ResolveFramebufferId);
+	    ApplyFXAA(&Resolve->FXAAPass, ReadTexture, ReadWidth, ReadHeight,
+		      Eye*Width, Width, Height, EyeWidth, EyeHeight);
+	}
+	glEnable(GL_DEPTH_TEST);
+    }
+    else
+    {
+	// NOTE: Same size needs no filtering, and NEAREST is the cheaper resolve.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, ReadFramebuffer);
+	for(int Eye = 0; Eye < EyeCount; ++Eye)
+	{
+	    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, Eyes[Eye]->ResolveFramebufferId);
+	    glBlitFramebuffer(Eye*Width, 0, (Eye + 1)*Width, Height,
+			      0, 0, EyeWidth, EyeHeight,
+			      GL_COLOR_BUFFER_BIT, Scaled ? GL_LINEAR : GL_NEAREST);
+	}
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    GLenum RenderAttachments[2] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+    InvalidateAttachments(Resolve, Source->RenderFramebufferId, RenderAttachments, 2);
+    if (ReadFramebuffer == Resolve->ScratchFramebuffer)
+    {
+	InvalidateAttachments(Resolve, Resolve->ScratchFramebuffer, RenderAttachments, 1);
+    }
+}
+
+#endif
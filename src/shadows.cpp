@@ -0,0 +1,434 @@
+#ifndef SHADOWS_CPP__
+#define SHADOWS_CPP__
+
+#include "glHelper.cpp"
+#include "platform.h"
+#include "math.cpp"
+#include "matrixMath.cpp"
+#include "camera.cpp"
+#include "culling.cpp"
+
+#include <string.h>
+
+// NOTE: Shadows for the key light. A point light (Position.w 1) gets a cube
+// map, a directional light (Position.w 0, Position is the direction towards
+// it) gets SHADOW_CASCADE_COUNT cascades around the camera.
+//
+// Every map comes in two: one holding the static casters, which is only
+// redrawn when the light moves, a static entity changes or, for a cascade,
+// the camera moves out of the region it covers; and an overlay of the
+// dynamic casters, which is cleared and redrawn every frame. The shader
+// samples both, so the per-frame cost is just the casters that move.
+//
+// Cascades are fit to a bounding sphere of their slice of the view, so
+// their size doesn't change as the camera turns, and the cached map is made
+// SHADOW_CASCADE_MARGIN times larger so the sphere can move around in it for
+// a while before it has to be recentred. Casters between the light and a
+// cascade are flattened onto its near plane by depth clamping instead of
+// stretching its depth range to the whole scene.
+
+#define SHADOW_CUBE_SIZE 512
+#define SHADOW_CUBE_NEAR 0.05f
+#define SHADOW_CUBE_FAR 50.0f
+#define SHADOW_CASCADE_SIZE 1024
+// NOTE: The shader's cascade arrays are sized to match.
+#define SHADOW_CASCADE_COUNT 3
+#define SHADOW_CASCADE_MARGIN 1.5f
+#define SHADOW_MAX_PASSES 12
+// NOTE: Static cube, dynamic cube, static cascades and dynamic cascades are
+// bound from this unit up, after the light clusters.
+#define SHADOW_TEXTURE_UNIT 6
+
+// NOTE: View depth each cascade ends at; the first starts at the camera.
+const float ShadowCascadeSplits[SHADOW_CASCADE_COUNT] = { 4.0f, 12.0f, 40.0f };
+
+enum shadow_mode
+{
+    SHADOW_NONE,
+    SHADOW_CUBE,
+    SHADOW_CASCADES,
+};
+
+enum shadow_map_kind
+{
+    SHADOW_STATIC,
+    SHADOW_DYNAMIC,
+};
+
+// NOTE: One face or cascade of one map to draw this frame.
+struct shadow_pass
+{
+    mat4 ViewProjection;
+    frustum Frustum;
+    shadow_map_kind Kind;
+    // NOTE: Cube face or cascade layer.
+    int32 Target;
+};
+
+// NOTE: What a static map was drawn for.
+struct shadow_cache
+{
+    bool32 Valid;
+    uint32 StaticVersion;
+    v4 LightPosition;
+};
+
+struct shadow_binding
+{
+    GLuint Mode;
+    GLuint CubeStatic;
+    GLuint CubeDynamic;
+    GLuint CubeDepth;
+    GLuint CubeTexel;
+    GLuint CascadesStatic;
+    GLuint CascadesDynamic;
+    GLuint CascadeMatrices;
+    GLuint CascadeSpheres;
+    GLuint CascadeTexels;
+};
+
+struct shadow_maps
+{
+    bool32 Enabled;
+    shadow_mode Mode;
+    GLuint Framebuffer;
+    // NOTE: Indexed by shadow_map_kind.
+    GLuint CubeMaps[2];
+    GLuint CascadeMaps[2];
+
+    shadow_cache CubeCache;
+    mat4 CubeViewProjections[6];
+
+    shadow_cache CascadeCaches[SHADOW_CASCADE_COUNT];
+    // NOTE: Centre and half size of the region each cached cascade covers,
+    // in the light's view space.
+    v3 CascadeCenters[SHADOW_CASCADE_COUNT];
+    float CascadeHalfSizes[SHADOW_CASCADE_COUNT];
+    mat4 CascadeMatrices[SHADOW_CASCADE_COUNT];
+    // NOTE: This frame's view slices, which pick the cascade in the shader.
+    v4 CascadeSpheres[SHADOW_CASCADE_COUNT];
+
+    // NOTE: Bit per face or cascade whose dynamic map has something in it,
+    // so empty ones aren't cleared again.
+    uint32 DynamicDrawn;
+
+    int32 PassCount;
+    shadow_pass Passes[SHADOW_MAX_PASSES];
+};
+
+shadow_binding CreateShadowBinding(GLuint ShaderProgram)
+{
+    shadow_binding Binding = {0};
+    Binding.Mode = glGetUniformLocation(ShaderProgram, "ShadowMode");
+    Binding.CubeStatic = glGetUniformLocation(ShaderProgram, "ShadowCubeStatic");
+    Binding.CubeDynamic = glGetUniformLocation(ShaderProgram, "ShadowCubeDynamic");
+    Binding.CubeDepth = glGetUniformLocation(ShaderProgram, "ShadowCubeDepth");
+    Binding.CubeTexel = glGetUniformLocation(ShaderProgram, "ShadowCubeTexel");
+    Binding.CascadesStatic = glGetUniformLocation(ShaderProgram, "ShadowCascadesStatic");
+    Binding.CascadesDynamic = glGetUniformLocation(ShaderProgram, "ShadowCascadesDynamic");
+    Binding.CascadeMatrices = glGetUniformLocation(ShaderProgram, "ShadowCascadeMatrices");
+    Binding.CascadeSpheres = glGetUniformLocation(ShaderProgram, "ShadowCascadeSpheres");
+    Binding.CascadeTexels = glGetUniformLocation(ShaderProgram, "ShadowCascadeTexels");
+    return Binding;
+}
+
+// NOTE: The samplers are set even with shadows off: samplers of different
+// types must never share a unit, used or not.
+void SetShadowUniforms(GLuint Program, shadow_binding *Binding)
+{
+    // NOTE: A cube face's depth for a point whose largest axis distance
+    // from the light is D is Depth.x - Depth.y/D.
+    float Near = SHADOW_CUBE_NEAR;
+    float Far = SHADOW_CUBE_FAR;
+    glUseProgram(Program);
+    glUniform1i(Binding->Mode, SHADOW_NONE);
+    glUniform1i(Binding->CubeStatic, SHADOW_TEXTURE_UNIT);
+    glUniform1i(Binding->CubeDynamic, SHADOW_TEXTURE_UNIT + 1);
+    glUniform1i(Binding->CascadesStatic, SHADOW_TEXTURE_UNIT + 2);
+    glUniform1i(Binding->CascadesDynamic, SHADOW_TEXTURE_UNIT + 3);
+    glUniform2f(Binding->CubeDepth, Far/(Far - Near), Far*Near/(Far - Near));
+    glUniform1f(Binding->CubeTexel, 2.0f/SHADOW_CUBE_SIZE);
+    glUseProgram(0);
+}
+
+void SetShadowTextureParameters(GLenum Target)
+{
+    glTexParameteri(Target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(Target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(Target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(Target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(Target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(Target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(Target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+}
+
+void InitShadowMaps(shadow_maps *Shadows, bool32 Enabled)
+{
+    memset(Shadows, 0, sizeof(*Shadows));
+    Shadows->Enabled = Enabled;
+    if (!Enabled)
+    {
+	return;
+    }
+
+    glGenFramebuffers(1, &Shadows->Framebuffer);
+    glGenTextures(2, Shadows->CubeMaps);
+    glGenTextures(2, Shadows->CascadeMaps);
+    for(int32 Kind = 0; Kind < 2; ++Kind)
+    {
+	glBindTexture(GL_TEXTURE_CUBE_MAP, Shadows->CubeMaps[Kind]);
+	for(int32 Face = 0; Face < 6; ++Face)
+	{
+	    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + Face, 0, GL_DEPTH_COMPONENT24,
+			 SHADOW_CUBE_SIZE, SHADOW_CUBE_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	}
+	SetShadowTextureParameters(GL_TEXTURE_CUBE_MAP);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, Shadows->CascadeMaps[Kind]);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24,
+		     SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_COUNT,
+		     0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	SetShadowTextureParameters(GL_TEXTURE_2D_ARRAY);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, Shadows->Framebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // NOTE: Lets the hardware filter across cube faces.
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+bool32 ShadowCacheMatches(shadow_cache *Cache, uint32 StaticVersion, v4 LightPosition)
+{
+    return (Cache->Valid && Cache->StaticVersion == StaticVersion &&
+	    Cache->LightPosition.x == LightPosition.x && Cache->LightPosition.y == LightPosition.y &&
+	    Cache->LightPosition.z == LightPosition.z && Cache->LightPosition.w == LightPosition.w);
+}
+
+void AddShadowPass(shadow_maps *Shadows, mat4 ViewProjection, shadow_map_kind Kind, int32 Target,
+		   bool32 Pancake)
+{
+    Assert(Shadows->PassCount < SHADOW_MAX_PASSES);
+    shadow_pass *Pass = Shadows->Passes + Shadows->PassCount++;
+    Pass->ViewProjection = ViewProjection;
+    Pass->Frustum = ExtractFrustumPlanes(ViewProjection);
+    Pass->Kind = Kind;
+    Pass->Target = Target;
+    if (Pancake)
+    {
+	// NOTE: Casters in front of the near plane are clamped onto it, so
+	// the plane mustn't cull them.
+	Pass->Frustum.Planes[4].Normal = V3(0.0f, 0.0f, 0.0f);
+	Pass->Frustum.Planes[4].D = 1.0f;
+    }
+}
+
+void PrepareCubeShadowPasses(shadow_maps *Shadows, v4 LightPosition, uint32 StaticVersion)
+{
+    shadow_cache *Cache = &Shadows->CubeCache;
+    bool32 Refresh = !ShadowCacheMatches(Cache, StaticVersion, LightPosition);
+    if (Refresh)
+    {
+	// NOTE: The GL cube map face orientations.
+	v3 Directions[6] = { V3(1, 0, 0), V3(-1, 0, 0), V3(0, 1, 0), V3(0, -1, 0), V3(0, 0, 1), V3(0, 0, -1) };
+	v3 Ups[6] = { V3(0, -1, 0), V3(0, -1, 0), V3(0, 0, 1), V3(0, 0, -1), V3(0, -1, 0), V3(0, -1, 0) };
+	v3 Position = V3(LightPosition);
+	mat4 Projection = MakePerspectiveProjection(PI*0.5f, 1.0f, SHADOW_CUBE_NEAR, SHADOW_CUBE_FAR);
+	for(int32 Face = 0; Face < 6; ++Face)
+	{
+	    Shadows->CubeViewProjections[Face] =
+		Projection * LookAtView(Position, Position + Directions[Face], Ups[Face]);
+	}
+	Cache->Valid = true;
+	Cache->StaticVersion = StaticVersion;
+	Cache->LightPosition = LightPosition;
+    }
+
+    for(int32 Face = 0; Face < 6; ++Face)
+    {
+	if (Refresh)
+	{
+	    AddShadowPass(Shadows, Shadows->CubeViewProjections[Face], SHADOW_STATIC, Face, false);
+	}
+	AddShadowPass(Shadows, Shadows->CubeViewProjections[Face], SHADOW_DYNAMIC, Face, false);
+    }
+}
+
+// NOTE: Padding grows the view slices, for stereo eyes offset from Camera.
+void PrepareCascadeShadowPasses(shadow_maps *Shadows, v4 LightPosition, uint32 StaticVersion,
+				camera Camera, float Padding)
+{
+    v3 ToLight = Normalize(V3(LightPosition));
+    v3 Up = (fabsf(ToLight.y) > 0.99f) ? V3(1.0f, 0.0f, 0.0f) : V3(0.0f, 1.0f, 0.0f);
+    mat4 LightView = DirectionView(V3(0.0f, 0.0f, 0.0f), ToLight, Up);
+
+    float TanY = (float)tan(Camera.FOV*0.5f);
+    float TanX = TanY*Camera.Aspect;
+    v3 Forward = Normalize(Camera.Forward);
+    float SliceStart = 0.0f;
+    for(int32 Cascade = 0; Cascade < SHADOW_CASCADE_COUNT; ++Cascade)
+    {
+	// NOTE: The far corners are the furthest points of the slice from
+	// the middle of it.
+	float SliceEnd = ShadowCascadeSplits[Cascade];
+	float Middle = 0.5f*(SliceStart + SliceEnd);
+	float HalfDepth = SliceEnd - Middle;
+	float Radius = (float)sqrt(HalfDepth*HalfDepth + SliceEnd*SliceEnd*(TanX*TanX + TanY*TanY)) + Padding;
+	v3 Center = Camera.Position + Middle*Forward;
+	Shadows->CascadeSpheres[Cascade] = V4(Center, Radius);
+	SliceStart = SliceEnd;
+
+	v3 LightCenter = TransformPoint(LightView, Center);
+	shadow_cache *Cache = Shadows->CascadeCaches + Cascade;
+	v3 CachedCenter = Shadows->CascadeCenters[Cascade];
+	float HalfSize = Shadows->CascadeHalfSizes[Cascade];
+	bool32 Covered = (fabsf(LightCenter.x - CachedCenter.x) + Radius <= HalfSize &&
+			  fabsf(LightCenter.y - CachedCenter.y) + Radius <= HalfSize &&
+			  fabsf(LightCenter.z - CachedCenter.z) + Radius <= HalfSize);
+	bool32 Refresh = !Covered || !ShadowCacheMatches(Cache, StaticVersion, LightPosition);
+	if (Refresh)
+	{
+	    // NOTE: Recentred on whole texels, so static edges don't crawl
+	    // when it moves.
+	    HalfSize = Radius*SHADOW_CASCADE_MARGIN;
+	    float Texel = 2.0f*HalfSize / SHADOW_CASCADE_SIZE;
+	    CachedCenter = V3((float)floor(LightCenter.x / Texel)*Texel,
+			      (float)floor(LightCenter.y / Texel)*Texel,
+			      LightCenter.z);
+	    Shadows->CascadeCenters[Cascade] = CachedCenter;
+	    Shadows->CascadeHalfSizes[Cascade] = HalfSize;
+	    Shadows->CascadeMatrices[Cascade] =
+		MakeOrthographicProjection(HalfSize, 1.0f, -HalfSize, HalfSize) *
+		MakeTranslation(-CachedCenter) * LightView;
+	    Cache->Valid = true;
+	    Cache->StaticVersion = StaticVersion;
+	    Cache->LightPosition = LightPosition;
+	    AddShadowPass(Shadows, Shadows->CascadeMatrices[Cascade], SHADOW_STATIC, Cascade, true);
+	}
+	AddShadowPass(Shadows, Shadows->CascadeMatrices[Cascade], SHADOW_DYNAMIC, Cascade, true);
+    }
+}
+
+// NOTE: Works out which maps need drawing this frame. StaticVersion changes
+// whenever a static caster does.
+void PrepareShadowPasses(shadow_maps *Shadows, v4 LightPosition, uint32 StaticVersion,
+			 camera Camera, float Padding)
+{
+    Shadows->PassCount = 0;
+    if (!Shadows->Enabled)
+    {
+	Shadows->Mode = SHADOW_NONE;
+	return;
+    }
+
+    shadow_mode Mode = (LightPosition.w == 0.0f) ? SHADOW_CASCADES : SHADOW_CUBE;
+    if (Mode != Shadows->Mode)
+    {
+	Shadows->CubeCache.Valid = false;
+	for(int32 Cascade = 0; Cascade < SHADOW_CASCADE_COUNT; ++Cascade)
+	{
+	    Shadows->CascadeCaches[Cascade].Valid = false;
+	}
+	Shadows->DynamicDrawn = 0xFFFFFFFF;
+	Shadows->Mode = Mode;
+    }
+
+    if (Mode == SHADOW_CUBE)
+    {
+	PrepareCubeShadowPasses(Shadows, LightPosition, StaticVersion);
+    }
+    else
+    {
+	PrepareCascadeShadowPasses(Shadows, LightPosition, StaticVersion, Camera, Padding);
+    }
+}
+
+void BeginShadowPasses(shadow_maps *Shadows)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, Shadows->Framebuffer);
+    int32 Size = (Shadows->Mode == SHADOW_CUBE) ? SHADOW_CUBE_SIZE : SHADOW_CASCADE_SIZE;
+    glViewport(0, 0, Size, Size);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 4.0f);
+}
+
+// NOTE: Attaches and clears the pass's face or layer. Returns false when
+// there's nothing to do: a dynamic map with no casters that was already
+// empty.
+bool32 BeginShadowPass(shadow_maps *Shadows, shadow_pass *Pass, int32 CasterCount)
+{
+    if (Pass->Kind == SHADOW_DYNAMIC)
+    {
+	uint32 Bit = 1 << Pass->Target;
+	if (CasterCount == 0 && !(Shadows->DynamicDrawn & Bit))
+	{
+	    return false;
+	}
+	Shadows->DynamicDrawn = CasterCount ? (Shadows->DynamicDrawn | Bit) : (Shadows->DynamicDrawn & ~Bit);
+    }
+
+    if (Shadows->Mode == SHADOW_CUBE)
+    {
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + Pass->Target,
+			       Shadows->CubeMaps[Pass->Kind], 0);
+    }
+    else
+    {
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, Shadows->CascadeMaps[Pass->Kind],
+				  0, Pass->Target);
+    }
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void EndShadowPasses()
+{
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// NOTE: Sets the lighting shader's shadow uniforms for this frame and binds
+// the maps from SHADOW_TEXTURE_UNIT. Leaves the program in use.
+void BindShadowMaps(shadow_maps *Shadows, GLuint Program, shadow_binding *Binding)
+{
+    glUseProgram(Program);
+    glUniform1i(Binding->Mode, Shadows->Mode);
+    if (Shadows->Mode == SHADOW_NONE)
+    {
+	return;
+    }
+
+    if (Shadows->Mode == SHADOW_CASCADES)
+    {
+	// NOTE: Scaled and biased into texture space.
+	mat4 Bias = MakeTranslation(V3(0.5f, 0.5f, 0.5f)) * MakeScale(V3(0.5f, 0.5f, 0.5f));
+	mat4 Matrices[SHADOW_CASCADE_COUNT];
+	float Texels[SHADOW_CASCADE_COUNT];
+	for(int32 Cascade = 0; Cascade < SHADOW_CASCADE_COUNT; ++Cascade)
+	{
+	    Matrices[Cascade] = Bias * Shadows->CascadeMatrices[Cascade];
+	    Texels[Cascade] = 2.0f*Shadows->CascadeHalfSizes[Cascade] / SHADOW_CASCADE_SIZE;
+	}
+	glUniformMatrix4fv(Binding->CascadeMatrices, SHADOW_CASCADE_COUNT, GL_FALSE, &Matrices[0].E[0][0]);
+	glUniform4fv(Binding->CascadeSpheres, SHADOW_CASCADE_COUNT, &Shadows->CascadeSpheres[0].x);
+	glUniform1fv(Binding->CascadeTexels, SHADOW_CASCADE_COUNT, Texels);
+    }
+
+    GLenum Targets[2] = { GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY };
+    GLuint *Maps[2] = { Shadows->CubeMaps, Shadows->CascadeMaps };
+    for(int32 Texture = 0; Texture < 4; ++Texture)
+    {
+	glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT + Texture);
+	glBindTexture(Targets[Texture / 2], Maps[Texture / 2][Texture % 2]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+#endif
@@ -2,15 +2,756 @@
 
 #include "matrixMath.cpp"
 #include "loadFBX.cpp"
+#include "jobs.cpp"
+#include "pool.cpp"
+#include "entities.cpp"
+#include "occlusion.cpp"
+#include "lightClusters.cpp"
+#include "inputRecording.cpp"
+
+#include <pthread.h>
+
+// NOTE: Jobs the owner pushes through one deque while the thieves steal.
+#define TEST_DEQUE_JOBS 1000000
+#define TEST_DEQUE_THIEVES 3
+#define TEST_JOB_THREADS 8
+
+struct test_deque_state
+{
+    job_deque *Deque;
+    std::atomic<int32> Running;
+    // NOTE: How many times each job was taken, by anyone.
+    std::atomic<int32> *Taken;
+    std::atomic<int32> Stolen;
+};
+
+void *TestDequeThief(void *Parameter)
+{
+    test_deque_state *State = (test_deque_state *)Parameter;
+    job Job;
+    while (State->Running.load())
+    {
+	if (StealJob(State->Deque, &Job))
+	{
+	    State->Taken[Job.Start].fetch_add(1);
+	    State->Stolen.fetch_add(1);
+	}
+    }
+    return 0;
+}
+
+// NOTE: Every job pushed has to come out exactly once, whether the owner
+// popped it or a thief stole it, including the last-item race in PopJob.
+bool32 TestJobDeque(memory_arena *Arena)
+{
+    job_deque *Deque = PushSize(Arena, job_deque);
+    Deque->Top.store(0);
+    Deque->Bottom.store(0);
+
+    test_deque_state State;
+    State.Deque = Deque;
+    State.Running.store(1);
+    State.Taken = PushArray(Arena, TEST_DEQUE_JOBS, std::atomic<int32>);
+    State.Stolen.store(0);
+    for(int32 Index = 0; Index < TEST_DEQUE_JOBS; ++Index)
+    {
+	State.Taken[Index].store(0);
+    }
+
+    pthread_t Thieves[TEST_DEQUE_THIEVES];
+    for(int32 Thief = 0; Thief < TEST_DEQUE_THIEVES; ++Thief)
+    {
+	pthread_create(Thieves + Thief, 0, TestDequeThief, &State);
+    }
+
+    // NOTE: Push a few and pop one, so the deque runs near empty and the
+    // owner keeps meeting thieves at the last item.
+    job Job = {0};
+    int32 Pushed = 0;
+    while (Pushed < TEST_DEQUE_JOBS)
+    {
+	for(int32 Burst = 0; Burst < 3 && Pushed < TEST_DEQUE_JOBS; ++Burst)
+	{
+	    Job.Start = Pushed;
+	    if (!PushJob(Deque, &Job))
+	    {
+		break;
+	    }
+	    ++Pushed;
+	}
+	if (PopJob(Deque, &Job))
+	{
+	    State.Taken[Job.Start].fetch_add(1);
+	}
+    }
+    while (PopJob(Deque, &Job))
+    {
+	State.Taken[Job.Start].fetch_add(1);
+    }
+
+    State.Running.store(0);
+    for(int32 Thief = 0; Thief < TEST_DEQUE_THIEVES; ++Thief)
+    {
+	pthread_join(Thieves[Thief], 0);
+    }
+
+    int32 Missing = 0;
+    int32 Duplicated = 0;
+    for(int32 Index = 0; Index < TEST_DEQUE_JOBS; ++Index)
+    {
+	int32 Taken = State.Taken[Index].load();
+	Missing += (Taken == 0);
+	Duplicated += (Taken > 1);
+    }
+    printf("Job deque: %d jobs, %d stolen, %d missing, %d taken twice\n",
+	   TEST_DEQUE_JOBS, State.Stolen.load(), Missing, Duplicated);
+    return (Missing == 0 && Duplicated == 0);
+}
+
+struct test_parallel_for
+{
+    job_system *Jobs;
+    std::atomic<int32> *Visits;
+    int32 Count;
+    int32 BatchSize;
+};
+
+void TestParallelForVisit(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    test_parallel_for *Test = (test_parallel_for *)Data;
+    // NOTE: Scratch is rewound between jobs, so it must always have room.
+    uint8 *Temp = PushArray(Scratch, KILOBYTES(64), uint8);
+    Temp[0] = 1;
+    for(int32 Index = Start; Index < End; ++Index)
+    {
+	Test->Visits[Index].fetch_add(1);
+    }
+}
+
+// NOTE: Each outer index runs a whole inner ParallelFor, so workers wait on
+// counters from inside jobs.
+void TestParallelForNested(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    test_parallel_for *Test = (test_parallel_for *)Data;
+    for(int32 Index = Start; Index < End; ++Index)
+    {
+	test_parallel_for Inner = *Test;
+	Inner.Visits = Test->Visits + Index*Test->Count;
+	ParallelFor(Test->Jobs, Inner.Count, Inner.BatchSize, TestParallelForVisit, &Inner);
+    }
+}
+
+bool32 CheckVisits(const char *Name, std::atomic<int32> *Visits, int32 Count)
+{
+    int32 Wrong = 0;
+    for(int32 Index = 0; Index < Count; ++Index)
+    {
+	Wrong += (Visits[Index].load() != 1);
+	Visits[Index].store(0);
+    }
+    if (Wrong)
+    {
+	printf("ParallelFor %s: %d of %d indices not visited exactly once\n", Name, Wrong, Count);
+    }
+    return (Wrong == 0);
+}
+
+// NOTE: Every index in [0, Count) has to be visited exactly once, for
+// batch sizes around and past the deque size and with nesting.
+bool32 TestParallelFor(job_system *Jobs, memory_arena *Arena)
+{
+    int32 MaxCount = 1 << 14;
+    test_parallel_for Test;
+    Test.Jobs = Jobs;
+    Test.Visits = PushArray(Arena, MaxCount, std::atomic<int32>);
+    for(int32 Index = 0; Index < MaxCount; ++Index)
+    {
+	Test.Visits[Index].store(0);
+    }
+
+    bool32 Passed = true;
+    int32 Counts[] = { 1, 7, 1000, JOB_DEQUE_SIZE + 5, MaxCount };
+    int32 BatchSizes[] = { 1, 3, 64, 1000 };
+    for(int32 Round = 0; Round < 10; ++Round)
+    {
+	for(int32 CountIndex = 0; CountIndex < (int32)ArrayCount(Counts); ++CountIndex)
+	{
+	    for(int32 BatchIndex = 0; BatchIndex < (int32)ArrayCount(BatchSizes); ++BatchIndex)
+	    {
+		Test.Count = Counts[CountIndex];
+		Test.BatchSize = BatchSizes[BatchIndex];
+		ParallelFor(Jobs, Test.Count, Test.BatchSize, TestParallelForVisit, &Test);
+		Passed &= CheckVisits("flat", Test.Visits, Test.Count);
+	    }
+	}
+
+	int32 OuterCount = 64;
+	Test.Count = MaxCount / OuterCount;
+	Test.BatchSize = 16;
+	ParallelFor(Jobs, OuterCount, 1, TestParallelForNested, &Test);
+	Passed &= CheckVisits("nested", Test.Visits, MaxCount);
+    }
+    printf("ParallelFor: %s on %d threads\n", Passed ? "passed" : "FAILED", Jobs->ThreadCount);
+    return Passed;
+}
+
+void TestBackgroundVisit(void *Data, int32 Start, int32 End, memory_arena *Scratch)
+{
+    std::atomic<int32> *Worker = (std::atomic<int32> *)Data;
+    Worker[Start].store(CurrentJobWorker->Index);
+}
+
+// NOTE: Background jobs must never run on the main thread, even when it
+// waits on them straight away with nothing else queued.
+bool32 TestBackgroundJobs(job_system *Jobs)
+{
+    std::atomic<int32> Worker[64];
+    job_counter Counter;
+    Counter.Count.store(0);
+    for(int32 Index = 0; Index < (int32)ArrayCount(Worker); ++Index)
+    {
+	Worker[Index].store(-1);
+	KickBackgroundJob(Jobs, TestBackgroundVisit, Worker, Index, Index + 1, &Counter);
+	if (Index % 8 == 7)
+	{
+	    WaitForCounter(Jobs, &Counter);
+	}
+    }
+    WaitForCounter(Jobs, &Counter);
+
+    int32 OnMain = 0;
+    for(int32 Index = 0; Index < (int32)ArrayCount(Worker); ++Index)
+    {
+	OnMain += (Worker[Index].load() <= 0);
+    }
+    printf("Background jobs: %s, %d of %d on the main thread\n", OnMain ? "FAILED" : "passed",
+	   OnMain, (int32)ArrayCount(Worker));
+    return (OnMain == 0);
+}
+
+// NOTE: Handles to freed or never used slots must not resolve, even ones
+// carrying the generation the slot has while it's free.
+bool32 TestPool(memory_arena *Arena)
+{
+    memory_pool Pool;
+    InitPool(&Pool, Arena, 4, uint32);
+    bool32 Passed = true;
+
+    pool_handle Unused = { 3, Pool.Slots[3].Generation };
+    Passed &= !IsPoolHandleValid(&Pool, Unused);
+
+    pool_handle A = AllocPoolItem(&Pool);
+    pool_handle B = AllocPoolItem(&Pool);
+    *GetPoolItem(&Pool, B, uint32) = 7;
+    Passed &= FreePoolItem(&Pool, A);
+    Passed &= !IsPoolHandleValid(&Pool, A);
+    Passed &= !FreePoolItem(&Pool, A);
+    pool_handle Freed = { A.Slot, Pool.Slots[A.Slot].Generation };
+    Passed &= !IsPoolHandleValid(&Pool, Freed);
+    Passed &= (GetPoolItem(&Pool, Freed, uint32) == 0);
+    Passed &= (*GetPoolItem(&Pool, B, uint32) == 7);
+
+    pool_handle C = AllocPoolItem(&Pool);
+    Passed &= (C.Slot == A.Slot && C.Generation != A.Generation);
+    Passed &= IsPoolHandleValid(&Pool, C) && !IsPoolHandleValid(&Pool, A);
+    pool_handle Null = {0};
+    Passed &= !IsPoolHandleValid(&Pool, Null);
+
+    printf("Pool: %s\n", Passed ? "passed" : "FAILED");
+    return Passed;
+}
+
+bool32 NearlyEqual(v3 A, v3 B)
+{
+    v3 D = A - B;
+    return (fabsf(D.x) < 0.0001f && fabsf(D.y) < 0.0001f && fabsf(D.z) < 0.0001f);
+}
+
+// NOTE: A child's world transform has to follow its parent's through the
+// transform pass, and removing the parent has to leave the child a root at
+// its local transform.
+bool32 TestEntityHierarchy(job_system *Jobs, memory_arena *Arena)
+{
+    entity_store Store;
+    InitEntityStore(&Store, Arena, 8);
+    aabb Bounds = { V3(-1.0f, -1.0f, -1.0f), V3(1.0f, 1.0f, 1.0f) };
+    bounding_sphere Sphere = { V3(0.0f, 0.0f, 0.0f), 1.0f };
+    entity_material Material = {};
+    bool32 Passed = true;
+
+    // NOTE: The child is added first so the sort has to move it behind its
+    // parent.
+    entity_handle Child = AddEntity(&Store, 0, Bounds, Sphere, Material, 0);
+    entity_handle Parent = AddEntity(&Store, 0, Bounds, Sphere, Material, 0);
+    Store.Positions[GetEntityIndex(&Store, Parent)] = V3(2.0f, 0.0f, 0.0f);
+    Store.Positions[GetEntityIndex(&Store, Child)] = V3(1.0f, 0.0f, 0.0f);
+    Passed &= SetEntityParent(&Store, Child, Parent);
+    Passed &= !SetEntityParent(&Store, Parent, Child);
+    Passed &= !SetEntityParent(&Store, Child, Child);
+    SortEntityHierarchy(&Store);
+    UpdateAllEntityTransforms(&Store, Jobs);
+    uint32 ChildIndex = GetEntityIndex(&Store, Child);
+    uint32 ParentIndex = GetEntityIndex(&Store, Parent);
+    Passed &= (ParentIndex < ChildIndex && Store.ParentIndices[ChildIndex] == ParentIndex);
+    Passed &= NearlyEqual(TransformPoint(Store.World[ChildIndex], V3(0.0f, 0.0f, 0.0f)), V3(3.0f, 0.0f, 0.0f));
+
+    // NOTE: Only the parent is marked, the child has to move with it.
+    Store.Angles[ParentIndex] = 0.5f*PI;
+    Store.Scales[ParentIndex] = V3(2.0f, 2.0f, 2.0f);
+    MarkEntityDirty(&Store, ParentIndex);
+    UpdateAllEntityTransforms(&Store, Jobs);
+    Passed &= (GetEntityFlags(&Store)[ChildIndex] & ENTITY_MOVED) != 0;
+    v3 Expected = TransformPoint(Store.World[ParentIndex], V3(1.0f, 0.0f, 0.0f));
+    Passed &= NearlyEqual(TransformPoint(Store.World[ChildIndex], V3(0.0f, 0.0f, 0.0f)), Expected);
+    Passed &= NearlyEqual(Store.WorldSpheres[ChildIndex].Center, Expected);
+    Passed &= fabsf(Store.WorldSpheres[ChildIndex].Radius - 2.0f) < 0.0001f;
+
+    Passed &= RemoveEntity(&Store, Parent);
+    SortEntityHierarchy(&Store);
+    UpdateAllEntityTransforms(&Store, Jobs);
+    ChildIndex = GetEntityIndex(&Store, Child);
+    Passed &= (GetEntityCount(&Store) == 1 && ChildIndex == 0);
+    Passed &= (Store.ParentIndices[ChildIndex] == ENTITY_NO_PARENT && Store.Parents[ChildIndex].Generation == 0);
+    Passed &= NearlyEqual(TransformPoint(Store.World[ChildIndex], V3(0.0f, 0.0f, 0.0f)), V3(1.0f, 0.0f, 0.0f));
+
+    printf("Entity hierarchy: %s\n", Passed ? "passed" : "FAILED");
+    return Passed;
+}
+
+// NOTE: xorshift, so the BVH tests see the same boxes every run.
+float TestRandomFloat(uint32 *State, float Low, float High)
+{
+    uint32 X = *State;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    *State = X;
+    return Low + (High - Low)*((X & 0xFFFFFF) / (float)0xFFFFFF);
+}
+
+aabb TestRandomBox(uint32 *State, float Range, float MaxSize)
+{
+    v3 Center = V3(TestRandomFloat(State, -Range, Range), TestRandomFloat(State, -Range, Range),
+		   TestRandomFloat(State, -Range, Range));
+    v3 Half = V3(TestRandomFloat(State, 0.0f, MaxSize), TestRandomFloat(State, 0.0f, MaxSize),
+		 TestRandomFloat(State, 0.0f, MaxSize));
+    aabb Result = { Center - Half, Center + Half };
+    return Result;
+}
+
+int32 GetBVHDepth(bvh *BVH)
+{
+    int32 Depth = 0;
+    for(int32 NodeIndex = 0; NodeIndex < BVH->NodeCount; ++NodeIndex)
+    {
+	int32 NodeDepth = 0;
+	for(int32 Parent = BVH->Nodes[NodeIndex].Parent; Parent >= 0; Parent = BVH->Nodes[Parent].Parent)
+	{
+	    ++NodeDepth;
+	}
+	Depth = Max(Depth, NodeDepth);
+    }
+    return Depth;
+}
+
+// NOTE: Expected holds 1 for every item the brute force test hit. Each item
+// found has to be one of those, once, and none of them can be missing.
+bool32 CheckBVHHits(int32 *Found, int32 FoundCount, uint8 *Expected, int32 ItemCount)
+{
+    bool32 Passed = true;
+    for(int32 Index = 0; Index < FoundCount; ++Index)
+    {
+	Passed &= (Expected[Found[Index]] == 1);
+	Expected[Found[Index]] = 2;
+    }
+    for(int32 Item = 0; Item < ItemCount; ++Item)
+    {
+	Passed &= (Expected[Item] != 1);
+    }
+    return Passed;
+}
+
+// NOTE: Frustum, sphere and ray queries from random places, each against
+// testing every item's bounds.
+bool32 CheckBVHQueries(bvh *BVH, uint32 *Random, memory_arena *Arena)
+{
+    temporary_memory QueryMemory = BeginTemporaryMemory(Arena);
+    int32 *Found = PushArray(Arena, BVH->ItemCount, int32);
+    uint8 *Expected = PushArray(Arena, BVH->ItemCount, uint8);
+    mat4 Projection = MakePerspectiveProjection(1.2f, 1.5f, 0.5f, 60.0f);
+    bool32 Passed = true;
+    for(int32 Query = 0; Query < 32; ++Query)
+    {
+	v3 Eye = V3(TestRandomFloat(Random, -60.0f, 60.0f), TestRandomFloat(Random, -60.0f, 60.0f),
+		    TestRandomFloat(Random, -60.0f, 60.0f));
+	v3 Target = V3(TestRandomFloat(Random, -20.0f, 20.0f), TestRandomFloat(Random, -20.0f, 20.0f),
+		       TestRandomFloat(Random, -20.0f, 20.0f));
+	frustum Frustum = ExtractFrustumPlanes(Projection*LookAtView(Eye, Target, V3(0.0f, 1.0f, 0.0f)));
+	for(int32 Item = 0; Item < BVH->ItemCount; ++Item)
+	{
+	    Expected[Item] = (TestFrustumAABB(&Frustum, BVH->ItemBounds[Item]) != FRUSTUM_OUTSIDE);
+	}
+	int32 FoundCount = QueryBVHFrustum(BVH, &Frustum, Found, BVH->ItemCount);
+	Passed &= CheckBVHHits(Found, FoundCount, Expected, BVH->ItemCount);
+
+	bounding_sphere Sphere = { Target, TestRandomFloat(Random, 0.0f, 15.0f) };
+	for(int32 Item = 0; Item < BVH->ItemCount; ++Item)
+	{
+	    Expected[Item] = TestSphereAABB(Sphere, BVH->ItemBounds[Item]);
+	}
+	FoundCount = QueryBVHSphere(BVH, Sphere, Found, BVH->ItemCount);
+	Passed &= CheckBVHHits(Found, FoundCount, Expected, BVH->ItemCount);
+
+	// NOTE: Every fourth ray runs along an axis, for the slab test's
+	// parallel case.
+	ray Ray = { Eye, Normalize(Target - Eye) };
+	if (Query % 4 == 0)
+	{
+	    Ray.Direction = V3(0.0f, 0.0f, (Eye.z > 0.0f) ? -1.0f : 1.0f);
+	}
+	v3 InvDirection = V3(1.0f / Ray.Direction.x, 1.0f / Ray.Direction.y, 1.0f / Ray.Direction.z);
+	float NearestT = 200.0f;
+	for(int32 Item = 0; Item < BVH->ItemCount; ++Item)
+	{
+	    NearestT = Min(NearestT, IntersectRayAABB(Ray.Origin, InvDirection, BVH->ItemBounds[Item], 200.0f));
+	}
+	float HitT;
+	int32 Hit = QueryBVHRay(BVH, Ray, 200.0f, &HitT);
+	Passed &= (Hit < 0) ? (NearestT == 200.0f) : (HitT == NearestT);
+    }
+    EndTemporaryMemory(QueryMemory);
+    return Passed;
+}
+
+// NOTE: Queries have to agree with brute force on a fresh build, after
+// refits that move items without a rebuild, and after removals and the
+// rebuild they need. Boxes that all coincide leave the SAH nothing to split
+// on, so that tree comes from median splits alone.
+bool32 TestBVH(memory_arena *Arena)
+{
+    temporary_memory TestMemory = BeginTemporaryMemory(Arena);
+    uint32 Random = 0x12345678;
+    int32 ItemCount = 1000;
+    bvh BVH;
+    InitBVH(&BVH, Arena, ItemCount);
+    for(int32 Item = 0; Item < ItemCount; ++Item)
+    {
+	AddBVHItem(&BVH, TestRandomBox(&Random, 40.0f, 2.0f));
+    }
+    BuildBVH(&BVH);
+    bool32 Passed = CheckBVHQueries(&BVH, &Random, Arena);
+
+    for(int32 Round = 0; Round < 4; ++Round)
+    {
+	for(int32 Item = Round; Item < BVH.ItemCount; Item += 3)
+	{
+	    UpdateBVHItem(&BVH, Item, TestRandomBox(&Random, 40.0f, 3.0f));
+	}
+	Passed &= !BVH.NeedsBuild;
+	Passed &= CheckBVHQueries(&BVH, &Random, Arena);
+    }
+
+    for(int32 Item = BVH.ItemCount - 1; Item >= 0; Item -= 7)
+    {
+	RemoveBVHItem(&BVH, Item);
+    }
+    Passed &= BVHNeedsRebuild(&BVH);
+    BuildBVH(&BVH);
+    Passed &= CheckBVHQueries(&BVH, &Random, Arena);
+    for(int32 Item = 0; Item < BVH.ItemCount; Item += 5)
+    {
+	UpdateBVHItem(&BVH, Item, TestRandomBox(&Random, 40.0f, 3.0f));
+    }
+    Passed &= CheckBVHQueries(&BVH, &Random, Arena);
+
+    int32 Depth = GetBVHDepth(&BVH);
+    Passed &= (Depth <= BVH_SAH_MAX_DEPTH + 31);
+
+    bvh Stacked;
+    int32 StackedCount = 1024;
+    InitBVH(&Stacked, Arena, StackedCount);
+    aabb Box = { V3(-1.0f, -1.0f, -1.0f), V3(1.0f, 1.0f, 1.0f) };
+    for(int32 Item = 0; Item < StackedCount; ++Item)
+    {
+	AddBVHItem(&Stacked, Box);
+    }
+    BuildBVH(&Stacked);
+    int32 StackedDepth = GetBVHDepth(&Stacked);
+    Passed &= (StackedDepth == 9);
+    Passed &= CheckBVHQueries(&Stacked, &Random, Arena);
+
+    printf("BVH: %s, %d levels for %d items, %d for %d coinciding\n", Passed ? "passed" : "FAILED",
+	   Depth, BVH.ItemCount, StackedDepth, StackedCount);
+    EndTemporaryMemory(TestMemory);
+    return Passed;
+}
+
+// NOTE: Outward facing, counter-clockwise; corner i has x from bit 0, y
+// from bit 1 and z from bit 2.
+static uint16 TestCubeIndices[36] =
+{
+    4, 5, 7,  4, 7, 6,
+    0, 2, 3,  0, 3, 1,
+    1, 3, 7,  1, 7, 5,
+    0, 4, 6,  0, 6, 2,
+    2, 6, 7,  2, 7, 3,
+    0, 1, 5,  0, 5, 4,
+};
+
+bool32 IsTestPointInView(v3 Point, mat4 ViewProjection)
+{
+    v4 Clip = TransformPoint4(ViewProjection, Point);
+    return (Clip.w > 0.0f && fabsf(Clip.x) <= Clip.w && fabsf(Clip.y) <= Clip.w && fabsf(Clip.z) <= Clip.w);
+}
+
+// NOTE: Whether the line of sight to Point enters the wall on the way.
+bool32 IsTestPointBehindWall(v3 Eye, v3 Point, aabb Wall)
+{
+    v3 Direction = Point - Eye;
+    v3 InvDirection = V3(1.0f / Direction.x, 1.0f / Direction.y, 1.0f / Direction.z);
+    return (IntersectRayAABB(Eye, InvDirection, Wall, 1.0f) != FLT_MAX);
+}
+
+// NOTE: The occlusion buffer may only ever under-estimate: a box with any
+// corner the eye can see past the wall, in front of it or beside it, must
+// never be called occluded. Boxes on screen and wholly in the wall's shadow
+// should mostly be, or the test proves nothing.
+bool32 TestOcclusion(job_system *Jobs, memory_arena *Arena)
+{
+    temporary_memory TestMemory = BeginTemporaryMemory(Arena);
+    occlusion_buffer Occlusion;
+    InitOcclusionBuffer(&Occlusion, Arena);
+
+    aabb Wall = { V3(-5.0f, -4.0f, -12.0f), V3(5.0f, 4.0f, -10.0f) };
+    float WallVertices[24];
+    for(int32 Corner = 0; Corner < 8; ++Corner)
+    {
+	WallVertices[3*Corner + 0] = (Corner & 1) ? Wall.Max.x : Wall.Min.x;
+	WallVertices[3*Corner + 1] = (Corner & 2) ? Wall.Max.y : Wall.Min.y;
+	WallVertices[3*Corner + 2] = (Corner & 4) ? Wall.Max.z : Wall.Min.z;
+    }
+
+    uint32 Random = 0x9E3779B9;
+    mat4 Projection = MakePerspectiveProjection(1.0f, (float)OCCLUSION_WIDTH / OCCLUSION_HEIGHT, 0.5f, 100.0f);
+    int32 VisibleCulled = 0;
+    int32 HiddenCount = 0;
+    int32 HiddenCulled = 0;
+    for(int32 View = 0; View < 8; ++View)
+    {
+	v3 Eye = V3(TestRandomFloat(&Random, -3.0f, 3.0f), TestRandomFloat(&Random, -2.0f, 2.0f), 0.0f);
+	v3 Target = V3(TestRandomFloat(&Random, -2.0f, 2.0f), TestRandomFloat(&Random, -2.0f, 2.0f), -11.0f);
+	mat4 ViewProjection = Projection*LookAtView(Eye, Target, V3(0.0f, 1.0f, 0.0f));
+	ClearOcclusionBuffer(&Occlusion);
+	AddOccluderMesh(&Occlusion, WallVertices, TestCubeIndices, ArrayCount(TestCubeIndices), ViewProjection);
+	RasterizeOcclusionBuffer(&Occlusion, Jobs);
+
+	for(int32 Test = 0; Test < 2000; ++Test)
+	{
+	    aabb Box = TestRandomBox(&Random, 1.0f, 1.5f);
+	    v3 Offset = V3(TestRandomFloat(&Random, -12.0f, 12.0f), TestRandomFloat(&Random, -8.0f, 8.0f),
+			   TestRandomFloat(&Random, -40.0f, -3.0f));
+	    Box.Min = Box.Min + Offset;
+	    Box.Max = Box.Max + Offset;
+
+	    bool32 Visible = false;
+	    bool32 Hidden = true;
+	    for(int32 Corner = 0; Corner < 8; ++Corner)
+	    {
+		v3 P = V3((Corner & 1) ? Box.Max.x : Box.Min.x,
+			  (Corner & 2) ? Box.Max.y : Box.Min.y,
+			  (Corner & 4) ? Box.Max.z : Box.Min.z);
+		bool32 InView = IsTestPointInView(P, ViewProjection);
+		bool32 BehindWall = IsTestPointBehindWall(Eye, P, Wall);
+		Visible |= (InView && !BehindWall);
+		Hidden &= (InView && BehindWall && P.z < Wall.Min.z);
+	    }
+	    bool32 Culled = IsOccluded(&Occlusion, Box, ViewProjection);
+	    VisibleCulled += (Visible && Culled);
+	    HiddenCount += Hidden;
+	    HiddenCulled += (Hidden && Culled);
+	}
+    }
+
+    bool32 Passed = (VisibleCulled == 0 && HiddenCulled*2 > HiddenCount);
+    printf("Occlusion: %s, %d visible boxes culled, %d of %d boxes behind the wall culled\n",
+	   Passed ? "passed" : "FAILED", VisibleCulled, HiddenCulled, HiddenCount);
+    EndTemporaryMemory(TestMemory);
+    return Passed;
+}
+
+// NOTE: Every cluster of every eye has to list exactly the lights whose
+// sphere touches its view space bounds, as testing each light against each
+// cluster finds them, up to CLUSTER_MAX_LIGHTS. Run again after the lights
+// move, when the light BVH is refit rather than rebuilt.
+bool32 TestLightClusters(job_system *Jobs, memory_arena *Arena)
+{
+    temporary_memory TestMemory = BeginTemporaryMemory(Arena);
+    light_clusters *Clusters = PushSize(Arena, light_clusters);
+    *Clusters = {};
+    InitLightClusterLists(Clusters, Arena);
+
+    int32 LightCount = 400;
+    point_light *Lights = PushArray(Arena, LightCount, point_light);
+    uint8 *Expected = PushArray(Arena, LightCount, uint8);
+    uint32 Random = 0xC0FFEE;
+    for(int32 Light = 0; Light < LightCount; ++Light)
+    {
+	Lights[Light].Position = V3(TestRandomFloat(&Random, -40.0f, 40.0f), TestRandomFloat(&Random, -10.0f, 10.0f),
+				    TestRandomFloat(&Random, -60.0f, 10.0f));
+	Lights[Light].Radius = TestRandomFloat(&Random, 0.5f, 6.0f);
+    }
+
+    mat4 Projection = MakePerspectiveProjection(1.2f, 16.0f / 9.0f, CLUSTER_NEAR, CLUSTER_FAR);
+    mat4 Views[2];
+    bool32 Passed = true;
+    int32 Assigned = 0;
+    for(int32 Round = 0; Round < 2; ++Round)
+    {
+	for(int32 Eye = 0; Eye < 2; ++Eye)
+	{
+	    v3 Position = V3(Eye ? 0.032f : -0.032f, 1.0f, 5.0f);
+	    Views[Eye] = LookAtView(Position, Position + V3(0.2f*Round, 0.0f, -1.0f), V3(0.0f, 1.0f, 0.0f));
+	}
+	AssignLightClusters(Clusters, Jobs, Lights, LightCount, Projection, Views, 2);
+
+	for(int32 Eye = 0; Eye < 2; ++Eye)
+	{
+	    for(int32 Cluster = 0; Cluster < CLUSTER_COUNT; ++Cluster)
+	    {
+		int32 ExpectedCount = 0;
+		for(int32 Light = 0; Light < LightCount; ++Light)
+		{
+		    bounding_sphere Sphere = { TransformPoint(Views[Eye], Lights[Light].Position), Lights[Light].Radius };
+		    Expected[Light] = TestSphereAABB(Sphere, Clusters->Bounds[Cluster]);
+		    ExpectedCount += Expected[Light];
+		}
+
+		int32 GlobalCluster = Eye*CLUSTER_COUNT + Cluster;
+		uint16 *ClusterLights = Clusters->ClusterLights + GlobalCluster*CLUSTER_MAX_LIGHTS;
+		int32 Count = (int32)Clusters->ClusterLightCounts[GlobalCluster];
+		Passed &= (Count == Min(ExpectedCount, CLUSTER_MAX_LIGHTS));
+		for(int32 Index = 0; Index < Count; ++Index)
+		{
+		    Passed &= (Expected[ClusterLights[Index]] == 1);
+		    Expected[ClusterLights[Index]] = 2;
+		}
+		Assigned += Count;
+	    }
+	}
+
+	// NOTE: Move every light a little, so the second round refits.
+	for(int32 Light = 0; Light < LightCount; ++Light)
+	{
+	    Lights[Light].Position = Lights[Light].Position + V3(TestRandomFloat(&Random, -1.0f, 1.0f), 0.0f,
+								 TestRandomFloat(&Random, -1.0f, 1.0f));
+	}
+    }
+
+    printf("Light clusters: %s, %d assignments\n", Passed ? "passed" : "FAILED", Assigned);
+    EndTemporaryMemory(TestMemory);
+    return Passed;
+}
+
+#define TEST_INPUT_FRAMES 32
+#define TEST_INPUT_PATH "test_input.rec"
+
+void TestRandomInput(uint32 *State, input *Input)
+{
+    uint8 *Bytes = (uint8 *)Input;
+    for(uint32 Byte = 0; Byte < sizeof(input); ++Byte)
+    {
+	Bytes[Byte] = (uint8)(TestRandomFloat(State, 0.0f, 255.0f));
+    }
+    Input->dT = TestRandomFloat(State, 0.001f, 0.1f);
+}
+
+// NOTE: Records frames of noise and plays them back: with the recorded
+// timestep every frame should come back byte for byte, with the fixed one
+// only dT should differ, and the replay should stop where the recording did,
+// a partly written last frame not counting.
+bool32 TestInputRecording()
+{
+    bool32 Passed = true;
+    uint32 Random = 0x2545F491;
+    input Recorded[TEST_INPUT_FRAMES];
+    for(int32 Frame = 0; Frame < TEST_INPUT_FRAMES; ++Frame)
+    {
+	TestRandomInput(&Random, &Recorded[Frame]);
+    }
+
+    input_recording Recording = {0};
+    Recording.Path = TEST_INPUT_PATH;
+    Recording.Mode = INPUT_RECORDING_RECORD;
+    Passed &= BeginInputRecording(&Recording);
+    for(int32 Frame = 0; Frame < TEST_INPUT_FRAMES; ++Frame)
+    {
+	input Input = Recorded[Frame];
+	Passed &= UpdateInputRecording(&Recording, &Input);
+    }
+    // NOTE: As if the recording were cut off halfway through a frame.
+    if (Recording.File)
+    {
+	fwrite(&Recorded[0], sizeof(input)/2, 1, Recording.File);
+    }
+    EndInputRecording(&Recording);
+
+    for(int32 Fixed = 0; Fixed < 2; ++Fixed)
+    {
+	input_recording Replay = {0};
+	Replay.Path = TEST_INPUT_PATH;
+	Replay.Mode = INPUT_RECORDING_REPLAY;
+	Replay.FixedTimestep = Fixed;
+	Passed &= BeginInputRecording(&Replay);
+	Passed &= (Replay.FrameCount == TEST_INPUT_FRAMES);
+	for(int32 Frame = 0; Frame < TEST_INPUT_FRAMES; ++Frame)
+	{
+	    input Input = {0};
+	    Passed &= UpdateInputRecording(&Replay, &Input);
+	    input Expected = Recorded[Frame];
+	    if (Fixed)
+	    {
+		Passed &= (Input.dT == INPUT_REPLAY_FIXED_DELTA_TIME);
+		Expected.dT = INPUT_REPLAY_FIXED_DELTA_TIME;
+	    }
+	    Passed &= (memcmp(&Input, &Expected, sizeof(input)) == 0);
+	}
+	input Input = {0};
+	Passed &= !UpdateInputRecording(&Replay, &Input);
+	EndInputRecording(&Replay);
+    }
+
+    // NOTE: A recording made with a different input layout mustn't replay.
+    FILE *File = fopen(TEST_INPUT_PATH, "r+b");
+    if (File)
+    {
+	input_recording_header Header = { INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION, sizeof(input) + 4, 0 };
+	fwrite(&Header, sizeof(Header), 1, File);
+	fclose(File);
+    }
+    input_recording Mismatched = {0};
+    Mismatched.Path = TEST_INPUT_PATH;
+    Mismatched.Mode = INPUT_RECORDING_REPLAY;
+    Passed &= (File != 0) && !BeginInputRecording(&Mismatched) && !Mismatched.File;
+    remove(TEST_INPUT_PATH);
+
+    printf("Input recording: %s, %d frames\n", Passed ? "passed" : "FAILED", TEST_INPUT_FRAMES);
+    return Passed;
+}
 
 int Test(int argc, char** argv)
 {
     printf("Testing\n");
 
 
-    FILE* monkeyFile =  fopen("monkey.fbx", "r");
-    ParseFBX(monkeyFile);
-    
+    memory_arena Arena;
+    InitArena(&Arena, MEGABYTES(64), (uint8 *)malloc(MEGABYTES(64)));
+    FILE* monkeyFile =  fopen("../res/Models/monkey.fbx", "r");
+    if (monkeyFile)
+    {
+	ParseFBX(monkeyFile, &Arena);
+	fclose(monkeyFile);
+    }
+
 /*
     mat4 M4 = { 1.0f, 0.0f, 0.0f, 0.0f,
 		0.0f, 1.0f, 0.0f, 0.0f,
@@ -19,5 +760,26 @@ int Test(int argc, char** argv)
     PrintMatrix(M4);
 */
 
-    return 0;
+    // NOTE: Arenas don't align pushes, and the deques' atomics need it, so
+    // the job tests get fresh zeroed memory of their own, as the platform
+    // layers give the game.
+    memory_arena JobArena;
+    InitArena(&JobArena, MEGABYTES(64), (uint8 *)calloc(1, MEGABYTES(64)));
+    bool32 Passed = TestPool(&Arena);
+    Passed &= TestBVH(&Arena);
+    Passed &= TestJobDeque(&JobArena);
+
+    // NOTE: The workers keep running until exit, so the system can't live
+    // on this stack.
+    job_system *Jobs = PushSize(&JobArena, job_system);
+    InitJobSystem(Jobs, &JobArena, TEST_JOB_THREADS);
+    Passed &= TestParallelFor(Jobs, &JobArena);
+    Passed &= TestBackgroundJobs(Jobs);
+    Passed &= TestEntityHierarchy(Jobs, &JobArena);
+    Passed &= TestOcclusion(Jobs, &JobArena);
+    Passed &= TestLightClusters(Jobs, &JobArena);
+    Passed &= TestInputRecording();
+
+    printf(Passed ? "All tests passed\n" : "Tests FAILED\n");
+    return Passed ? 0 : 1;
 }
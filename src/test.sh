@@ -1,9 +1,10 @@
 #!/bin/sh
 
-cc main.cpp -o test.out -Wall -Wno-write-strings -lX11 -lGL -lGLU -lm -D TESTING
+cc linux_glx.cpp -o test.out -Wall -Wno-write-strings -fno-exceptions -lX11 -lGL -lGLU -lm -lpthread -D TESTING
 if [ $? -ne 0 ]
 then
     echo "Compilation Failed"
+    exit 1
 else
     echo "Compilation Successful"
     ./test.out
@@ -0,0 +1,272 @@
+#ifndef VIRTUALMEMORY_CPP__
+#define VIRTUALMEMORY_CPP__
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+// NOTE: Game memory for the Linux entry points. The whole block is reserved
+// as PROT_NONE address space up front, which costs nothing, and is committed
+// in huge page sized chunks as the arenas grow into it. Committed chunks are
+// prefaulted, so the page faults happen in the commit instead of scattered
+// through later frames. By default the block is advised for transparent huge
+// pages; hugetlb mode maps explicit huge pages instead, which needs
+// vm.nr_hugepages set and falls back to normal pages when it runs out.
+
+#define VIRTUAL_MEMORY_CHUNK_SIZE (MEGABYTES(2))
+#define VIRTUAL_MEMORY_MAX_CHUNKS 4096
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+enum huge_page_mode
+{
+    HUGE_PAGES_OFF,
+    HUGE_PAGES_TRANSPARENT,
+    HUGE_PAGES_HUGETLB
+};
+
+struct virtual_memory
+{
+    uint8 *Base;
+    size_t Reserved;
+    size_t Committed;
+    huge_page_mode HugePages;
+    int32 HugeTLBFailures;
+    uint8 ChunkCommitted[VIRTUAL_MEMORY_MAX_CHUNKS];
+};
+
+struct memory_stats
+{
+    size_t Reserved;
+    size_t Committed;
+    size_t Resident;
+    size_t HugePageResident;
+    uint64 MinorFaults;
+    uint64 MajorFaults;
+};
+
+// NOTE: There is only one reservation, the commit callback finds it here.
+// Arenas owned by job workers grow from their threads, so commits are
+// serialized on the lock.
+virtual_memory GlobalVirtualMemory;
+pthread_mutex_t GlobalVirtualMemoryLock = PTHREAD_MUTEX_INITIALIZER;
+
+// NOTE: The base is aligned to the chunk size so chunks line up with huge
+// pages.
+bool32 ReserveVirtualMemory(virtual_memory *Memory, size_t Size, huge_page_mode HugePages)
+{
+    Size = (Size + VIRTUAL_MEMORY_CHUNK_SIZE - 1) & ~(size_t)(VIRTUAL_MEMORY_CHUNK_SIZE - 1);
+    if (Size / VIRTUAL_MEMORY_CHUNK_SIZE > VIRTUAL_MEMORY_MAX_CHUNKS)
+    {
+	return false;
+    }
+
+    size_t MappedSize = Size + VIRTUAL_MEMORY_CHUNK_SIZE;
+    uint8 *Mapped = (uint8 *)mmap(0, MappedSize, PROT_NONE,
+				  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (Mapped == MAP_FAILED)
+    {
+	return false;
+    }
+    uint8 *Base = (uint8 *)(((uintptr_t)Mapped + VIRTUAL_MEMORY_CHUNK_SIZE - 1) &
+			    ~(uintptr_t)(VIRTUAL_MEMORY_CHUNK_SIZE - 1));
+    if (Base > Mapped)
+    {
+	munmap(Mapped, Base - Mapped);
+    }
+    if (Base + Size < Mapped + MappedSize)
+    {
+	munmap(Base + Size, (Mapped + MappedSize) - (Base + Size));
+    }
+
+    Memory->Base = Base;
+    Memory->Reserved = Size;
+    Memory->Committed = 0;
+    Memory->HugePages = HugePages;
+    return true;
+}
+
+bool32 CommitVirtualMemoryChunks(virtual_memory *Memory, size_t FirstChunk, size_t ChunkCount)
+{
+    uint8 *Base = Memory->Base + FirstChunk*VIRTUAL_MEMORY_CHUNK_SIZE;
+    size_t Size = ChunkCount*VIRTUAL_MEMORY_CHUNK_SIZE;
+    int Flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+
+    if (Memory->HugePages == HUGE_PAGES_HUGETLB)
+    {
+	if (mmap(Base, Size, PROT_READ | PROT_WRITE, Flags | MAP_HUGETLB | MAP_POPULATE, -1, 0) != MAP_FAILED)
+	{
+	    return true;
+	}
+	if (Memory->HugeTLBFailures++ == 0)
+	{
+	    printf("No hugetlb pages available, committing normal pages instead.\n");
+	}
+    }
+
+    if (Memory->HugePages == HUGE_PAGES_OFF)
+    {
+	return mmap(Base, Size, PROT_READ | PROT_WRITE, Flags | MAP_POPULATE, -1, 0) != MAP_FAILED;
+    }
+
+    // NOTE: MAP_POPULATE would fault the pages in before the mapping could be
+    // advised, so they would all come in small. Advise first, then populate.
+    if (mmap(Base, Size, PROT_READ | PROT_WRITE, Flags, -1, 0) == MAP_FAILED)
+    {
+	return false;
+    }
+    madvise(Base, Size, MADV_HUGEPAGE);
+    if (madvise(Base, Size, MADV_POPULATE_WRITE) != 0)
+    {
+	// NOTE: Kernels before 5.14; a write per page does the same.
+	size_t PageSize = (size_t)sysconf(_SC_PAGESIZE);
+	for(size_t Offset = 0; Offset < Size; Offset += PageSize)
+	{
+	    ((volatile uint8 *)Base)[Offset] = 0;
+	}
+    }
+    return true;
+}
+
+// NOTE: Commits every chunk the range touches that isn't committed yet, so
+// it's safe to call on overlapping ranges. Callers hold the lock.
+bool32 CommitVirtualMemoryLocked(void *Address, size_t Size)
+{
+    virtual_memory *Memory = &GlobalVirtualMemory;
+    uint8 *Start = (uint8 *)Address;
+    if (Size == 0)
+    {
+	return true;
+    }
+    if (Start < Memory->Base || Start + Size > Memory->Base + Memory->Reserved)
+    {
+	return false;
+    }
+
+    size_t FirstChunk = (Start - Memory->Base) / VIRTUAL_MEMORY_CHUNK_SIZE;
+    size_t EndChunk = ((Start + Size - Memory->Base) + VIRTUAL_MEMORY_CHUNK_SIZE - 1) / VIRTUAL_MEMORY_CHUNK_SIZE;
+    size_t Chunk = FirstChunk;
+    while (Chunk < EndChunk)
+    {
+	if (Memory->ChunkCommitted[Chunk])
+	{
+	    ++Chunk;
+	    continue;
+	}
+
+	size_t RunStart = Chunk;
+	while (Chunk < EndChunk && !Memory->ChunkCommitted[Chunk])
+	{
+	    ++Chunk;
+	}
+	if (!CommitVirtualMemoryChunks(Memory, RunStart, Chunk - RunStart))
+	{
+	    return false;
+	}
+	for(size_t Committed = RunStart; Committed < Chunk; ++Committed)
+	{
+	    Memory->ChunkCommitted[Committed] = true;
+	}
+	Memory->Committed += (Chunk - RunStart)*VIRTUAL_MEMORY_CHUNK_SIZE;
+    }
+    return true;
+}
+
+// NOTE: platform_commit_memory, called from any thread.
+bool32 CommitVirtualMemory(void *Address, size_t Size)
+{
+    pthread_mutex_lock(&GlobalVirtualMemoryLock);
+    bool32 Result = CommitVirtualMemoryLocked(Address, Size);
+    pthread_mutex_unlock(&GlobalVirtualMemoryLock);
+    return Result;
+}
+
+// NOTE: Process wide: resident covers the GL driver and everything else too.
+void GetMemoryStats(virtual_memory *Memory, memory_stats *Stats)
+{
+    memset(Stats, 0, sizeof(*Stats));
+    Stats->Reserved = Memory->Reserved;
+    Stats->Committed = Memory->Committed;
+
+    size_t PageSize = (size_t)sysconf(_SC_PAGESIZE);
+    FILE *File = fopen("/proc/self/statm", "r");
+    if (File)
+    {
+	unsigned long long TotalPages, ResidentPages;
+	if (fscanf(File, "%llu %llu", &TotalPages, &ResidentPages) == 2)
+	{
+	    Stats->Resident = ResidentPages*PageSize;
+	}
+	fclose(File);
+    }
+
+    File = fopen("/proc/self/smaps_rollup", "r");
+    if (File)
+    {
+	char Line[256];
+	while (fgets(Line, sizeof(Line), File))
+	{
+	    unsigned long long Kilobytes;
+	    if (sscanf(Line, "AnonHugePages: %llu kB", &Kilobytes) == 1)
+	    {
+		Stats->HugePageResident = Kilobytes*1024;
+		break;
+	    }
+	}
+	fclose(File);
+    }
+
+    rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage) == 0)
+    {
+	Stats->MinorFaults = Usage.ru_minflt;
+	Stats->MajorFaults = Usage.ru_majflt;
+    }
+}
+
+// NOTE: Faults are counted since Since was taken, or since startup without it.
+void PrintMemoryStats(virtual_memory *Memory, const char *Label, memory_stats *Since = 0)
+{
+    memory_stats Stats;
+    GetMemoryStats(Memory, &Stats);
+    uint64 MinorFaults = Stats.MinorFaults - (Since ? Since->MinorFaults : 0);
+    uint64 MajorFaults = Stats.MajorFaults - (Since ? Since->MajorFaults : 0);
+    printf("Memory (%s): reserved %zu MB, committed %zu MB, resident %zu MB (%zu MB huge pages), "
+	   "page faults %llu minor %llu major\n",
+	   Label,
+	   Stats.Reserved / (1024*1024),
+	   Stats.Committed / (1024*1024),
+	   Stats.Resident / (1024*1024),
+	   Stats.HugePageResident / (1024*1024),
+	   (unsigned long long)MinorFaults,
+	   (unsigned long long)MajorFaults);
+}
+
+// NOTE: MainMemory and TempMemory are carved back to back from one
+// reservation. Only the head of MainMemory is committed here, enough for
+// the game to find its game_data; the arenas commit the rest as they grow.
+bool32 SetupPlatformMemory(platform_data *Platform, huge_page_mode HugePages)
+{
+    virtual_memory *Memory = &GlobalVirtualMemory;
+    size_t MainSize = (size_t)Platform->MainMemorySize;
+    size_t TempSize = (size_t)Platform->TempMemorySize;
+    if (!ReserveVirtualMemory(Memory, MainSize + TempSize, HugePages))
+    {
+	return false;
+    }
+
+    Platform->MainMemory = Memory->Base;
+    Platform->TempMemory = Memory->Base + MainSize;
+    Platform->TotalMemorySize = (int32)(MainSize + TempSize);
+    Platform->CommitMemory = CommitVirtualMemory;
+    return CommitVirtualMemory(Platform->MainMemory, VIRTUAL_MEMORY_CHUNK_SIZE);
+}
+
+#endif
@@ -5,6 +5,8 @@
 #include <io.h>
 #include <fcntl.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <openvr.h>
 #include "win32_platform.h"
@@ -770,13 +772,24 @@ int CALLBACK WinMain(
     GLErrorShow();
     /*End Init OpenGL*/
 
+    // NOTE: Off unless asked for with "--dynamic-res TARGET_MS", as on the
+    // other platforms. A 90 Hz headset leaves 11.1 ms a frame, so around 9
+    // keeps some of it for the compositor.
+    float DynamicResolutionTargetMs = 0.0f;
+    char *DynamicResolutionArgument = strstr(CommandLine, "--dynamic-res ");
+    if (DynamicResolutionArgument)
+    {
+	DynamicResolutionTargetMs = (float)atof(DynamicResolutionArgument + strlen("--dynamic-res "));
+    }
+    float EyeBufferScale = (DynamicResolutionTargetMs > 0.0f) ? DYNAMIC_RESOLUTION_MAX_SCALE : 1.0f;
+    int32 MSAASamples = 4;
     uint32 VRWidth;
     uint32 VRHeight;
     FramebufferDesc LeftEyeBuffer = {0};
     FramebufferDesc RightEyeBuffer = {0};
     if (State.VRSystem)
     {
-	if (!SetupStereoRenderTargets(State.VRSystem, &VRWidth, &VRHeight, &LeftEyeBuffer, &RightEyeBuffer))
+	if (!SetupStereoRenderTargets(State.VRSystem, EyeBufferScale, MSAASamples, &VRWidth, &VRHeight, &LeftEyeBuffer, &RightEyeBuffer))
 	{
 	    ShowAlert("Failed to setup render targets!");
 	}
@@ -796,7 +809,7 @@ int CALLBACK WinMain(
     float TargetFrameSeconds = 1.0f/GameUpdateHz;
 
     platform_data PlatformData = {0};
-    PlatformData.MainMemorySize = MEGABYTES(32);
+    PlatformData.MainMemorySize = MEGABYTES(512);
     PlatformData.TempMemorySize = MEGABYTES(32);
     PlatformData.TotalMemorySize = PlatformData.MainMemorySize + PlatformData.TempMemorySize;
     PlatformData.MainMemory = VirtualAlloc(0,
@@ -817,6 +830,9 @@ int CALLBACK WinMain(
     PlatformData.VRBufferHeight = VRHeight;
     PlatformData.LeftEye = &LeftEyeBuffer;
     PlatformData.RightEye = &RightEyeBuffer;
+    PlatformData.Shadows = true;
+    PlatformData.DynamicResolutionTargetMs = State.VRSystem ? DynamicResolutionTargetMs : 0.0f;
+    PlatformData.MSAASamples = MSAASamples;
     
     NewInput->dT = 0.0f;
     State.Running = true;
@@ -896,6 +912,8 @@ int CALLBACK WinMain(
 					     vr::TextureType_OpenGL,
 					     vr::ColorSpace_Gamma };
 	    vr::VRCompositor()->Submit(vr::Eye_Right, &RightEyeTexture);
+	    // NOTE: The compositor uses the context too.
+	    InvalidateGLStateCache();
 	}
 	
 	glFinish();